@@ -0,0 +1,239 @@
+/* FCE Ultra Network Play Server
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <vector>
+
+#include "evloop.h"
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+
+struct EVLOOP
+{
+	int epfd;
+	std::vector <struct epoll_event> buf;
+};
+
+static uint32_t ToEpoll(int events)
+{
+	uint32_t ev = 0;
+
+	if(events & EVLOOP_READ)
+		ev |= EPOLLIN | EPOLLRDHUP;
+	if(events & EVLOOP_WRITE)
+		ev |= EPOLLOUT;
+	return(ev);
+}
+
+EVLOOP *EvLoopCreate(void)
+{
+	EVLOOP *loop;
+	int epfd;
+
+	if((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+		return(0);
+
+	loop = new EVLOOP;
+	loop->epfd = epfd;
+	return(loop);
+}
+
+void EvLoopDestroy(EVLOOP *loop)
+{
+	close(loop->epfd);
+	delete loop;
+}
+
+int EvLoopAdd(EVLOOP *loop, int fd, int events, void *ptr)
+{
+	struct epoll_event ev;
+
+	ev.events = ToEpoll(events);
+	ev.data.ptr = ptr;
+	return(epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == 0);
+}
+
+int EvLoopModify(EVLOOP *loop, int fd, int events, void *ptr)
+{
+	struct epoll_event ev;
+
+	ev.events = ToEpoll(events);
+	ev.data.ptr = ptr;
+	return(epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev) == 0);
+}
+
+void EvLoopRemove(EVLOOP *loop, int fd)
+{
+	struct epoll_event ev; /* Kernels before 2.6.9 want a non-NULL pointer. */
+
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int EvLoopWait(EVLOOP *loop, EVLOOP_EVENT *events, int maxevents, int timeout)
+{
+	int n, x;
+
+	if(loop->buf.size() < (size_t)maxevents)
+		loop->buf.resize(maxevents);
+
+	n = epoll_wait(loop->epfd, &loop->buf[0], maxevents, timeout);
+	if(n == -1)
+		return(errno == EINTR ? 0 : -1);
+
+	for(x=0; x<n; x++)
+	{
+		uint32_t ev = loop->buf[x].events;
+
+		events[x].ptr = loop->buf[x].data.ptr;
+		events[x].events = 0;
+		if(ev & EPOLLIN)
+			events[x].events |= EVLOOP_READ;
+		if(ev & EPOLLOUT)
+			events[x].events |= EVLOOP_WRITE;
+		if(ev & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+			events[x].events |= EVLOOP_HANGUP;
+	}
+	return(n);
+}
+
+#else
+
+#include <poll.h>
+
+struct EVLOOP
+{
+	std::vector <struct pollfd> fds;
+	std::vector <void *> ptrs;
+	std::vector <int> index;   /* fd -> position in fds, -1 if not watched */
+	size_t next;               /* Where the next wait starts scanning, for fairness. */
+};
+
+static short ToPoll(int events)
+{
+	short ev = 0;
+
+	if(events & EVLOOP_READ)
+		ev |= POLLIN;
+	if(events & EVLOOP_WRITE)
+		ev |= POLLOUT;
+	return(ev);
+}
+
+EVLOOP *EvLoopCreate(void)
+{
+	EVLOOP *loop = new EVLOOP;
+
+	loop->next = 0;
+	return(loop);
+}
+
+void EvLoopDestroy(EVLOOP *loop)
+{
+	delete loop;
+}
+
+int EvLoopAdd(EVLOOP *loop, int fd, int events, void *ptr)
+{
+	struct pollfd pfd;
+
+	if(fd < 0)
+		return(0);
+	if(loop->index.size() <= (size_t)fd)
+		loop->index.resize(fd + 1, -1);
+	if(loop->index[fd] != -1)
+		return(0);
+
+	pfd.fd = fd;
+	pfd.events = ToPoll(events);
+	pfd.revents = 0;
+	loop->index[fd] = loop->fds.size();
+	loop->fds.push_back(pfd);
+	loop->ptrs.push_back(ptr);
+	return(1);
+}
+
+int EvLoopModify(EVLOOP *loop, int fd, int events, void *ptr)
+{
+	int i;
+
+	if(fd < 0 || loop->index.size() <= (size_t)fd || (i = loop->index[fd]) == -1)
+		return(0);
+
+	loop->fds[i].events = ToPoll(events);
+	loop->ptrs[i] = ptr;
+	return(1);
+}
+
+void EvLoopRemove(EVLOOP *loop, int fd)
+{
+	int i, last;
+
+	if(fd < 0 || loop->index.size() <= (size_t)fd || (i = loop->index[fd]) == -1)
+		return;
+
+	last = loop->fds.size() - 1;
+	if(i != last)
+	{
+		loop->fds[i] = loop->fds[last];
+		loop->ptrs[i] = loop->ptrs[last];
+		loop->index[loop->fds[i].fd] = i;
+	}
+	loop->fds.pop_back();
+	loop->ptrs.pop_back();
+	loop->index[fd] = -1;
+}
+
+int EvLoopWait(EVLOOP *loop, EVLOOP_EVENT *events, int maxevents, int timeout)
+{
+	size_t count = loop->fds.size();
+	size_t x;
+	int got = 0;
+
+	if(poll(count ? &loop->fds[0] : 0, count, timeout) == -1)
+		return(errno == EINTR ? 0 : -1);
+
+	if(loop->next >= count)
+		loop->next = 0;
+
+	for(x=0; x<count && got<maxevents; x++)
+	{
+		size_t i = (loop->next + x) % count;
+		short ev = loop->fds[i].revents;
+
+		if(!ev)
+			continue;
+
+		events[got].ptr = loop->ptrs[i];
+		events[got].events = 0;
+		if(ev & POLLIN)
+			events[got].events |= EVLOOP_READ;
+		if(ev & POLLOUT)
+			events[got].events |= EVLOOP_WRITE;
+		if(ev & (POLLERR | POLLHUP | POLLNVAL))
+			events[got].events |= EVLOOP_HANGUP;
+		got++;
+	}
+	loop->next += x;
+	return(got);
+}
+
+#endif
@@ -0,0 +1,50 @@
+/* FCE Ultra Network Play Server
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _EVLOOP_H
+#define _EVLOOP_H
+
+/* Socket readiness notification.  Uses epoll on Linux, so the cost of a
+   wait doesn't depend on the number of idle connections, and falls back
+   to poll() elsewhere(OS X, Cygwin).  Level triggered in both cases.
+*/
+
+#define EVLOOP_READ     1
+#define EVLOOP_WRITE    2
+#define EVLOOP_HANGUP   4
+
+typedef struct
+{
+	void *ptr;     /* As passed to EvLoopAdd()/EvLoopModify() */
+	int events;    /* EVLOOP_* bits */
+} EVLOOP_EVENT;
+
+typedef struct EVLOOP EVLOOP;
+
+EVLOOP *EvLoopCreate(void);
+void EvLoopDestroy(EVLOOP *loop);
+
+/* Return 0 on failure. */
+int EvLoopAdd(EVLOOP *loop, int fd, int events, void *ptr);
+int EvLoopModify(EVLOOP *loop, int fd, int events, void *ptr);
+void EvLoopRemove(EVLOOP *loop, int fd);
+
+/* Waits up to timeout milliseconds(-1 = forever), returns the number
+   of events stored, 0 on timeout or -1 on error. */
+int EvLoopWait(EVLOOP *loop, EVLOOP_EVENT *events, int maxevents, int timeout);
+
+#endif
@@ -0,0 +1,506 @@
+/* FCE Ultra Network Play Server
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Load generator for the network play server.  Connects a number of fake
+   clients, groups them into games, and has each of them send a new input
+   byte every frame.  The time from sending a byte until it comes back in
+   the server's joypad update is the latency reported at the end.
+*/
+
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "types.h"
+#include "md5.h"
+#include "throttle.h"
+#include "netbuf.h"
+#include "evloop.h"
+
+#define DEFAULT_PORT 4046
+#define DEFAULT_CLIENTS 100
+#define DEFAULT_PLAYERS 2
+#define DEFAULT_DURATION 10
+
+#if defined (__APPLE__) || defined(BSD)
+#define MSG_NOSIGNAL SO_NOSIGPIPE
+#define SOL_TCP IPPROTO_TCP
+#endif
+
+typedef struct
+{
+	int num;
+	int TCPSocket;
+	int connected;
+	int events;         /* EVLOOP_* bits currently waited for. */
+	int divisor;        /* Frame divisor sent by the server, 0 until received. */
+	int slot;           /* Player slot(0-3), -1 until the server told us. */
+	uint8 seq;          /* Next input byte to send. */
+	uint64 sendtime[256];
+	uint8 hdr[5];       /* Header of the message being received. */
+	int havehdr;
+	NETBUF inbuf;
+	NETBUF outbuf;
+} LOADCLIENT;
+
+static uint64 GetCurTime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint64)ts.tv_sec*1000000 + ts.tv_nsec/1000);
+}
+
+static void en32(uint8 *buf, uint32 morp)
+{
+	buf[0]=morp;
+	buf[1]=morp>>8;
+	buf[2]=morp>>16;
+	buf[3]=morp>>24;
+}
+
+static uint32 de32(uint8 *morp)
+{
+	return(morp[0]|(morp[1]<<8)|(morp[2]<<16)|(morp[3]<<24));
+}
+
+static EVLOOP *Loop;
+static std::vector <uint32> Latencies;
+static uint32 Disconnects = 0;
+static uint32 LoggedIn = 0;
+static uint64 BytesIn = 0, BytesOut = 0;
+
+static void Drop(LOADCLIENT *client, const char *why)
+{
+	if(client->TCPSocket == -1)
+		return;
+
+	printf("Client %d: %s\n", client->num, why);
+	EvLoopRemove(Loop, client->TCPSocket);
+	close(client->TCPSocket);
+	client->TCPSocket = -1;
+	if(client->slot >= 0)
+		LoggedIn--;
+	Disconnects++;
+}
+
+static void Flush(LOADCLIENT *client)
+{
+	struct iovec iov[2];
+	int n;
+
+	while(client->TCPSocket != -1 && (n = NetBufDataVecs(&client->outbuf, iov)))
+	{
+		ssize_t l = writev(client->TCPSocket, iov, n);
+		if(l == -1)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			Drop(client, strerror(errno));
+			return;
+		}
+		BytesOut += l;
+		NetBufConsume(&client->outbuf, l);
+	}
+	if(client->TCPSocket == -1)
+		return;
+
+	int events = EVLOOP_READ | (client->outbuf.fill ? EVLOOP_WRITE : 0);
+	if(events != client->events)
+	{
+		EvLoopModify(Loop, client->TCPSocket, events, client);
+		client->events = events;
+	}
+}
+
+static void Send(LOADCLIENT *client, const uint8 *data, uint32 len)
+{
+	if(client->TCPSocket == -1)
+		return;
+	if(!NetBufWrite(&client->outbuf, data, len, 1024*1024))
+	{
+		Drop(client, "server isn't reading");
+		return;
+	}
+	if(client->connected)
+		Flush(client);
+}
+
+static void SendLogin(LOADCLIENT *client, int game, uint8 *password)
+{
+	struct md5_context md5;
+	uint8 buf[4 + 16 + 16 + 64 + 1 + 32];
+	uint8 *bp = buf + 4;
+	char nick[32];
+	uint32 len;
+
+	/* Same game id for every client of a game. */
+	md5_starts(&md5);
+	md5_update(&md5, (uint8 *)&game, sizeof(game));
+	md5_finish(&md5, bp);
+	bp += 16;
+
+	if(password)
+		memcpy(bp, password, 16);
+	else
+		memset(bp, 0, 16);
+	bp += 16;
+
+	memset(bp, 0, 64);
+	bp += 64;
+
+	*bp++ = 1; /* Local players */
+
+	len = snprintf(nick, sizeof(nick), "load%d", client->num);
+	memcpy(bp, nick, len);
+	bp += len;
+
+	en32(buf, bp - buf - 4);
+	Send(client, buf, bp - buf);
+}
+
+/* Parses what the server sent, returns 0 on protocol errors. */
+static int Receive(LOADCLIENT *client)
+{
+	if(!client->divisor)
+	{
+		uint8 d;
+		if(!NetBufRead(&client->inbuf, &d, 1))
+			return(1);
+		client->divisor = d ? d : 1;
+	}
+
+	while(1)
+	{
+		uint8 *hdr = client->hdr;
+		uint32 len = 0;
+
+		if(!client->havehdr)
+		{
+			if(client->inbuf.fill < 5)
+				break;
+			NetBufRead(&client->inbuf, hdr, 5);
+			client->havehdr = 1;
+		}
+
+		if(hdr[4] & 0x80)
+		{
+			len = de32(hdr);
+			if(len > 200000)
+				return(0);
+			if(client->inbuf.fill < len)
+				break; /* Wait for the rest. */
+		}
+		client->havehdr = 0;
+
+		if(hdr[4] == 0x90)
+		{
+			char text[256];
+			uint32 tlen = len < sizeof(text) - 1 ? len : sizeof(text) - 1;
+			int player;
+
+			NetBufRead(&client->inbuf, (uint8 *)text, tlen);
+			NetBufConsume(&client->inbuf, len - tlen);
+			text[tlen] = 0;
+			if(client->slot < 0 && sscanf(text, "* You(Player %d)", &player) == 1 && player >= 1 && player <= 4)
+			{
+				client->slot = player - 1;
+				LoggedIn++;
+			}
+		}
+		else if(hdr[4] & 0x80)
+		{
+			NetBufConsume(&client->inbuf, len);
+		}
+		else if(client->slot >= 0) /* Joypad update */
+		{
+			uint8 v = hdr[client->slot];
+
+			if(client->sendtime[v])
+			{
+				Latencies.push_back(GetCurTime() - client->sendtime[v]);
+				client->sendtime[v] = 0;
+			}
+		}
+	}
+	return(1);
+}
+
+static void HandleEvent(LOADCLIENT *client, int events)
+{
+	if(client->TCPSocket == -1)
+		return;
+
+	if(!client->connected && (events & (EVLOOP_WRITE | EVLOOP_HANGUP)))
+	{
+		int err = 0;
+		socklen_t errlen = sizeof(err);
+
+		getsockopt(client->TCPSocket, SOL_SOCKET, SO_ERROR, &err, &errlen);
+		if(err)
+		{
+			Drop(client, strerror(err));
+			return;
+		}
+		client->connected = 1;
+	}
+
+	if(events & (EVLOOP_READ | EVLOOP_HANGUP))
+	{
+		struct iovec iov[2];
+		int n;
+
+		NetBufReserve(&client->inbuf, 4096, 1024*1024);
+		n = NetBufFreeVecs(&client->inbuf, iov);
+
+		ssize_t l = readv(client->TCPSocket, iov, n);
+		if(l == 0)
+		{
+			Drop(client, "disconnected by the server");
+			return;
+		}
+		if(l > 0)
+		{
+			BytesIn += l;
+			NetBufCommit(&client->inbuf, l);
+			if(!Receive(client))
+			{
+				Drop(client, "protocol error");
+				return;
+			}
+		}
+		else if(errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			Drop(client, strerror(errno));
+			return;
+		}
+	}
+	if(client->outbuf.fill || (events & EVLOOP_WRITE))
+		Flush(client);
+}
+
+static void Usage(const char *argv0)
+{
+	printf("Usage: %s [OPTION]...\n", argv0);
+	printf("Simulates network play clients against an FCE Ultra game server.\n\n");
+	printf("-h\t--help\t\tDisplays this help message.\n");
+	printf("-s\t--server\tServer address. (default=127.0.0.1)\n");
+	printf("-p\t--port\t\tServer port. (default=%d)\n", DEFAULT_PORT);
+	printf("-w\t--password\tServer password.\n");
+	printf("-n\t--clients\tNumber of clients. (default=%d)\n", DEFAULT_CLIENTS);
+	printf("-g\t--players\tPlayers per game, 1-4. (default=%d)\n", DEFAULT_PLAYERS);
+	printf("-d\t--duration\tSeconds to run for. (default=%d)\n", DEFAULT_DURATION);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *server = "127.0.0.1";
+	int port = DEFAULT_PORT;
+	int numclients = DEFAULT_CLIENTS;
+	int players = DEFAULT_PLAYERS;
+	int duration = DEFAULT_DURATION;
+	uint8 password[16], *pass = 0;
+	int i;
+
+	for(i=1; i<argc; i++)
+	{
+		const char *arg = argv[i];
+
+		if(!strcmp(arg, "--help") || !strcmp(arg, "-h"))
+		{
+			Usage(argv[0]);
+			return -1;
+		}
+		if(i + 1 == argc)
+		{
+			printf("Missing value for %s\n", arg);
+			return -1;
+		}
+		i++;
+		if(!strcmp(arg, "--server") || !strcmp(arg, "-s"))
+			server = argv[i];
+		else if(!strcmp(arg, "--port") || !strcmp(arg, "-p"))
+			port = atoi(argv[i]);
+		else if(!strcmp(arg, "--clients") || !strcmp(arg, "-n"))
+			numclients = atoi(argv[i]);
+		else if(!strcmp(arg, "--players") || !strcmp(arg, "-g"))
+			players = atoi(argv[i]);
+		else if(!strcmp(arg, "--duration") || !strcmp(arg, "-d"))
+			duration = atoi(argv[i]);
+		else if(!strcmp(arg, "--password") || !strcmp(arg, "-w"))
+		{
+			struct md5_context md5;
+			md5_starts(&md5);
+			md5_update(&md5, (uint8 *)argv[i], strlen(argv[i]));
+			md5_finish(&md5, password);
+			pass = password;
+		}
+		else
+		{
+			printf("Invalid parameter: %s\n", arg);
+			return -1;
+		}
+	}
+	if(numclients < 1 || players < 1 || players > 4 || duration < 1)
+	{
+		Usage(argv[0]);
+		return -1;
+	}
+
+	struct sockaddr_in sockin;
+	memset(&sockin, 0, sizeof(sockin));
+	sockin.sin_family = AF_INET;
+	sockin.sin_port = htons(port);
+	if(!inet_aton(server, &sockin.sin_addr))
+	{
+		struct hostent *he = gethostbyname(server);
+		if(!he)
+		{
+			printf("Unknown host %s\n", server);
+			return -1;
+		}
+		memcpy(&sockin.sin_addr, he->h_addr, 4);
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if(!(Loop = EvLoopCreate()))
+	{
+		printf("Error setting up the event loop: %s\n", strerror(errno));
+		return -1;
+	}
+
+	std::vector <LOADCLIENT> clients(numclients);
+
+	for(i=0; i<numclients; i++)
+	{
+		LOADCLIENT *client = &clients[i];
+		int s, tcpopt = 1;
+
+		memset(client, 0, sizeof(LOADCLIENT));
+		client->num = i;
+		client->slot = -1;
+		client->TCPSocket = -1;
+		NetBufInit(&client->inbuf);
+		NetBufInit(&client->outbuf);
+
+		if((s = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		{
+			printf("socket(): %s%s\n", strerror(errno), errno == EMFILE ? " (raise ulimit -n)" : "");
+			return -1;
+		}
+		fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+		setsockopt(s, SOL_TCP, TCP_NODELAY, &tcpopt, sizeof(int));
+
+		if(connect(s, (struct sockaddr *)&sockin, sizeof(sockin)) == 0)
+			client->connected = 1;
+		else if(errno != EINPROGRESS)
+		{
+			printf("connect(): %s\n", strerror(errno));
+			close(s);
+			return -1;
+		}
+		client->TCPSocket = s;
+		client->events = EVLOOP_READ | EVLOOP_WRITE;
+		EvLoopAdd(Loop, s, client->events, client);
+
+		/* Queued until the connection is up. */
+		SendLogin(client, i / players, pass);
+	}
+	printf("Connecting %d clients in %d games...\n", numclients, (numclients + players - 1) / players);
+
+	THROTTLE throttle;
+	InitThrottle(&throttle, 1);
+
+	std::vector <EVLOOP_EVENT> events(1024);
+	uint64 start = GetCurTime();
+	uint64 end = start + (uint64)duration*1000000;
+	uint64 frames = 0;
+
+	Latencies.reserve((size_t)numclients * duration * 60);
+
+	while(GetCurTime() < end)
+	{
+		uint64 wait;
+		int n;
+
+		if(TestThrottle(&throttle, &wait))
+		{
+			uint64 now = GetCurTime();
+
+			for(i=0; i<numclients; i++)
+			{
+				LOADCLIENT *client = &clients[i];
+
+				if(client->TCPSocket == -1 || client->slot < 0)
+					continue;
+				if(frames % client->divisor)
+					continue;
+
+				uint8 v = client->seq;
+				client->seq = (client->seq + 1) % 0xFF; /* 0xFF starts a command */
+				client->sendtime[v] = now;
+				Send(client, &v, 1);
+			}
+			frames++;
+		}
+
+		n = EvLoopWait(Loop, &events[0], events.size(), (wait + 999) / 1000);
+		for(i=0; i<n; i++)
+			HandleEvent((LOADCLIENT *)events[i].ptr, events[i].events);
+	}
+
+	double secs = (GetCurTime() - start) / 1000000.0;
+
+	printf("\n%u of %d clients in a game at the end, %u disconnects.\n", LoggedIn, numclients, Disconnects);
+	printf("%.1f seconds, %llu frames, %.1f KB/s in, %.1f KB/s out.\n", secs, (unsigned long long)frames,
+		BytesIn / secs / 1024, BytesOut / secs / 1024);
+
+	if(Latencies.empty())
+	{
+		puts("No input made the round trip.");
+		return 1;
+	}
+
+	std::sort(Latencies.begin(), Latencies.end());
+
+	static const double pct[] = { 50, 90, 99, 99.9 };
+	size_t count = Latencies.size();
+
+	printf("%llu round trips, latency in ms:\n", (unsigned long long)count);
+	for(i=0; i<4; i++)
+	{
+		size_t idx = (size_t)(pct[i] / 100 * (count - 1) + 0.5);
+		printf("  p%-5g %8.2f\n", pct[i], Latencies[idx] / 1000.0);
+	}
+	printf("  max    %8.2f\n", Latencies[count - 1] / 1000.0);
+	return 0;
+}
@@ -0,0 +1,169 @@
+/* FCE Ultra Network Play Server
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "netbuf.h"
+
+#define NETBUF_MINSIZE 512
+
+void NetBufInit(NETBUF *nb)
+{
+	nb->data = 0;
+	nb->size = 0;
+	nb->head = 0;
+	nb->fill = 0;
+}
+
+void NetBufFree(NETBUF *nb)
+{
+	if(nb->data)
+		free(nb->data);
+	NetBufInit(nb);
+}
+
+int NetBufReserve(NETBUF *nb, uint32 len, uint32 maxsize)
+{
+	uint32 need = nb->fill + len;
+	uint32 size;
+	uint8 *data;
+
+	if(need < nb->fill || need > maxsize)
+		return(0);
+	if(need <= nb->size)
+		return(1);
+
+	size = nb->size ? nb->size : NETBUF_MINSIZE;
+	while(size < need)
+		size <<= 1;
+
+	if(!(data = (uint8 *)malloc(size)))
+		return(0);
+
+	/* Unwrap the queued data to the start of the new storage. */
+	NetBufRead(nb, data, nb->fill);
+	nb->fill = need - len;
+
+	free(nb->data);
+	nb->data = data;
+	nb->size = size;
+	nb->head = 0;
+	return(1);
+}
+
+int NetBufWrite(NETBUF *nb, const uint8 *data, uint32 len, uint32 maxsize)
+{
+	uint32 tail, first;
+
+	if(!len)
+		return(1);
+	if(!NetBufReserve(nb, len, maxsize))
+		return(0);
+
+	tail = (nb->head + nb->fill) & (nb->size - 1);
+	first = nb->size - tail;
+	if(first > len)
+		first = len;
+
+	memcpy(nb->data + tail, data, first);
+	memcpy(nb->data, data + first, len - first);
+	nb->fill += len;
+	return(1);
+}
+
+uint32 NetBufRead(NETBUF *nb, uint8 *dest, uint32 len)
+{
+	uint32 first;
+
+	if(len > nb->fill)
+		len = nb->fill;
+	if(!len)
+		return(0);
+
+	first = nb->size - nb->head;
+	if(first > len)
+		first = len;
+
+	memcpy(dest, nb->data + nb->head, first);
+	memcpy(dest + first, nb->data, len - first);
+	NetBufConsume(nb, len);
+	return(len);
+}
+
+void NetBufConsume(NETBUF *nb, uint32 len)
+{
+	if(len >= nb->fill)
+	{
+		/* Restart at the beginning, so the next readv()/writev() is
+		   more likely to need only one vector. */
+		nb->head = 0;
+		nb->fill = 0;
+		return;
+	}
+	nb->head = (nb->head + len) & (nb->size - 1);
+	nb->fill -= len;
+}
+
+int NetBufDataVecs(NETBUF *nb, struct iovec iov[2])
+{
+	uint32 first;
+
+	if(!nb->fill)
+		return(0);
+
+	first = nb->size - nb->head;
+	if(first >= nb->fill)
+	{
+		iov[0].iov_base = nb->data + nb->head;
+		iov[0].iov_len = nb->fill;
+		return(1);
+	}
+	iov[0].iov_base = nb->data + nb->head;
+	iov[0].iov_len = first;
+	iov[1].iov_base = nb->data;
+	iov[1].iov_len = nb->fill - first;
+	return(2);
+}
+
+int NetBufFreeVecs(NETBUF *nb, struct iovec iov[2])
+{
+	uint32 tail, room, first;
+
+	room = nb->size - nb->fill;
+	if(!room)
+		return(0);
+
+	tail = (nb->head + nb->fill) & (nb->size - 1);
+	first = nb->size - tail;
+	if(first >= room)
+	{
+		iov[0].iov_base = nb->data + tail;
+		iov[0].iov_len = room;
+		return(1);
+	}
+	iov[0].iov_base = nb->data + tail;
+	iov[0].iov_len = first;
+	iov[1].iov_base = nb->data;
+	iov[1].iov_len = room - first;
+	return(2);
+}
+
+void NetBufCommit(NETBUF *nb, uint32 len)
+{
+	nb->fill += len;
+}
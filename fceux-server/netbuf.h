@@ -0,0 +1,57 @@
+/* FCE Ultra Network Play Server
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _NETBUF_H
+#define _NETBUF_H
+
+#include <sys/uio.h>
+
+/* Byte ring used for the per-connection input and output queues.
+   The storage starts out empty and doubles as needed, up to the
+   limit given to NetBufReserve()/NetBufWrite().
+*/
+typedef struct
+{
+	uint8 *data;
+	uint32 size;   /* Capacity, always 0 or a power of 2. */
+	uint32 head;   /* Offset of the oldest queued byte. */
+	uint32 fill;   /* Number of queued bytes. */
+} NETBUF;
+
+void NetBufInit(NETBUF *nb);
+void NetBufFree(NETBUF *nb);
+
+/* Makes room for at least len more bytes.  Returns 0 if that would
+   take more than maxsize bytes of storage. */
+int NetBufReserve(NETBUF *nb, uint32 len, uint32 maxsize);
+
+/* Queues len bytes, returns 0 if they don't fit within maxsize. */
+int NetBufWrite(NETBUF *nb, const uint8 *data, uint32 len, uint32 maxsize);
+
+/* Dequeues up to len bytes into dest, returns the number copied. */
+uint32 NetBufRead(NETBUF *nb, uint8 *dest, uint32 len);
+void NetBufConsume(NETBUF *nb, uint32 len);
+
+/* Fill in iov[] with the queued data (for writev()) or the free
+   space (for readv()), returns the number of vectors used, 0-2. */
+int NetBufDataVecs(NETBUF *nb, struct iovec iov[2]);
+int NetBufFreeVecs(NETBUF *nb, struct iovec iov[2]);
+
+/* Accounts for len bytes stored into the free space by readv(). */
+void NetBufCommit(NETBUF *nb, uint32 len);
+
+#endif
@@ -26,6 +26,7 @@
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <sys/param.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -35,26 +36,45 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <signal.h>
 
 #include <exception>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "types.h"
 #include "md5.h"
 #include "throttle.h"
+#include "netbuf.h"
+#include "evloop.h"
 
-#define VERSION "0.0.5"
+#define VERSION "0.0.6"
 #define DEFAULT_PORT 4046
 #define DEFAULT_MAX 100
 #define DEFAULT_TIMEOUT 5
 #define DEFAULT_FRAMEDIVISOR 1
+#define DEFAULT_WORKERS 1
 #define DEFAULT_CONFIG "/etc/fceux-server.conf"
 
+#define MAX_WORKERS 64
+#define MAX_EVENTS 256
+#define INBUF_CHUNK 4096            /* Bytes read from a client per recv. */
+#define INBUF_MAX   (INBUF_CHUNK*4)
+#define OUTBUF_MAX  (1024*1024)     /* Clients falling further behind than this are dropped. */
+
 // MSG_NOSIGNAL and SOL_TCP have been depreciated on osx
 #if defined (__APPLE__) || defined(BSD)
 #define MSG_NOSIGNAL SO_NOSIGPIPE
 #define SOL_TCP IPPROTO_TCP
 #endif
 
+struct WORKER;
+
 typedef struct {
 	uint32 id; /* mainly for faster referencing when pointed to from the Games
 	              entries.
@@ -66,10 +86,25 @@ typedef struct {
 
 	time_t timeconnect; /* Time the client made the connection. */
 
-	/* Variables to handle non-blocking TCP reads. */
+	/* Variables to handle non-blocking TCP reads.  Small nbtcp buffers
+	   are kept between messages. */
 	uint8 *nbtcp;
 	uint32 nbtcphas, nbtcplen;
 	uint32 nbtcptype;
+	uint32 nbtcpsize;
+
+	NETBUF inbuf;       /* Received, not yet parsed. */
+	NETBUF outbuf;      /* Queued, not yet sent. */
+
+	WORKER *worker;     /* The event loop this client is handled by. */
+	int events;         /* EVLOOP_* bits it's currently registered for. */
+	int queued;         /* Set while on the worker's flush list. */
+	int dead;           /* Fell too far behind, to be dropped at the next flush. */
+
+	/* Login data, kept until the client is added to its game. */
+	int loggedin;
+	uint8 gameid[16];
+	uint8 extra[64];
 } ClientEntry;
 
 typedef struct
@@ -85,8 +120,30 @@ typedef struct
 	uint8 ExtraInfo[64];     /* Expansion information to be used in future versions
 	                            of FCE Ultra.
 	                         */
+	uint32 num;              /* Game number, for the log. */
 } GameEntry;
 
+/* Every connection belongs to exactly one WORKER, and is only touched from
+   that worker's thread.  The main thread(the lobby) accepts connections and
+   handles the login, then hands each client over to the worker that owns its
+   game, chosen from the game id.  Games never move between workers, so the
+   per-frame work needs no locking.
+*/
+struct WORKER
+{
+	EVLOOP *loop;
+	THROTTLE throttle;
+	int wakepipe[2];                          /* Written to when incoming is filled. */
+
+	std::mutex lock;
+	std::vector <ClientEntry *> incoming;     /* Logged in clients handed over by the lobby. */
+
+	std::vector <ClientEntry *> clients;      /* Clients still logging in(lobby only). */
+	std::vector <ClientEntry *> flushlist;    /* Clients with output queued this pass. */
+	std::vector <ClientEntry *> zombies;      /* Killed clients, freed at the end of the pass. */
+	std::unordered_map <std::string, GameEntry *> games;
+};
+
 typedef struct
 {
 	unsigned int MaxClients;     /* The maximum number of clients to allow. */
@@ -103,6 +160,7 @@ typedef struct
 	                                2 = 30 updates/sec, etc. */
 	unsigned int Port;           /* The port to listen on. */
 	uint8 *Password;             /* The server password. */
+	unsigned int Workers;        /* The number of threads games are spread over. */
 } CONFIG;
 
 CONFIG ServerConfig;
@@ -111,6 +169,7 @@ int LoadConfigFile(const char *fn)
 {
 	FILE *fp;
 	ServerConfig.Port = ServerConfig.MaxClients = ServerConfig.ConnectTimeout = ServerConfig.FrameDivisor = ~0;
+	ServerConfig.Workers = DEFAULT_WORKERS;
 	if(fp=fopen(fn,"rb"))
 	{
 		char buf[256];
@@ -124,6 +183,8 @@ int LoadConfigFile(const char *fn)
 				sscanf(buf,"%*s %d",&ServerConfig.FrameDivisor);
 			else if(!strncasecmp(buf,"port",strlen("port")))
 				sscanf(buf,"%*s %d",&ServerConfig.Port);
+			else if(!strncasecmp(buf,"workers",strlen("workers")))
+				sscanf(buf,"%*s %u",&ServerConfig.Workers);
 			else if(!strncasecmp(buf,"password",strlen("password")))
 			{
 				char *pass = 0;
@@ -156,8 +217,15 @@ int LoadConfigFile(const char *fn)
 	return(1);
 }
 
-static ClientEntry *Clients;
-static GameEntry *Games;
+static WORKER Lobby;
+static WORKER *Workers;
+
+static std::atomic <uint32> ClientCount(0);
+static std::atomic <uint32> GameCount(0);
+static uint32 NextClientId = 0;
+
+/* Markers for the event loop entries that aren't clients. */
+static int ListenMarker, WakeMarker;
 
 static void en32(uint8 *buf, uint32 morp)
 {
@@ -174,10 +242,10 @@ static uint32 de32(uint8 *morp)
 
 static char *CleanNick(char *nick);
 static int NickUnique(ClientEntry *client);
-static void AddClientToGame(ClientEntry *client, uint8 id[16], uint8 extra[64]) throw();
-static void SendToAll(GameEntry *game, int cmd, uint8 *data, uint32 len) throw();
-static void BroadcastText(GameEntry *game, const char *fmt, ...) throw();
-static void TextToClient(ClientEntry *client, const char *fmt, ...) throw();
+static void AddClientToGame(ClientEntry *client, uint8 id[16], uint8 extra[64]);
+static void SendToAll(GameEntry *game, int cmd, uint8 *data, uint32 len);
+static void BroadcastText(GameEntry *game, const char *fmt, ...);
+static void TextToClient(ClientEntry *client, const char *fmt, ...);
 static void KillClient(ClientEntry *client);
 
 #define NBTCP_LOGINLEN      0x100
@@ -189,7 +257,11 @@ static void KillClient(ClientEntry *client);
 
 static void StartNBTCPReceive(ClientEntry *client, uint32 type, uint32 len)
 {
-	client->nbtcp = (uint8 *)malloc(len);
+	if(len > client->nbtcpsize)
+	{
+		client->nbtcp = (uint8 *)realloc(client->nbtcp, len);
+		client->nbtcpsize = len;
+	}
 	client->nbtcplen = len;
 	client->nbtcphas = 0;
 	client->nbtcptype = type;
@@ -202,16 +274,21 @@ static void RedoNBTCPReceive(ClientEntry *client)
 
 static void EndNBTCPReceive(ClientEntry *client)
 {
-	free(client->nbtcp);
-	client->nbtcplen = client->localplayers;
+	/* Don't hold on to the buffer of a save state or cheat file. */
+	if(client->nbtcpsize > 1024)
+	{
+		free(client->nbtcp);
+		client->nbtcp = 0;
+		client->nbtcpsize = 0;
+	}
+	client->nbtcplen = 0;
 	client->nbtcphas = 0;
 	client->nbtcptype = 0;
-	client->nbtcp = 0;
 }
 
 static uint8 *MakeMPS(ClientEntry *client)
 {
-	static uint8 buf[64];
+	static thread_local uint8 buf[64];
 	uint8 *bp = buf;
 	int x;
 	GameEntry *game = (GameEntry *)client->game;
@@ -226,216 +303,215 @@ static uint8 *MakeMPS(ClientEntry *client)
 			bp++;
 		}
 	}
-	if(*(bp-1) == ',') bp--;
+	if(bp != buf && *(bp-1) == ',') bp--;
 
 	*bp = 0;
 	return(buf);
 }
 
-/* Returns 1 if we are back to normal game mode, 0 if more data is yet to arrive. */
-static int CheckNBTCPReceive(ClientEntry *client) throw()
+/* Returns 1 if a message was handled, 0 if more data is yet to arrive(or the
+   login just completed, and the client is waiting to be handed to its worker). */
+static int CheckNBTCPReceive(ClientEntry *client)
 {
 	if(!client->nbtcplen)
 		throw(1); /* Should not happen. */
 
-	int l;
-
-	while(l = recv(client->TCPSocket, client->nbtcp + client->nbtcphas, client->nbtcplen  - client->nbtcphas, MSG_NOSIGNAL))
+	while(client->nbtcphas < client->nbtcplen)
 	{
-		if(l == -1)
-		{
-			if(errno == EAGAIN || errno == EWOULDBLOCK)
-				break;
-			throw(1); /* Die now.  NOW. */
-		}
+		uint32 l = NetBufRead(&client->inbuf, client->nbtcp + client->nbtcphas, client->nbtcplen - client->nbtcphas);
+		if(!l)
+			return(0);
 		client->nbtcphas += l;
+	}
 
-		//printf("Read: %d, %04x, %d, %d\n",l,client->nbtcptype,client->nbtcphas, client->nbtcplen);
+	//printf("Read: %04x, %d, %d\n",client->nbtcptype,client->nbtcphas, client->nbtcplen);
 
-		/* We're all full.  Yippie. */
-		if(client->nbtcphas == client->nbtcplen)
-		{
-			uint32 len;
+	/* We're all full.  Yippie. */
+	uint32 len;
 
-			switch(client->nbtcptype & 0xF00)
+	switch(client->nbtcptype & 0xF00)
+	{
+	case NBTCP_UPDATEDATA:
+		{
+			GameEntry *game = (GameEntry *)client->game;
+			int x, wx;
+			if(client->nbtcp[0] == 0xFF)
+			{
+				EndNBTCPReceive(client);
+				StartNBTCPReceive(client, NBTCP_COMMANDLEN, 5);
+				return(1);
+			}
+			for(x=0,wx=0; x < 4; x++)
 			{
-			case NBTCP_UPDATEDATA:
+				if(game->Players[x] == client)
 				{
-					GameEntry *game = (GameEntry *)client->game;
-					int x, wx;
-					if(client->nbtcp[0] == 0xFF)
-					{
-						EndNBTCPReceive(client);
-						StartNBTCPReceive(client, NBTCP_COMMANDLEN, 5);
-						return(1);
-					}
-					for(x=0,wx=0; x < 4; x++)
-					{
-						if(game->Players[x] == client)
-						{
-							game->joybuf[x] = client->nbtcp[wx];
-							wx++;
-						}
-					}
-					RedoNBTCPReceive(client);
+					game->joybuf[x] = client->nbtcp[wx];
+					wx++;
 				}
-				return(1);
-			case NBTCP_COMMANDLEN:
+			}
+			RedoNBTCPReceive(client);
+		}
+		return(1);
+	case NBTCP_COMMANDLEN:
+		{
+			uint8 cmd = client->nbtcp[4];
+			len = de32(client->nbtcp);
+			if(len > 200000) /* Sanity check. */
+				throw(1);
+
+			//printf("%02x, %d\n",cmd,len);
+			if(!len && !(cmd&0x80))
+			{
+				SendToAll((GameEntry*)client->game, client->nbtcp[4], 0, 0);
+				EndNBTCPReceive(client);
+				StartNBTCPReceive(client,NBTCP_UPDATEDATA,client->localplayers);
+			}
+			else if(client->nbtcp[4]&0x80)
+			{
+				EndNBTCPReceive(client);
+				if(len)
 				{
-					uint8 cmd = client->nbtcp[4];
-					len = de32(client->nbtcp);
-					if(len > 200000) /* Sanity check. */
-						throw(1);
-
-					//printf("%02x, %d\n",cmd,len);
-					if(!len && !(cmd&0x80))
-					{
-						SendToAll((GameEntry*)client->game, client->nbtcp[4], 0, 0);
-						EndNBTCPReceive(client);
-						StartNBTCPReceive(client,NBTCP_UPDATEDATA,client->localplayers);
-					}
-					else if(client->nbtcp[4]&0x80)
-					{
-						EndNBTCPReceive(client);
-						if(len)
-						{
-							StartNBTCPReceive(client,NBTCP_COMMAND | cmd,len);
-						}
-						else
-						{
-							/* Woops.  Client probably tried to send a text message of 0 length.
-							   Or maybe a 0-length cheat file?  Better be safe! */
-							StartNBTCPReceive(client,NBTCP_UPDATEDATA,client->localplayers);
-						}
-					}
-					else throw(1);
-					return(1);
+					StartNBTCPReceive(client,NBTCP_COMMAND | cmd,len);
 				}
-			case NBTCP_COMMAND:
+				else
 				{
-					len = client->nbtcplen;
-					uint32 tocmd = client->nbtcptype & 0xFF;
-
-					if(tocmd == 0x90) /* Text */
-					{
-						char *ma, *ma2;
-
-						ma = (char *) malloc(len + 1);
-						memcpy(ma, client->nbtcp, len);
-						ma[len] = 0;
-						asprintf(&ma2, "<%s> %s",client->nickname,ma);
-						free(ma);
-						ma = ma2;
-						len=strlen(ma);
-						SendToAll((GameEntry*)client->game, tocmd, (uint8 *)ma, len);
-						free(ma);
-					}
-					else
-					{
-						SendToAll((GameEntry*)client->game, tocmd, client->nbtcp, len);
-					}
-					EndNBTCPReceive(client);
+					/* Woops.  Client probably tried to send a text message of 0 length.
+					   Or maybe a 0-length cheat file?  Better be safe! */
 					StartNBTCPReceive(client,NBTCP_UPDATEDATA,client->localplayers);
-					return(1);
 				}
-			case NBTCP_LOGINLEN:
-				len = de32(client->nbtcp);
-				if(len > 1024 || len < (16 + 16 + 64 + 1))
-				throw(1);
-				EndNBTCPReceive(client);
-				StartNBTCPReceive(client,NBTCP_LOGIN,len);
-				return(1);
-			case NBTCP_LOGIN:
+			}
+			else throw(1);
+			return(1);
+		}
+	case NBTCP_COMMAND:
+		{
+			len = client->nbtcplen;
+			uint32 tocmd = client->nbtcptype & 0xFF;
+
+			if(tocmd == 0x90) /* Text */
+			{
+				char *ma, *ma2;
+
+				ma = (char *) malloc(len + 1);
+				memcpy(ma, client->nbtcp, len);
+				ma[len] = 0;
+				if(asprintf(&ma2, "<%s> %s",client->nickname,ma) < 0)
+					ma2 = 0;
+				free(ma);
+				ma = ma2;
+				if(ma)
 				{
-					uint32 len;
-					uint8 gameid[16];
-					uint8 *sexybuf;
-					uint8 extra[64];
-
-					len = client->nbtcplen;
-					sexybuf = client->nbtcp;
-
-					/* Game ID(MD5'd game MD5 and password on client side). */
-					memcpy(gameid, sexybuf, 16);
-					sexybuf += 16;
-					len -= 16;
-
-					if(ServerConfig.Password)
-					if(memcmp(ServerConfig.Password,sexybuf,16))
-					{
-						TextToClient(client,"Invalid server password.");
-						throw(1);
-					}
-					sexybuf += 16;
-					len -= 16;
-
-					memcpy(extra, sexybuf, 64);
-					sexybuf += 64;
-					len -= 64;
-
-					client->localplayers = *sexybuf;
-					if(client->localplayers < 1 || client->localplayers > 4)
-					{
-						TextToClient(client,"Invalid number(%d) of local players!",client->localplayers);
-						throw(1);
-					}
-					sexybuf++;
-					len -= 1;
-
-					AddClientToGame(client, gameid, extra);
-					/* Get the nickname */
-					if(len)
-					{
-						client->nickname = (char *)malloc(len + 1);
-						memcpy(client->nickname, sexybuf, len);
-						client->nickname[len] = 0;
-						if((client->nickname = CleanNick(client->nickname)))
-						if(!NickUnique(client)) /* Nickname already exists */
-						{
-							free(client->nickname);
-							client->nickname = 0;
-						}
-					}
-					uint8 *mps = MakeMPS(client);
-
-					if(!client->nickname)
-						asprintf(&client->nickname,"*Player %s",mps);
-
-					printf("Client %d assigned to game %d as player %s <%s>\n",client->id,(GameEntry*)client->game - Games,mps, client->nickname);
-
-					int x;
-					GameEntry *tg=(GameEntry *)client->game;
-
-					for(x=0; x<tg->MaxPlayers; x++)
-					{
-						if(tg->Players[x] && tg->IsUnique[x])
-						{
-							if(tg->Players[x] != client)
-							{
-								try
-								{
-									TextToClient(tg->Players[x], "* Player %s has just connected as: %s",MakeMPS(client),client->nickname);
-								}
-								catch(int i)
-								{
-									KillClient(tg->Players[x]);
-								}
-								TextToClient(client, "* Player %s is already connected as: %s",MakeMPS(tg->Players[x]),tg->Players[x]->nickname);
-							}
-							else
-								TextToClient(client, "* You(Player %s) have just connected as: %s",MakeMPS(client),client->nickname);
-						}
-					}
+					len=strlen(ma);
+					SendToAll((GameEntry*)client->game, tocmd, (uint8 *)ma, len);
+					free(ma);
 				}
-				EndNBTCPReceive(client);
-				StartNBTCPReceive(client,NBTCP_UPDATEDATA,client->localplayers);
-				return(1);
 			}
+			else
+			{
+				SendToAll((GameEntry*)client->game, tocmd, client->nbtcp, len);
+			}
+			EndNBTCPReceive(client);
+			StartNBTCPReceive(client,NBTCP_UPDATEDATA,client->localplayers);
+			return(1);
+		}
+	case NBTCP_LOGINLEN:
+		len = de32(client->nbtcp);
+		if(len > 1024 || len < (16 + 16 + 64 + 1))
+		throw(1);
+		EndNBTCPReceive(client);
+		StartNBTCPReceive(client,NBTCP_LOGIN,len);
+		return(1);
+	case NBTCP_LOGIN:
+		{
+			uint32 len;
+			uint8 *sexybuf;
+
+			len = client->nbtcplen;
+			sexybuf = client->nbtcp;
+
+			/* Game ID(MD5'd game MD5 and password on client side). */
+			memcpy(client->gameid, sexybuf, 16);
+			sexybuf += 16;
+			len -= 16;
+
+			if(ServerConfig.Password)
+			if(memcmp(ServerConfig.Password,sexybuf,16))
+			{
+				TextToClient(client,"Invalid server password.");
+				throw(1);
+			}
+			sexybuf += 16;
+			len -= 16;
+
+			memcpy(client->extra, sexybuf, 64);
+			sexybuf += 64;
+			len -= 64;
+
+			client->localplayers = *sexybuf;
+			if(client->localplayers < 1 || client->localplayers > 4)
+			{
+				TextToClient(client,"Invalid number(%d) of local players!",client->localplayers);
+				throw(1);
+			}
+			sexybuf++;
+			len -= 1;
+
+			/* Get the nickname, it's checked once the client is in its game. */
+			if(len)
+			{
+				client->nickname = (char *)malloc(len + 1);
+				memcpy(client->nickname, sexybuf, len);
+				client->nickname[len] = 0;
+			}
+			client->loggedin = 1;
 		}
+		EndNBTCPReceive(client);
+		StartNBTCPReceive(client,NBTCP_UPDATEDATA,client->localplayers);
+		return(0);
 	}
 	return(0);
 }
 
+/* Called on the client's worker once it was handed over by the lobby. */
+static void JoinGame(ClientEntry *client)
+{
+	AddClientToGame(client, client->gameid, client->extra);
+
+	if(client->nickname)
+	{
+		if((client->nickname = CleanNick(client->nickname)))
+		if(!NickUnique(client)) /* Nickname already exists */
+		{
+			free(client->nickname);
+			client->nickname = 0;
+		}
+	}
+	uint8 *mps = MakeMPS(client);
+
+	if(!client->nickname)
+		if(asprintf(&client->nickname,"*Player %s",mps) < 0)
+			throw(1);
+
+	printf("Client %d assigned to game %d as player %s <%s>\n",client->id,((GameEntry*)client->game)->num,mps, client->nickname);
+
+	int x;
+	GameEntry *tg=(GameEntry *)client->game;
+
+	for(x=0; x<tg->MaxPlayers; x++)
+	{
+		if(tg->Players[x] && tg->IsUnique[x])
+		{
+			if(tg->Players[x] != client)
+			{
+				TextToClient(tg->Players[x], "* Player %s has just connected as: %s",MakeMPS(client),client->nickname);
+				TextToClient(client, "* Player %s is already connected as: %s",MakeMPS(tg->Players[x]),tg->Players[x]->nickname);
+			}
+			else
+				TextToClient(client, "* You(Player %s) have just connected as: %s",MakeMPS(client),client->nickname);
+		}
+	}
+}
+
 int ListenSocket;
 
 static char *CleanNick(char *nick)
@@ -469,52 +545,163 @@ static int NickUnique(ClientEntry *client)
 	return(1);
 }
 
-static int MakeSendTCP(ClientEntry *client, uint8 *data, uint32 len) throw()
+static void SetClientEvents(ClientEntry *client)
 {
-	if(send(client->TCPSocket, data, len, MSG_NOSIGNAL) != len)
-		throw(1);
+	int events = EVLOOP_READ;
+
+	if(client->outbuf.fill)
+		events |= EVLOOP_WRITE;
 
+	if(events != client->events)
+	{
+		EvLoopModify(client->worker->loop, client->TCPSocket, events, client);
+		client->events = events;
+	}
+}
+
+/* Queues data for the client, it's sent by FlushClients() at the end of the
+   current pass.  Never fails right away; a client whose queue overflows is
+   marked dead and dropped there instead, so the fan-out loops don't have
+   to deal with players vanishing halfway through.
+*/
+static void MakeSendTCP(ClientEntry *client, const uint8 *data, uint32 len)
+{
+	if(client->dead || client->TCPSocket == -1)
+		return;
+
+	if(!NetBufWrite(&client->outbuf, data, len, OUTBUF_MAX))
+	{
+		printf("Client %d is too far behind, dropping it.\n", client->id);
+		client->dead = 1;
+	}
+	if(!client->queued)
+	{
+		client->queued = 1;
+		client->worker->flushlist.push_back(client);
+	}
+}
+
+/* Writes as much of the queued output as the socket takes, all of it in one
+   call.  Returns 0 if the connection is gone. */
+static int FlushClient(ClientEntry *client)
+{
+	struct iovec iov[2];
+	struct msghdr msg;
+	int n;
+
+	while((n = NetBufDataVecs(&client->outbuf, iov)))
+	{
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n;
+
+		ssize_t l = sendmsg(client->TCPSocket, &msg, MSG_NOSIGNAL);
+		if(l == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return(0);
+		}
+		NetBufConsume(&client->outbuf, l);
+	}
+	SetClientEvents(client);
 	return(1);
 }
 
-static void SendToAll(GameEntry *game, int cmd, uint8 *data, uint32 len) throw()
+static void FlushClients(WORKER *w)
+{
+	size_t x;
+
+	/* Killing a client may queue more messages(and grow the list). */
+	for(x=0; x<w->flushlist.size(); x++)
+	{
+		ClientEntry *client = w->flushlist[x];
+
+		client->queued = 0;
+		if(client->TCPSocket == -1)
+			continue;
+		if(client->dead || !FlushClient(client))
+			KillClient(client);
+	}
+	w->flushlist.clear();
+
+	for(x=0; x<w->zombies.size(); x++)
+		free(w->zombies[x]);
+	w->zombies.clear();
+}
+
+/* Returns 0 if the client closed the connection. */
+static int ReadClient(ClientEntry *client)
+{
+	struct iovec iov[2];
+	int x, n;
+
+	/* Don't let one client hog the loop, whatever is left is picked up
+	   on the next pass. */
+	for(x=0; x<4; x++)
+	{
+		if(!NetBufReserve(&client->inbuf, INBUF_CHUNK, INBUF_MAX))
+			break;
+		n = NetBufFreeVecs(&client->inbuf, iov);
+
+		ssize_t l = readv(client->TCPSocket, iov, n);
+		if(l == 0)
+			return(0);
+		if(l == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			throw(1); /* Die now.  NOW. */
+		}
+		NetBufCommit(&client->inbuf, l);
+
+		/* Parse as we go, so the buffer stays small. */
+		while(!client->loggedin || client->game)
+			if(!CheckNBTCPReceive(client))
+				break;
+		if(client->loggedin && !client->game)
+			break;
+	}
+	return(1);
+}
+
+static void SendToAll(GameEntry *game, int cmd, uint8 *data, uint32 len)
 {
 	uint8 poo[5];
 	int x;
 
+	en32(poo, (cmd & 0x80) ? len : 0);
 	poo[4] = cmd;
 
 	for(x=0;x<game->MaxPlayers;x++)
 	{
 		if(!game->Players[x] || !game->IsUnique[x]) continue;
 
-		try
-		{
-			if(cmd & 0x80)
-				en32(poo, len);
-			MakeSendTCP(game->Players[x],poo,5);
+		MakeSendTCP(game->Players[x],poo,5);
 
-			if(cmd & 0x80)
-			{
-				MakeSendTCP(game->Players[x], data, len);
-			}
-		}
-		catch(int i)
+		if(cmd & 0x80)
 		{
-			KillClient(game->Players[x]);
+			MakeSendTCP(game->Players[x], data, len);
 		}
 	}
 }
 
-static void TextToClient(ClientEntry *client, const char *fmt, ...) throw()
+static void TextToClient(ClientEntry *client, const char *fmt, ...)
 {
 	char *moo;
 	va_list ap;
 
 	va_start(ap,fmt);
-	vasprintf(&moo, fmt, ap);
+	if(vasprintf(&moo, fmt, ap) < 0)
+		moo = 0;
 	va_end(ap);
 
+	if(!moo)
+		return;
 
 	uint8 poo[5];
 	uint32 len;
@@ -528,15 +715,19 @@ static void TextToClient(ClientEntry *client, const char *fmt, ...) throw()
 	free(moo);
 }
 
-static void BroadcastText(GameEntry *game, const char *fmt, ...) throw()
+static void BroadcastText(GameEntry *game, const char *fmt, ...)
 {
 	char *moo;
 	va_list ap;
 
 	va_start(ap,fmt);
-	vasprintf(&moo, fmt, ap);
+	if(vasprintf(&moo, fmt, ap) < 0)
+		moo = 0;
 	va_end(ap);
 
+	if(!moo)
+		return;
+
 	SendToAll(game, 0x90,(uint8 *)moo,strlen(moo));
 	free(moo);
 }
@@ -544,8 +735,11 @@ static void BroadcastText(GameEntry *game, const char *fmt, ...) throw()
 static void KillClient(ClientEntry *client)
 {
 	GameEntry *game;
-	uint8 *mps;
-	char *bmsg;
+	WORKER *worker = client->worker;
+	char *bmsg = 0;
+
+	if(client->TCPSocket == -1)
+		return; /* Already gone. */
 
 	game = (GameEntry *)client->game;
 	if(game)
@@ -562,14 +756,16 @@ static void KillClient(ClientEntry *client)
 					game->Players[w] = NULL;
 
 		time_t curtime = time(0);
-		printf("Player <%s> disconnected from game %d on %s",client->nickname,game-Games,ctime(&curtime));
-		asprintf(&bmsg, "* Player %s <%s> left.",MakeMPS(client),client->nickname);
+		printf("Player <%s> disconnected from game %d on %s",client->nickname,game->num,ctime(&curtime));
+		if(asprintf(&bmsg, "* Player %s <%s> left.",MakeMPS(client),client->nickname) < 0)
+			bmsg = 0;
 		if(tc == client->localplayers) /* If total players for this game = total local
 		                                  players for this client, destroy the game.
 		                               */
 		{
-			printf("Game %d destroyed.\n",game-Games);
-			memset(game, 0, sizeof(GameEntry));
+			printf("Game %d destroyed.\n",game->num);
+			worker->games.erase(std::string((char *)game->id, 16));
+			free(game);
 			game = 0;
 		}
 	}
@@ -577,80 +773,75 @@ static void KillClient(ClientEntry *client)
 	{
 		time_t curtime = time(0);
 		printf("Unassigned client %d disconnected on %s",client->id, ctime(&curtime));
+
+		std::vector <ClientEntry *>::iterator it = std::find(worker->clients.begin(), worker->clients.end(), client);
+		if(it != worker->clients.end())
+			worker->clients.erase(it);
 	}
 
+	/* Last chance for error messages to get out. */
+	if(!client->dead)
+		FlushClient(client);
+
 	if(client->nbtcp)
 		free(client->nbtcp);
 
 	if(client->nickname)
 		free(client->nickname);
 
-	if(client->TCPSocket != -1)
-		close(client->TCPSocket);
+	NetBufFree(&client->inbuf);
+	NetBufFree(&client->outbuf);
+
+	EvLoopRemove(worker->loop, client->TCPSocket);
+	close(client->TCPSocket);
 
 	memset(client, 0, sizeof(ClientEntry));
 	client->TCPSocket = -1;
+	client->worker = worker;
+	ClientCount--;
+
+	/* The flush list and the current batch of events may still point here. */
+	worker->zombies.push_back(client);
 
 	if(game)
 		BroadcastText(game,"%s",bmsg);
+	free(bmsg);
 }
 
-static void AddClientToGame(ClientEntry *client, uint8 id[16], uint8 extra[64]) throw()
+static void AddClientToGame(ClientEntry *client, uint8 id[16], uint8 extra[64])
 {
-	int wg;
-	GameEntry *game,*fegame;
-
-retry:
-
-	game = NULL;
-	fegame = NULL;
+	WORKER *w = client->worker;
+	GameEntry *game;
 
 	/* First, find an available game. */
-	for(wg=0; wg<ServerConfig.MaxClients; wg++)
+	std::unordered_map <std::string, GameEntry *>::iterator it = w->games.find(std::string((char *)id, 16));
+
+	if(it != w->games.end()) /* A match was found! */
 	{
-		if(!Games[wg].MaxPlayers && !fegame)
-		{
-			if(!fegame)
-				fegame=&Games[wg];
-		}
-		else if(!memcmp(Games[wg].id,id,16)) /* A match was found! */
-		{
-			game = &Games[wg];
-			break;
-		}
+		game = it->second;
 	}
-
-	if(!game) /* Hmm, no game found.  Guess we'll have to create one. */
+	else /* Hmm, no game found.  Guess we'll have to create one. */
 	{
-		game=fegame;
-		printf("Game %d added\n",game-Games);
+		game = (GameEntry *)malloc(sizeof(GameEntry));
 		memset(game, 0, sizeof(GameEntry));
+		game->num = GameCount++;
+		printf("Game %d added\n",game->num);
 		game->MaxPlayers = 4;
 		memcpy(game->id, id, 16);
 		memcpy(game->ExtraInfo, extra, 64);
+		w->games[std::string((char *)id, 16)] = game;
 	}
 
 	int n;
 	for(n = 0; n < game->MaxPlayers; n++)
 	if(game->Players[n])
 	{
-		try
-		{
-			uint8 b[5];
-			b[4] = 0x81;
-			MakeSendTCP(game->Players[n], b, 5);
-			break;
-		}
-		catch(int i)
-		{
-			KillClient(game->Players[n]);
-			/* All right, now the client we sent the request to is killed.  I HOPE YOU'RE HAPPY! */
-			/* Since killing a client can destroy a game, we'll need to see if the game was trashed.
-			   If it was, then "goto retry", and try again.  Ugly, yes.  I LIKE UGLY.
-			*/
-			if(!game->MaxPlayers)
-				goto retry;
-		}
+		/* Ask a player already in the game for a save state. */
+		uint8 b[5];
+		en32(b, 0);
+		b[4] = 0x81;
+		MakeSendTCP(game->Players[n], b, 5);
+		break;
 	}
 
 	int instancecount = client->localplayers;
@@ -683,7 +874,234 @@ retry:
 	client->game = (void *)game;
 }
 
+/* Moves a client that just logged in from the lobby to its game's worker. */
+static void HandOffClient(ClientEntry *client)
+{
+	WORKER *w = &Workers[de32(client->gameid) % ServerConfig.Workers];
+	std::vector <ClientEntry *>::iterator it;
+
+	EvLoopRemove(Lobby.loop, client->TCPSocket);
+
+	it = std::find(Lobby.clients.begin(), Lobby.clients.end(), client);
+	if(it != Lobby.clients.end())
+		Lobby.clients.erase(it);
+	if(client->queued)
+	{
+		it = std::find(Lobby.flushlist.begin(), Lobby.flushlist.end(), client);
+		if(it != Lobby.flushlist.end())
+			Lobby.flushlist.erase(it);
+		client->queued = 0;
+	}
+
+	client->worker = w;
+	client->events = 0;
+	{
+		std::lock_guard <std::mutex> guard(w->lock);
+		w->incoming.push_back(client);
+	}
+	uint8 b = 0;
+	if(write(w->wakepipe[1], &b, 1) < 0 && errno != EAGAIN)
+		printf("Worker wakeup failed: %s\n", strerror(errno));
+}
+
+static void TakeIncoming(WORKER *w)
+{
+	std::vector <ClientEntry *> incoming;
+	uint8 buf[64];
+	size_t x;
 
+	while(read(w->wakepipe[0], buf, sizeof(buf)) > 0) {};
+
+	{
+		std::lock_guard <std::mutex> guard(w->lock);
+		incoming.swap(w->incoming);
+	}
+
+	for(x=0; x<incoming.size(); x++)
+	{
+		ClientEntry *client = incoming[x];
+
+		client->events = EVLOOP_READ;
+		EvLoopAdd(w->loop, client->TCPSocket, EVLOOP_READ, client);
+		try
+		{
+			JoinGame(client);
+
+			/* Input that came in along with the login. */
+			while(CheckNBTCPReceive(client)) {};
+			MakeSendTCP(client, 0, 0);
+		}
+		catch(int i)
+		{
+			KillClient(client);
+		}
+	}
+}
+
+static void AcceptClients(void)
+{
+	int x;
+
+	for(x=0; x<64; x++)
+	{
+		struct sockaddr_in sockin;
+		socklen_t sockin_len = sizeof(sockin);
+		int s;
+
+		if((s = accept(ListenSocket, (struct sockaddr *)&sockin, &sockin_len)) == -1)
+			break;
+
+		if(ClientCount >= ServerConfig.MaxClients)
+		{
+			printf("Refused connection from %s, server is full.\n",inet_ntoa(sockin.sin_addr));
+			close(s);
+			continue;
+		}
+
+		/* We have a new client.  Yippie. */
+		ClientEntry *client = (ClientEntry *)malloc(sizeof(ClientEntry));
+		memset(client, 0, sizeof(ClientEntry));
+		NetBufInit(&client->inbuf);
+		NetBufInit(&client->outbuf);
+
+		fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+		int tcpopt = 1;
+		setsockopt(s, SOL_TCP, TCP_NODELAY, &tcpopt, sizeof(int));
+
+		client->TCPSocket = s;
+		client->timeconnect = time(0);
+		client->id = NextClientId++;
+		client->worker = &Lobby;
+		client->events = EVLOOP_READ;
+		ClientCount++;
+		printf("Client %d connecting from %s on %s",client->id,inet_ntoa(sockin.sin_addr),ctime(&client->timeconnect));
+
+		if(!EvLoopAdd(Lobby.loop, s, EVLOOP_READ, client))
+		{
+			printf("Error watching client socket: %s\n",strerror(errno));
+			KillClient(client);
+			continue;
+		}
+		Lobby.clients.push_back(client);
+		{
+			uint8 buf[1];
+
+			buf[0] = ServerConfig.FrameDivisor;
+			MakeSendTCP(client,buf,1);
+		}
+		StartNBTCPReceive(client, NBTCP_LOGINLEN, 4);
+	}
+}
+
+static void HandleClientEvent(ClientEntry *client, int events)
+{
+	if(client->TCPSocket == -1) return; /* Killed earlier in this pass. */
+
+	try
+	{
+		if(events & (EVLOOP_READ | EVLOOP_HANGUP))
+		{
+			if(!ReadClient(client))
+				throw(1);
+
+			if(client->worker == &Lobby && client->loggedin)
+			{
+				HandOffClient(client);
+				return;
+			}
+		}
+		if(events & EVLOOP_WRITE)
+			MakeSendTCP(client, 0, 0);
+	}
+	catch(int i)
+	{
+		KillClient(client);
+	}
+}
+
+static void WorkerLoop(WORKER *w)
+{
+	EVLOOP_EVENT events[MAX_EVENTS];
+	int timeout = 0;
+
+	while(1)
+	{
+		int n, x;
+		uint64 wait;
+
+		n = EvLoopWait(w->loop, events, MAX_EVENTS, timeout);
+		for(x=0; x<n; x++)
+		{
+			if(events[x].ptr == &WakeMarker)
+				TakeIncoming(w);
+			else
+				HandleClientEvent((ClientEntry *)events[x].ptr, events[x].events);
+		}
+
+		/* Now we send the data to all the clients. */
+		if(TestThrottle(&w->throttle, &wait))
+		{
+			std::unordered_map <std::string, GameEntry *>::iterator it;
+
+			for(it = w->games.begin(); it != w->games.end(); ++it)
+			{
+				GameEntry *game = it->second;
+
+				for(x = 0; x < game->MaxPlayers; x++)
+				{
+					if(!game->Players[x] || !game->IsUnique[x]) continue;
+					MakeSendTCP(game->Players[x], game->joybuf, 5);
+				}
+			}
+		}
+		FlushClients(w);
+
+		timeout = (wait + 999) / 1000;
+	}
+}
+
+static void LobbyLoop(void)
+{
+	EVLOOP_EVENT events[MAX_EVENTS];
+
+	while(1)
+	{
+		int n, x;
+
+		n = EvLoopWait(Lobby.loop, events, MAX_EVENTS, 1000);
+		for(x=0; x<n; x++)
+		{
+			if(events[x].ptr == &ListenMarker)
+				AcceptClients();
+			else
+				HandleClientEvent((ClientEntry *)events[x].ptr, events[x].events);
+		}
+
+		/* Check for users still in the login process(not yet assigned a game). BOING */
+		time_t curtime = time(0);
+		for(x = Lobby.clients.size() - 1; x >= 0; x--)
+		{
+			if((Lobby.clients[x]->timeconnect + ServerConfig.ConnectTimeout) < curtime)
+				KillClient(Lobby.clients[x]);
+		}
+		FlushClients(&Lobby);
+	}
+}
+
+static int InitWorker(WORKER *w)
+{
+	if(!(w->loop = EvLoopCreate()))
+		return(0);
+
+	InitThrottle(&w->throttle, ServerConfig.FrameDivisor);
+
+	if(pipe(w->wakepipe))
+		return(0);
+	fcntl(w->wakepipe[0], F_SETFL, fcntl(w->wakepipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(w->wakepipe[1], F_SETFL, fcntl(w->wakepipe[1], F_GETFL) | O_NONBLOCK);
+
+	return(EvLoopAdd(w->loop, w->wakepipe[0], EVLOOP_READ, &WakeMarker));
+}
 
 
 int main(int argc, char *argv[])
@@ -699,6 +1117,7 @@ int main(int argc, char *argv[])
 		ServerConfig.MaxClients = DEFAULT_MAX;
 		ServerConfig.ConnectTimeout = DEFAULT_TIMEOUT;
 		ServerConfig.FrameDivisor = DEFAULT_FRAMEDIVISOR;
+		ServerConfig.Workers = DEFAULT_WORKERS;
 	}
 	char* configfile = 0;
 
@@ -717,6 +1136,7 @@ int main(int argc, char *argv[])
 			printf("-m\t--maxclients\tSpecifies the maximum amount of clients allowed \n\t\t\tto access the server. (default=%d)\n", DEFAULT_MAX);
 			printf("-t\t--timeout\tSpecifies the amount of seconds before the server \n\t\t\ttimes out. (default=%d)\n", DEFAULT_TIMEOUT);
 			printf("-f\t--framedivisor\tSpecifies frame divisor.\n\t\t\t(eg: 60 / framedivisor = updates per second)(default=%d)\n", DEFAULT_FRAMEDIVISOR);
+			printf("-j\t--workers\tSpecifies the number of threads games are spread \n\t\t\tover. (default=%d)\n", DEFAULT_WORKERS);
 			printf("-c\t--configfile\tLoads the given configuration file.\n");
 			return -1;
 		}
@@ -781,6 +1201,17 @@ int main(int argc, char *argv[])
 			ServerConfig.FrameDivisor = atoi(argv[i]);
 			continue;
 		}
+		if(!strcmp(argv[i], "--workers") || !strcmp(argv[i], "-j"))
+		{
+			i++;
+			if(argc == i)
+			{
+				printf("Please specify the number of worker threads.\n");
+				return -1;
+			}
+			ServerConfig.Workers = atoi(argv[i]);
+			continue;
+		}
 		if(!strcmp(argv[i], "--configfile") || !strcmp(argv[i], "-c"))
 		{
 			i++;
@@ -807,22 +1238,20 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	Games = (GameEntry *)malloc(sizeof(GameEntry) * ServerConfig.MaxClients);
-	Clients = (ClientEntry *)malloc(sizeof(ClientEntry) * ServerConfig.MaxClients);
-
-	memset(Games,0,sizeof(GameEntry) * ServerConfig.MaxClients);
-	memset(Clients,0,sizeof(ClientEntry) * ServerConfig.MaxClients);
+	if(ServerConfig.Workers < 1)
+		ServerConfig.Workers = 1;
+	if(ServerConfig.Workers > MAX_WORKERS)
+		ServerConfig.Workers = MAX_WORKERS;
 
-	{
-		int x;
-		for(x=0; x<ServerConfig.MaxClients; x++)
-			Clients[x].TCPSocket = -1;
-	}
-	RefreshThrottleFPS(ServerConfig.FrameDivisor);
+	/* Dead connections are noticed through send() errors. */
+	signal(SIGPIPE, SIG_IGN);
 
 	/* First, we need to create a socket to listen on. */
 	ListenSocket = socket(AF_INET, SOCK_STREAM, 0);
 
+	int reuseaddr = 1;
+	setsockopt(ListenSocket, SOL_SOCKET, SO_REUSEADDR, &reuseaddr, sizeof(int));
+
 	/* Set send buffer size to 262,144 bytes. */
 	int sndbufsize = 262144;
 	if(setsockopt(ListenSocket, SOL_SOCKET, SO_SNDBUF, &sndbufsize, sizeof(int)))
@@ -849,7 +1278,7 @@ int main(int argc, char *argv[])
 	}
 	puts("Ok");
 	printf("Listening on socket... ");
-	if(listen(ListenSocket, 8))
+	if(listen(ListenSocket, SOMAXCONN))
 	{
 		printf("Error: %s",strerror(errno));
 		exit(-1);
@@ -859,89 +1288,24 @@ int main(int argc, char *argv[])
 	/* We don't want to block on accept() */
 	fcntl(ListenSocket, F_SETFL, fcntl(ListenSocket, F_GETFL) | O_NONBLOCK);
 
-	/* Now for the BIG LOOP. */
-	while(1)
+	if(!(Lobby.loop = EvLoopCreate()) || !EvLoopAdd(Lobby.loop, ListenSocket, EVLOOP_READ, &ListenMarker))
 	{
-		int n;
-
-		for(n=0; n<ServerConfig.MaxClients; n++)
-		{
-			if(Clients[n].TCPSocket != -1) continue;
-			if((Clients[n].TCPSocket = accept(ListenSocket, (struct sockaddr *)&sockin, &sockin_len)) != -1)
-			{
-				struct sockaddr_in usockin;
-				/* We have a new client.  Yippie. */
-
-				fcntl(Clients[n].TCPSocket, F_SETFL, fcntl(Clients[n].TCPSocket, F_GETFL) | O_NONBLOCK);
-
-				Clients[n].timeconnect = time(0);
-				Clients[n].id = n;
-				printf("Client %d connecting from %s on %s",n,inet_ntoa(sockin.sin_addr),ctime(&Clients[n].timeconnect));
-				{
-					uint8 buf[1];
-
-					buf[0] = ServerConfig.FrameDivisor;
-					send(Clients[n].TCPSocket,buf,1,MSG_NOSIGNAL);
-				}
-				StartNBTCPReceive(&Clients[n], NBTCP_LOGINLEN, 4);
-			}
-		}
+		printf("Error setting up the event loop: %s\n",strerror(errno));
+		exit(-1);
+	}
 
-		/* Check for users still in the login process(not yet assigned a game). BOING */
-		time_t curtime = time(0);
-		for(n = 0; n < ServerConfig.MaxClients; n++)
-		try
-		{
-			if(Clients[n].TCPSocket != -1 && !Clients[n].game)
-			{
-				if((Clients[n].timeconnect + ServerConfig.ConnectTimeout) < curtime)
-				{
-					KillClient(&Clients[n]);
-				}
-				else
-					while(CheckNBTCPReceive(&Clients[n])) {};
-			}
-		}
-		catch(int i)
+	Workers = new WORKER[ServerConfig.Workers];
+	for(unsigned int w=0; w<ServerConfig.Workers; w++)
+	{
+		if(!InitWorker(&Workers[w]))
 		{
-			KillClient(&Clients[n]);
+			printf("Error setting up worker %u: %s\n",w,strerror(errno));
+			exit(-1);
 		}
+		std::thread(WorkerLoop, &Workers[w]).detach();
+	}
+	printf("Running %u worker thread(s).\n",ServerConfig.Workers);
 
-		int whichgame;
-		for(whichgame = 0; whichgame < ServerConfig.MaxClients; whichgame ++)
-		{
-			/* Now, the loop to get data from each client.  Meep. */
-			for(n = 0; n < Games[whichgame].MaxPlayers; n++)
-			{
-				try
-				{
-					ClientEntry *client = Games[whichgame].Players[n];
-					if(!client || !Games[whichgame].IsUnique[n]) continue;
-					int localplayers = client->localplayers;
-
-					while(CheckNBTCPReceive(client)) {};
-				} // catch
-				catch(int i)
-				{
-					KillClient(Games[whichgame].Players[n]);
-				}
-			} // A games clients
-
-			/* Now we send the data to all the clients. */
-			for(n = 0; n < Games[whichgame].MaxPlayers; n++)
-			{
-				if(!Games[whichgame].Players[n] || !Games[whichgame].IsUnique[n]) continue;
-				try
-				{
-					MakeSendTCP(Games[whichgame].Players[n], Games[whichgame].joybuf, 5);
-				}
-				catch(int i)
-				{
-					KillClient(Games[whichgame].Players[n]);
-				}
-			} // A game's clients
-		} // Games
-
-		SpeedThrottle();
-	} // while(1)
+	/* Now for the BIG LOOP. */
+	LobbyLoop();
 }
@@ -25,34 +25,6 @@
 #include "types.h"
 #include "throttle.h"
 
-#ifdef TODO
-THROTTLE *MakeThrottle(uint32 fps)
-{
-
-
-}
-
-/* Returns 1 if it's time to run, 0 if it's not time yet. */
-int TestThrottle(THROTTLE *throt)
-{
-
-}
-
-/* Pass it a pointer to an array of THROTTLE structs */
-/* It will check  */
-void DoAllThrottles(THROTTLE *throt)
-{
-
-
-}
-
-void KillThrottle(THROTTLE *throt)
-{
-
-}
-
-#endif
-
 static uint64 tfreq;
 static uint64 desiredfps;
 
@@ -100,3 +72,33 @@ void SpeedThrottle(void)
   ltime+=tfreq/desiredfps;
 }
 
+void InitThrottle(THROTTLE *throt, int divooder)
+{
+ uint64 fps = (FCEUI_GetDesiredFPS() / divooder)>>8;
+
+ throt->period = ((uint64)1000000<<16) / fps;
+ throt->ltime = GetCurTime();
+}
+
+int TestThrottle(THROTTLE *throt, uint64 *wait)
+{
+ uint64 ttime = GetCurTime();
+ uint64 period = throt->period;
+ uint64 due = throt->ltime + period;
+
+ if(ttime < due)
+ {
+  *wait = due - ttime;
+  return(0);
+ }
+ /* More than a few frames late, don't try to catch up. */
+ if( (ttime - throt->ltime) >= period*4 )
+  throt->ltime = ttime;
+ else
+  throt->ltime = due;
+
+ due = throt->ltime + period;
+ *wait = (due > ttime) ? due - ttime : 0;
+ return(1);
+}
+
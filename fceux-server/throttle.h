@@ -19,5 +19,19 @@
  * */
 
 
+typedef struct
+{
+	uint64 ltime;      /* When the last frame was due. */
+	uint64 period;     /* Frame period, in microseconds. */
+} THROTTLE;
+
 void RefreshThrottleFPS(int divooder);
 void SpeedThrottle(void);
+
+/* Non-blocking variant of the above, for use with an event loop.  Each
+   THROTTLE keeps its own timing, so every thread can have one. */
+void InitThrottle(THROTTLE *throt, int divooder);
+
+/* Returns 1 if it's time to run, 0 if it's not time yet.  *wait is set
+   to the number of microseconds until the next frame is due either way. */
+int TestThrottle(THROTTLE *throt, uint64 *wait);
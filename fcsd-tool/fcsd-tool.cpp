@@ -0,0 +1,238 @@
+/* FCE Ultra - Indexed savestate tool
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "fcsd.h"
+
+static void usage(const char *prog)
+{
+	printf("Usage:\n");
+	printf("  %s list <state>                           List chunks and fields\n", prog);
+	printf("  %s get <state> <chunk> <tag> [out]        Dump a field (hex to stdout, or raw to file)\n", prog);
+	printf("  %s convert <in.fcs> <out> [level]         Convert an FCSX savestate to FCSD\n", prog);
+	printf("\n<chunk> is a chunk number or name (CPU, CPUC, PPU, NEWPPU, CTRL, SND, MOVSTATE, EXTRA)\n");
+}
+
+static bool loadFile(const char *fname, std::vector<uint8_t> &buf)
+{
+	FILE *fp = fopen(fname, "rb");
+
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Error: Could not open %s\n", fname);
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	buf.resize(size > 0 ? size : 0);
+
+	bool ok = (size > 0) && (fread(&buf[0], 1, size, fp) == (size_t)size);
+
+	fclose(fp);
+
+	if (!ok)
+	{
+		fprintf(stderr, "Error: Could not read %s\n", fname);
+	}
+	return ok;
+}
+
+static bool saveFile(const char *fname, const uint8_t *data, size_t size)
+{
+	FILE *fp = fopen(fname, "wb");
+
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Error: Could not create %s\n", fname);
+		return false;
+	}
+	bool ok = fwrite(data, 1, size, fp) == size;
+
+	fclose(fp);
+
+	return ok;
+}
+
+static int parseChunkType(const char *s)
+{
+	char *end;
+	long v = strtol(s, &end, 0);
+
+	if ((end != s) && (*end == 0))
+	{
+		return (int)v;
+	}
+	for (int i=0; i<256; i++)
+	{
+		const char *name = FCSD_ChunkName(i);
+
+		if (name && (strcasecmp(name, s) == 0))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static std::string tagString(const char tag[4])
+{
+	std::string s;
+
+	for (int i=0; (i<4) && tag[i]; i++)
+	{
+		s.push_back( ((tag[i] >= 0x20) && (tag[i] < 0x7f)) ? tag[i] : '?' );
+	}
+	return s;
+}
+
+static bool openState(const char *fname, std::vector<uint8_t> &buf, FCSD_Reader &reader)
+{
+	if (!loadFile(fname, buf))
+	{
+		return false;
+	}
+	if (!reader.open(&buf[0], buf.size()))
+	{
+		fprintf(stderr, "Error: %s is not an indexed (FCSD) savestate\n", fname);
+		return false;
+	}
+	return true;
+}
+
+static int doList(const char *fname)
+{
+	std::vector<uint8_t> buf;
+	FCSD_Reader reader;
+
+	if (!openState(fname, buf, reader))
+	{
+		return 1;
+	}
+	printf("%s: emulator version %u, %u bytes uncompressed, %zu chunks, %zu fields\n",
+		fname, reader.emuVersion(), reader.totalSize(), reader.numChunks(), reader.numFields());
+
+	for (size_t i=0; i<reader.numChunks(); i++)
+	{
+		const FCSD_Chunk &c = reader.chunk(i);
+		const char *name = FCSD_ChunkName(c.type);
+
+		printf("chunk %3u %-9s raw:%8u stored:%8u%s\n", c.type, name ? name : "?",
+				c.rawSize, c.storedSize, (c.flags & FCSD_CHUNK_COMPRESSED) ? " (deflated)" : "");
+
+		for (uint32_t j=c.firstField; j<c.firstField+c.numFields; j++)
+		{
+			const FCSD_Field &f = reader.field(j);
+
+			printf("    %-4s  offset:%8u  size:%8u\n", tagString(f.tag).c_str(), f.offset, f.size);
+		}
+	}
+	return 0;
+}
+
+static int doGet(const char *fname, const char *chunkName, const char *tag, const char *outName)
+{
+	std::vector<uint8_t> buf, data;
+	FCSD_Reader reader;
+
+	if (!openState(fname, buf, reader))
+	{
+		return 1;
+	}
+	int type = parseChunkType(chunkName);
+
+	if (type < 0)
+	{
+		fprintf(stderr, "Error: Unknown chunk %s\n", chunkName);
+		return 1;
+	}
+	int idx = reader.findField(type, tag);
+
+	if (idx < 0)
+	{
+		fprintf(stderr, "Error: Field %s not found in chunk %s\n", tag, chunkName);
+		return 1;
+	}
+	if (!reader.readField(idx, data))
+	{
+		fprintf(stderr, "Error: Could not read field %s\n", tag);
+		return 1;
+	}
+
+	if (outName)
+	{
+		return saveFile(outName, data.size() ? &data[0] : NULL, data.size()) ? 0 : 1;
+	}
+
+	for (size_t i=0; i<data.size(); i++)
+	{
+		printf("%02X%c", data[i], ((i % 16) == 15) ? '\n' : ' ');
+	}
+	if (data.size() % 16)
+	{
+		printf("\n");
+	}
+	return 0;
+}
+
+static int doConvert(const char *inName, const char *outName, int level)
+{
+	std::vector<uint8_t> buf, out;
+
+	if (!loadFile(inName, buf))
+	{
+		return 1;
+	}
+	if (!FCSD_BuildFromFCSX(&buf[0], buf.size(), level, out))
+	{
+		fprintf(stderr, "Error: %s is not a valid FCSX savestate\n", inName);
+		return 1;
+	}
+	return saveFile(outName, &out[0], out.size()) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "list"))
+	{
+		return doList(argv[2]);
+	}
+	else if (!strcmp(argv[1], "get") && (argc >= 5))
+	{
+		return doGet(argv[2], argv[3], argv[4], (argc >= 6) ? argv[5] : NULL);
+	}
+	else if (!strcmp(argv[1], "convert") && (argc >= 4))
+	{
+		return doConvert(argv[2], argv[3], (argc >= 5) ? atoi(argv[4]) : -1);
+	}
+	usage(argv[0]);
+
+	return 1;
+}
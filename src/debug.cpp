@@ -1047,6 +1047,17 @@ void* FCEUI_TraceInstructionRegister( void (*func)(uint8*,int) )
 	return cb;
 }
 
+void FCEUI_TraceInstructionUnregisterAll(void)
+{
+	while (traceInstructionCB != nullptr)
+	{
+		TraceInstructionCallback* cb = traceInstructionCB;
+
+		traceInstructionCB = cb->next;
+		delete cb;
+	}
+}
+
 bool FCEUI_TraceInstructionUnregisterHandle( void* handle )
 {
 	TraceInstructionCallback* cb, *cb_prev, *cb_handle;
@@ -177,5 +177,6 @@ unsigned int NewBreak(const char* name, int start, int end, unsigned int type, c
 
 void* FCEUI_TraceInstructionRegister( void (*func)(uint8*,int) );
 bool FCEUI_TraceInstructionUnregisterHandle( void* handle );
+void FCEUI_TraceInstructionUnregisterAll(void);
 
 #endif
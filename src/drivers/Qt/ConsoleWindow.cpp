@@ -920,6 +920,8 @@ void consoleWin_t::initHotKeys(void)
 
 	connect( Hotkeys[ HK_LOAD_PREV_STATE      ].getShortcut(), SIGNAL(activated()), this, SLOT(loadPrevState(void))     );
 	connect( Hotkeys[ HK_LOAD_NEXT_STATE      ].getShortcut(), SIGNAL(activated()), this, SLOT(loadNextState(void))     );
+	connect( Hotkeys[ HK_LOAD_PREV_FRAME      ].getShortcut(), SIGNAL(activated()), this, SLOT(loadPrevFrame(void))     );
+	connect( Hotkeys[ HK_LOAD_NEXT_FRAME      ].getShortcut(), SIGNAL(activated()), this, SLOT(loadNextFrame(void))     );
 }
 //---------------------------------------------------------------------------
 void consoleWin_t::createMainMenu(void)
@@ -2950,6 +2952,21 @@ void consoleWin_t::loadNextState(void)
 	FCEU_WRAPPER_UNLOCK();
 }
 
+void consoleWin_t::loadPrevFrame(void)
+{
+	FCEU_WRAPPER_LOCK();
+	FCEU_StateRecorderLoadFrame( FCEUMOV_GetFrame() - 1 );
+	FCEU_WRAPPER_UNLOCK();
+}
+
+void consoleWin_t::loadNextFrame(void)
+{
+	FCEU_WRAPPER_LOCK();
+	// Only forward along the recorded input, never back to a snapshot
+	FCEU_StateRecorderLoadFrame( FCEUMOV_GetFrame() + 1, true );
+	FCEU_WRAPPER_UNLOCK();
+}
+
 void consoleWin_t::quickSave(void)
 {
 	FCEU_WRAPPER_LOCK();
@@ -466,6 +466,8 @@ class  consoleWin_t : public QMainWindow
 		void loadState9(void);
 		void loadPrevState(void);
 		void loadNextState(void);
+		void loadPrevFrame(void);
+		void loadNextFrame(void);
 		void mainMenuOpen(void);
 		void mainMenuClose(void);
 		void warnAmbiguousShortcut( QShortcut*);
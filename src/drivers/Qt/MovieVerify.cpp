@@ -0,0 +1,661 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+// MovieVerify.cpp
+//
+// Batch verification of movies against new builds:
+//
+//   fceux --verify-movies manifest.txt [--verify-jobs N] [--verify-report report.json]
+//
+// Every manifest entry is played back by its own headless worker process
+// (fceux --verify-worker manifest.txt index) at unthrottled speed, with as many
+// workers running at once as there are cores. A worker prints a single result line,
+// the runner collects them into a JSON report and exits with 0 only if every entry passed.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QThread>
+
+#include "Qt/config.h"
+#include "Qt/fceuWrapper.h"
+#include "Qt/MovieVerify.h"
+
+#include "../../fceu.h"
+#include "../../cheat.h"
+#include "../../driver.h"
+#include "../../movie.h"
+#include "../../state.h"
+#include "../../version.h"
+#include "../../utils/md5.h"
+
+// prefix of the line a worker reports its result with, everything else it prints is just log
+#define VERIFY_RESULT_TAG  "@verify-result "
+
+//-----------------------------------------------------------------------------
+static std::string jsonString( const std::string &s )
+{
+	std::string out("\"");
+
+	for (size_t i=0; i<s.size(); i++)
+	{
+		unsigned char c = s[i];
+
+		switch (c)
+		{
+			case '"':  out.append("\\\""); break;
+			case '\\': out.append("\\\\"); break;
+			case '\n': out.append("\\n"); break;
+			case '\r': out.append("\\r"); break;
+			case '\t': out.append("\\t"); break;
+			default:
+				if ( c < 0x20 )
+				{
+					char esc[8];
+					snprintf( esc, sizeof(esc), "\\u%04x", c );
+					out.append(esc);
+				}
+				else
+				{
+					out.push_back(c);
+				}
+			break;
+		}
+	}
+	out.push_back('"');
+
+	return out;
+}
+//-----------------------------------------------------------------------------
+static void splitFields( const std::string &line, std::vector <std::string> &fields )
+{
+	size_t start = 0;
+
+	fields.clear();
+
+	while ( start <= line.size() )
+	{
+		size_t end = line.find('\t', start);
+
+		if ( end == std::string::npos )
+		{
+			end = line.size();
+		}
+		std::string field = line.substr( start, end - start );
+
+		// trim the spaces around the field, paths with spaces inside are fine
+		size_t first = field.find_first_not_of(" \r\n");
+		size_t last  = field.find_last_not_of(" \r\n");
+
+		if ( first != std::string::npos )
+		{
+			fields.push_back( field.substr( first, last - first + 1 ) );
+		}
+		start = end + 1;
+	}
+}
+//-----------------------------------------------------------------------------
+bool movieVerifyLoadManifest( const char *path, std::vector <MovieVerifyEntry> &entries, std::string &errorMsg )
+{
+	FILE *fp;
+	char line[4096];
+	int lineNum = 0;
+	std::vector <std::string> fields;
+
+	entries.clear();
+
+	fp = ::fopen( path, "r" );
+
+	if ( fp == NULL )
+	{
+		errorMsg = std::string("Could not open manifest: ") + path;
+		return false;
+	}
+
+	while ( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		lineNum++;
+
+		if ( line[0] == '#' )
+		{
+			continue;
+		}
+		splitFields( line, fields );
+
+		if ( fields.empty() )
+		{
+			continue;
+		}
+		if ( fields.size() < 2 )
+		{
+			errorMsg = std::string("Manifest line ") + std::to_string(lineNum) + ": expected a ROM and a movie";
+			fclose(fp);
+			return false;
+		}
+		MovieVerifyEntry entry;
+
+		entry.romPath   = fields[0];
+		entry.moviePath = fields[1];
+
+		for (size_t i=2; i<fields.size(); i++)
+		{
+			const std::string &f = fields[i];
+			size_t colon = f.find(':');
+
+			if ( f.compare( 0, 9, "baseline=" ) == 0 )
+			{
+				entry.baselinePath = f.substr(9);
+			}
+			else if ( colon != std::string::npos )
+			{
+				MovieVerifyCheckpoint cp;
+
+				cp.frame  = atoi( f.substr(0, colon).c_str() );
+				cp.ramMd5 = f.substr(colon+1);
+				entry.checkpoints.push_back(cp);
+			}
+			else if ( (i == 2) && (f != "-") )
+			{
+				entry.finalRamMd5 = f;
+			}
+			else if ( i != 2 )
+			{
+				errorMsg = std::string("Manifest line ") + std::to_string(lineNum) + ": unknown field '" + f + "'";
+				fclose(fp);
+				return false;
+			}
+		}
+		std::sort( entry.checkpoints.begin(), entry.checkpoints.end(),
+				[]( const MovieVerifyCheckpoint &a, const MovieVerifyCheckpoint &b ){ return a.frame < b.frame; } );
+
+		entries.push_back(entry);
+	}
+	fclose(fp);
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool movieVerifyRequested( int argc, char *argv[] )
+{
+	for (int i=1; i<argc; i++)
+	{
+		if ( (strcmp(argv[i], "--verify-movies") == 0) || (strcmp(argv[i], "--verify-worker") == 0) )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+//-----------------------------------------------------------------------------
+//--- Worker
+//-----------------------------------------------------------------------------
+static std::string md5String( uint8 digest[16] )
+{
+	MD5DATA md5;
+
+	memcpy( md5.data, digest, 16 );
+
+	return md5_asciistr(md5);
+}
+//-----------------------------------------------------------------------------
+static std::string ramMd5(void)
+{
+	md5_context ctx;
+	uint8 digest[16];
+
+	md5_starts(&ctx);
+	md5_update(&ctx, RAM, 0x800);
+	md5_finish(&ctx, digest);
+
+	return md5String(digest);
+}
+//-----------------------------------------------------------------------------
+// baseline files hold one "frame md5" line for every frame, as written by a previous run
+static bool loadBaseline( const std::string &path, std::vector <std::string> &hashes )
+{
+	FILE *fp;
+	char line[256];
+
+	hashes.clear();
+
+	fp = ::fopen( path.c_str(), "r" );
+
+	if ( fp == NULL )
+	{
+		return false;
+	}
+	while ( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		int frame;
+		char hash[64];
+
+		if ( line[0] == '#' )
+		{
+			continue;
+		}
+		if ( (sscanf( line, "%i %63s", &frame, hash ) != 2) || (frame < 0) )
+		{
+			continue;
+		}
+		if ( static_cast<size_t>(frame) >= hashes.size() )
+		{
+			hashes.resize( frame+1 );
+		}
+		hashes[frame] = hash;
+	}
+	fclose(fp);
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+static int workerReport( int index, const MovieVerifyEntry *entry, const char *status, const std::string &fields )
+{
+	std::string line;
+
+	line.append("{\"index\": ");
+	line.append( std::to_string(index) );
+	line.append(", \"status\": ");
+	line.append( jsonString(status) );
+
+	if ( entry )
+	{
+		line.append(", \"rom\": ");
+		line.append( jsonString(entry->romPath) );
+		line.append(", \"movie\": ");
+		line.append( jsonString(entry->moviePath) );
+	}
+	line.append(fields);
+	line.append("}");
+
+	fflush(stdout);
+	printf( "\n%s%s %s\n", VERIFY_RESULT_TAG, status, line.c_str() );
+	fflush(stdout);
+
+	return strcmp( status, "pass" ) == 0 ? 0 : 1;
+}
+//-----------------------------------------------------------------------------
+static int workerError( int index, const MovieVerifyEntry *entry, const std::string &msg )
+{
+	return workerReport( index, entry, "error", ", \"error\": " + jsonString(msg) );
+}
+//-----------------------------------------------------------------------------
+static int runWorker( const char *manifest, int index )
+{
+	std::vector <MovieVerifyEntry> entries;
+	std::vector <std::string> baseline;
+	std::string errorMsg;
+	FILE *baselineOut = NULL;
+	std::string baselineTmpPath;
+	bool compareBaseline = false;
+	uint8 digest[16];
+
+	if ( !movieVerifyLoadManifest( manifest, entries, errorMsg ) )
+	{
+		return workerError( index, NULL, errorMsg );
+	}
+	if ( (index < 0) || (static_cast<size_t>(index) >= entries.size()) )
+	{
+		return workerError( index, NULL, "Manifest entry does not exist" );
+	}
+	const MovieVerifyEntry &entry = entries[index];
+
+	// Only the defaults are used, so that the results don't depend on the
+	// settings of the machine: no config file, no cheats, no pause at the end.
+	g_config = InitConfig();
+
+	if ( g_config == NULL )
+	{
+		return workerError( index, &entry, "Could not initialize configuration system" );
+	}
+	if ( FCEUI_Initialize() != 1 )
+	{
+		return workerError( index, &entry, "Could not initialize the emulator" );
+	}
+	disableAutoLSCheats = 2;
+	pauseAfterPlayback  = false;
+
+	if ( FCEUI_LoadGame( entry.romPath.c_str(), 1, true ) == NULL )
+	{
+		return workerError( index, &entry, "Could not load ROM" );
+	}
+	if ( !FCEUI_LoadMovie( entry.moviePath.c_str(), true, 0 ) || !FCEUMOV_Mode(MOVIEMODE_PLAY) )
+	{
+		return workerError( index, &entry, "Could not load movie" );
+	}
+
+	if ( !entry.baselinePath.empty() )
+	{
+		compareBaseline = loadBaseline( entry.baselinePath, baseline );
+
+		if ( !compareBaseline )
+		{
+			// written next to it and renamed once the movie has played to the end,
+			// so that a run that stalls or is killed leaves no partial baseline behind
+			baselineTmpPath = entry.baselinePath + ".tmp";
+			baselineOut = ::fopen( baselineTmpPath.c_str(), "w" );
+
+			if ( baselineOut == NULL )
+			{
+				return workerError( index, &entry, "Could not create baseline: " + entry.baselinePath );
+			}
+			fprintf( baselineOut, "# %s\n", entry.moviePath.c_str() );
+		}
+	}
+	const int totalFrames = static_cast<int>(currMovieData.records.size());
+	size_t nextCheckpoint = 0;
+	int firstDivergentFrame = -1;
+	std::string failedCheckpoints;
+	uint8 *gfx = NULL;
+	int32 *sound = NULL;
+	int32 soundSize = 0;
+	QElapsedTimer timer;
+
+	timer.start();
+
+	// frame N is the state once N frames of the movie have been emulated
+	for (;;)
+	{
+		const int frame = currFrameCounter;
+
+		while ( (nextCheckpoint < entry.checkpoints.size()) && (entry.checkpoints[nextCheckpoint].frame <= frame) )
+		{
+			const MovieVerifyCheckpoint &cp = entry.checkpoints[nextCheckpoint++];
+
+			if ( (cp.frame < frame) || (cp.ramMd5 != ramMd5()) )
+			{
+				failedCheckpoints.append( failedCheckpoints.empty() ? "" : ", " );
+				failedCheckpoints.append( std::to_string(cp.frame) );
+			}
+		}
+		if ( baselineOut || (compareBaseline && (firstDivergentFrame < 0)) )
+		{
+			FCEUSS_HashState(digest);
+
+			std::string hash = md5String(digest);
+
+			if ( baselineOut )
+			{
+				fprintf( baselineOut, "%i %s\n", frame, hash.c_str() );
+			}
+			else if ( (static_cast<size_t>(frame) >= baseline.size()) || (baseline[frame] != hash) )
+			{
+				firstDivergentFrame = frame;
+			}
+		}
+		if ( (currFrameCounter >= totalFrames) || !FCEUMOV_Mode(MOVIEMODE_PLAY) )
+		{
+			break;
+		}
+		if ( FCEUI_EmulationPaused() )
+		{
+			FCEUI_ToggleEmulationPause();
+		}
+		FCEUI_Emulate( &gfx, &sound, &soundSize, 1 );
+
+		if ( currFrameCounter != frame + 1 )
+		{
+			if ( baselineOut )
+			{
+				fclose( baselineOut );
+				::remove( baselineTmpPath.c_str() );
+			}
+			return workerError( index, &entry, "Movie playback stalled at frame " + std::to_string(frame) );
+		}
+	}
+	double seconds = timer.nsecsElapsed() / 1e9;
+
+	// a baseline of a longer movie diverges right after this one ends
+	if ( compareBaseline && (firstDivergentFrame < 0) && (baseline.size() > static_cast<size_t>(totalFrames) + 1) )
+	{
+		firstDivergentFrame = totalFrames + 1;
+	}
+	// checkpoints past the end of the movie were never reached
+	while ( nextCheckpoint < entry.checkpoints.size() )
+	{
+		failedCheckpoints.append( failedCheckpoints.empty() ? "" : ", " );
+		failedCheckpoints.append( std::to_string( entry.checkpoints[nextCheckpoint++].frame ) );
+	}
+	if ( baselineOut )
+	{
+		bool written = fclose( baselineOut ) == 0;
+
+		::remove( entry.baselinePath.c_str() );
+
+		if ( !written || (::rename( baselineTmpPath.c_str(), entry.baselinePath.c_str() ) != 0) )
+		{
+			::remove( baselineTmpPath.c_str() );
+			return workerError( index, &entry, "Could not write baseline: " + entry.baselinePath );
+		}
+	}
+	std::string finalRam = ramMd5();
+
+	FCEUSS_HashState(digest);
+
+	std::string finalState = md5String(digest);
+
+	bool pass = failedCheckpoints.empty() && (firstDivergentFrame < 0) &&
+			(entry.finalRamMd5.empty() || (entry.finalRamMd5 == finalRam));
+
+	char num[64];
+	std::string fields;
+
+	fields.append(", \"frames\": ");
+	fields.append( std::to_string(totalFrames) );
+	snprintf( num, sizeof(num), ", \"seconds\": %.3f, \"fps\": %.1f", seconds, seconds > 0 ? totalFrames / seconds : 0.0 );
+	fields.append(num);
+	fields.append(", \"final_ram_md5\": ");
+	fields.append( jsonString(finalRam) );
+	fields.append(", \"final_state_md5\": ");
+	fields.append( jsonString(finalState) );
+	if ( !entry.finalRamMd5.empty() )
+	{
+		fields.append(", \"expected_ram_md5\": ");
+		fields.append( jsonString(entry.finalRamMd5) );
+	}
+	fields.append(", \"failed_checkpoints\": [");
+	fields.append(failedCheckpoints);
+	fields.append("]");
+	fields.append(", \"baseline\": ");
+	fields.append( jsonString( baselineOut ? "written" : compareBaseline ? "compared" : "none" ) );
+	fields.append(", \"first_divergent_frame\": ");
+	fields.append( std::to_string(firstDivergentFrame) );
+
+	return workerReport( index, &entry, pass ? "pass" : "fail", fields );
+}
+//-----------------------------------------------------------------------------
+//--- Runner
+//-----------------------------------------------------------------------------
+static int runBatch( int argc, char *argv[], const char *manifest, int jobs, const char *reportPath )
+{
+	std::vector <MovieVerifyEntry> entries;
+	std::string errorMsg;
+
+	if ( !movieVerifyLoadManifest( manifest, entries, errorMsg ) )
+	{
+		fprintf( stderr, "Error: %s\n", errorMsg.c_str() );
+		return 1;
+	}
+	QCoreApplication app(argc, argv);
+
+	if ( jobs <= 0 )
+	{
+		jobs = QThread::idealThreadCount();
+	}
+	jobs = std::max( 1, std::min( jobs, static_cast<int>(entries.size()) ) );
+
+	const QString exe = QCoreApplication::applicationFilePath();
+	std::vector <std::string> results( entries.size() );
+	size_t next = 0, done = 0;
+	int running = 0, passed = 0;
+	QElapsedTimer timer;
+
+	timer.start();
+
+	std::function<void(void)> startNext = [&](void)
+	{
+		while ( (running < jobs) && (next < entries.size()) )
+		{
+			size_t index = next++;
+			QProcess *proc = new QProcess();
+
+			proc->setProcessChannelMode( QProcess::ForwardedErrorChannel );
+
+			QObject::connect( proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+					[&, proc, index](int exitCode, QProcess::ExitStatus exitStatus)
+			{
+				QByteArray output = proc->readAllStandardOutput();
+				int tag = output.lastIndexOf( VERIFY_RESULT_TAG );
+				bool entryPassed = false;
+
+				(void)exitCode;
+
+				if ( tag >= 0 )
+				{
+					QByteArray line = output.mid( tag + strlen(VERIFY_RESULT_TAG) );
+					int end = line.indexOf('\n');
+
+					if ( end >= 0 )
+					{
+						line.truncate(end);
+					}
+					int space = line.indexOf(' ');
+
+					entryPassed = line.left(space) == "pass";
+					results[index] = line.mid(space+1).trimmed().constData();
+				}
+				else
+				{
+					const char *why = (exitStatus == QProcess::CrashExit) ? "Worker crashed" : "Worker gave no result";
+
+					// the baseline it was writing never got renamed into place
+					if ( !entries[index].baselinePath.empty() )
+					{
+						::remove( (entries[index].baselinePath + ".tmp").c_str() );
+					}
+
+					results[index] = "{\"index\": " + std::to_string(index) +
+						", \"status\": \"error\", \"rom\": " + jsonString(entries[index].romPath) +
+						", \"movie\": " + jsonString(entries[index].moviePath) +
+						", \"error\": " + jsonString(why) + "}";
+				}
+				passed += entryPassed ? 1 : 0;
+				done++;
+				running--;
+
+				fprintf( stderr, "[%lu/%lu] %s %s\n", (unsigned long)done, (unsigned long)entries.size(),
+						entryPassed ? "pass" : "FAIL", entries[index].moviePath.c_str() );
+
+				proc->deleteLater();
+
+				if ( done == entries.size() )
+				{
+					QCoreApplication::quit();
+				}
+				else
+				{
+					startNext();
+				}
+			});
+
+			proc->start( exe, QStringList() << "--verify-worker" << manifest << QString::number(index) );
+			running++;
+		}
+	};
+
+	if ( !entries.empty() )
+	{
+		startNext();
+		app.exec();
+	}
+
+	std::string report;
+	char num[128];
+
+	report.append("{\n  \"version\": ");
+	report.append( jsonString(FCEU_VERSION_STRING) );
+	snprintf( num, sizeof(num), ",\n  \"jobs\": %i,\n  \"seconds\": %.3f,\n  \"passed\": %i,\n  \"failed\": %i,\n",
+			jobs, timer.nsecsElapsed() / 1e9, passed, static_cast<int>(entries.size()) - passed );
+	report.append(num);
+	report.append("  \"results\": [");
+
+	for (size_t i=0; i<results.size(); i++)
+	{
+		report.append( i ? ",\n    " : "\n    " );
+		report.append( results[i] );
+	}
+	report.append("\n  ]\n}\n");
+
+	if ( reportPath )
+	{
+		FILE *fp = ::fopen( reportPath, "w" );
+
+		if ( fp == NULL )
+		{
+			fprintf( stderr, "Error: Could not write report: %s\n", reportPath );
+			return 1;
+		}
+		fputs( report.c_str(), fp );
+		fclose(fp);
+	}
+	else
+	{
+		fputs( report.c_str(), stdout );
+	}
+
+	return passed == static_cast<int>(entries.size()) ? 0 : 1;
+}
+//-----------------------------------------------------------------------------
+int  movieVerifyMain( int argc, char *argv[] )
+{
+	const char *manifest = NULL;
+	const char *reportPath = NULL;
+	int jobs = 0;
+
+	for (int i=1; i<argc; i++)
+	{
+		if ( (strcmp(argv[i], "--verify-worker") == 0) && (i+2 < argc) )
+		{
+			return runWorker( argv[i+1], atoi(argv[i+2]) );
+		}
+		else if ( (strcmp(argv[i], "--verify-movies") == 0) && (i+1 < argc) )
+		{
+			manifest = argv[++i];
+		}
+		else if ( (strcmp(argv[i], "--verify-jobs") == 0) && (i+1 < argc) )
+		{
+			jobs = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--verify-report") == 0) && (i+1 < argc) )
+		{
+			reportPath = argv[++i];
+		}
+	}
+	if ( manifest == NULL )
+	{
+		fprintf( stderr, "Error: --verify-movies needs a manifest file\n" );
+		return 1;
+	}
+	return runBatch( argc, argv, manifest, jobs, reportPath );
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,34 @@
+// MovieVerify.h
+//
+#pragma once
+
+#include <string>
+#include <vector>
+
+// One line of a movie verification manifest:
+//
+//   rom <TAB> movie [<TAB> final RAM md5] [<TAB> frame:RAM md5 ...] [<TAB> baseline=file]
+//
+// empty lines and lines starting with '#' are skipped, '-' leaves the final RAM md5 unchecked.
+struct MovieVerifyCheckpoint
+{
+	int frame;
+	std::string ramMd5;
+};
+
+struct MovieVerifyEntry
+{
+	std::string romPath;
+	std::string moviePath;
+	std::string finalRamMd5;
+	std::string baselinePath;
+	std::vector <MovieVerifyCheckpoint> checkpoints;
+};
+
+bool movieVerifyLoadManifest( const char *path, std::vector <MovieVerifyEntry> &entries, std::string &errorMsg );
+
+// True if the command line asks for a batch verification run (or is one of its workers),
+// which happens without any GUI.
+bool movieVerifyRequested( int argc, char *argv[] );
+
+int  movieVerifyMain( int argc, char *argv[] );
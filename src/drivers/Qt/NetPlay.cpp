@@ -18,16 +18,26 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <zlib.h>
+
 #include <QDir>
+#include <QFile>
 #include <QMessageBox>
 #include <QTemporaryFile>
+#include <QRandomGenerator>
 
 #include "../../fceu.h"
 #include "../../cart.h"
 #include "../../state.h"
 #include "../../movie.h"
 #include "../../debug.h"
+#include "utils/md5.h"
 #include "utils/crc32.h"
+#include "utils/endian.h"
 #include "utils/timeStamp.h"
 #include "utils/StringUtils.h"
 #include "Qt/main.h"
@@ -42,21 +52,84 @@
 //-----------------------------------------------------------------------------
 //--- NetPlay State Monitoring Metrics
 //-----------------------------------------------------------------------------
-static uint32_t opsCrc32 = 0;
-static void *traceRegistrationHandle = nullptr;
 static bool  serverRequestedStateLoad = false;
 
+// Host and clients hash their state at the start of every Nth frame,
+// clients report their latest hash for the host to compare.
+static constexpr uint32_t netPlayStateHashInterval = 4;
+
+// A spectator relay gets the input a few frames at a time, and a full state now and then
+static constexpr uint32_t netPlayRelayBatchFrames = 4;
+static constexpr uint32_t netPlayRelayKeyframeInterval = 300;
+
+// UDP clients are sent the input of the frames they don't have yet, but at most this many at once
+static constexpr uint32_t netPlayUdpMaxFrames = 64;
+static constexpr size_t   netPlayUdpHistorySize = 256;
+static constexpr size_t   netPlayUdpMaxPacketSize = 2048;
+
+// FCEU_NETPLAY_UDP_LOSS=<percent> drops that share of the UDP packets sent, to test lossy links
+static bool netPlayUdpDropPacket(void)
+{
+	static int lossPercent = -1;
+
+	if (lossPercent < 0)
+	{
+		const char *env = getenv("FCEU_NETPLAY_UDP_LOSS");
+
+		lossPercent = (env != nullptr) ? atoi(env) : 0;
+		lossPercent = std::max( 0, std::min( lossPercent, 100 ) );
+	}
+	return (lossPercent > 0) && ((rand() % 100) < lossPercent);
+}
+
+// Checks the header of a UDP packet and passes each message it carries to msgCallback,
+// which gets the size without the message header like readMessages() callbacks do.
+static bool netPlayUdpUnpack( char *buf, size_t size, netPlayUdpPacket &pkt, std::function<void(uint32_t msgId, char *msgBuf, size_t msgSize)> msgCallback )
+{
+	if (size < sizeof(netPlayUdpPacket))
+	{
+		return false;
+	}
+	memcpy( &pkt, buf, sizeof(pkt) );
+	pkt.toHostByteOrder();
+
+	if ( (pkt.hdr.magic[0] != NETPLAY_MAGIC_NUMBER) || (pkt.hdr.magic[1] != NETPLAY_MAGIC_NUMBER) ||
+	     (pkt.hdr.msgId != NETPLAY_UDP_PACKET) || (pkt.hdr.msgSize != size) )
+	{
+		return false;
+	}
+	size_t ofs = sizeof(netPlayUdpPacket);
+
+	while ( (ofs + sizeof(netPlayMsgHdr)) <= size )
+	{
+		netPlayMsgHdr hdr(0);
+
+		memcpy( &hdr, &buf[ofs], sizeof(hdr) );
+		hdr.toHostByteOrder();
+
+		if ( (hdr.magic[0] != NETPLAY_MAGIC_NUMBER) || (hdr.magic[1] != NETPLAY_MAGIC_NUMBER) ||
+		     (hdr.msgSize < sizeof(netPlayMsgHdr)) || ((ofs + hdr.msgSize) > size) )
+		{
+			return false;
+		}
+		msgCallback( hdr.msgId, &buf[ofs], hdr.msgSize - sizeof(netPlayMsgHdr) );
+
+		ofs += hdr.msgSize;
+	}
+	return true;
+}
+
 struct NetPlayFrameData
 {
 	uint32_t frameNum = 0;
-	uint32_t opsCrc32 = 0;
-	uint32_t ramCrc32 = 0;
+	uint32_t stateHash = 0;
+	uint32_t ramHash = 0;
 
 	void reset()
 	{
 		frameNum = 0;
-		opsCrc32 = 0;
-		ramCrc32 = 0;
+		stateHash = 0;
+		ramHash = 0;
 	}
 };
 
@@ -139,6 +212,286 @@ struct NetPlayFrameDataHist_t
 	int bufHead = 0;
 };
 static NetPlayFrameDataHist_t  netPlayFrameData;
+static void netPlayCalcStateHash( NetPlayFrameData &data );
+//-----------------------------------------------------------------------------
+//--- NetPlay Rollback
+//-----------------------------------------------------------------------------
+// In rollback mode a client does not wait for the host's input of a frame.
+// It runs ahead using the last confirmed input of the other players and its
+// own controller, and keeps a savestate for the start of every frame that
+// has not been confirmed yet. When the host's input for a frame differs from
+// what was predicted, that frame's state is restored and the frames up to
+// the current one are emulated again without video or sound.
+//
+// Only used from the emulator thread or with the emulator mutex held.
+struct NetPlayRollbackFrame
+{
+	uint32_t frameNum = 0;
+	uint32_t stateHash = 0;
+	uint32_t ramHash = 0;
+	uint8_t  ctrl[4] = { 0 }; // Input the frame was last emulated with
+	uint8_t  localCtrl = 0;   // Local controller when the frame was first emulated
+	bool     confirmed = false;
+	bool     hasState = false;
+	bool     hasHash = false;
+	std::vector <uint8_t> state;
+};
+
+struct NetPlayRollback_t
+{
+	bool active()
+	{
+		return !frames.empty();
+	}
+
+	void reset( unsigned int numFrames, uint32_t frame )
+	{
+		frames.clear();
+
+		if (numFrames > 0)
+		{
+			frames.resize(numFrames + 1);
+		}
+		ahead.clear();
+		lastConfirmed = lastReported = lastEmulated = frame;
+		memset( lastConfirmedCtrl, 0, sizeof(lastConfirmedCtrl) );
+	}
+
+	NetPlayRollbackFrame* find( uint32_t frame )
+	{
+		NetPlayRollbackFrame &f = frames[ frame % frames.size() ];
+
+		return (f.frameNum == frame) ? &f : nullptr;
+	}
+
+	// Snapshot taken between frames, before the given frame is emulated
+	void saveFrame( uint32_t frame )
+	{
+		NetPlayRollbackFrame &f = frames[ frame % frames.size() ];
+
+		if (f.frameNum != frame)
+		{
+			f.frameNum  = frame;
+			f.localCtrl = 0;
+			f.confirmed = false;
+			memset( f.ctrl, 0, sizeof(f.ctrl) );
+		}
+		EMUFILE_MEMORY em( &f.state );
+		em.truncate(0);
+
+		f.hasState = FCEUSS_SaveMS( &em, 0 );
+		f.hasHash  = ((frame - 1) % netPlayStateHashInterval) == 0;
+
+		if (f.hasHash)
+		{
+			NetPlayFrameData data;
+			netPlayCalcStateHash( data );
+			f.stateHash = data.stateHash;
+			f.ramHash   = data.ramHash;
+		}
+	}
+
+	bool loadFrame( uint32_t frame )
+	{
+		NetPlayRollbackFrame *f = find(frame);
+
+		if ( (f == nullptr) || !f->hasState )
+		{
+			return false;
+		}
+		EMUFILE_MEMORY em( &f->state );
+
+		serverRequestedStateLoad = true;
+		bool loaded = FCEUSS_LoadFP( &em, SSLOADPARAM_NOBACKUP );
+		serverRequestedStateLoad = false;
+
+		if (loaded)
+		{
+			currFrameCounter = frame - 1;
+		}
+		return loaded;
+	}
+
+	void readInput( NetPlayClient *client, uint8_t *joy )
+	{
+		const uint32_t frame = static_cast<uint32_t>(currFrameCounter) + 1;
+		const bool firstRun = frame > lastEmulated;
+
+		NetPlayRollbackFrame *f = find(frame);
+
+		if (f == nullptr)
+		{	// No snapshot for this frame, it can't be corrected later
+			NetPlayRollbackFrame &slot = frames[ frame % frames.size() ];
+			slot.frameNum  = frame;
+			slot.hasState  = false;
+			slot.confirmed = false;
+			f = &slot;
+		}
+
+		if (firstRun)
+		{
+			if (client->isPlayerRole())
+			{
+				uint32_t ctlrData = client->localGamepadState( frame );
+
+				f->localCtrl = (ctlrData >> (8 * client->role)) & 0x000000ff;
+
+				client->statsLocalPad( f->localCtrl );
+			}
+			client->statsFrameRun();
+			lastEmulated = frame;
+
+			while (!ahead.empty() && (ahead.front().frameCounter < frame))
+			{
+				ahead.pop_front();
+			}
+			if (!ahead.empty() && (ahead.front().frameCounter == frame))
+			{
+				memcpy( f->ctrl, ahead.front().ctrl, sizeof(f->ctrl) );
+				f->confirmed = true;
+				ahead.pop_front();
+			}
+			if (client->isPlayerRole())
+			{
+				NetPlayFrameInput localFrame;
+
+				localFrame.frameCounter = frame;
+				localFrame.ctrl[client->role] = f->localCtrl;
+
+				client->pushLocalInput( localFrame );
+			}
+		}
+
+		if (!f->confirmed)
+		{
+			memcpy( f->ctrl, lastConfirmedCtrl, sizeof(f->ctrl) );
+
+			if (client->isPlayerRole())
+			{
+				f->ctrl[client->role] = f->localCtrl;
+			}
+		}
+		memcpy( joy, f->ctrl, sizeof(f->ctrl) );
+	}
+
+	void update( NetPlayClient *client )
+	{
+		const uint32_t currFrame = static_cast<uint32_t>(currFrameCounter);
+		uint32_t rollbackFrame = 0;
+
+		// Apply the host's input to the frames it was predicted for
+		while (client->inputAvailable())
+		{
+			NetPlayFrameInput in = client->getNextInput();
+
+			if (in.frameCounter <= lastConfirmed)
+			{
+				continue;
+			}
+			lastConfirmed = in.frameCounter;
+			memcpy( lastConfirmedCtrl, in.ctrl, sizeof(lastConfirmedCtrl) );
+
+			if (in.frameCounter > lastEmulated)
+			{
+				ahead.push_back(in);
+				continue;
+			}
+			NetPlayRollbackFrame *f = find(in.frameCounter);
+
+			if (f == nullptr)
+			{
+				printf("NetPlay Rollback: Frame %u is no longer buffered\n", in.frameCounter);
+				continue;
+			}
+			f->confirmed = true;
+
+			if (memcmp( f->ctrl, in.ctrl, sizeof(f->ctrl) ) != 0)
+			{
+				memcpy( f->ctrl, in.ctrl, sizeof(f->ctrl) );
+
+				if (rollbackFrame == 0)
+				{
+					rollbackFrame = in.frameCounter;
+				}
+			}
+		}
+
+		if (rollbackFrame != 0)
+		{
+			if (loadFrame(rollbackFrame))
+			{
+				uint8 *gfx;
+				int32 *sound;
+				int32 ssize;
+				int savedPause = EmulationPaused;
+
+				EmulationPaused = 0;
+
+				for (uint32_t frame = rollbackFrame; frame <= currFrame; frame++)
+				{
+					if (frame != rollbackFrame)
+					{
+						saveFrame(frame);
+					}
+					// skip = 2, no video or sound output
+					FCEUI_Emulate(&gfx, &sound, &ssize, 2);
+				}
+				EmulationPaused = savedPause;
+			}
+			else
+			{
+				printf("NetPlay Rollback: No state for frame %u\n", rollbackFrame);
+			}
+		}
+
+		// Snapshot for the frame about to run, unless it was taken already while waiting
+		const uint32_t nextFrame = static_cast<uint32_t>(currFrameCounter) + 1;
+		NetPlayRollbackFrame *next = find(nextFrame);
+
+		if ( (rollbackFrame != 0) || (next == nullptr) || !next->hasState )
+		{
+			saveFrame(nextFrame);
+		}
+
+		// Only frames run on confirmed input are reported for desync checks.
+		// The state at the start of frame N + 1 is what the host records for frame N.
+		const uint32_t reportFrame = std::min( lastConfirmed, static_cast<uint32_t>(currFrameCounter) );
+
+		while (lastReported < reportFrame)
+		{
+			lastReported++;
+
+			NetPlayRollbackFrame *f = find(lastReported + 1);
+
+			if ( (f != nullptr) && f->hasHash )
+			{
+				NetPlayFrameData data;
+
+				data.frameNum  = lastReported;
+				data.stateHash = f->stateHash;
+				data.ramHash   = f->ramHash;
+
+				netPlayFrameData.push( data );
+			}
+		}
+	}
+
+	// How many frames the client may run past the last confirmed one
+	uint32_t leadFrames( NetPlayClient *client )
+	{
+		uint32_t lead = (client->hostPingDelay / 16) + 2;
+
+		return std::min( lead, static_cast<uint32_t>(frames.size() - 1) );
+	}
+
+	std::vector <NetPlayRollbackFrame> frames;
+	std::list <NetPlayFrameInput> ahead; // Confirmed input for frames not emulated yet
+	uint32_t lastConfirmed = 0;
+	uint32_t lastReported = 0;
+	uint32_t lastEmulated = 0;
+	uint8_t  lastConfirmedCtrl[4] = { 0 };
+};
+static NetPlayRollback_t  netPlayRollback;
 //-----------------------------------------------------------------------------
 const char* NetPlayPlayerRoleToString(int role)
 {
@@ -162,6 +515,9 @@ const char* NetPlayPlayerRoleToString(int role)
 		case netPlayerId::NETPLAY_PLAYER4:
 			roleString = "Player 4";
 			break;
+		case netPlayerId::NETPLAY_RELAY:
+			roleString = "Relay";
+			break;
 	}
 	return roleString;
 }
@@ -199,6 +555,13 @@ NetPlayServer::~NetPlayServer(void)
 
 	closeAllConnections();
 
+	for (auto& job : syncJobs)
+	{
+		job->worker.join();
+		delete job;
+	}
+	syncJobs.clear();
+
 	printf("NetPlayServer Destructor\n");
 }
 
@@ -213,12 +576,6 @@ int NetPlayServer::Create(QObject *parent)
 			printf("Error Creating Netplay Server!!!\n");
 		}
 	}
-	FCEU_WRAPPER_LOCK();
-	if (traceRegistrationHandle == nullptr)
-	{
-		traceRegistrationHandle = FCEUI_TraceInstructionRegister( NetPlayTraceInstruction );
-	}
-	FCEU_WRAPPER_UNLOCK();
 	return 0;
 }
 
@@ -230,16 +587,6 @@ int NetPlayServer::Destroy()
 		delete server;
 		server = nullptr;
 	}
-	FCEU_WRAPPER_LOCK();
-	if (traceRegistrationHandle != nullptr)
-	{
-		if ( !FCEUI_TraceInstructionUnregisterHandle( traceRegistrationHandle ) )
-		{
-			printf("Unregister Trace Callback Error\n");
-		}
-		traceRegistrationHandle = nullptr;
-	}
-	FCEU_WRAPPER_UNLOCK();
 	return 0;
 }
 
@@ -291,6 +638,13 @@ int NetPlayServer::closeAllConnections(void)
 	{
 		auto* client = *it;
 
+		for (auto& job : syncJobs)
+		{
+			if (job->client == client)
+			{
+				job->client = nullptr;
+			}
+		}
 		delete client;
 	}
 	clientList.clear();
@@ -315,7 +669,54 @@ int NetPlayServer::sendMsg( NetPlayClient *client, void *msg, size_t msgSize, st
 	return 0;
 }
 //-----------------------------------------------------------------------------
-int NetPlayServer::sendRomLoadReq( NetPlayClient *client )
+//--- NetPlay ROM Cache
+//-----------------------------------------------------------------------------
+// Clients keep the ROM files they were sent under the MD5 of the file data, the host
+// offers a ROM by its hash first and only sends the data to clients that don't have it.
+static QString netPlayRomCachePath( const uint8_t md5[16] )
+{
+	QDir dir( QString(FCEUI_GetBaseDirectory()) + QString("/netplay/romcache") );
+
+	if (!dir.exists())
+	{
+		dir.mkpath(".");
+	}
+	QString fileName;
+
+	for (int i=0; i<16; i++)
+	{
+		fileName += QString::asprintf("%02x", md5[i]);
+	}
+	return dir.filePath( fileName + QString(".nes") );
+}
+//-----------------------------------------------------------------------------
+static void netPlayRomMd5( const char *data, size_t size, uint8_t md5[16] )
+{
+	struct md5_context ctx;
+
+	md5_starts( &ctx );
+	md5_update( &ctx, reinterpret_cast<uint8*>(const_cast<char*>(data)), size );
+	md5_finish( &ctx, md5 );
+}
+//-----------------------------------------------------------------------------
+// The file name is the hash, this checks that the file still goes with it
+static bool netPlayRomCacheHas( const QString &filepath, const uint8_t md5[16] )
+{
+	QFile file( filepath );
+	uint8_t fileMd5[16];
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		return false;
+	}
+	QByteArray data = file.readAll();
+
+	netPlayRomMd5( data.constData(), data.size(), fileMd5 );
+
+	return memcmp( fileMd5, md5, sizeof(fileMd5) ) == 0;
+}
+//-----------------------------------------------------------------------------
+int NetPlayServer::sendRomLoadReq( NetPlayClient *client, bool sendData )
 {
 	constexpr size_t BufferSize = 8 * 1024;
 	char buf[BufferSize];
@@ -351,19 +752,42 @@ int NetPlayServer::sendRomLoadReq( NetPlayClient *client )
 	{
 		return -1;
 	}
-	fseek( fp, 0, SEEK_END);
+	struct md5_context md5;
+	md5_starts( &md5 );
+
+	while ( (bytesRead = fread( buf, 1, sizeof(buf), fp )) > 0 )
+	{
+		md5_update( &md5, reinterpret_cast<uint8*>(buf), bytesRead );
+	}
+	md5_finish( &md5, romFileMd5 );
 
 	fileSize = ftell(fp);
 
 	rewind(fp);
 
-	msg.hdr.msgSize += fileSize;
 	msg.fileSize     = fileSize;
+	memcpy( msg.md5, romFileMd5, sizeof(msg.md5) );
 	Strlcpy( msg.fileName, GameInfo->filename, sizeof(msg.fileName) );
 
-	printf("Sending ROM Load Request: %s  %lu\n", filepath, fileSize );
 	FCEUI_SetEmulationPaused(EMULATIONPAUSED_PAUSED);
 
+	// A relay passes the message on to its spectators as is, so it gets the data right away
+	if (!sendData && !client->isRelay())
+	{
+		printf("Sending ROM Offer: %s  %lu\n", filepath, fileSize );
+		msg.flags |= netPlayLoadRomReq::CacheFlag;
+
+		sendMsg( client, &msg, sizeof(netPlayLoadRomReq), [&msg]{ msg.toNetworkByteOrder(); } );
+		client->flushData();
+
+		::fclose(fp);
+
+		return 0;
+	}
+	msg.hdr.msgSize += fileSize;
+
+	printf("Sending ROM Load Request: %s  %lu\n", filepath, fileSize );
+
 	sendMsg( client, &msg, sizeof(netPlayLoadRomReq), [&msg]{ msg.toNetworkByteOrder(); } );
 
 	while ( (bytesRead = fread( buf, 1, sizeof(buf), fp )) > 0 )
@@ -377,31 +801,449 @@ int NetPlayServer::sendRomLoadReq( NetPlayClient *client )
 	return 0;
 }
 //-----------------------------------------------------------------------------
-int NetPlayServer::sendStateSyncReq( NetPlayClient *client )
+//--- NetPlay State Sync
+//-----------------------------------------------------------------------------
+// A sync state is snapshot uncompressed on the host, between frames. Encoding
+// it is left to a worker thread so that the session keeps running meanwhile.
+// A client that acknowledged an earlier state of the same size gets the xor
+// against it, which is mostly zeroes, otherwise a regular compressed savestate.
+struct NetPlayStateSyncJob
+{
+	NetPlayClient *client = nullptr;
+	std::shared_ptr <std::vector<uint8_t>> state;
+	std::shared_ptr <std::vector<uint8_t>> base;
+	std::vector <uint8_t> payload;
+	uint32_t stateId = 0;
+	uint32_t baseId = 0;
+	uint32_t frameNum = 0;
+	uint32_t inputFrame = 0;
+	bool     delta = false;
+	bool     keyframe = false;
+	std::atomic<bool> done{false};
+	std::thread worker;
+};
+
+static constexpr int netPlaySyncStateHeaderSize = 16;
+static constexpr int netPlaySyncCompressionLevel = 1;
+
+static void netPlayEncodeSyncState( NetPlayStateSyncJob *job )
+{
+	const std::vector <uint8_t> &state = *job->state;
+	const size_t stateSize = state.size();
+
+	if ( job->base && (job->base->size() == stateSize) )
+	{
+		const std::vector <uint8_t> &base = *job->base;
+		std::vector <uint8_t> work( stateSize );
+
+		for (size_t i=0; i<stateSize; i++)
+		{
+			work[i] = state[i] ^ base[i];
+		}
+		uLongf comprLen = compressBound( stateSize );
+		job->payload.resize( comprLen );
+
+		if (compress2( &job->payload[0], &comprLen, &work[0], stateSize, netPlaySyncCompressionLevel ) == Z_OK)
+		{
+			job->payload.resize( comprLen );
+			job->delta = true;
+			job->done  = true;
+			return;
+		}
+	}
+
+	// Full state, the chunks of the uncompressed savestate get compressed behind its header
+	const size_t bodySize = stateSize - netPlaySyncStateHeaderSize;
+	uLongf comprLen = compressBound( bodySize );
+	job->payload.resize( netPlaySyncStateHeaderSize + comprLen );
+	memcpy( &job->payload[0], &state[0], netPlaySyncStateHeaderSize );
+
+	if (compress2( &job->payload[netPlaySyncStateHeaderSize], &comprLen, &state[netPlaySyncStateHeaderSize], bodySize, netPlaySyncCompressionLevel ) == Z_OK)
+	{
+		FCEU_en32lsb( &job->payload[12], comprLen );
+		job->payload.resize( netPlaySyncStateHeaderSize + comprLen );
+	}
+	else
+	{
+		job->payload = state;
+	}
+	job->done = true;
+}
+
+// Rebuilds the uncompressed state the host snapshot from a sync message
+static bool netPlayDecodeSyncState( netPlayLoadStateResp *msg, const std::vector <uint8_t> &base, uint32_t baseId, std::vector <uint8_t> &state )
+{
+	const uint8_t *data = reinterpret_cast<const uint8_t*>( msg->stateDataBuf() );
+	const uint32_t dataSize = msg->stateDataSize();
+
+	if (msg->flags & netPlayLoadStateResp::DeltaFlag)
+	{
+		if ( (msg->baseId != baseId) || (base.size() != msg->rawSize) || (msg->rawSize == 0) )
+		{
+			return false;
+		}
+		uLongf stateSize = msg->rawSize;
+		state.resize( stateSize );
+
+		if ( (uncompress( &state[0], &stateSize, data, dataSize ) != Z_OK) || (stateSize != msg->rawSize) )
+		{
+			return false;
+		}
+		for (size_t i=0; i<state.size(); i++)
+		{
+			state[i] ^= base[i];
+		}
+		return true;
+	}
+
+	if ( (dataSize < netPlaySyncStateHeaderSize) || (memcmp( data, "FCSX", 4 ) != 0) )
+	{	// Not something a delta can be built on, load it as it is
+		state.assign( data, data + dataSize );
+		return true;
+	}
+	uint8_t header[netPlaySyncStateHeaderSize];
+	memcpy( header, data, sizeof(header) );
+
+	const uint32_t bodySize = FCEU_de32lsb( header + 4 );
+	const uint32_t comprLen = FCEU_de32lsb( header + 12 );
+
+	state.resize( netPlaySyncStateHeaderSize + bodySize );
+	FCEU_en32lsb( header + 12, ~0u );
+	memcpy( &state[0], header, sizeof(header) );
+
+	if (comprLen == ~0u)
+	{
+		if (dataSize < netPlaySyncStateHeaderSize + bodySize)
+		{
+			return false;
+		}
+		memcpy( &state[netPlaySyncStateHeaderSize], data + netPlaySyncStateHeaderSize, bodySize );
+		return true;
+	}
+	uLongf stateSize = bodySize;
+
+	if ( (uncompress( &state[netPlaySyncStateHeaderSize], &stateSize, data + netPlaySyncStateHeaderSize, dataSize - netPlaySyncStateHeaderSize ) != Z_OK) ||
+	     (stateSize != bodySize) )
+	{
+		return false;
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+int NetPlayServer::sendStateSyncReq( NetPlayClient *client, bool keyframe )
+{
+	if ( GameInfo == nullptr )
+	{
+		return -1;
+	}
+	if (client->syncInProgress)
+	{
+		if (!keyframe)
+		{	// Taken again once the current one is out
+			client->syncRequested = true;
+		}
+		return 0;
+	}
+	// Input batched for a relay belongs ahead of the state
+	sendRunFrameBatch( client );
+
+	auto state = std::make_shared<std::vector<uint8_t>>();
+	EMUFILE_MEMORY em( state.get() );
+
+	if ( !FCEUSS_SaveMS( &em, Z_NO_COMPRESSION ) || (em.size() <= netPlaySyncStateHeaderSize) )
+	{
+		return -1;
+	}
+	auto *job = new NetPlayStateSyncJob();
+
+	job->client     = client;
+	job->state      = state;
+	job->stateId    = ++syncStateId;
+	job->frameNum   = static_cast<uint32_t>(currFrameCounter);
+	job->inputFrame = inputFrameCount;
+	job->keyframe   = keyframe;
+
+	if (client->syncAckedState)
+	{
+		job->base   = client->syncAckedState;
+		job->baseId = client->syncAckedId;
+	}
+	client->syncInProgress = true;
+
+	job->worker = std::thread( netPlayEncodeSyncState, job );
+
+	syncJobs.push_back( job );
+
+	return 0;
+}
+//-----------------------------------------------------------------------------
+void NetPlayServer::processStateSyncJobs(void)
+{
+	for (auto it = syncJobs.begin(); it != syncJobs.end(); )
+	{
+		NetPlayStateSyncJob *job = *it;
+
+		if (!job->done)
+		{
+			it++;
+			continue;
+		}
+		job->worker.join();
+
+		if (job->client != nullptr)
+		{
+			sendStateSync( job );
+		}
+		it = syncJobs.erase(it);
+		delete job;
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlayServer::sendStateSync( NetPlayStateSyncJob *job )
+{
+	NetPlayClient *client = job->client;
+	netPlayLoadStateResp resp;
+
+	resp.hdr.msgSize += job->payload.size();
+	resp.stateSize    = job->payload.size();
+	resp.frameNum     = job->frameNum;
+	resp.inputFrame   = job->inputFrame;
+	resp.stateId      = job->stateId;
+	resp.rawSize      = job->state->size();
+
+	if (job->delta)
+	{
+		resp.flags  |= netPlayLoadStateResp::DeltaFlag;
+		resp.baseId  = job->baseId;
+	}
+	if (job->keyframe)
+	{
+		resp.flags  |= netPlayLoadStateResp::KeyframeFlag;
+	}
+
+	printf("Sending ROM Sync Request: %zu%s\n", job->payload.size(), job->delta ? " (delta)" : (job->keyframe ? " (keyframe)" : ""));
+
+	sendMsg( client, &resp, sizeof(netPlayLoadStateResp), [&resp]{ resp.toNetworkByteOrder(); } );
+	sendMsg( client, &job->payload[0], job->payload.size() );
+
+	client->syncSentState  = job->state;
+	client->syncSentId     = job->stateId;
+	client->syncInProgress = false;
+
+	for (auto& inputFrame : client->deferredInput)
+	{
+		sendRunFrameReq( client, inputFrame );
+	}
+	client->deferredInput.clear();
+
+	client->flushData();
+
+	if (client->syncRequested)
+	{
+		client->syncRequested = false;
+
+		FCEU_WRAPPER_LOCK();
+		sendStateSyncReq( client );
+		FCEU_WRAPPER_UNLOCK();
+	}
+}
+//-----------------------------------------------------------------------------
+int NetPlayServer::sendRunFrameReq( NetPlayClient *client, NetPlayFrameInput &inputFrame )
+{
+	if (client->isRelay())
+	{	// Sent in batches, see sendRunFrameBatch()
+		client->relayInput.push_back( inputFrame );
+		return 0;
+	}
+	if (client->udpActive)
+	{	// Goes with the next UDP packet, see sendUdpPacket()
+		return 0;
+	}
+	netPlayRunFrameReq  runFrameReq;
+
+	runFrameReq.frameNum     = inputFrame.frameCounter;
+	runFrameReq.ctrlState[0] = inputFrame.ctrl[0];
+	runFrameReq.ctrlState[1] = inputFrame.ctrl[1];
+	runFrameReq.ctrlState[2] = inputFrame.ctrl[2];
+	runFrameReq.ctrlState[3] = inputFrame.ctrl[3];
+
+	uint32_t  catchUpThreshold = maxLeadFrames;
+	if (catchUpThreshold < 3)
+	{
+		catchUpThreshold = 3;
+	}
+	runFrameReq.catchUpThreshold = catchUpThreshold;
+	runFrameReq.rollbackFrames   = rollbackFrames;
+
+	return sendMsg( client, &runFrameReq, sizeof(runFrameReq), [&runFrameReq]{ runFrameReq.toNetworkByteOrder(); } );
+}
+//-----------------------------------------------------------------------------
+int NetPlayServer::sendRunFrameBatch( NetPlayClient *client )
+{
+	if (client->relayInput.empty())
+	{
+		return 0;
+	}
+	const size_t frameCount = client->relayInput.size();
+	std::vector <uint8_t> ctrlData( frameCount * 4 );
+	netPlayRunFrameBatch  batch;
+
+	for (size_t i=0; i<frameCount; i++)
+	{
+		memcpy( &ctrlData[i*4], client->relayInput[i].ctrl, 4 );
+	}
+	batch.hdr.msgSize += ctrlData.size();
+	batch.firstFrame   = client->relayInput.front().frameCounter;
+	batch.frameCount   = frameCount;
+
+	uint32_t  catchUpThreshold = maxLeadFrames;
+	if (catchUpThreshold < 3)
+	{
+		catchUpThreshold = 3;
+	}
+	batch.catchUpThreshold = catchUpThreshold;
+	batch.rollbackFrames   = rollbackFrames;
+
+	client->relayInput.clear();
+
+	sendMsg( client, &batch, sizeof(batch), [&batch]{ batch.toNetworkByteOrder(); } );
+	return sendMsg( client, &ctrlData[0], ctrlData.size() );
+}
+//-----------------------------------------------------------------------------
+//--- NetPlay UDP Transport
+//-----------------------------------------------------------------------------
+// With UDP enabled, the input, client state and pings go in UDP packets once both sides
+// get them; ROMs, states and text messages stay on TCP. Each packet to a client carries
+// the input of all frames from the last one the client reported having, but at least of
+// the last udpRedundancy frames, so a lost packet is made up for by the next one.
+bool NetPlayServer::openUdp( int port )
+{
+	udpSock = new QUdpSocket(this);
+
+	if (!udpSock->bind( QHostAddress::Any, port ))
+	{
+		FCEU_printf("NetPlay: Could not open UDP port %i, using TCP only: %s\n", port, udpSock->errorString().toLocal8Bit().constData());
+		delete udpSock;
+		udpSock = nullptr;
+		return false;
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+void NetPlayServer::readUdp(void)
+{
+	alignas(8) char buf[netPlayUdpMaxPacketSize];
+
+	while ( (udpSock != nullptr) && udpSock->hasPendingDatagrams() )
+	{
+		QHostAddress sender;
+		quint16 senderPort = 0;
+		netPlayUdpPacket pkt;
+		NetPlayClient *client = nullptr;
+
+		qint64 size = udpSock->readDatagram( buf, sizeof(buf), &sender, &senderPort );
+
+		if ( (size < static_cast<qint64>(sizeof(netPlayUdpPacket))) || (size >= static_cast<qint64>(sizeof(buf))) )
+		{
+			continue;
+		}
+		memcpy( &pkt, buf, sizeof(pkt) );
+		pkt.toHostByteOrder();
+
+		for (auto& c : clientList)
+		{
+			if ( (c->udpToken != 0) && (c->udpToken == pkt.token) && (c->state > 0) )
+			{
+				client = c;
+			}
+		}
+		if ( (client == nullptr) || (pkt.seq <= client->udpRecvSeq) )
+		{
+			continue;
+		}
+
+		bool valid = netPlayUdpUnpack( buf, size, pkt, [this, client](uint32_t msgId, char *msgBuf, size_t msgSize)
+		{
+			if ( (msgId == NETPLAY_CLIENT_STATE) || (msgId == NETPLAY_CLIENT_INPUT) || (msgId == NETPLAY_PING_RESP) )
+			{
+				serverProcessMessage( client, msgBuf, msgSize );
+			}
+		});
+		if (!valid)
+		{
+			continue;
+		}
+		client->udpRecvSeq = pkt.seq;
+		client->udpAddr    = sender;
+		client->udpPort    = senderPort;
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlayServer::sendUdpPacket( NetPlayClient *client, const void *msg, size_t msgSize )
 {
-	EMUFILE_MEMORY em;
-	int compressionLevel = 1;
-	netPlayLoadStateResp resp;
+	alignas(8) char buf[netPlayUdpMaxPacketSize];
+	netPlayUdpPacket pkt;
+	size_t size = sizeof(netPlayUdpPacket);
 
-	if ( GameInfo == nullptr )
+	// While a sync state is on its way, the input that follows it has to wait
+	if ( client->udpActive && !client->syncInProgress && !udpInputHistory.empty() )
 	{
-		return -1;
-	}
-	FCEUSS_SaveMS( &em, compressionLevel );
-
-	resp.hdr.msgSize += em.size();
-	resp.stateSize    = em.size();
-	resp.opsCrc32     = opsCrc32;
+		const uint32_t oldest = udpInputHistory.front().frameCounter;
+		const uint32_t newest = udpInputHistory.back().frameCounter;
+		uint32_t first = client->readyFrame + 1;
 
-	printf("Sending ROM Sync Request: %zu\n", em.size());
-	FCEUI_SetEmulationPaused(EMULATIONPAUSED_PAUSED);
+		if ( (newest - oldest + 1) > udpRedundancy )
+		{
+			first = std::min( first, newest - udpRedundancy + 1 );
+		}
+		else
+		{
+			first = oldest;
+		}
+		first = std::max( first, oldest );
 
-	sendMsg( client, &resp, sizeof(netPlayLoadStateResp), [&resp]{ resp.toNetworkByteOrder(); } );
-	sendMsg( client, em.buf(), em.size() );
+		if (first <= newest)
+		{
+			const uint32_t frameCount = std::min( newest - first + 1, netPlayUdpMaxFrames );
+			netPlayRunFrameBatch batch;
+			uint8_t *ctrlData = reinterpret_cast<uint8_t*>(&buf[size + sizeof(netPlayRunFrameBatch)]);
 
-	client->flushData();
+			for (uint32_t i=0; i<frameCount; i++)
+			{
+				memcpy( &ctrlData[i*4], udpInputHistory[ first - oldest + i ].ctrl, 4 );
+			}
+			uint32_t  catchUpThreshold = maxLeadFrames;
+			if (catchUpThreshold < 3)
+			{
+				catchUpThreshold = 3;
+			}
+			batch.hdr.msgSize     += frameCount * 4;
+			batch.firstFrame       = first;
+			batch.frameCount       = frameCount;
+			batch.catchUpThreshold = catchUpThreshold;
+			batch.rollbackFrames   = rollbackFrames;
+			batch.stateId          = client->syncSentId;
+			batch.toNetworkByteOrder();
+
+			memcpy( &buf[size], &batch, sizeof(batch) );
+			size += sizeof(batch) + (frameCount * 4);
+		}
+	}
+	if ( (msg != nullptr) && ((size + msgSize) <= sizeof(buf)) )
+	{
+		memcpy( &buf[size], msg, msgSize );
+		size += msgSize;
+	}
+	pkt.hdr.msgSize = size;
+	pkt.token       = client->udpToken;
+	pkt.seq         = ++client->udpSendSeq;
+	pkt.toNetworkByteOrder();
+	memcpy( buf, &pkt, sizeof(pkt) );
 
-	return 0;
+	if (!netPlayUdpDropPacket())
+	{
+		udpSock->writeDatagram( buf, size, client->udpAddr, client->udpPort );
+	}
 }
 //-----------------------------------------------------------------------------
 void NetPlayServer::setRole(int _role)
@@ -435,6 +1277,10 @@ bool NetPlayServer::claimRole(NetPlayClient* client, int _role)
 			client->role = _role;
 		}
 	}
+	else if (_role == NETPLAY_RELAY)
+	{
+		client->role = NETPLAY_RELAY;
+	}
 	else
 	{
 		client->role = NETPLAY_SPECTATOR;
@@ -464,7 +1310,6 @@ void NetPlayServer::onRomLoad()
 		romCrc32 = currCartInfo->CRC32;
 	}
 
-	opsCrc32 = 0;
 	netPlayFrameData.reset();
 
 	inputClear();
@@ -473,6 +1318,7 @@ void NetPlayServer::onRomLoad()
 	// New ROM has been loaded by server, signal clients to load and sync
 	for (auto& client : clientList )
 	{
+		client->lastInputFrame = 0;
 		sendRomLoadReq( client );
 		sendStateSyncReq( client );
 	}
@@ -499,7 +1345,6 @@ void NetPlayServer::onStateLoad()
 	//printf("New State Loaded!\n");
 	FCEU_WRAPPER_LOCK();
 
-	opsCrc32 = 0;
 	netPlayFrameData.reset();
 
 	inputClear();
@@ -508,8 +1353,8 @@ void NetPlayServer::onStateLoad()
 	// New State has been loaded by server, signal clients to load and sync
 	for (auto& client : clientList )
 	{
-		sendRomLoadReq( client );
-		sendStateSyncReq( client );
+		client->lastInputFrame = 0;
+		resyncClient( client );
 	}
 	FCEU_WRAPPER_UNLOCK();
 }
@@ -519,7 +1364,6 @@ void NetPlayServer::onNesReset()
 	//printf("NES Reset Event!\n");
 	FCEU_WRAPPER_LOCK();
 
-	opsCrc32 = 0;
 	netPlayFrameData.reset();
 
 	inputClear();
@@ -528,8 +1372,8 @@ void NetPlayServer::onNesReset()
 	// NES Reset has occurred on server, signal clients sync
 	for (auto& client : clientList )
 	{
-		sendRomLoadReq( client );
-		sendStateSyncReq( client );
+		client->lastInputFrame = 0;
+		resyncClient( client );
 	}
 	FCEU_WRAPPER_UNLOCK();
 }
@@ -537,7 +1381,12 @@ void NetPlayServer::onNesReset()
 void NetPlayServer::resyncClient( NetPlayClient *client )
 {
 	FCEU_WRAPPER_LOCK();
-	sendRomLoadReq( client );
+	// Only send the ROM again if the client doesn't run the same one,
+	// a relay always has the one last loaded
+	if (!client->romMatch && !client->isRelay())
+	{
+		sendRomLoadReq( client );
+	}
 	sendStateSyncReq( client );
 	FCEU_WRAPPER_UNLOCK();
 }
@@ -626,6 +1475,18 @@ void NetPlayServer::serverProcessMessage( NetPlayClient *client, void *msgBuf, s
 					FCEU_WRAPPER_UNLOCK();
 					client->state = 1;
 					FCEU_DispMessage("%s Joined",0, client->userName.toLocal8Bit().constData());
+
+					if ( (udpSock != nullptr) && !client->isRelay() )
+					{
+						netPlayUdpSetup setup;
+
+						client->udpToken = QRandomGenerator::global()->generate() | 0x01;
+
+						setup.port       = udpSock->localPort();
+						setup.redundancy = udpRedundancy;
+						setup.token      = client->udpToken;
+						sendMsg( client, &setup, sizeof(setup), [&setup]{ setup.toNetworkByteOrder(); } );
+					}
 				}
 				else
 				{
@@ -646,31 +1507,42 @@ void NetPlayServer::serverProcessMessage( NetPlayClient *client, void *msgBuf, s
 
 			client->currentFrame = msg->frameRun;
 			client->readyFrame   = msg->frameRdy;
-			client->gpData[0] = msg->ctrlState[0];
-			client->gpData[1] = msg->ctrlState[1];
-			client->gpData[2] = msg->ctrlState[2];
-			client->gpData[3] = msg->ctrlState[3];
+
+			// Rollback clients send their input per frame instead
+			if (rollbackFrames == 0)
+			{
+				client->gpData[0] = msg->ctrlState[0];
+				client->gpData[1] = msg->ctrlState[1];
+				client->gpData[2] = msg->ctrlState[2];
+				client->gpData[3] = msg->ctrlState[3];
+			}
 
 			client->setPaused( (msg->flags & netPlayClientState::PauseFlag ) ? true : false );
 			client->setDesync( (msg->flags & netPlayClientState::DesyncFlag) ? true : false );
 
+			if ( !client->udpActive && (client->udpPort != 0) && (msg->flags & netPlayClientState::UdpFlag) )
+			{
+				FCEU_printf("NetPlay: Sending input to '%s' over UDP\n", client->userName.toLocal8Bit().constData());
+				client->udpActive = true;
+			}
+
 			client->romMatch = (romCrc32 == msg->romCrc32);
 
 			NetPlayFrameData data;
-			if ( (msg->opsFrame == 0) || netPlayFrameData.find( msg->opsFrame, data ) )
+			if ( (msg->hashFrame == 0) || netPlayFrameData.find( msg->hashFrame, data ) )
 			{
-				//printf("Error: Server Could not find data for frame: %u\n", msg->opsFrame );
+				//printf("Error: Server Could not find data for frame: %u\n", msg->hashFrame );
 			}
 			else
 			{
-				bool opsSync   = (data.opsCrc32 == msg->opsChkSum);
-				bool ramSync   = (data.ramCrc32 == msg->ramChkSum);
+				bool stateSync = (data.stateHash == msg->stateHash);
+				bool ramSync   = (data.ramHash == msg->ramHash);
 
-				client->syncOk = client->romMatch && opsSync && ramSync;
+				client->syncOk = client->romMatch && stateSync && ramSync;
 
 				if (!client->syncOk)
 				{
-					printf("Frame:%u  is NOT in Sync: OPS:%i  RAM:%i\n", msg->frameRun, opsSync, ramSync);
+					printf("Frame:%u  is NOT in Sync: STATE:%i  RAM:%i\n", msg->hashFrame, stateSync, ramSync);
 					client->desyncCount++;
 
 					if (client->desyncCount > forceResyncCount)
@@ -696,6 +1568,26 @@ void NetPlayServer::serverProcessMessage( NetPlayClient *client, void *msgBuf, s
 			}
 		}
 		break;
+		case NETPLAY_CLIENT_INPUT:
+		{
+			NetPlayFrameInput  inputFrame;
+			netPlayClientInput *msg = static_cast<netPlayClientInput*>(msgBuf);
+			msg->toHostByteOrder();
+
+			inputFrame.frameCounter = msg->frameNum;
+			inputFrame.ctrl[0] = msg->ctrlState[0];
+			inputFrame.ctrl[1] = msg->ctrlState[1];
+			inputFrame.ctrl[2] = msg->ctrlState[2];
+			inputFrame.ctrl[3] = msg->ctrlState[3];
+
+			// UDP packets repeat the last few frames
+			if (inputFrame.frameCounter > client->lastInputFrame)
+			{
+				client->lastInputFrame = inputFrame.frameCounter;
+				client->pushBackInput( inputFrame );
+			}
+		}
+		break;
 		case NETPLAY_PING_RESP:
 		{
 
@@ -712,6 +1604,22 @@ void NetPlayServer::serverProcessMessage( NetPlayClient *client, void *msgBuf, s
 			//printf("Ping Latency ms: %llu    Avg:%f\n", static_cast<unsigned long long>(diff), client->getAvgPingDelay());
 		}
 		break;
+		case NETPLAY_ROM_DATA_REQ:
+		{
+			netPlayRomDataReq *msg = static_cast<netPlayRomDataReq*>(msgBuf);
+			msg->toHostByteOrder();
+
+			// A request for a ROM offered before the current one is answered by the newer offer
+			if ( (client->state > 0) && (memcmp( msg->md5, romFileMd5, sizeof(romFileMd5) ) == 0) )
+			{
+				FCEU_WRAPPER_LOCK();
+				sendRomLoadReq( client, true );
+				// The client drops the states sent ahead of the data
+				sendStateSyncReq( client );
+				FCEU_WRAPPER_UNLOCK();
+			}
+		}
+		break;
 		case NETPLAY_LOAD_ROM_REQ:
 		{
 			netPlayLoadRomReq *msg = static_cast<netPlayLoadRomReq*>(msgBuf);
@@ -773,8 +1681,24 @@ void NetPlayServer::serverProcessMessage( NetPlayClient *client, void *msgBuf, s
 			}
 		}
 		break;
+		case NETPLAY_SYNC_STATE_ACK:
+		{
+			netPlaySyncStateAck *msg = static_cast<netPlaySyncStateAck*>(msgBuf);
+			msg->toHostByteOrder();
+
+			if ( (msg->stateId == client->syncSentId) && client->syncSentState )
+			{
+				client->syncAckedState = client->syncSentState;
+				client->syncAckedId    = client->syncSentId;
+			}
+		}
+		break;
 		case NETPLAY_CLIENT_SYNC_REQ:
 		{
+			// The client may have lost track of its base state, send it a full one
+			client->syncAckedState.reset();
+			client->syncAckedId = 0;
+
 			FCEU_WRAPPER_LOCK();
 			resyncClient( client );
 			FCEU_WRAPPER_UNLOCK();
@@ -905,6 +1829,7 @@ void NetPlayServer::update(void)
 	uint8_t  localGP[4] = { 0 };
 	uint8_t  gpData[4] = { 0 };
 	int   numClientsPaused = 0;
+	int   numRelays = 0;
 
 	if (currFrame > maxLead)
 	{
@@ -922,6 +1847,8 @@ void NetPlayServer::update(void)
 		gpData[role] = localGP[role];
 	}
 
+	readUdp();
+
 	// Input Processing
 	for (auto it = clientList.begin(); it != clientList.end(); )
 	{
@@ -929,7 +1856,11 @@ void NetPlayServer::update(void)
 
 		client->readMessages( serverMessageCallback, client );
 
-		if (client->isAuthenticated())
+		if (client->isAuthenticated() && client->isRelay())
+		{	// A relay doesn't run the game, it only passes the input on
+			numRelays++;
+		}
+		else if (client->isAuthenticated())
 		{
 			if (client->currentFrame < clientMinFrame)
 			{
@@ -942,6 +1873,18 @@ void NetPlayServer::update(void)
 
 			if (client->isPlayerRole())
 			{
+				if (rollbackFrames > 0)
+				{
+					// Use the latest input the client has sent for the frame about to be built,
+					// if nothing arrived in time its previous input is repeated.
+					const uint32_t nextFrame = inputFrameCount + 1;
+
+					while ( client->inputAvailable() && (client->inputFrameFront() <= nextFrame) )
+					{
+						NetPlayFrameInput in = client->getNextInput();
+						client->gpData[client->role] = in.ctrl[client->role];
+					}
+				}
 				gpData[client->role] = client->gpData[client->role];
 			}
 
@@ -961,6 +1904,13 @@ void NetPlayServer::update(void)
 					clientPlayer[i] = nullptr;
 				}
 			}
+			for (auto& job : syncJobs)
+			{
+				if (job->client == client)
+				{
+					job->client = nullptr;
+				}
+			}
 			releaseRole(client);
 			delete client;
 			//printf("Emit clientDisconnected!\n");
@@ -972,11 +1922,14 @@ void NetPlayServer::update(void)
 		}
 	}
 
+	processStateSyncJobs();
+
 	hostRdyFrame = (currFrame >= inputFrameCount);
 
-	shouldRunFrame = (clientMinFrame != 0xFFFFFFFF) && 
+	// Rollback clients are expected to run ahead of the host, only lagging clients hold it back.
+	shouldRunFrame = ((clientMinFrame != 0xFFFFFFFF) || (numRelays > 0)) && 
 		(clientMinFrame >= lagFrame ) &&
-		(clientMaxFrame  < leadFrame) &&
+		((clientMaxFrame < leadFrame) || (rollbackFrames > 0)) &&
 		(numClientsPaused == 0) &&
 		 hostRdyFrame;
 
@@ -996,7 +1949,6 @@ void NetPlayServer::update(void)
 	{
 		// Output Processing
 		NetPlayFrameInput  inputFrame;
-		netPlayRunFrameReq  runFrameReq;
 
 		inputFrame.frameCounter = ++inputFrameCount;
 		inputFrame.ctrl[0] = gpData[0];
@@ -1004,28 +1956,38 @@ void NetPlayServer::update(void)
 		inputFrame.ctrl[2] = gpData[2];
 		inputFrame.ctrl[3] = gpData[3];
 
-		runFrameReq.frameNum     = inputFrame.frameCounter;
-		runFrameReq.ctrlState[0] = inputFrame.ctrl[0];
-		runFrameReq.ctrlState[1] = inputFrame.ctrl[1];
-		runFrameReq.ctrlState[2] = inputFrame.ctrl[2];
-		runFrameReq.ctrlState[3] = inputFrame.ctrl[3];
+		pushBackInput( inputFrame );
 
-		uint32_t  catchUpThreshold = maxLead;
-		if (catchUpThreshold < 3)
+		if (udpSock != nullptr)
 		{
-			catchUpThreshold = 3;
-		}
-		runFrameReq.catchUpThreshold = catchUpThreshold;
-
-		pushBackInput( inputFrame );
+			udpInputHistory.push_back( inputFrame );
 
-		runFrameReq.toNetworkByteOrder();
+			if (udpInputHistory.size() > netPlayUdpHistorySize)
+			{
+				udpInputHistory.pop_front();
+			}
+		}
 
 		for (auto& client : clientList )
 		{
 			if (client->state > 0)
 			{
-				sendMsg( client, &runFrameReq, sizeof(runFrameReq) );
+				if (client->syncInProgress)
+				{	// Has to go after the sync state that is being prepared
+					client->deferredInput.push_back( inputFrame );
+				}
+				else
+				{
+					sendRunFrameReq( client, inputFrame );
+				}
+
+				// Spectators joining a relay start from its latest keyframe
+				if (client->isRelay() && ((inputFrame.frameCounter % netPlayRelayKeyframeInterval) == 0))
+				{
+					FCEU_WRAPPER_LOCK();
+					sendStateSyncReq( client, true );
+					FCEU_WRAPPER_UNLOCK();
+				}
 			}
 		}
 	}
@@ -1037,15 +1999,37 @@ void NetPlayServer::update(void)
 		FCEU::timeStampRecord ts;
 		ts.readNew();
 
-		netPlayPingReq  ping;
-		ping.hostTimeStamp = ts.toMilliSeconds();
-		ping.toNetworkByteOrder();
-
 		for (auto& client : clientList )
 		{
 			if (client->state > 0)
 			{
-				sendMsg( client, &ping, sizeof(ping) );
+				netPlayPingReq  ping;
+				ping.hostTimeStamp = ts.toMilliSeconds();
+				ping.avgPingDelay  = static_cast<uint32_t>(client->getAvgPingDelay());
+
+				if (client->udpActive)
+				{
+					ping.toNetworkByteOrder();
+					sendUdpPacket( client, &ping, sizeof(ping) );
+				}
+				else
+				{
+					sendMsg( client, &ping, sizeof(ping), [&ping]{ ping.toNetworkByteOrder(); } );
+				}
+			}
+		}
+	}
+
+	if (udpSock != nullptr)
+	{
+		for (auto& client : clientList )
+		{
+			// Input goes out as it is run, and again every few cycles in case the last packets were lost.
+			// Until the client confirms that it gets UDP packets, one now and then lets it find out.
+			if ( (client->state > 0) && (client->udpPort != 0) &&
+			     (client->udpActive ? (shouldRunFrame || ((cycleCounter % 4) == 0)) : ((cycleCounter % 30) == 0)) )
+			{
+				sendUdpPacket( client );
 			}
 		}
 	}
@@ -1055,6 +2039,10 @@ void NetPlayServer::update(void)
 	{
 		for (auto& client : clientList )
 		{
+			if ( client->isRelay() && (!shouldRunFrame || (client->relayInput.size() >= netPlayRelayBatchFrames)) )
+			{
+				sendRunFrameBatch( client );
+			}
 			client->flushData();
 		}
 	}
@@ -1141,12 +2129,6 @@ int NetPlayClient::Create(QObject *parent)
 			printf("Error Creating Netplay Client!!!\n");
 		}
 	}
-	FCEU_WRAPPER_LOCK();
-	if (traceRegistrationHandle == nullptr)
-	{
-		traceRegistrationHandle = FCEUI_TraceInstructionRegister( NetPlayTraceInstruction );
-	}
-	FCEU_WRAPPER_UNLOCK();
 	return 0;
 }
 
@@ -1158,16 +2140,6 @@ int NetPlayClient::Destroy()
 		delete client;
 		client = nullptr;
 	}
-	FCEU_WRAPPER_LOCK();
-	if (traceRegistrationHandle != nullptr)
-	{
-		if ( !FCEUI_TraceInstructionUnregisterHandle( traceRegistrationHandle ) )
-		{
-			printf("Unregister Trace Callback Error\n");
-		}
-		traceRegistrationHandle = nullptr;
-	}
-	FCEU_WRAPPER_UNLOCK();
 	return 0;
 }
 //-----------------------------------------------------------------------------
@@ -1206,6 +2178,11 @@ bool NetPlayClient::isPlayerRole()
 	return (role >= NETPLAY_PLAYER1) && (role <= NETPLAY_PLAYER4);
 }
 //-----------------------------------------------------------------------------
+bool NetPlayClient::isRelay()
+{
+	return (role == NETPLAY_RELAY);
+}
+//-----------------------------------------------------------------------------
 bool NetPlayClient::flushData()
 {
 	bool success = false;
@@ -1415,74 +2392,435 @@ int NetPlayClient::requestSync(void)
 	return 0;
 }
 //-----------------------------------------------------------------------------
-void NetPlayClient::recordPingResult( uint64_t delay_ms )
+void NetPlayClient::recordPingResult( uint64_t delay_ms )
+{
+	pingNumSamples++;
+	pingDelayLast = delay_ms;
+	pingDelaySum += delay_ms;
+}
+//-----------------------------------------------------------------------------
+void NetPlayClient::resetPingData()
+{
+	pingNumSamples = 0;
+	pingDelayLast = 0;
+	pingDelaySum = 0;
+}
+//-----------------------------------------------------------------------------
+double NetPlayClient::getAvgPingDelay()
+{
+	double ms = 0.0;
+	if (pingNumSamples > 0)
+	{
+		ms = static_cast<double>(pingDelaySum) / static_cast<double>(pingNumSamples);
+	}
+	return ms;
+}
+//-----------------------------------------------------------------------------
+static void clientMessageCallback( void *userData, void *msgBuf, size_t msgSize )
+{
+	NetPlayClient *client = static_cast<NetPlayClient*>(userData);
+
+	client->clientProcessMessage( msgBuf, msgSize );
+}
+//-----------------------------------------------------------------------------
+void NetPlayClient::update(void)
+{
+	readMessages( clientMessageCallback, this );
+	readUdp();
+
+	if (_connected)
+	{
+		NetPlayFrameInput localFrame;
+		while (getNextLocalInput(localFrame))
+		{
+			if (udpActive)
+			{	// Every packet repeats the last few frames
+				udpLocalInput.push_back( localFrame );
+
+				while (udpLocalInput.size() > std::max( udpRedundancy, 1u ))
+				{
+					udpLocalInput.pop_front();
+				}
+				continue;
+			}
+			netPlayClientInput  inputMsg;
+			inputMsg.frameNum     = localFrame.frameCounter;
+			inputMsg.ctrlState[0] = localFrame.ctrl[0];
+			inputMsg.ctrlState[1] = localFrame.ctrl[1];
+			inputMsg.ctrlState[2] = localFrame.ctrl[2];
+			inputMsg.ctrlState[3] = localFrame.ctrl[3];
+
+			inputMsg.toNetworkByteOrder();
+			sock->write( reinterpret_cast<const char*>(&inputMsg), sizeof(inputMsg) );
+		}
+
+		if (!udpActive)
+		{
+			netPlayClientState  statusMsg;
+
+			fillClientState( statusMsg );
+
+			statusMsg.toNetworkByteOrder();
+			sock->write( reinterpret_cast<const char*>(&statusMsg), sizeof(statusMsg) );
+		}
+
+		// Until the host's packets come in, this tells it where to send them
+		if (udpSock != nullptr)
+		{
+			sendUdpPacket();
+		}
+		flushData();
+	}
+
+	if (!stats.path.isEmpty())
+	{
+		writeStats();
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlayClient::fillClientState( netPlayClientState &statusMsg )
+{
+	uint32_t currFrame = static_cast<uint32_t>(currFrameCounter);
+	uint32_t ctlrData = localGamepadState( currFrame );
+
+	// Rollback clients send the buttons of each frame they run instead
+	if ( (rollbackFrames == 0) && isPlayerRole() )
+	{
+		statsLocalPad( (ctlrData >> (8 * role)) & 0x000000ff );
+	}
+
+	NetPlayFrameData lastFrameData;
+	netPlayFrameData.getLast( lastFrameData );
+
+	statusMsg.flags     = 0;
+	if (FCEUI_EmulationPaused())
+	{
+		statusMsg.flags |= netPlayClientState::PauseFlag;
+	}
+	if (desyncCount > 0)
+	{
+		statusMsg.flags |= netPlayClientState::DesyncFlag;
+	}
+	if (udpActive)
+	{
+		statusMsg.flags |= netPlayClientState::UdpFlag;
+	}
+	statusMsg.frameRdy  = lastInputFrame;
+	statusMsg.frameRun  = currFrame;
+	statusMsg.hashFrame = lastFrameData.frameNum;
+	statusMsg.stateHash = lastFrameData.stateHash;
+	statusMsg.ramHash   = lastFrameData.ramHash;
+	statusMsg.romCrc32  = romCrc32;
+	statusMsg.ctrlState[0] = (ctlrData      ) & 0x000000ff;
+	statusMsg.ctrlState[1] = (ctlrData >>  8) & 0x000000ff;
+	statusMsg.ctrlState[2] = (ctlrData >> 16) & 0x000000ff;
+	statusMsg.ctrlState[3] = (ctlrData >> 24) & 0x000000ff;
+}
+//-----------------------------------------------------------------------------
+bool NetPlayClient::loadScriptedInput( const char *fm2Path )
+{
+	FILE *fp = ::fopen( fm2Path, "r" );
+	char line[512];
+
+	scriptedInput.clear();
+
+	if ( (fp == nullptr) || !isPlayerRole() )
+	{
+		if (fp != nullptr)
+		{
+			::fclose(fp);
+		}
+		return false;
+	}
+	while ( fgets( line, sizeof(line), fp ) != nullptr )
+	{
+		if (line[0] != '|')
+		{
+			continue;
+		}
+		// |commands|port0|port1|...
+		const char *field = line;
+
+		for (int i=0; (i < (role + 1)) && (field != nullptr); i++)
+		{
+			field = strchr( field + 1, '|' );
+		}
+		uint8_t pad = 0;
+
+		for (int i=0; (field != nullptr) && (i<8); i++)
+		{
+			const char c = field[i+1];
+
+			if ( (c == '|') || (c == '\0') || (c == '\n') || (c == '\r') )
+			{
+				break;
+			}
+			if ( (c != '.') && (c != ' ') )
+			{	// RLDUTSBA
+				pad |= 0x80 >> i;
+			}
+		}
+		scriptedInput.push_back( pad );
+	}
+	::fclose(fp);
+
+	return !scriptedInput.empty();
+}
+//-----------------------------------------------------------------------------
+uint32_t NetPlayClient::localGamepadState( uint32_t frame )
+{
+	if (scriptedInput.empty())
+	{
+		return GetGamepadPressedImmediate();
+	}
+	return static_cast<uint32_t>( scriptedInput[ frame % scriptedInput.size() ] ) << (8 * role);
+}
+//-----------------------------------------------------------------------------
+static uint64_t netPlayStatsNow(void)
+{
+	FCEU::timeStampRecord ts;
+	ts.readNew();
+
+	return ts.toMilliSeconds();
+}
+//-----------------------------------------------------------------------------
+void NetPlayClient::statsLocalPad( uint8_t pad )
+{
+	if (stats.path.isEmpty())
+	{
+		return;
+	}
+	FCEU::autoScopedLock alock(inputMtx);
+
+	if ( (stats.syncedAt != 0) && (pad != stats.pad) )
+	{
+		stats.pad = pad;
+		stats.padChangedAt = netPlayStatsNow();
+	}
+}
+//-----------------------------------------------------------------------------
+// Called with inputMtx held, as the host's input comes in
+void NetPlayClient::statsHostInput( const NetPlayFrameInput &in )
+{
+	if ( isPlayerRole() && (in.ctrl[role] == stats.pad) )
+	{
+		stats.latency.push_back( static_cast<uint32_t>( netPlayStatsNow() - stats.padChangedAt ) );
+		stats.padChangedAt = 0;
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlayClient::statsFrameRun(void)
 {
-	pingNumSamples++;
-	pingDelayLast = delay_ms;
-	pingDelaySum += delay_ms;
+	if (stats.path.isEmpty())
+	{
+		return;
+	}
+	FCEU::autoScopedLock alock(inputMtx);
+
+	if (stats.syncedAt != 0)
+	{
+		stats.framesRun++;
+	}
 }
 //-----------------------------------------------------------------------------
-void NetPlayClient::resetPingData()
+void NetPlayClient::statsFrameWait( bool wait )
 {
-	pingNumSamples = 0;
-	pingDelayLast = 0;
-	pingDelaySum = 0;
+	if (stats.path.isEmpty())
+	{
+		return;
+	}
+	FCEU::autoScopedLock alock(inputMtx);
+
+	if (stats.syncedAt == 0)
+	{
+		return;
+	}
+	if (wait && (stats.waitSince == 0))
+	{
+		stats.waitSince = netPlayStatsNow();
+	}
+	else if (!wait && (stats.waitSince != 0))
+	{
+		stats.stallTime += netPlayStatsNow() - stats.waitSince;
+		stats.waitSince = 0;
+	}
 }
 //-----------------------------------------------------------------------------
-double NetPlayClient::getAvgPingDelay()
+void NetPlayClient::statsSyncLoaded(void)
 {
-	double ms = 0.0;
-	if (pingNumSamples > 0)
+	if (stats.path.isEmpty())
 	{
-		ms = static_cast<double>(pingDelaySum) / static_cast<double>(pingNumSamples);
+		return;
+	}
+	FCEU::autoScopedLock alock(inputMtx);
+
+	if (stats.syncedAt == 0)
+	{
+		stats.syncedAt = netPlayStatsNow();
+	}
+	// The first state of a ROM starts the session, any later one corrects a desync
+	if (stats.statesThisRom++ > 0)
+	{
+		stats.resyncs++;
 	}
-	return ms;
 }
 //-----------------------------------------------------------------------------
-static void clientMessageCallback( void *userData, void *msgBuf, size_t msgSize )
+void NetPlayClient::writeStats(void)
 {
-	NetPlayClient *client = static_cast<NetPlayClient*>(userData);
+	const uint64_t now = netPlayStatsNow();
+	std::vector <uint32_t> latency;
+	uint64_t seconds, stallTime;
+	uint32_t framesRun, resyncs, romFetches;
 
-	client->clientProcessMessage( msgBuf, msgSize );
+	{
+		FCEU::autoScopedLock alock(inputMtx);
+
+		if ( (stats.syncedAt == 0) || (now < stats.nextWrite) )
+		{
+			return;
+		}
+		stats.nextWrite = now + 500;
+
+		latency    = stats.latency;
+		seconds    = now - stats.syncedAt;
+		stallTime  = stats.stallTime + ((stats.waitSince != 0) ? (now - stats.waitSince) : 0);
+		framesRun  = stats.framesRun;
+		resyncs    = stats.resyncs;
+		romFetches = stats.romFetches;
+	}
+	std::sort( latency.begin(), latency.end() );
+
+	double avg = 0.0;
+
+	for (auto& ms : latency)
+	{
+		avg += ms;
+	}
+	if (!latency.empty())
+	{
+		avg /= latency.size();
+	}
+	// Written next to it and renamed, so that the file read is always whole
+	std::string path = stats.path.toLocal8Bit().constData();
+	std::string tmpPath = path + ".tmp";
+	FILE *fp = ::fopen( tmpPath.c_str(), "w" );
+
+	if (fp == nullptr)
+	{
+		return;
+	}
+	fprintf( fp, "seconds %.1f\n", seconds / 1000.0 );
+	fprintf( fp, "frames %u\n", framesRun );
+	fprintf( fp, "latency_ms %zu %.1f %u %u\n", latency.size(), avg,
+			latency.empty() ? 0 : latency[ (latency.size() * 95) / 100 ],
+			latency.empty() ? 0 : latency.back() );
+	fprintf( fp, "stall_ms %llu\n", static_cast<unsigned long long>(stallTime) );
+	fprintf( fp, "resyncs %u\n", resyncs );
+	fprintf( fp, "rom_fetches %u\n", romFetches );
+	fprintf( fp, "udp %i\n", udpActive ? 1 : 0 );
+	::fclose(fp);
+
+	if (::rename( tmpPath.c_str(), path.c_str() ) != 0)
+	{	// Windows doesn't replace a file that exists
+		::remove( path.c_str() );
+		::rename( tmpPath.c_str(), path.c_str() );
+	}
 }
 //-----------------------------------------------------------------------------
-void NetPlayClient::update(void)
+void NetPlayClient::readUdp(void)
 {
-	readMessages( clientMessageCallback, this );
+	alignas(8) char buf[netPlayUdpMaxPacketSize];
 
-	if (_connected)
+	while ( (udpSock != nullptr) && udpSock->hasPendingDatagrams() )
 	{
-		uint32_t ctlrData = GetGamepadPressedImmediate();
-		uint32_t currFrame = static_cast<uint32_t>(currFrameCounter);
+		netPlayUdpPacket pkt;
 
-		NetPlayFrameData lastFrameData;
-		netPlayFrameData.getLast( lastFrameData );
+		qint64 size = udpSock->readDatagram( buf, sizeof(buf) );
 
-		netPlayClientState  statusMsg;
-		statusMsg.flags     = 0;
-		if (FCEUI_EmulationPaused())
+		if ( (size < static_cast<qint64>(sizeof(netPlayUdpPacket))) || (size >= static_cast<qint64>(sizeof(buf))) )
 		{
-			statusMsg.flags |= netPlayClientState::PauseFlag;
+			continue;
 		}
-		if (desyncCount > 0)
+		memcpy( &pkt, buf, sizeof(pkt) );
+		pkt.toHostByteOrder();
+
+		if ( (pkt.token != udpToken) || (pkt.seq <= udpRecvSeq) )
 		{
-			statusMsg.flags |= netPlayClientState::DesyncFlag;
+			continue;
 		}
-		statusMsg.frameRdy  = inputFrameBack();
-		statusMsg.frameRun  = currFrame;
-		statusMsg.opsFrame  = lastFrameData.frameNum;
-		statusMsg.opsChkSum = lastFrameData.opsCrc32;
-		statusMsg.ramChkSum = lastFrameData.ramCrc32;
-		statusMsg.romCrc32  = romCrc32;
-		statusMsg.ctrlState[0] = (ctlrData      ) & 0x000000ff;
-		statusMsg.ctrlState[1] = (ctlrData >>  8) & 0x000000ff;
-		statusMsg.ctrlState[2] = (ctlrData >> 16) & 0x000000ff;
-		statusMsg.ctrlState[3] = (ctlrData >> 24) & 0x000000ff;
 
-		statusMsg.toNetworkByteOrder();
-		sock->write( reinterpret_cast<const char*>(&statusMsg), sizeof(statusMsg) );
+		bool valid = netPlayUdpUnpack( buf, size, pkt, [this](uint32_t msgId, char *msgBuf, size_t msgSize)
+		{
+			if (msgId == NETPLAY_RUN_FRAME_BATCH)
+			{
+				netPlayRunFrameBatch *batch = reinterpret_cast<netPlayRunFrameBatch*>(msgBuf);
 
-		flushData();
+				// Input that was sent ahead of the last state loaded, or that follows one still on its way
+				if ( (msgSize < (sizeof(netPlayRunFrameBatch) - sizeof(netPlayMsgHdr))) ||
+				     (netPlayByteSwap(batch->stateId) != syncBaseId) )
+				{
+					return;
+				}
+				clientProcessMessage( msgBuf, msgSize );
+			}
+			else if (msgId == NETPLAY_PING_REQ)
+			{
+				clientProcessMessage( msgBuf, msgSize );
+			}
+		});
+		if (!valid)
+		{
+			continue;
+		}
+		udpRecvSeq = pkt.seq;
+
+		if (!udpActive)
+		{
+			FCEU_printf("NetPlay: Receiving input over UDP\n");
+			udpActive = true;
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlayClient::sendUdpPacket( const void *msg, size_t msgSize )
+{
+	alignas(8) char buf[netPlayUdpMaxPacketSize];
+	netPlayUdpPacket pkt;
+	netPlayClientState statusMsg;
+	size_t size = sizeof(netPlayUdpPacket);
+
+	fillClientState( statusMsg );
+	statusMsg.toNetworkByteOrder();
+	memcpy( &buf[size], &statusMsg, sizeof(statusMsg) );
+	size += sizeof(statusMsg);
+
+	for (auto& localFrame : udpLocalInput)
+	{
+		netPlayClientInput  inputMsg;
+		inputMsg.frameNum     = localFrame.frameCounter;
+		inputMsg.ctrlState[0] = localFrame.ctrl[0];
+		inputMsg.ctrlState[1] = localFrame.ctrl[1];
+		inputMsg.ctrlState[2] = localFrame.ctrl[2];
+		inputMsg.ctrlState[3] = localFrame.ctrl[3];
+
+		inputMsg.toNetworkByteOrder();
+		memcpy( &buf[size], &inputMsg, sizeof(inputMsg) );
+		size += sizeof(inputMsg);
+	}
+	if ( (msg != nullptr) && ((size + msgSize) <= sizeof(buf)) )
+	{
+		memcpy( &buf[size], msg, msgSize );
+		size += msgSize;
+	}
+	pkt.hdr.msgSize = size;
+	pkt.token       = udpToken;
+	pkt.seq         = ++udpSendSeq;
+	pkt.toNetworkByteOrder();
+	memcpy( buf, &pkt, sizeof(pkt) );
+
+	if (!netPlayUdpDropPacket())
+	{
+		udpSock->writeDatagram( buf, size, udpAddr, udpPort );
 	}
 }
 //-----------------------------------------------------------------------------
@@ -1643,12 +2981,63 @@ void NetPlayClient::clientProcessMessage( void *msgBuf, size_t msgSize )
 
 			FCEU_printf("Load ROM Request Received: %s\n", msg->fileName);
 
-			tmpFile.setFileTemplate(QString("tmpRomXXXXXX.nes"));
-			tmpFile.open();
-			QString filepath = tmpFile.fileName();
-			printf("Dumping Temp Rom to: %s\n", tmpFile.fileName().toLocal8Bit().constData());
-			tmpFile.write( romData, msgSize );
-			tmpFile.close();
+			QString filepath = netPlayRomCachePath( msg->md5 );
+
+			if (msg->flags & netPlayLoadRomReq::CacheFlag)
+			{
+				if (!netPlayRomCacheHas( filepath, msg->md5 ))
+				{
+					FCEU_printf("NetPlay: ROM is not in the cache, requesting it from the host\n");
+					netPlayRomDataReq req;
+					memcpy( req.md5, msg->md5, sizeof(req.md5) );
+					req.toNetworkByteOrder();
+					sock->write( reinterpret_cast<const char*>(&req), sizeof(req) );
+
+					romFetchPending = true;
+
+					if (!stats.path.isEmpty())
+					{
+						FCEU::autoScopedLock alock(inputMtx);
+						stats.romFetches++;
+					}
+					break;
+				}
+				FCEU_printf("NetPlay: Loading ROM from cache: %s\n", filepath.toLocal8Bit().constData());
+			}
+			else
+			{
+				if ( (msgSize + sizeof(netPlayMsgHdr)) < (sizeof(netPlayLoadRomReq) + msg->fileSize) )
+				{
+					break;
+				}
+				uint8_t md5[16];
+				netPlayRomMd5( romData, msg->fileSize, md5 );
+
+				// Stored under the hash of what actually came in
+				filepath = netPlayRomCachePath( md5 );
+				QFile cacheFile( filepath );
+
+				if ( cacheFile.open(QIODevice::WriteOnly) &&
+				     (cacheFile.write( romData, msg->fileSize ) == static_cast<qint64>(msg->fileSize)) )
+				{
+					printf("Saved ROM to cache: %s\n", filepath.toLocal8Bit().constData());
+					cacheFile.close();
+				}
+				else
+				{
+					cacheFile.close();
+					cacheFile.remove();
+
+					tmpFile.setFileTemplate(QString("tmpRomXXXXXX.nes"));
+					tmpFile.open();
+					filepath = tmpFile.fileName();
+					printf("Dumping Temp Rom to: %s\n", tmpFile.fileName().toLocal8Bit().constData());
+					tmpFile.write( romData, msg->fileSize );
+					tmpFile.close();
+				}
+			}
+			romFetchPending = false;
+			stats.statesThisRom = 0;
 
 			FCEU_WRAPPER_LOCK();
 			LoadGame( filepath.toLocal8Bit().constData(), true, true );
@@ -1658,6 +3047,9 @@ void NetPlayClient::clientProcessMessage( void *msgBuf, size_t msgSize )
 		break;
 		case NETPLAY_UNLOAD_ROM_REQ:
 		{
+			romFetchPending = false;
+			stats.statesThisRom = 0;
+
 			FCEU_WRAPPER_LOCK();
 			CloseGame();
 			FCEU_WRAPPER_UNLOCK();
@@ -1668,22 +3060,64 @@ void NetPlayClient::clientProcessMessage( void *msgBuf, size_t msgSize )
 			netPlayLoadStateResp* msg = static_cast<netPlayLoadStateResp*>(msgBuf);
 			msg->toHostByteOrder();
 
-			char *stateData = msg->stateDataBuf();
 			const uint32_t stateDataSize = msg->stateDataSize();
 
-			FCEU_printf("Sync state Request Received: %u\n", stateDataSize);
+			FCEU_printf("Sync state Request Received: %u%s\n", stateDataSize,
+					(msg->flags & netPlayLoadStateResp::DeltaFlag) ? " (delta)" : "");
+
+			if (romFetchPending)
+			{	// Goes with a ROM not loaded yet, the host sends another one after the ROM data
+				FCEU_printf("NetPlay: Dropping sync state, still waiting for the ROM\n");
+				break;
+			}
+
+			std::vector <uint8_t> state;
 
-			EMUFILE_MEMORY em( stateData, stateDataSize );
+			if ( !netPlayDecodeSyncState( msg, syncBaseState, syncBaseId, state ) )
+			{
+				FCEU_printf("NetPlay: Could not apply sync state, requesting a full state\n");
+				syncBaseState.clear();
+				syncBaseId = 0;
+				requestSync();
+				break;
+			}
+			EMUFILE_MEMORY em( &state );
 
 			FCEU_WRAPPER_LOCK();
 			serverRequestedStateLoad = true;
 			FCEUSS_LoadFP( &em, SSLOADPARAM_NOBACKUP );
 			serverRequestedStateLoad = false;
-			FCEU_WRAPPER_UNLOCK();
 
-			opsCrc32 = msg->opsCrc32;
+			// The frame counter is only part of the state while a movie is active
+			if (FCEUMOV_Mode(MOVIEMODE_INACTIVE))
+			{
+				currFrameCounter = msg->frameNum;
+			}
 			netPlayFrameData.reset();
-			inputClear();
+			netPlayRollback.reset( rollbackFrames, static_cast<uint32_t>(currFrameCounter) );
+
+			inputRewind( static_cast<uint32_t>(currFrameCounter), msg->inputFrame );
+
+			lastInputFrame = inputFrameBack();
+			if (lastInputFrame == 0)
+			{
+				lastInputFrame = static_cast<uint32_t>(currFrameCounter);
+			}
+			FCEU_WRAPPER_UNLOCK();
+
+			statsSyncLoaded();
+
+			// Later syncs can be sent as a delta against this state
+			syncBaseState.swap(state);
+			syncBaseId = msg->stateId;
+
+			if (msg->stateId != 0)
+			{
+				netPlaySyncStateAck ack;
+				ack.stateId = msg->stateId;
+				ack.toNetworkByteOrder();
+				sock->write( reinterpret_cast<const char*>(&ack), sizeof(ack) );
+			}
 		}
 		break;
 		case NETPLAY_RUN_FRAME_REQ:
@@ -1699,19 +3133,82 @@ void NetPlayClient::clientProcessMessage( void *msgBuf, size_t msgSize )
 			inputFrame.ctrl[3] = msg->ctrlState[3];
 
 			catchUpThreshold   = msg->catchUpThreshold;
+			rollbackFrames     = msg->rollbackFrames;
 
-			uint32_t lastInputFrame = inputFrameBack();
+			uint32_t lastQueuedFrame = inputFrameBack();
 			uint32_t currFrame = static_cast<uint32_t>(currFrameCounter);
 
-			if (inputFrame.frameCounter > lastInputFrame)
+			if (inputFrame.frameCounter > lastQueuedFrame)
 			{
 				pushBackInput( inputFrame );
+				lastInputFrame = inputFrame.frameCounter;
 			}
 			else
 			{
-				printf("Drop Frame: LastRun:%u   LastInput:%u   NewInput:%u\n", currFrame, lastInputFrame, inputFrame.frameCounter);
+				printf("Drop Frame: LastRun:%u   LastInput:%u   NewInput:%u\n", currFrame, lastQueuedFrame, inputFrame.frameCounter);
+			}
+			//printf("Run Frame: LastRun:%u   LastInput:%u   NewInput:%u\n", currFrame, lastQueuedFrame, inputFrame.frameCounter);
+		}
+		break;
+		case NETPLAY_RUN_FRAME_BATCH:
+		{
+			netPlayRunFrameBatch *msg = static_cast<netPlayRunFrameBatch*>(msgBuf);
+			msg->toHostByteOrder();
+
+			if ( (msg->frameCount > recvMsgBufSize / 4) ||
+			     ((sizeof(netPlayRunFrameBatch) + (msg->frameCount * 4)) > (msgSize + sizeof(netPlayMsgHdr))) )
+			{
+				printf("Error: Run frame batch is truncated\n");
+				break;
+			}
+			const uint8_t *ctrlData = msg->ctrlDataBuf();
+
+			catchUpThreshold   = msg->catchUpThreshold;
+			rollbackFrames     = msg->rollbackFrames;
+
+			for (uint32_t i=0; i<msg->frameCount; i++)
+			{
+				NetPlayFrameInput  inputFrame;
+
+				inputFrame.frameCounter = msg->firstFrame + i;
+				memcpy( inputFrame.ctrl, &ctrlData[i*4], sizeof(inputFrame.ctrl) );
+
+				if (inputFrame.frameCounter <= lastInputFrame)
+				{	// Already have it, UDP packets repeat the last few frames
+					continue;
+				}
+				if ( (lastInputFrame != 0) && (inputFrame.frameCounter != (lastInputFrame + 1)) )
+				{	// Packets got lost, the host sends the missing frames again
+					break;
+				}
+				pushBackInput( inputFrame );
+				lastInputFrame = inputFrame.frameCounter;
+			}
+		}
+		break;
+		case NETPLAY_UDP_SETUP:
+		{
+			netPlayUdpSetup *msg = static_cast<netPlayUdpSetup*>(msgBuf);
+			msg->toHostByteOrder();
+
+			if (udpSock == nullptr)
+			{
+				udpSock = new QUdpSocket(this);
+
+				if (!udpSock->bind( QHostAddress::Any, 0 ))
+				{
+					FCEU_printf("NetPlay: Could not open a UDP socket, staying on TCP: %s\n", udpSock->errorString().toLocal8Bit().constData());
+					delete udpSock;
+					udpSock = nullptr;
+					break;
+				}
 			}
-			//printf("Run Frame: LastRun:%u   LastInput:%u   NewInput:%u\n", currFrame, lastInputFrame, inputFrame.frameCounter);
+			FCEU_printf("NetPlay: Host offers UDP on port %u\n", msg->port);
+
+			udpAddr       = sock->peerAddress();
+			udpPort       = msg->port;
+			udpToken      = msg->token;
+			udpRedundancy = msg->redundancy;
 		}
 		break;
 		case NETPLAY_PING_REQ:
@@ -1720,9 +3217,19 @@ void NetPlayClient::clientProcessMessage( void *msgBuf, size_t msgSize )
 			netPlayPingReq *ping = static_cast<netPlayPingReq*>(msgBuf);
 			ping->toHostByteOrder();
 
+			hostPingDelay = ping->avgPingDelay;
+
 			pong.hostTimeStamp = ping->hostTimeStamp;
 			pong.toNetworkByteOrder();
-			sock->write( (const char*)&pong, sizeof(netPlayPingResp) );
+
+			if (udpActive)
+			{
+				sendUdpPacket( &pong, sizeof(pong) );
+			}
+			else
+			{
+				sock->write( (const char*)&pong, sizeof(netPlayPingResp) );
+			}
 		}
 		break;
 		default:
@@ -1825,21 +3332,43 @@ NetPlayHostDialog::NetPlayHostDialog(QWidget *parent)
 	grid->addWidget( lbl, 0, 0, 1, 1 );
 	grid->addWidget( frameLeadSpinBox, 0, 1, 1, 1 );
 
+	int rollbackFrames = 0;
+	g_config->getOption("SDL.NetPlayHostRollbackFrames", &rollbackFrames);
+	lbl = new QLabel( tr("Rollback Frames:") );
+	rollbackSpinBox = new QSpinBox();
+	rollbackSpinBox->setRange(0,20);
+	rollbackSpinBox->setValue(rollbackFrames);
+	rollbackSpinBox->setSpecialValueText( tr("Off") );
+	rollbackSpinBox->setToolTip( tr("Let clients run ahead on predicted input and correct it when the host's input arrives.\nOff waits for the host's input every frame.") );
+	grid->addWidget( lbl, 1, 0, 1, 1 );
+	grid->addWidget( rollbackSpinBox, 1, 1, 1, 1 );
+
+	int udpRedundancy = 0;
+	g_config->getOption("SDL.NetPlayHostUdpRedundancy", &udpRedundancy);
+	lbl = new QLabel( tr("UDP Input Redundancy:") );
+	udpRedundancySpinBox = new QSpinBox();
+	udpRedundancySpinBox->setRange(0,16);
+	udpRedundancySpinBox->setValue(udpRedundancy);
+	udpRedundancySpinBox->setSpecialValueText( tr("Off") );
+	udpRedundancySpinBox->setToolTip( tr("Send input, client state and pings over UDP on the same port, every packet repeating the input of this many frames, so that a lost packet doesn't hold up the frames after it.\nOff sends everything over TCP.") );
+	grid->addWidget( lbl, 2, 0, 1, 1 );
+	grid->addWidget( udpRedundancySpinBox, 2, 1, 1, 1 );
+
 	bool enforceAppVersionChk = false;
 	enforceAppVersionChkCBox = new QCheckBox(tr("Enforce Client Versions Match"));
-	grid->addWidget( enforceAppVersionChkCBox, 1, 0, 1, 2 );
+	grid->addWidget( enforceAppVersionChkCBox, 3, 0, 1, 2 );
 	g_config->getOption("SDL.NetPlayHostEnforceAppVersionChk", &enforceAppVersionChk);
 	enforceAppVersionChkCBox->setChecked(enforceAppVersionChk);
 
 	bool romLoadReqEna = false;
 	allowClientRomReqCBox = new QCheckBox(tr("Allow Client ROM Load Requests"));
-	grid->addWidget( allowClientRomReqCBox, 2, 0, 1, 2 );
+	grid->addWidget( allowClientRomReqCBox, 4, 0, 1, 2 );
 	g_config->getOption("SDL.NetPlayHostAllowClientRomLoadReq", &romLoadReqEna);
 	allowClientRomReqCBox->setChecked(romLoadReqEna);
 
 	bool stateLoadReqEna = false;
 	allowClientStateReqCBox = new QCheckBox(tr("Allow Client State Load Requests"));
-	grid->addWidget( allowClientStateReqCBox, 3, 0, 1, 2 );
+	grid->addWidget( allowClientStateReqCBox, 5, 0, 1, 2 );
 	g_config->getOption("SDL.NetPlayHostAllowClientStateLoadReq", &stateLoadReqEna);
 	allowClientStateReqCBox->setChecked(stateLoadReqEna);
 
@@ -1925,6 +3454,8 @@ void NetPlayHostDialog::onStartClicked(void)
 	server->setRole( playerRoleBox->currentData().toInt() );
 	server->sessionName = sessionNameEntry->text();
 	server->setMaxLeadFrames( frameLeadSpinBox->value() );
+	server->setRollbackFrames( rollbackSpinBox->value() );
+	server->setUdpRedundancy( udpRedundancySpinBox->value() );
 	server->setEnforceAppVersionCheck( enforceAppVersionChkCBox->isChecked() );
 	server->setAllowClientRomLoadRequest( allowClientRomReqCBox->isChecked() );
 	server->setAllowClientStateLoadRequest( allowClientStateReqCBox->isChecked() );
@@ -1937,7 +3468,13 @@ void NetPlayHostDialog::onStartClicked(void)
 
 	if (listenSucceeded)
 	{
+		if (server->getUdpRedundancy() > 0)
+		{
+			server->openUdp( netPort );
+		}
 		g_config->setOption("SDL.NetworkPort", netPort);
+		g_config->setOption("SDL.NetPlayHostRollbackFrames", rollbackSpinBox->value());
+		g_config->setOption("SDL.NetPlayHostUdpRedundancy", udpRedundancySpinBox->value());
 		done(0);
 		deleteLater();
 	}
@@ -2567,7 +4104,17 @@ int NetPlayFrameWait(void)
 
 	if (client)
 	{
-		wait = client->inputAvailable() == 0;
+		if (netPlayRollback.active())
+		{
+			const uint32_t nextFrame = static_cast<uint32_t>(currFrameCounter) + 1;
+
+			wait = nextFrame > (netPlayRollback.lastConfirmed + netPlayRollback.leadFrames(client));
+		}
+		else
+		{
+			wait = client->inputAvailable() == 0;
+		}
+		client->statsFrameWait( wait != 0 );
 	}
 	else
 	{
@@ -2581,6 +4128,26 @@ int NetPlayFrameWait(void)
 	return wait;
 }
 //----------------------------------------------------------------------------
+void NetPlayRollbackUpdate(void)
+{
+	NetPlayClient *client = NetPlayClient::GetInstance();
+
+	if ( (client == nullptr) || (GameInfo == nullptr) || (client->rollbackFrames == 0) )
+	{
+		if (netPlayRollback.active())
+		{
+			netPlayRollback.reset( 0, 0 );
+		}
+		return;
+	}
+
+	if (netPlayRollback.frames.size() != (client->rollbackFrames + 1))
+	{
+		netPlayRollback.reset( client->rollbackFrames, static_cast<uint32_t>(currFrameCounter) );
+	}
+	netPlayRollback.update( client );
+}
+//----------------------------------------------------------------------------
 bool NetPlaySkipWait(void)
 {
 	bool skip = false;
@@ -2589,7 +4156,14 @@ bool NetPlaySkipWait(void)
 
 	if (client)
 	{
-		skip = client->inputAvailableCount() > client->catchUpThreshold;
+		if (netPlayRollback.active())
+		{
+			skip = netPlayRollback.lastConfirmed > (static_cast<uint32_t>(currFrameCounter) + client->catchUpThreshold);
+		}
+		else
+		{
+			skip = client->inputAvailableCount() > client->catchUpThreshold;
+		}
 	}
 	return skip;
 }
@@ -2600,7 +4174,15 @@ void NetPlayReadInputFrame(uint8_t* joy)
 
 	if (client)
 	{
+		if (netPlayRollback.active())
+		{
+			// Desync check data is recorded as frames get confirmed
+			netPlayRollback.readInput( client, joy );
+			return;
+		}
 		netPlayInputFrame = client->getNextInput();
+
+		client->statsFrameRun();
 	}
 	else
 	{
@@ -2620,6 +4202,113 @@ void NetPlayReadInputFrame(uint8_t* joy)
 	NetPlayOnFrameBegin();
 }
 //----------------------------------------------------------------------------
+bool NetPlayHostFromConfig(void)
+{
+	int isServer = 0;
+	int netPort = NetPlayServer::DefaultPort;
+	int rollbackFrames = 0;
+	int udpRedundancy = 0;
+	bool enforceAppVersionChk = true;
+	QString passwd;
+
+	g_config->getOption("SDL.NetworkIsServer", &isServer);
+
+	if ( !isServer || (NetPlayServer::GetInstance() != nullptr) || (NetPlayClient::GetInstance() != nullptr) )
+	{
+		return false;
+	}
+	// Only for this run, like SDL.NetworkIP
+	g_config->setOption("SDL.NetworkIsServer", 0);
+
+	g_config->getOption("SDL.NetworkPort", &netPort);
+	g_config->getOption("SDL.NetworkPassword", &passwd);
+	g_config->getOption("SDL.NetPlayHostRollbackFrames", &rollbackFrames);
+	g_config->getOption("SDL.NetPlayHostUdpRedundancy", &udpRedundancy);
+	g_config->getOption("SDL.NetPlayHostEnforceAppVersionChk", &enforceAppVersionChk);
+
+	NetPlayServer::Create(consoleWindow);
+
+	NetPlayServer *server = NetPlayServer::GetInstance();
+	server->setRole( NETPLAY_SPECTATOR );
+	server->sessionPasswd = passwd;
+	server->setRollbackFrames( rollbackFrames );
+	server->setUdpRedundancy( udpRedundancy );
+	server->setEnforceAppVersionCheck( enforceAppVersionChk );
+
+	if (!server->listen( QHostAddress::Any, netPort ))
+	{
+		FCEU_printf("NetPlay: Failed to start TCP server on port %i: %s\n", netPort, server->errorString().toLocal8Bit().constData());
+		NetPlayServer::Destroy();
+		return false;
+	}
+	if (server->getUdpRedundancy() > 0)
+	{
+		server->openUdp( netPort );
+	}
+	FCEU_printf("NetPlay: Hosting on port %i\n", netPort);
+
+	return true;
+}
+//----------------------------------------------------------------------------
+bool NetPlayJoinFromConfig(void)
+{
+	int join = 0;
+	int netPort = NetPlayServer::DefaultPort;
+	int playerNum = 1;
+	QString hostAddress;
+	QString userName;
+	QString passwd;
+	std::string inputPath;
+	std::string statsPath;
+
+	g_config->getOption("SDL.NetworkJoin", &join);
+
+	if ( !join || (NetPlayServer::GetInstance() != nullptr) || (NetPlayClient::GetInstance() != nullptr) )
+	{
+		return false;
+	}
+	// Only for this run, like SDL.NetworkIsServer
+	g_config->setOption("SDL.NetworkJoin", 0);
+
+	g_config->getOption("SDL.NetworkIP", &hostAddress);
+	g_config->getOption("SDL.NetworkPort", &netPort);
+	g_config->getOption("SDL.NetworkUsername", &userName);
+	g_config->getOption("SDL.NetworkPassword", &passwd);
+	g_config->getOption("SDL.NetPlayJoinPlayer", &playerNum);
+	g_config->getOption("SDL.NetPlayJoinInput", &inputPath);
+	g_config->getOption("SDL.NetPlayJoinStats", &statsPath);
+
+	g_config->setOption("SDL.NetPlayJoinInput", "");
+	g_config->setOption("SDL.NetPlayJoinStats", "");
+
+	if (hostAddress.isEmpty())
+	{
+		hostAddress = "localhost";
+	}
+	NetPlayClient::Create(consoleWindow);
+
+	NetPlayClient *client = NetPlayClient::GetInstance();
+	client->role = ((playerNum >= 1) && (playerNum <= 4)) ? (NETPLAY_PLAYER1 + playerNum - 1) : NETPLAY_SPECTATOR;
+	client->userName = userName;
+	client->password = passwd;
+
+	if ( !inputPath.empty() && !client->loadScriptedInput( inputPath.c_str() ) )
+	{
+		FCEU_printf("NetPlay: Could not read the input of player %i from movie: %s\n", playerNum, inputPath.c_str());
+		NetPlayClient::Destroy();
+		return false;
+	}
+	if (!statsPath.empty())
+	{
+		client->setStatsPath( QString::fromLocal8Bit( statsPath.c_str() ) );
+	}
+	client->connectToHost( hostAddress, netPort );
+
+	FCEU_printf("NetPlay: Joining %s:%i\n", hostAddress.toLocal8Bit().constData(), netPort);
+
+	return true;
+}
+//----------------------------------------------------------------------------
 void NetPlayCloseSession(void)
 {
 	NetPlayClient::Destroy();
@@ -2725,36 +4414,33 @@ uint64_t netPlayByteSwap(uint64_t in)
 	return out;
 }
 //----------------------------------------------------------------------------
-uint32_t netPlayCalcRamChkSum()
+static void netPlayCalcStateHash( NetPlayFrameData &data )
 {
-	uint32_t crc = 0;
-	uint8_t ram[256];
+	uint8_t digest[16];
 
-	for (int i=0; i<256; i++)
-	{
-		ram[i] = GetMem(i);
-	}
-	crc = CalcCRC32( crc, ram, sizeof(ram));
+	// CPU, PPU, APU, input and mapper state, as it would be saved
+	FCEUSS_HashState( digest );
 
-	return crc;
-}
-//----------------------------------------------------------------------------
-void NetPlayTraceInstruction(uint8_t *opcode, int size)
-{
-	opsCrc32 = CalcCRC32( opsCrc32, opcode, size);
+	data.stateHash = FCEU_de32lsb( digest );
+	data.ramHash   = CalcCRC32( 0, RAM, 0x800 );
 }
 //----------------------------------------------------------------------------
 void NetPlayOnFrameBegin()
 {
+	const uint32_t frame = static_cast<uint32_t>(currFrameCounter);
+
+	if ( (frame % netPlayStateHashInterval) != 0 )
+	{
+		return;
+	}
 	NetPlayFrameData data;
 
-	data.frameNum = static_cast<uint32_t>(currFrameCounter);
-	data.opsCrc32 = opsCrc32;
-	data.ramCrc32 = netPlayCalcRamChkSum();
+	data.frameNum = frame;
+	netPlayCalcStateHash( data );
 
 	netPlayFrameData.push( data );
 
-	//printf("Frame: %u   Ops:%08X  Ram:%08X\n", data.frameNum, data.opsCrc32, data.ramCrc32 );
+	//printf("Frame: %u   State:%08X  Ram:%08X\n", data.frameNum, data.stateHash, data.ramHash );
 }
 //----------------------------------------------------------------------------
 bool NetPlayStateLoadReq(EMUFILE* is)
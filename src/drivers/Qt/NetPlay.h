@@ -7,6 +7,9 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <list>
+#include <deque>
+#include <vector>
+#include <memory>
 #include <functional>
 
 #include <QWidget>
@@ -29,10 +32,13 @@
 
 #include <QTcpSocket>
 #include <QTcpServer>
+#include <QUdpSocket>
 
 #include "utils/mutex.h"
 
 class NetPlayClient;
+struct NetPlayStateSyncJob;
+struct netPlayClientState;
 
 struct NetPlayFrameInput
 {
@@ -123,14 +129,17 @@ class NetPlayServer : public QTcpServer
 		{
 			FCEU::autoScopedLock alock(inputMtx);
 			input.clear();
+			udpInputHistory.clear();
 		}
 
 		void resyncClient( NetPlayClient *client );
 		void resyncAllClients();
 
 		int  sendMsg( NetPlayClient *client, void *msg, size_t msgSize, std::function<void(void)> netByteOrderConvertFunc = []{});
-		int  sendRomLoadReq( NetPlayClient *client );
-		int  sendStateSyncReq( NetPlayClient *client );
+		int  sendRomLoadReq( NetPlayClient *client, bool sendData = false );
+		int  sendStateSyncReq( NetPlayClient *client, bool keyframe = false );
+		int  sendRunFrameReq( NetPlayClient *client, NetPlayFrameInput &inputFrame );
+		int  sendRunFrameBatch( NetPlayClient *client );
 		void setRole(int _role);
 		int  getRole(void){ return role; }
 		bool claimRole(NetPlayClient* client, int _role);
@@ -139,9 +148,14 @@ class NetPlayServer : public QTcpServer
 
 		uint32_t getMaxLeadFrames(){ return maxLeadFrames; }
 		void setMaxLeadFrames(uint32_t value){ maxLeadFrames = value; }
+		uint32_t getRollbackFrames(){ return rollbackFrames; }
+		void setRollbackFrames(uint32_t value){ rollbackFrames = value; }
 		void setEnforceAppVersionCheck(bool value){ enforceAppVersionCheck = value; }
 		void setAllowClientRomLoadRequest(bool value){ allowClientRomLoadReq = value; }
 		void setAllowClientStateLoadRequest(bool value){ allowClientStateLoadReq = value; }
+		uint32_t getUdpRedundancy(){ return udpRedundancy; }
+		void setUdpRedundancy(uint32_t value){ udpRedundancy = value; }
+		bool openUdp( int port );
 
 		void serverProcessMessage( NetPlayClient *client, void *msgBuf, size_t msgSize );
 
@@ -153,19 +167,30 @@ class NetPlayServer : public QTcpServer
 		static NetPlayServer *instance;
 
 		void processPendingConnections(void);
+		void processStateSyncJobs(void);
+		void sendStateSync( NetPlayStateSyncJob *job );
+		void readUdp(void);
+		void sendUdpPacket( NetPlayClient *client, const void *msg = nullptr, size_t msgSize = 0 );
 
 		ClientList_t clientList;
+		std::list <NetPlayStateSyncJob*> syncJobs;
 		std::list <NetPlayFrameInput> input;
+		std::deque <NetPlayFrameInput> udpInputHistory; // Last frames run, UDP clients catch up from it
 		FCEU::mutex inputMtx;
+		QUdpSocket *udpSock = nullptr;
 		int role = -1;
 		int roleMask = 0;
 		NetPlayClient* clientPlayer[4] = { nullptr };
 		int forceResyncCount = 10;
 		uint32_t cycleCounter = 0;
 		uint32_t maxLeadFrames = 10u;
+		uint32_t rollbackFrames = 0u;
 		uint32_t clientWaitCounter = 0;
 		uint32_t inputFrameCount = 0;
 		uint32_t romCrc32 = 0;
+		uint8_t  romFileMd5[16] = { 0 }; // Of the ROM file last offered to the clients
+		uint32_t syncStateId = 0;
+		uint32_t udpRedundancy = 0u;
 		bool     enforceAppVersionCheck = true;
 		bool     allowClientRomLoadReq = false;
 		bool     allowClientStateLoadReq = false;
@@ -232,6 +257,11 @@ class NetPlayClient : public QObject
 		{
 			FCEU::autoScopedLock alock(inputMtx);
 			input.push_back(in);
+
+			if (stats.padChangedAt != 0)
+			{
+				statsHostInput(in);
+			}
 		};
 
 		NetPlayFrameInput getNextInput(void)
@@ -242,6 +272,13 @@ class NetPlayClient : public QObject
 			{
 				in = input.front();
 				input.pop_front();
+
+				inputHistory.push_back(in);
+
+				if (inputHistory.size() > maxInputHistory)
+				{
+					inputHistory.pop_front();
+				}
 			}
 			return in;
 		};
@@ -258,14 +295,73 @@ class NetPlayClient : public QObject
 			return frame;
 		}
 
+		uint32_t inputFrameFront()
+		{
+			uint32_t frame = 0;
+			FCEU::autoScopedLock alock(inputMtx);
+			if (!input.empty())
+			{
+				NetPlayFrameInput &in = input.front();
+				frame = in.frameCounter;
+			}
+			return frame;
+		}
+
 		void inputClear()
 		{
 			FCEU::autoScopedLock alock(inputMtx);
 			input.clear();
 		}
 
+		// After a sync state for the given frame is loaded, only the input for frames
+		// (frame, lastFrame] that the host sent ahead of the state is still valid.
+		// Some of it may have been used already, so it is taken back from the history.
+		void inputRewind(uint32_t frame, uint32_t lastFrame)
+		{
+			std::list <NetPlayFrameInput> kept;
+			FCEU::autoScopedLock alock(inputMtx);
+
+			for (auto& in : inputHistory)
+			{
+				if ( (in.frameCounter > frame) && (in.frameCounter <= lastFrame) )
+				{
+					kept.push_back(in);
+				}
+			}
+			for (auto& in : input)
+			{
+				if ( (in.frameCounter > frame) && (in.frameCounter <= lastFrame) &&
+				     (kept.empty() || (in.frameCounter > kept.back().frameCounter)) )
+				{
+					kept.push_back(in);
+				}
+			}
+			input.swap(kept);
+			inputHistory.clear();
+		}
+
+		// Rollback mode: local input recorded by the emulator thread, waiting to be sent to the host.
+		void pushLocalInput( NetPlayFrameInput &in )
+		{
+			FCEU::autoScopedLock alock(inputMtx);
+			localInput.push_back(in);
+		};
+
+		bool getNextLocalInput( NetPlayFrameInput &in )
+		{
+			FCEU::autoScopedLock alock(inputMtx);
+			if (localInput.empty())
+			{
+				return false;
+			}
+			in = localInput.front();
+			localInput.pop_front();
+			return true;
+		};
+
 		bool isAuthenticated();
 		bool isPlayerRole();
+		bool isRelay();
 		bool shouldDestroy(){ return needsDestroy; }
 		bool isPaused(){ return paused; }
 		void setPaused(bool value){ paused = value; }
@@ -275,6 +371,17 @@ class NetPlayClient : public QObject
 		void resetPingData(void);
 		double getAvgPingDelay();
 
+		// Buttons pressed by this client, one entry per frame run, over and over,
+		// instead of the gamepad's.
+		bool loadScriptedInput( const char *fm2Path );
+		uint32_t localGamepadState( uint32_t frame );
+
+		// Figures of the session, rewritten to the stats file while it runs
+		void setStatsPath( const QString &path ){ stats.path = path; }
+		void statsLocalPad( uint8_t pad );
+		void statsFrameRun(void);
+		void statsFrameWait( bool wait );
+
 		QString userName;
 		QString password;
 		int     role = -1;
@@ -286,8 +393,44 @@ class NetPlayClient : public QObject
 		unsigned int readyFrame = 0;
 		unsigned int catchUpThreshold = 10;
 		unsigned int tailTarget = 3;
+		unsigned int rollbackFrames = 0;
+		unsigned int hostPingDelay = 0;
 		uint8_t gpData[4];
 
+		// Host side: the last state sent to this client, and the last one it acknowledged,
+		// which later syncs are sent as a delta against.
+		std::shared_ptr <std::vector<uint8_t>> syncSentState;
+		std::shared_ptr <std::vector<uint8_t>> syncAckedState;
+		uint32_t syncSentId = 0;
+		uint32_t syncAckedId = 0;
+		bool     syncInProgress = false;
+		bool     syncRequested = false;
+		std::list <NetPlayFrameInput> deferredInput; // Frames run while a sync is being prepared
+		std::vector <NetPlayFrameInput> relayInput;  // Frames not sent yet to a spectator relay
+
+		// Client side: the last state loaded from the host
+		std::vector <uint8_t> syncBaseState;
+		uint32_t syncBaseId = 0;
+
+		// Client side: the ROM offered isn't in the cache, states wait for its data
+		bool     romFetchPending = false;
+
+		// Last input frame received from the other side
+		uint32_t lastInputFrame = 0;
+
+		// Buttons of the loadScriptedInput() log
+		std::vector <uint8_t> scriptedInput;
+
+		// UDP transport of the per frame messages, set up by NETPLAY_UDP_SETUP.
+		// Active once the other side has confirmed that it gets the packets.
+		QHostAddress udpAddr;
+		quint16  udpPort = 0;
+		uint32_t udpToken = 0;
+		uint32_t udpRedundancy = 0;
+		uint32_t udpSendSeq = 0;
+		uint32_t udpRecvSeq = 0;
+		bool     udpActive = false;
+
 		struct RomLoadReqData
 		{
 			char* buf = nullptr;
@@ -310,7 +453,15 @@ class NetPlayClient : public QObject
 
 		static NetPlayClient *instance;
 
+		void readUdp(void);
+		void sendUdpPacket( const void *msg = nullptr, size_t msgSize = 0 );
+		void fillClientState( netPlayClientState &statusMsg );
+		void statsHostInput( const NetPlayFrameInput &in );
+		void statsSyncLoaded(void);
+		void writeStats(void);
+
 		QTcpSocket *sock = nullptr;
+		QUdpSocket *udpSock = nullptr;
 		int     recvMsgId = 0;
 		int     recvMsgSize = 0;
 		int     recvMsgBytesLeft = 0;
@@ -329,9 +480,30 @@ class NetPlayClient : public QObject
 		uint32_t  romCrc32 = 0;
 
 		std::list <NetPlayFrameInput> input;
+		std::list <NetPlayFrameInput> inputHistory;
+		std::list <NetPlayFrameInput> localInput;
+		std::deque <NetPlayFrameInput> udpLocalInput; // Repeated in every UDP packet
 		FCEU::mutex inputMtx;
 
+		// Times are in ms, what the emulator thread updates is guarded by inputMtx
+		struct SessionStats
+		{
+			QString  path;
+			uint64_t syncedAt = 0;     // First state loaded
+			uint32_t statesThisRom = 0;
+			uint64_t nextWrite = 0;
+			uint64_t waitSince = 0;
+			uint64_t stallTime = 0;
+			uint64_t padChangedAt = 0; // Waiting for the host's input to show this change
+			uint8_t  pad = 0;
+			std::vector <uint32_t> latency;
+			uint32_t framesRun = 0;
+			uint32_t resyncs = 0;
+			uint32_t romFetches = 0;
+		} stats;
+
 		static constexpr size_t recvMsgBufSize = 2 * 1024 * 1024;
+		static constexpr size_t maxInputHistory = 300;
 
 	signals:
 		void connected(void);
@@ -366,6 +538,8 @@ protected:
 	QLineEdit  *passwordEntry;
 	QCheckBox  *passwordRequiredCBox;
 	QSpinBox   *frameLeadSpinBox;
+	QSpinBox   *rollbackSpinBox;
+	QSpinBox   *udpRedundancySpinBox;
 	QCheckBox  *enforceAppVersionChkCBox;
 	QCheckBox  *allowClientRomReqCBox;
 	QCheckBox  *allowClientStateReqCBox;
@@ -487,11 +661,13 @@ bool isNetPlayClient(void);
 void NetPlayPeriodicUpdate(void);
 bool NetPlaySkipWait(void);
 int NetPlayFrameWait(void);
+void NetPlayRollbackUpdate(void);
 void NetPlayOnFrameBegin(void);
 void NetPlayReadInputFrame(uint8_t* joy);
 void NetPlayCloseSession(void);
+bool NetPlayHostFromConfig(void);
+bool NetPlayJoinFromConfig(void);
 bool NetPlayStateLoadReq(EMUFILE* is);
-void NetPlayTraceInstruction(uint8_t *opcode, int size);
 void openNetPlayHostDialog(QWidget* parent = nullptr);
 void openNetPlayJoinDialog(QWidget* parent = nullptr);
 void openNetPlayHostStatusDialog(QWidget* parent = nullptr);
@@ -19,20 +19,27 @@ enum netPlayMsgType
 	NETPLAY_AUTH_RESP,
 	NETPLAY_LOAD_ROM_REQ = 10,
 	NETPLAY_UNLOAD_ROM_REQ,
+	NETPLAY_ROM_DATA_REQ,
 	NETPLAY_SYNC_STATE_REQ = 20,
 	NETPLAY_SYNC_STATE_RESP,
+	NETPLAY_SYNC_STATE_ACK,
 	NETPLAY_RUN_FRAME_REQ = 30,
+	NETPLAY_RUN_FRAME_BATCH,
 	NETPLAY_CLIENT_STATE = 40,
 	NETPLAY_CLIENT_SYNC_REQ,
+	NETPLAY_CLIENT_INPUT,
 	NETPLAY_INFO_MSG = 50,
 	NETPLAY_ERROR_MSG,
 	NETPLAY_CHAT_MSG,
+	NETPLAY_UDP_SETUP = 60,
+	NETPLAY_UDP_PACKET,
 	NETPLAY_PING_REQ = 100,
 	NETPLAY_PING_RESP,
 };
 
 enum netPlayerId
 {
+	NETPLAY_RELAY = -2, // Spectator relay, passes the session on to its own spectators
 	NETPLAY_SPECTATOR = -1,
 	NETPLAY_PLAYER1,
 	NETPLAY_PLAYER2,
@@ -235,11 +242,18 @@ struct netPlayLoadRomReq
 	netPlayMsgHdr  hdr;
 
 	uint32_t  fileSize;
+	uint32_t  flags;
+	uint8_t   md5[16];  // MD5 of the file data
 	char fileName[256];
 
+	// Only the file hash, without the data. The client loads the file from its
+	// ROM cache, or asks for the data with NETPLAY_ROM_DATA_REQ.
+	static constexpr uint32_t  CacheFlag = 0x0001;
+
 	netPlayLoadRomReq(void)
-		: hdr(NETPLAY_LOAD_ROM_REQ, sizeof(netPlayLoadRomReq)), fileSize(0)
+		: hdr(NETPLAY_LOAD_ROM_REQ, sizeof(netPlayLoadRomReq)), fileSize(0), flags(0)
 	{
+		memset(md5, 0, sizeof(md5));
 		memset(fileName, 0, sizeof(fileName));
 	}
 
@@ -247,12 +261,37 @@ struct netPlayLoadRomReq
 	{
 		hdr.toHostByteOrder();
 		fileSize  = netPlayByteSwap(fileSize);
+		flags     = netPlayByteSwap(flags);
 	}
 
 	void toNetworkByteOrder()
 	{
 		hdr.toNetworkByteOrder();
 		fileSize  = netPlayByteSwap(fileSize);
+		flags     = netPlayByteSwap(flags);
+	}
+};
+
+struct netPlayRomDataReq
+{
+	netPlayMsgHdr  hdr;
+
+	uint8_t   md5[16];  // File the client doesn't have
+
+	netPlayRomDataReq(void)
+		: hdr(NETPLAY_ROM_DATA_REQ, sizeof(netPlayRomDataReq))
+	{
+		memset(md5, 0, sizeof(md5));
+	}
+
+	void toHostByteOrder()
+	{
+		hdr.toHostByteOrder();
+	}
+
+	void toNetworkByteOrder()
+	{
+		hdr.toNetworkByteOrder();
 	}
 };
 
@@ -261,10 +300,22 @@ struct netPlayLoadStateResp
 	netPlayMsgHdr  hdr;
 
 	uint32_t  stateSize;
-	uint32_t  opsCrc32;
+	uint32_t  frameNum;   // Host frame counter the state was saved at
+	uint32_t  inputFrame; // Last input frame sent ahead of the state
+	uint32_t  flags;
+	uint32_t  stateId;    // Non-zero if the state is to be acknowledged
+	uint32_t  baseId;     // State a delta applies to
+	uint32_t  rawSize;    // Uncompressed state size
+
+	// The data is the uncompressed state xor'ed with the base state, zlib compressed.
+	// Without this flag it is a regular savestate.
+	static constexpr uint32_t  DeltaFlag = 0x0001;
+	// Periodic state sent to a spectator relay for late joiners, not a resync.
+	static constexpr uint32_t  KeyframeFlag = 0x0002;
 
 	netPlayLoadStateResp(void)
-		: hdr(NETPLAY_SYNC_STATE_RESP, sizeof(netPlayLoadStateResp)), stateSize(0), opsCrc32(0)
+		: hdr(NETPLAY_SYNC_STATE_RESP, sizeof(netPlayLoadStateResp)), stateSize(0), frameNum(0),
+		inputFrame(0), flags(0), stateId(0), baseId(0), rawSize(0)
 	{
 	}
 
@@ -272,14 +323,24 @@ struct netPlayLoadStateResp
 	{
 		hdr.toHostByteOrder();
 		stateSize  = netPlayByteSwap(stateSize);
-		opsCrc32   = netPlayByteSwap(opsCrc32);
+		frameNum   = netPlayByteSwap(frameNum);
+		inputFrame = netPlayByteSwap(inputFrame);
+		flags      = netPlayByteSwap(flags);
+		stateId    = netPlayByteSwap(stateId);
+		baseId     = netPlayByteSwap(baseId);
+		rawSize    = netPlayByteSwap(rawSize);
 	}
 
 	void toNetworkByteOrder()
 	{
 		hdr.toNetworkByteOrder();
 		stateSize  = netPlayByteSwap(stateSize);
-		opsCrc32   = netPlayByteSwap(opsCrc32);
+		frameNum   = netPlayByteSwap(frameNum);
+		inputFrame = netPlayByteSwap(inputFrame);
+		flags      = netPlayByteSwap(flags);
+		stateId    = netPlayByteSwap(stateId);
+		baseId     = netPlayByteSwap(baseId);
+		rawSize    = netPlayByteSwap(rawSize);
 	}
 
 	char* stateDataBuf()
@@ -294,6 +355,29 @@ struct netPlayLoadStateResp
 	}
 };
 
+struct netPlaySyncStateAck
+{
+	netPlayMsgHdr  hdr;
+
+	uint32_t  stateId;
+
+	netPlaySyncStateAck(void)
+		: hdr(NETPLAY_SYNC_STATE_ACK, sizeof(netPlaySyncStateAck)), stateId(0)
+	{
+	}
+
+	void toHostByteOrder()
+	{
+		hdr.toHostByteOrder();
+		stateId = netPlayByteSwap(stateId);
+	}
+
+	void toNetworkByteOrder()
+	{
+		hdr.toNetworkByteOrder();
+		stateId = netPlayByteSwap(stateId);
+	}
+};
 
 struct netPlayRunFrameReq
 {
@@ -303,9 +387,10 @@ struct netPlayRunFrameReq
 	uint32_t  frameNum;
 	uint8_t   ctrlState[4];
 	uint8_t   catchUpThreshold;
+	uint8_t   rollbackFrames; // Zero for lockstep, else how far clients may run ahead on predicted input
 
 	netPlayRunFrameReq(void)
-		: hdr(NETPLAY_RUN_FRAME_REQ, sizeof(netPlayRunFrameReq)), flags(0), frameNum(0), catchUpThreshold(10)
+		: hdr(NETPLAY_RUN_FRAME_REQ, sizeof(netPlayRunFrameReq)), flags(0), frameNum(0), catchUpThreshold(10), rollbackFrames(0)
 	{
 		memset( ctrlState, 0, sizeof(ctrlState) );
 	}
@@ -325,6 +410,53 @@ struct netPlayRunFrameReq
 	}
 };
 
+// Input for consecutive frames starting at firstFrame, as sent to a spectator relay which
+// passes it on unchanged, and in UDP packets. The message is followed by frameCount
+// ctrlState[4] entries.
+struct netPlayRunFrameBatch
+{
+	netPlayMsgHdr  hdr;
+
+	uint32_t  flags;
+	uint32_t  firstFrame;
+	uint32_t  frameCount;
+	uint32_t  stateId;    // UDP only: the sync state the input follows
+	uint8_t   catchUpThreshold;
+	uint8_t   rollbackFrames;
+	uint8_t   reserved[2];
+
+	netPlayRunFrameBatch(void)
+		: hdr(NETPLAY_RUN_FRAME_BATCH, sizeof(netPlayRunFrameBatch)), flags(0), firstFrame(0), frameCount(0),
+		stateId(0), catchUpThreshold(10), rollbackFrames(0)
+	{
+		memset( reserved, 0, sizeof(reserved) );
+	}
+
+	void toHostByteOrder()
+	{
+		hdr.toHostByteOrder();
+		flags      = netPlayByteSwap(flags);
+		firstFrame = netPlayByteSwap(firstFrame);
+		frameCount = netPlayByteSwap(frameCount);
+		stateId    = netPlayByteSwap(stateId);
+	}
+
+	void toNetworkByteOrder()
+	{
+		hdr.toNetworkByteOrder();
+		flags      = netPlayByteSwap(flags);
+		firstFrame = netPlayByteSwap(firstFrame);
+		frameCount = netPlayByteSwap(frameCount);
+		stateId    = netPlayByteSwap(stateId);
+	}
+
+	uint8_t* ctrlDataBuf()
+	{
+		uintptr_t buf = ((uintptr_t)this) + sizeof(netPlayRunFrameBatch);
+		return (uint8_t*)buf;
+	}
+};
+
 struct netPlayClientState
 {
 	netPlayMsgHdr  hdr;
@@ -332,18 +464,19 @@ struct netPlayClientState
 	uint32_t  flags;
 	uint32_t  frameRdy; // What frame we have input ready for
 	uint32_t  frameRun;
-	uint32_t  opsFrame; // Last frame for ops data
-	uint32_t  opsChkSum;
-	uint32_t  ramChkSum;
+	uint32_t  hashFrame; // Last frame the state was hashed at
+	uint32_t  stateHash;
+	uint32_t  ramHash;
 	uint32_t  romCrc32;
 	uint8_t   ctrlState[4];
 
 	static constexpr uint32_t  PauseFlag  = 0x0001;
 	static constexpr uint32_t  DesyncFlag = 0x0002;
+	static constexpr uint32_t  UdpFlag    = 0x0004; // Client receives the host's UDP packets
 
 	netPlayClientState(void)
 		: hdr(NETPLAY_CLIENT_STATE, sizeof(netPlayClientState)), flags(0),
-		frameRdy(0), frameRun(0), opsChkSum(0), ramChkSum(0), romCrc32(0)
+		frameRdy(0), frameRun(0), hashFrame(0), stateHash(0), ramHash(0), romCrc32(0)
 	{
 		memset( ctrlState, 0, sizeof(ctrlState) );
 	}
@@ -354,9 +487,9 @@ struct netPlayClientState
 		flags     = netPlayByteSwap(flags);
 		frameRdy  = netPlayByteSwap(frameRdy);
 		frameRun  = netPlayByteSwap(frameRun);
-		opsFrame  = netPlayByteSwap(opsFrame);
-		opsChkSum = netPlayByteSwap(opsChkSum);
-		ramChkSum = netPlayByteSwap(ramChkSum);
+		hashFrame = netPlayByteSwap(hashFrame);
+		stateHash = netPlayByteSwap(stateHash);
+		ramHash   = netPlayByteSwap(ramHash);
 		romCrc32  = netPlayByteSwap(romCrc32);
 	}
 
@@ -366,21 +499,110 @@ struct netPlayClientState
 		flags     = netPlayByteSwap(flags);
 		frameRdy  = netPlayByteSwap(frameRdy);
 		frameRun  = netPlayByteSwap(frameRun);
-		opsFrame  = netPlayByteSwap(opsFrame);
-		opsChkSum = netPlayByteSwap(opsChkSum);
-		ramChkSum = netPlayByteSwap(ramChkSum);
+		hashFrame = netPlayByteSwap(hashFrame);
+		stateHash = netPlayByteSwap(stateHash);
+		ramHash   = netPlayByteSwap(ramHash);
 		romCrc32  = netPlayByteSwap(romCrc32);
 	}
 };
 
+// Local controller input of a rollback mode client, for the host to use in the given frame.
+struct netPlayClientInput
+{
+	netPlayMsgHdr  hdr;
+
+	uint32_t  frameNum;
+	uint8_t   ctrlState[4];
+
+	netPlayClientInput(void)
+		: hdr(NETPLAY_CLIENT_INPUT, sizeof(netPlayClientInput)), frameNum(0)
+	{
+		memset( ctrlState, 0, sizeof(ctrlState) );
+	}
+
+	void toHostByteOrder()
+	{
+		hdr.toHostByteOrder();
+		frameNum = netPlayByteSwap(frameNum);
+	}
+
+	void toNetworkByteOrder()
+	{
+		hdr.toNetworkByteOrder();
+		frameNum = netPlayByteSwap(frameNum);
+	}
+};
+
+// Sent by a host that has UDP enabled after a client authenticated. The client answers with
+// UDP packets to the port, which tells the host where to send its own.
+struct netPlayUdpSetup
+{
+	netPlayMsgHdr  hdr;
+
+	uint16_t  port;
+	uint16_t  redundancy; // How many frames of input every packet repeats
+	uint32_t  token;      // Identifies the client's packets
+
+	netPlayUdpSetup(void)
+		: hdr(NETPLAY_UDP_SETUP, sizeof(netPlayUdpSetup)), port(0), redundancy(0), token(0)
+	{
+	}
+
+	void toHostByteOrder()
+	{
+		hdr.toHostByteOrder();
+		port       = netPlayByteSwap(port);
+		redundancy = netPlayByteSwap(redundancy);
+		token      = netPlayByteSwap(token);
+	}
+
+	void toNetworkByteOrder()
+	{
+		hdr.toNetworkByteOrder();
+		port       = netPlayByteSwap(port);
+		redundancy = netPlayByteSwap(redundancy);
+		token      = netPlayByteSwap(token);
+	}
+};
+
+// Header of a UDP datagram, hdr.msgSize covers the whole datagram. The regular messages
+// it carries follow, each with its own header.
+struct netPlayUdpPacket
+{
+	netPlayMsgHdr  hdr;
+
+	uint32_t  token;
+	uint32_t  seq;   // Older packets than the last one received are dropped
+
+	netPlayUdpPacket(void)
+		: hdr(NETPLAY_UDP_PACKET, sizeof(netPlayUdpPacket)), token(0), seq(0)
+	{
+	}
+
+	void toHostByteOrder()
+	{
+		hdr.toHostByteOrder();
+		token = netPlayByteSwap(token);
+		seq   = netPlayByteSwap(seq);
+	}
+
+	void toNetworkByteOrder()
+	{
+		hdr.toNetworkByteOrder();
+		token = netPlayByteSwap(token);
+		seq   = netPlayByteSwap(seq);
+	}
+};
+
 struct netPlayPingReq
 {
 	netPlayMsgHdr  hdr;
 
 	uint64_t  hostTimeStamp;
+	uint32_t  avgPingDelay; // Host's average round trip time to this client (ms)
 
 	netPlayPingReq(void)
-		: hdr(NETPLAY_PING_REQ, sizeof(netPlayPingReq)), hostTimeStamp(0)
+		: hdr(NETPLAY_PING_REQ, sizeof(netPlayPingReq)), hostTimeStamp(0), avgPingDelay(0)
 	{
 	}
 
@@ -388,12 +610,14 @@ struct netPlayPingReq
 	{
 		hdr.toHostByteOrder();
 		hostTimeStamp = netPlayByteSwap(hostTimeStamp);
+		avgPingDelay  = netPlayByteSwap(avgPingDelay);
 	}
 
 	void toNetworkByteOrder()
 	{
 		hdr.toNetworkByteOrder();
 		hostTimeStamp = netPlayByteSwap(hostTimeStamp);
+		avgPingDelay  = netPlayByteSwap(avgPingDelay);
 	}
 };
 
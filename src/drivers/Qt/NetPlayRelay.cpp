@@ -0,0 +1,687 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+// NetPlayRelay.cpp
+//
+// Spectator relay for a NetPlay session:
+//
+//   fceux --netplay-relay host[:port] [--relay-port N] [--relay-password P]
+//         [--relay-host-password P] [--relay-name NAME]
+//
+// The relay joins the host like a client, but in the relay role. The host sends it the
+// ROM, the input a few frames per message and every few seconds a full state (keyframe),
+// which is all the relay needs, it doesn't run the game. Spectators connect to the relay
+// as they would to the host, and get the ROM, the latest keyframe and the input since.
+// From then on the host's input messages are passed on to them unchanged, so the number
+// of spectators costs the host nothing.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <list>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "utils/StringUtils.h"
+#include "Qt/NetPlayRelay.h"
+#include "Qt/NetPlayMsgDef.h"
+
+static constexpr int      netPlayRelayDefaultHostPort = 4046;
+static constexpr int      netPlayRelayDefaultPort = 4047;
+static constexpr uint32_t netPlayRelayMaxMsgSize = 2 * 1024 * 1024;
+// A spectator that has this much data waiting to be sent can't keep up and is dropped
+static constexpr qint64   netPlayRelayMaxBacklog = 8 * 1024 * 1024;
+
+//-----------------------------------------------------------------------------
+// A connection to the host or to a spectator
+struct NetPlayRelayPeer
+{
+	QTcpSocket *sock = nullptr;
+	QByteArray  recvBuf;
+	QString     userName;
+	bool        authenticated = false;
+	bool        synced = false; // Has a state loaded, gets the input as it comes
+	bool        closed = false;
+
+	// Takes the next complete message out of the receive buffer, false if there is none yet
+	bool nextMessage( QByteArray &msg )
+	{
+		if (closed || (recvBuf.size() < static_cast<int>(sizeof(netPlayMsgHdr))))
+		{
+			return false;
+		}
+		netPlayMsgHdr hdr(0);
+
+		memcpy( &hdr, recvBuf.constData(), sizeof(hdr) );
+		hdr.toHostByteOrder();
+
+		if ( (hdr.magic[0] != NETPLAY_MAGIC_NUMBER) || (hdr.magic[1] != NETPLAY_MAGIC_NUMBER) ||
+		     (hdr.msgSize < sizeof(netPlayMsgHdr)) || (hdr.msgSize > netPlayRelayMaxMsgSize) )
+		{
+			printf("Error: Message Header Validity Check Failed: %08X\n", hdr.msgId);
+			recvBuf.clear();
+			sock->abort();
+			closed = true;
+			return false;
+		}
+		if (recvBuf.size() < static_cast<int>(hdr.msgSize))
+		{
+			return false;
+		}
+		msg = recvBuf.left( hdr.msgSize );
+		recvBuf.remove( 0, hdr.msgSize );
+
+		return true;
+	}
+};
+//-----------------------------------------------------------------------------
+struct NetPlayRelayInput
+{
+	uint32_t frameNum;
+	uint8_t  ctrl[4];
+};
+//-----------------------------------------------------------------------------
+class NetPlayRelay
+{
+	public:
+		QString  hostName;
+		int      hostPort = netPlayRelayDefaultHostPort;
+		int      port = netPlayRelayDefaultPort;
+		QString  hostPasswd;
+		QString  passwd;
+		QString  name = "Relay";
+
+		bool start(void);
+
+	private:
+		void hostReadyRead(void);
+		void hostProcessMessage( QByteArray &msg );
+		void spectatorConnected(void);
+		void spectatorReadyRead( NetPlayRelayPeer *peer );
+		void spectatorProcessMessage( NetPlayRelayPeer *peer, QByteArray &msg );
+		void startSpectator( NetPlayRelayPeer *peer );
+		void sendState( NetPlayRelayPeer *peer, bool asKeyframe );
+		void sendInput( NetPlayRelayPeer *peer );
+		void sendError( NetPlayRelayPeer *peer, const char *text );
+		void send( NetPlayRelayPeer *peer, const char *data, size_t size );
+		void purgeSpectators(void);
+
+		NetPlayRelayPeer host;
+		QTcpServer server;
+		std::list <NetPlayRelayPeer*> spectators;
+
+		// What a spectator joining now has to be sent: the ROM, the last state, and the input
+		// that follows it.
+		QByteArray  romMsg;
+		netPlayLoadStateResp state;
+		QByteArray  stateData;
+		bool        haveState = false;
+		std::deque <NetPlayRelayInput> input;
+		uint8_t     catchUpThreshold = 10;
+		uint8_t     rollbackFrames = 0;
+};
+//-----------------------------------------------------------------------------
+bool NetPlayRelay::start(void)
+{
+	if (!server.listen( QHostAddress::Any, port ))
+	{
+		fprintf( stderr, "Error: Relay could not listen on port %i: %s\n", port, server.errorString().toLocal8Bit().constData() );
+		return false;
+	}
+	QObject::connect( &server, &QTcpServer::newConnection, [this]{ spectatorConnected(); } );
+
+	host.sock = new QTcpSocket();
+	host.sock->setSocketOption( QAbstractSocket::LowDelayOption, 1 );
+
+	QObject::connect( host.sock, &QTcpSocket::readyRead, [this]{ hostReadyRead(); } );
+	QObject::connect( host.sock, &QTcpSocket::connected, [this]
+	{
+		printf("Relay connected to %s:%i, spectators can join on port %i\n", hostName.toLocal8Bit().constData(), hostPort, port);
+	});
+	QObject::connect( host.sock, &QTcpSocket::disconnected, []
+	{
+		printf("Host closed the session\n");
+		QCoreApplication::exit(0);
+	});
+	QObject::connect( host.sock, &QTcpSocket::errorOccurred, [this](QAbstractSocket::SocketError)
+	{
+		if (host.sock->state() != QAbstractSocket::ConnectedState)
+		{
+			fprintf( stderr, "Error: Relay could not connect to %s:%i: %s\n", hostName.toLocal8Bit().constData(), hostPort,
+					host.sock->errorString().toLocal8Bit().constData() );
+			QCoreApplication::exit(1);
+		}
+	});
+	host.sock->connectToHost( hostName, hostPort );
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::hostReadyRead(void)
+{
+	QByteArray msg;
+
+	host.recvBuf.append( host.sock->readAll() );
+
+	while (host.nextMessage(msg))
+	{
+		hostProcessMessage( msg );
+	}
+
+	for (auto& peer : spectators)
+	{
+		if (!peer->closed)
+		{
+			peer->sock->flush();
+		}
+	}
+	host.sock->flush();
+
+	purgeSpectators();
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::hostProcessMessage( QByteArray &msg )
+{
+	netPlayMsgHdr hdr(0);
+
+	memcpy( &hdr, msg.constData(), sizeof(hdr) );
+	hdr.toHostByteOrder();
+
+	switch (hdr.msgId)
+	{
+		case NETPLAY_AUTH_REQ:
+		{
+			netPlayAuthResp resp;
+			resp.playerId = NETPLAY_RELAY;
+			Strlcpy( resp.userName, name.toLocal8Bit().constData(), sizeof(resp.userName) );
+			Strlcpy( resp.pswd, hostPasswd.toLocal8Bit().constData(), sizeof(resp.pswd) );
+
+			resp.toNetworkByteOrder();
+			host.sock->write( reinterpret_cast<const char*>(&resp), sizeof(resp) );
+		}
+		break;
+		case NETPLAY_INFO_MSG:
+		case NETPLAY_ERROR_MSG:
+		{
+			netPlayTextMsg<256> text(hdr.msgId);
+
+			memcpy( &text, msg.constData(), std::min( static_cast<size_t>(msg.size()), sizeof(text) ) );
+			text.toHostByteOrder();
+
+			printf("Host %s: %.*s\n", (hdr.msgId == NETPLAY_ERROR_MSG) ? "Error" : "Info",
+					static_cast<int>(std::min<uint32_t>(text.dataSize, 255)), text.getBuffer());
+
+			if (text.isFlagSet(netPlayTextMsgFlags::Disconnect))
+			{
+				host.sock->disconnectFromHost();
+			}
+		}
+		break;
+		case NETPLAY_LOAD_ROM_REQ:
+		{
+			// The same ROM loaded again, spectators go on with the state that follows
+			if (msg == romMsg)
+			{
+				break;
+			}
+			romMsg = msg;
+			haveState = false;
+			stateData.clear();
+			input.clear();
+
+			for (auto& peer : spectators)
+			{
+				if (peer->authenticated)
+				{
+					send( peer, romMsg.constData(), romMsg.size() );
+					peer->synced = false;
+				}
+			}
+		}
+		break;
+		case NETPLAY_UNLOAD_ROM_REQ:
+		{
+			romMsg.clear();
+			haveState = false;
+			stateData.clear();
+			input.clear();
+
+			for (auto& peer : spectators)
+			{
+				if (peer->authenticated)
+				{
+					send( peer, msg.constData(), msg.size() );
+					peer->synced = false;
+				}
+			}
+		}
+		break;
+		case NETPLAY_SYNC_STATE_RESP:
+		{
+			if (msg.size() < static_cast<int>(sizeof(netPlayLoadStateResp)))
+			{
+				break;
+			}
+			netPlayLoadStateResp resp;
+
+			memcpy( &resp, msg.constData(), sizeof(resp) );
+			resp.toHostByteOrder();
+
+			if ( (resp.flags & netPlayLoadStateResp::DeltaFlag) ||
+			     (resp.stateSize != (msg.size() - sizeof(netPlayLoadStateResp))) )
+			{	// The relay never acknowledges a state, so it can't get a delta
+				printf("Error: Unexpected sync state from host\n");
+				break;
+			}
+			state     = resp;
+			stateData = msg.mid( sizeof(netPlayLoadStateResp) );
+			haveState = true;
+
+			// Same as a client loading the state, only input for (frame, inputFrame] is still valid
+			std::deque <NetPlayRelayInput> kept;
+
+			for (auto& in : input)
+			{
+				if ( (in.frameNum > state.frameNum) && (in.frameNum <= state.inputFrame) )
+				{
+					kept.push_back(in);
+				}
+			}
+			input.swap(kept);
+
+			const bool keyframe = (resp.flags & netPlayLoadStateResp::KeyframeFlag) ? true : false;
+
+			for (auto& peer : spectators)
+			{
+				if (!peer->authenticated || romMsg.isEmpty())
+				{
+					continue;
+				}
+				if (!peer->synced)
+				{
+					startSpectator( peer );
+				}
+				else if (!keyframe)
+				{	// A resync, spectators have to follow it
+					sendState( peer, false );
+				}
+			}
+		}
+		break;
+		case NETPLAY_RUN_FRAME_BATCH:
+		{
+			if (msg.size() < static_cast<int>(sizeof(netPlayRunFrameBatch)))
+			{
+				break;
+			}
+			netPlayRunFrameBatch batch;
+
+			memcpy( &batch, msg.constData(), sizeof(batch) );
+			batch.toHostByteOrder();
+
+			if ( (batch.frameCount > netPlayRelayMaxMsgSize / 4) ||
+			     ((sizeof(netPlayRunFrameBatch) + (batch.frameCount * 4)) > static_cast<size_t>(msg.size())) )
+			{
+				printf("Error: Run frame batch is truncated\n");
+				break;
+			}
+			const uint8_t *ctrlData = reinterpret_cast<const uint8_t*>(msg.constData()) + sizeof(netPlayRunFrameBatch);
+
+			catchUpThreshold = batch.catchUpThreshold;
+			rollbackFrames   = batch.rollbackFrames;
+
+			for (uint32_t i=0; i<batch.frameCount; i++)
+			{
+				NetPlayRelayInput in;
+
+				in.frameNum = batch.firstFrame + i;
+				memcpy( in.ctrl, &ctrlData[i*4], sizeof(in.ctrl) );
+
+				if ( haveState && (in.frameNum > state.frameNum) &&
+				     (input.empty() || (in.frameNum > input.back().frameNum)) )
+				{
+					input.push_back(in);
+				}
+			}
+
+			for (auto& peer : spectators)
+			{
+				if (peer->synced)
+				{
+					send( peer, msg.constData(), msg.size() );
+				}
+			}
+		}
+		break;
+		case NETPLAY_PING_REQ:
+		{
+			if (msg.size() < static_cast<int>(sizeof(netPlayPingReq)))
+			{
+				break;
+			}
+			netPlayPingReq  ping;
+			netPlayPingResp pong;
+
+			memcpy( &ping, msg.constData(), sizeof(ping) );
+			ping.toHostByteOrder();
+
+			pong.hostTimeStamp = ping.hostTimeStamp;
+			pong.toNetworkByteOrder();
+			host.sock->write( reinterpret_cast<const char*>(&pong), sizeof(pong) );
+		}
+		break;
+		default:
+			printf("Unknown Msg: %08X\n", hdr.msgId);
+		break;
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::spectatorConnected(void)
+{
+	QTcpSocket *sock;
+
+	while ( (sock = server.nextPendingConnection()) != nullptr )
+	{
+		NetPlayRelayPeer *peer = new NetPlayRelayPeer();
+
+		peer->sock = sock;
+		sock->setSocketOption( QAbstractSocket::LowDelayOption, 1 );
+
+		QObject::connect( sock, &QTcpSocket::readyRead, [this, peer]{ spectatorReadyRead( peer ); } );
+		QObject::connect( sock, &QTcpSocket::disconnected, [this, peer]
+		{
+			peer->closed = true;
+			QTimer::singleShot( 0, [this]{ purgeSpectators(); } );
+		});
+		spectators.push_back( peer );
+
+		netPlayAuthReq msg;
+
+		msg.toNetworkByteOrder();
+		send( peer, reinterpret_cast<const char*>(&msg), sizeof(msg) );
+		sock->flush();
+
+		printf("Spectator connected: %s   %zu\n", sock->peerAddress().toString().toLocal8Bit().constData(), spectators.size());
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::spectatorReadyRead( NetPlayRelayPeer *peer )
+{
+	QByteArray msg;
+
+	if (peer->closed)
+	{
+		return;
+	}
+	peer->recvBuf.append( peer->sock->readAll() );
+
+	while (peer->nextMessage(msg))
+	{
+		spectatorProcessMessage( peer, msg );
+	}
+	if (!peer->closed)
+	{
+		peer->sock->flush();
+	}
+	purgeSpectators();
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::spectatorProcessMessage( NetPlayRelayPeer *peer, QByteArray &msg )
+{
+	netPlayMsgHdr hdr(0);
+
+	memcpy( &hdr, msg.constData(), sizeof(hdr) );
+	hdr.toHostByteOrder();
+
+	switch (hdr.msgId)
+	{
+		case NETPLAY_AUTH_RESP:
+		{
+			if (peer->authenticated || (msg.size() < static_cast<int>(sizeof(netPlayAuthResp))))
+			{
+				break;
+			}
+			netPlayAuthResp resp;
+
+			memcpy( &resp, msg.constData(), sizeof(resp) );
+			resp.toHostByteOrder();
+			resp.userName[ sizeof(resp.userName)-1 ] = 0;
+			resp.pswd[ sizeof(resp.pswd)-1 ] = 0;
+
+			if ( (resp.appVersionMajor != FCEU_VERSION_MAJOR) ||
+			     (resp.appVersionMinor != FCEU_VERSION_MINOR) ||
+			     (resp.appVersionPatch != FCEU_VERSION_PATCH) )
+			{
+				char text[128];
+
+				snprintf( text, sizeof(text), "Client/Relay Version Mismatch:\nRelay version is %i.%i.%i\nClient version is %i.%i.%i",
+						FCEU_VERSION_MAJOR, FCEU_VERSION_MINOR, FCEU_VERSION_PATCH,
+						resp.appVersionMajor, resp.appVersionMinor, resp.appVersionPatch);
+				sendError( peer, text );
+			}
+			else if ( !passwd.isEmpty() && (passwd.compare(resp.pswd, Qt::CaseSensitive) != 0) )
+			{
+				sendError( peer, "Invalid Password" );
+			}
+			else if (resp.playerId != NETPLAY_SPECTATOR)
+			{
+				sendError( peer, "Only spectators can join through a relay" );
+			}
+			else
+			{
+				peer->userName      = resp.userName;
+				peer->authenticated = true;
+
+				printf("Spectator joined: %s\n", peer->userName.toLocal8Bit().constData());
+
+				if (!romMsg.isEmpty())
+				{
+					send( peer, romMsg.constData(), romMsg.size() );
+
+					if (haveState)
+					{
+						startSpectator( peer );
+					}
+				}
+			}
+		}
+		break;
+		case NETPLAY_CLIENT_STATE:
+		case NETPLAY_SYNC_STATE_ACK:
+		case NETPLAY_PING_RESP:
+			// Nothing depends on how far a spectator is
+		break;
+		default:
+			printf("Unexpected Msg from spectator: %08X\n", hdr.msgId);
+		break;
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::startSpectator( NetPlayRelayPeer *peer )
+{
+	sendState( peer, true );
+	sendInput( peer );
+
+	peer->synced = true;
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::sendState( NetPlayRelayPeer *peer, bool asKeyframe )
+{
+	netPlayLoadStateResp resp = state;
+
+	// Spectators don't acknowledge states to the relay
+	resp.stateId = 0;
+	resp.flags  &= ~netPlayLoadStateResp::KeyframeFlag;
+
+	// A spectator starting from this state has not been sent any input ahead of it
+	if (asKeyframe)
+	{
+		resp.inputFrame = resp.frameNum;
+	}
+	resp.toNetworkByteOrder();
+
+	send( peer, reinterpret_cast<const char*>(&resp), sizeof(resp) );
+	send( peer, stateData.constData(), stateData.size() );
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::sendInput( NetPlayRelayPeer *peer )
+{
+	if (input.empty())
+	{
+		return;
+	}
+	std::vector <uint8_t> ctrlData;
+	ctrlData.reserve( input.size() * 4 );
+
+	for (auto& in : input)
+	{
+		ctrlData.insert( ctrlData.end(), in.ctrl, in.ctrl + 4 );
+	}
+	netPlayRunFrameBatch batch;
+
+	batch.hdr.msgSize     += ctrlData.size();
+	batch.firstFrame       = input.front().frameNum;
+	batch.frameCount       = input.size();
+	batch.catchUpThreshold = catchUpThreshold;
+	batch.rollbackFrames   = rollbackFrames;
+	batch.toNetworkByteOrder();
+
+	send( peer, reinterpret_cast<const char*>(&batch), sizeof(batch) );
+	send( peer, reinterpret_cast<const char*>(&ctrlData[0]), ctrlData.size() );
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::sendError( NetPlayRelayPeer *peer, const char *text )
+{
+	netPlayTextMsg<128>  errorMsg(NETPLAY_ERROR_MSG);
+	errorMsg.setFlag(netPlayTextMsgFlags::Disconnect);
+	errorMsg.setFlag(netPlayTextMsgFlags::Error);
+	errorMsg.assign(text);
+
+	const size_t msgSize = errorMsg.hdr.msgSize;
+
+	errorMsg.toNetworkByteOrder();
+	send( peer, reinterpret_cast<const char*>(&errorMsg), msgSize );
+	peer->sock->disconnectFromHost();
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::send( NetPlayRelayPeer *peer, const char *data, size_t size )
+{
+	if (peer->closed)
+	{
+		return;
+	}
+	if (peer->sock->bytesToWrite() > netPlayRelayMaxBacklog)
+	{
+		printf("Spectator %s can't keep up, dropped\n", peer->userName.toLocal8Bit().constData());
+		peer->closed = true;
+		peer->sock->abort();
+		return;
+	}
+	peer->sock->write( data, size );
+}
+//-----------------------------------------------------------------------------
+void NetPlayRelay::purgeSpectators(void)
+{
+	for (auto it = spectators.begin(); it != spectators.end(); )
+	{
+		NetPlayRelayPeer *peer = *it;
+
+		if (peer->closed)
+		{
+			it = spectators.erase(it);
+
+			printf("Spectator left: %s   %zu\n", peer->userName.toLocal8Bit().constData(), spectators.size());
+
+			QObject::disconnect( peer->sock, nullptr, nullptr, nullptr );
+			peer->sock->deleteLater();
+			delete peer;
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+//-----------------------------------------------------------------------------
+//--- Main
+//-----------------------------------------------------------------------------
+bool netPlayRelayRequested( int argc, char *argv[] )
+{
+	for (int i=1; i<argc; i++)
+	{
+		if ( strcmp(argv[i], "--netplay-relay") == 0 )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+//-----------------------------------------------------------------------------
+int  netPlayRelayMain( int argc, char *argv[] )
+{
+	QCoreApplication app(argc, argv);
+	NetPlayRelay relay;
+
+	for (int i=1; i<argc; i++)
+	{
+		if ( (strcmp(argv[i], "--netplay-relay") == 0) && (i+1 < argc) )
+		{
+			QString host = argv[++i];
+			int sep = host.lastIndexOf(':');
+
+			if (sep > 0)
+			{
+				relay.hostPort = host.mid(sep+1).toInt();
+				host.truncate(sep);
+			}
+			relay.hostName = host;
+		}
+		else if ( (strcmp(argv[i], "--relay-port") == 0) && (i+1 < argc) )
+		{
+			relay.port = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--relay-password") == 0) && (i+1 < argc) )
+		{
+			relay.passwd = argv[++i];
+		}
+		else if ( (strcmp(argv[i], "--relay-host-password") == 0) && (i+1 < argc) )
+		{
+			relay.hostPasswd = argv[++i];
+		}
+		else if ( (strcmp(argv[i], "--relay-name") == 0) && (i+1 < argc) )
+		{
+			relay.name = argv[++i];
+		}
+	}
+	if ( relay.hostName.isEmpty() || (relay.hostPort <= 0) || (relay.port <= 0) )
+	{
+		fprintf( stderr, "Error: --netplay-relay needs the host to relay, as host[:port]\n" );
+		return 1;
+	}
+	if (!relay.start())
+	{
+		return 1;
+	}
+	return app.exec();
+}
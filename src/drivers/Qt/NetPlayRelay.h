@@ -0,0 +1,8 @@
+// NetPlayRelay.h
+//
+#pragma once
+
+// True if the command line asks to run as a spectator relay, which happens without any GUI.
+bool netPlayRelayRequested( int argc, char *argv[] );
+
+int  netPlayRelayMain( int argc, char *argv[] );
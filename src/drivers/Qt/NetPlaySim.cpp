@@ -0,0 +1,874 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+// NetPlaySim.cpp
+//
+// NetPlay network simulation, to measure how a session holds up on a given link:
+//
+//   fceux --netplay-sim rom.nes|host[:port] [--sim-clients N] [--sim-movie movie.fm2]
+//         [--sim-duration S] [--sim-delay MS] [--sim-jitter MS] [--sim-loss PERCENT]
+//         [--sim-udp K] [--sim-rollback N] [--sim-port P] [--sim-password P]
+//         [--sim-seed N] [--sim-report report.json]
+//
+// Given a ROM file, a host is started as a child process (fceux --server 1 with the
+// offscreen Qt platform), otherwise the session hosted at host:port is joined, with the
+// host not taking a player role. Every client connects through its own proxy, which
+// holds each chunk of data for the delay plus a random part of the jitter, in both
+// directions. TCP data stays in order, a lost segment holds up everything after it until
+// it would have been sent again. UDP packets are dropped, or overtake each other.
+//
+// The clients are real fceux processes as well (fceux --join 1), each with a base
+// directory of its own, that press the buttons of the movie (or a random pattern) and
+// keep writing the figures of their session to a stats file. After the run a JSON
+// report gives for each client the input latency (from a button change until the host's
+// input has it), the time per minute spent waiting for input, the number of resyncs and
+// the bytes per second both ways.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QProcess>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+#include <QTemporaryDir>
+#include <QTimer>
+
+#include "Qt/NetPlaySim.h"
+#include "Qt/NetPlayMsgDef.h"
+
+static constexpr int      netPlaySimDefaultHostPort = 4046;
+static constexpr uint32_t netPlaySimMaxMsgSize = 16 * 1024 * 1024;
+// A lost TCP segment is sent again after at least this long
+static constexpr qint64   netPlaySimMinRetransmit = 200000;
+static constexpr size_t   netPlaySimMaxUdpPacketSize = 2048;
+
+static QElapsedTimer netPlaySimClock;
+
+// Microseconds since the simulation started
+static qint64 netPlaySimNow(void)
+{
+	return netPlaySimClock.nsecsElapsed() / 1000;
+}
+//-----------------------------------------------------------------------------
+struct NetPlaySimLinkConfig
+{
+	int    delayMs = 0;
+	int    jitterMs = 0;
+	double lossPercent = 0.0;
+	std::mt19937 rng;
+
+	qint64 transitTime(void)
+	{
+		qint64 us = static_cast<qint64>(delayMs) * 1000;
+
+		if (jitterMs > 0)
+		{
+			us += std::uniform_int_distribution<qint64>( 0, static_cast<qint64>(jitterMs) * 1000 )(rng);
+		}
+		return us;
+	}
+
+	bool lost(void)
+	{
+		return (lossPercent > 0.0) && (std::uniform_real_distribution<double>( 0.0, 100.0 )(rng) < lossPercent);
+	}
+};
+static NetPlaySimLinkConfig netPlaySimLink;
+
+//-----------------------------------------------------------------------------
+//--- Proxy
+//-----------------------------------------------------------------------------
+// One direction of a proxied TCP connection
+struct NetPlaySimStream
+{
+	struct Chunk
+	{
+		qint64     due;
+		QByteArray data;
+	};
+	std::deque <Chunk> queue;
+	qint64   lastDue = 0;
+	uint64_t bytes = 0;
+
+	void push( const QByteArray &data )
+	{
+		Chunk chunk;
+		qint64 transit = netPlaySimLink.transitTime();
+
+		if (netPlaySimLink.lost())
+		{	// Sent again once the sender notices
+			transit += std::max( netPlaySimMinRetransmit, 2 * transit );
+		}
+		chunk.due  = std::max( netPlaySimNow() + transit, lastDue );
+		chunk.data = data;
+		lastDue    = chunk.due;
+		bytes     += data.size();
+
+		queue.push_back( chunk );
+	}
+
+	void deliver( QTcpSocket *sock, qint64 now )
+	{
+		while ( !queue.empty() && (queue.front().due <= now) )
+		{
+			sock->write( queue.front().data );
+			queue.pop_front();
+		}
+	}
+};
+//-----------------------------------------------------------------------------
+// Sits between a client and the host, and passes their TCP connection and UDP packets
+// on late, or not at all.
+class NetPlaySimProxy
+{
+	public:
+		bool start( const QString &hostName, int hostPort );
+		void update( qint64 now );
+
+		int  tcpPort(void){ return server.serverPort(); }
+		int  udpPort(void){ return udpFront.localPort(); }
+
+		uint64_t bytesDown(void){ return down.bytes + udpBytesDown; }
+		uint64_t bytesUp(void){ return up.bytes + udpBytesUp; }
+
+	private:
+		void connectHost(void);
+		void readHost(void);
+		void readUdp( QUdpSocket &sock, bool toHost );
+
+		struct Packet
+		{
+			qint64     due;
+			QByteArray data;
+			bool       toHost;
+		};
+
+		QString      hostName;
+		int          hostPort = 0;
+		int          connectTries = 0;
+		QTcpServer   server;
+		QTcpSocket  *client = nullptr;
+		QTcpSocket  *host = nullptr;
+		QByteArray   hostBuf;  // Host data short of a whole message
+		QUdpSocket   udpFront; // Faces the client
+		QUdpSocket   udpBack;  // Faces the host
+		QHostAddress udpClientAddr;
+		quint16      udpClientPort = 0;
+		std::vector <Packet> packets;
+		NetPlaySimStream up;
+		NetPlaySimStream down;
+		uint64_t     udpBytesUp = 0;
+		uint64_t     udpBytesDown = 0;
+};
+//-----------------------------------------------------------------------------
+bool NetPlaySimProxy::start( const QString &_hostName, int _hostPort )
+{
+	hostName = _hostName;
+	hostPort = _hostPort;
+
+	if ( !server.listen( QHostAddress::LocalHost, 0 ) ||
+	     !udpFront.bind( QHostAddress::LocalHost, 0 ) || !udpBack.bind( QHostAddress::Any, 0 ) )
+	{
+		fprintf( stderr, "Error: Could not open the simulation proxy ports\n" );
+		return false;
+	}
+	QObject::connect( &server, &QTcpServer::newConnection, [this]
+	{
+		QTcpSocket *sock = server.nextPendingConnection();
+
+		if ( (sock == nullptr) || (client != nullptr) )
+		{
+			delete sock;
+			return;
+		}
+		client = sock;
+		client->setSocketOption( QAbstractSocket::LowDelayOption, 1 );
+
+		QObject::connect( client, &QTcpSocket::readyRead, [this]{ up.push( client->readAll() ); } );
+
+		connectHost();
+	});
+	QObject::connect( &udpFront, &QUdpSocket::readyRead, [this]{ readUdp( udpFront, true  ); } );
+	QObject::connect( &udpBack,  &QUdpSocket::readyRead, [this]{ readUdp( udpBack,  false ); } );
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+void NetPlaySimProxy::connectHost(void)
+{
+	if (host != nullptr)
+	{
+		host->deleteLater();
+	}
+	host = new QTcpSocket();
+	host->setSocketOption( QAbstractSocket::LowDelayOption, 1 );
+
+	QObject::connect( host, &QTcpSocket::readyRead, [this]{ readHost(); } );
+	QObject::connect( host, &QTcpSocket::disconnected, [this]
+	{
+		fprintf( stderr, "Error: Host closed the session\n" );
+		client->disconnectFromHost();
+		QCoreApplication::exit(1);
+	});
+	QObject::connect( host, &QTcpSocket::errorOccurred, [this](QAbstractSocket::SocketError)
+	{
+		if (host->state() == QAbstractSocket::ConnectedState)
+		{
+			return;
+		}
+		// A host that was just started may not be listening yet
+		if (++connectTries < 60)
+		{
+			QTimer::singleShot( 250, [this]{ connectHost(); } );
+			return;
+		}
+		fprintf( stderr, "Error: Could not connect to %s:%i: %s\n", hostName.toLocal8Bit().constData(), hostPort,
+				host->errorString().toLocal8Bit().constData() );
+		QCoreApplication::exit(1);
+	});
+	host->connectToHost( hostName, hostPort );
+}
+//-----------------------------------------------------------------------------
+// Passed on a whole message at a time, as the host's UDP port has to be swapped for the
+// proxy's, which the client then sends its packets to.
+void NetPlaySimProxy::readHost(void)
+{
+	int len = 0;
+
+	hostBuf.append( host->readAll() );
+
+	while ( (hostBuf.size() - len) >= static_cast<int>(sizeof(netPlayMsgHdr)) )
+	{
+		netPlayMsgHdr hdr(0);
+
+		memcpy( &hdr, hostBuf.constData() + len, sizeof(hdr) );
+		hdr.toHostByteOrder();
+
+		if ( (hdr.magic[0] != NETPLAY_MAGIC_NUMBER) || (hdr.magic[1] != NETPLAY_MAGIC_NUMBER) ||
+		     (hdr.msgSize < sizeof(netPlayMsgHdr)) || (hdr.msgSize > netPlaySimMaxMsgSize) )
+		{
+			fprintf( stderr, "Error: Message Header Validity Check Failed: %08X\n", hdr.msgId );
+			QCoreApplication::exit(1);
+			return;
+		}
+		if ( (hostBuf.size() - len) < static_cast<int>(hdr.msgSize) )
+		{
+			break;
+		}
+		if ( (hdr.msgId == NETPLAY_UDP_SETUP) && (hdr.msgSize >= sizeof(netPlayUdpSetup)) )
+		{
+			netPlayUdpSetup setup;
+
+			memcpy( &setup, hostBuf.constData() + len, sizeof(setup) );
+			setup.toHostByteOrder();
+			setup.port = udpFront.localPort();
+			setup.toNetworkByteOrder();
+			memcpy( hostBuf.data() + len, &setup, sizeof(setup) );
+		}
+		len += hdr.msgSize;
+	}
+	if (len > 0)
+	{
+		down.push( hostBuf.left(len) );
+		hostBuf.remove( 0, len );
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlaySimProxy::readUdp( QUdpSocket &sock, bool toHost )
+{
+	char buf[netPlaySimMaxUdpPacketSize];
+
+	while (sock.hasPendingDatagrams())
+	{
+		QHostAddress sender;
+		quint16 senderPort = 0;
+
+		qint64 size = sock.readDatagram( buf, sizeof(buf), &sender, &senderPort );
+
+		if (size <= 0)
+		{
+			continue;
+		}
+		if (toHost)
+		{
+			udpClientAddr = sender;
+			udpClientPort = senderPort;
+			udpBytesUp   += size;
+		}
+		else
+		{
+			udpBytesDown += size;
+		}
+		if (netPlaySimLink.lost())
+		{
+			continue;
+		}
+		Packet pkt;
+		pkt.due    = netPlaySimNow() + netPlaySimLink.transitTime();
+		pkt.data   = QByteArray( buf, size );
+		pkt.toHost = toHost;
+
+		packets.push_back( pkt );
+	}
+}
+//-----------------------------------------------------------------------------
+void NetPlaySimProxy::update( qint64 now )
+{
+	if ( (client != nullptr) && (host != nullptr) && (host->state() == QAbstractSocket::ConnectedState) )
+	{
+		up.deliver( host, now );
+		down.deliver( client, now );
+	}
+
+	// Packets each go when they are due, which can be ahead of one sent earlier
+	for (auto it = packets.begin(); it != packets.end(); )
+	{
+		if (it->due > now)
+		{
+			it++;
+			continue;
+		}
+		if (it->toHost)
+		{
+			if (host != nullptr)
+			{	// The host listens for UDP on its TCP port
+				udpBack.writeDatagram( it->data, host->peerAddress(), hostPort );
+			}
+		}
+		else if (udpClientPort != 0)
+		{
+			udpFront.writeDatagram( it->data, udpClientAddr, udpClientPort );
+		}
+		it = packets.erase(it);
+	}
+}
+
+//-----------------------------------------------------------------------------
+//--- Client Process
+//-----------------------------------------------------------------------------
+// A real fceux client, started with the offscreen Qt platform, that joins the session
+// through its own proxy.
+class NetPlaySimClient
+{
+	public:
+		QString  name;
+		int      player = 0; // 1-4, 0 for a spectator
+		QString  inputPath;  // FM2 movie with the buttons pressed
+		QString  statsPath;
+
+		NetPlaySimProxy proxy;
+
+		~NetPlaySimClient(void);
+
+		bool start( const QString &hostName, int hostPort, const QString &passwd, const QString &dir );
+		void stop(void);
+		bool isSynced(void){ return QFileInfo::exists(statsPath); }
+		std::string report(void);
+
+	private:
+		QProcess *process = nullptr;
+};
+//-----------------------------------------------------------------------------
+NetPlaySimClient::~NetPlaySimClient(void)
+{
+	stop();
+}
+//-----------------------------------------------------------------------------
+bool NetPlaySimClient::start( const QString &hostName, int hostPort, const QString &passwd, const QString &dir )
+{
+	if (!proxy.start( hostName, hostPort ))
+	{
+		return false;
+	}
+	QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+	QStringList args;
+
+	// Its own base directory, with an empty ROM cache like a first time player
+	QDir().mkpath( dir );
+	env.insert( "FCEUX_CONFIG_DIR", dir );
+	env.insert( "QT_QPA_PLATFORM", "offscreen" );
+
+	statsPath = dir + "/stats.txt";
+
+	args << "--no-config" << "1" << "--sound" << "0" << "--join" << "1"
+	     << "--net" << "127.0.0.1" << "--port" << QString::number(proxy.tcpPort())
+	     << "--user" << name << "--netplayPlayer" << QString::number(player)
+	     << "--netplayStats" << statsPath;
+	if (!passwd.isEmpty())
+	{
+		args << "--pass" << passwd;
+	}
+	if (player > 0)
+	{
+		args << "--netplayInput" << inputPath;
+	}
+
+	process = new QProcess();
+	process->setProcessEnvironment( env );
+	process->setStandardOutputFile( QProcess::nullDevice() );
+	process->setProcessChannelMode( QProcess::ForwardedErrorChannel );
+
+	QObject::connect( process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), [this](int, QProcess::ExitStatus)
+	{
+		fprintf( stderr, "Error: %s quit during the simulation\n", name.toLocal8Bit().constData() );
+		QCoreApplication::exit(1);
+	});
+	process->start( QCoreApplication::applicationFilePath(), args );
+
+	if (!process->waitForStarted())
+	{
+		fprintf( stderr, "Error: Could not start %s: %s\n", name.toLocal8Bit().constData(),
+				process->errorString().toLocal8Bit().constData() );
+		return false;
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+void NetPlaySimClient::stop(void)
+{
+	if (process == nullptr)
+	{
+		return;
+	}
+	QObject::disconnect( process, nullptr, nullptr, nullptr );
+
+	process->terminate();
+
+	if (!process->waitForFinished(3000))
+	{
+		process->kill();
+		process->waitForFinished(1000);
+	}
+	delete process;
+	process = nullptr;
+}
+//-----------------------------------------------------------------------------
+static std::string netPlaySimNumber( const char *fmt, double value )
+{
+	char num[64];
+
+	snprintf( num, sizeof(num), fmt, value );
+
+	return num;
+}
+//-----------------------------------------------------------------------------
+// From the figures the client keeps writing to its stats file
+std::string NetPlaySimClient::report(void)
+{
+	double seconds = 0.0, avg = 0.0;
+	unsigned int frames = 0, p95 = 0, max = 0, resyncs = 0, romFetches = 0;
+	unsigned long long samples = 0, stallMs = 0;
+	int udp = 0;
+	char line[256];
+
+	FILE *fp = ::fopen( statsPath.toLocal8Bit().constData(), "r" );
+
+	if (fp != nullptr)
+	{
+		while ( fgets( line, sizeof(line), fp ) != nullptr )
+		{
+			sscanf( line, "seconds %lf", &seconds );
+			sscanf( line, "frames %u", &frames );
+			sscanf( line, "latency_ms %llu %lf %u %u", &samples, &avg, &p95, &max );
+			sscanf( line, "stall_ms %llu", &stallMs );
+			sscanf( line, "resyncs %u", &resyncs );
+			sscanf( line, "rom_fetches %u", &romFetches );
+			sscanf( line, "udp %i", &udp );
+		}
+		::fclose(fp);
+	}
+	std::string s;
+
+	s += "    { \"name\": \"" + std::string(name.toLocal8Bit().constData()) + "\"";
+	s += ", \"role\": " + std::to_string( (player > 0) ? (NETPLAY_PLAYER1 + player - 1) : NETPLAY_SPECTATOR );
+	s += ", \"frames\": " + std::to_string(frames);
+	s += netPlaySimNumber( ", \"seconds\": %.1f", seconds );
+	s += ",\n      \"latency_ms\": { \"samples\": " + std::to_string(samples);
+	s += netPlaySimNumber( ", \"avg\": %.1f", avg );
+	s += netPlaySimNumber( ", \"p95\": %.1f", p95 );
+	s += netPlaySimNumber( ", \"max\": %.1f }", max );
+	s += netPlaySimNumber( ",\n      \"stall_ms_per_min\": %.1f", (seconds > 0) ? stallMs * 60.0 / seconds : 0.0 );
+	s += ", \"resyncs\": " + std::to_string(resyncs);
+	s += ", \"rom_fetches\": " + std::to_string(romFetches);
+	s += std::string(", \"udp\": ") + (udp ? "true" : "false");
+	s += netPlaySimNumber( ",\n      \"bytes_per_sec\": { \"down\": %.0f", (seconds > 0) ? proxy.bytesDown() / seconds : 0.0 );
+	s += netPlaySimNumber( ", \"up\": %.0f } }", (seconds > 0) ? proxy.bytesUp() / seconds : 0.0 );
+
+	return s;
+}
+
+//-----------------------------------------------------------------------------
+//--- Main
+//-----------------------------------------------------------------------------
+// Without a movie, buttons change every few frames
+static void netPlaySimMakeButtons( std::mt19937 &rng, std::vector <uint8_t> &buttons )
+{
+	static const uint8_t pads[] = { 0x00, 0x01, 0x02, 0x80, 0x40, 0x81, 0x41, 0x10, 0x20, 0x83 };
+
+	while (buttons.size() < 36000)
+	{
+		const uint8_t pad = pads[ std::uniform_int_distribution<size_t>( 0, sizeof(pads)-1 )(rng) ];
+		const int hold = std::uniform_int_distribution<int>( 4, 40 )(rng);
+
+		buttons.insert( buttons.end(), hold, pad );
+	}
+}
+//-----------------------------------------------------------------------------
+// The input log of an FM2 movie, one port per player, that the clients read their buttons from
+static bool netPlaySimWriteInput( const QString &path, const std::vector <std::vector<uint8_t>> &buttons )
+{
+	static const char names[] = "RLDUTSBA";
+	FILE *fp = ::fopen( path.toLocal8Bit().constData(), "w" );
+	size_t numFrames = buttons.front().size();
+
+	if (fp == nullptr)
+	{
+		return false;
+	}
+	for (auto& b : buttons)
+	{
+		numFrames = std::min( numFrames, b.size() );
+	}
+	for (size_t f=0; f<numFrames; f++)
+	{
+		fputs( "|0", fp );
+
+		for (auto& b : buttons)
+		{
+			fputc( '|', fp );
+
+			for (int i=0; i<8; i++)
+			{
+				fputc( (b[f] & (0x80 >> i)) ? names[i] : '.', fp );
+			}
+		}
+		fputs( "|\n", fp );
+	}
+	return ::fclose(fp) == 0;
+}
+//-----------------------------------------------------------------------------
+bool netPlaySimRequested( int argc, char *argv[] )
+{
+	for (int i=1; i<argc; i++)
+	{
+		if ( strcmp(argv[i], "--netplay-sim") == 0 )
+		{
+			return true;
+		}
+	}
+	return false;
+}
+//-----------------------------------------------------------------------------
+int  netPlaySimMain( int argc, char *argv[] )
+{
+	QCoreApplication app(argc, argv);
+	QString target;
+	QString hostName = "127.0.0.1";
+	QString passwd;
+	int hostPort = netPlaySimDefaultHostPort;
+	int numClients = 2;
+	int duration = 60;
+	int udpRedundancy = 0;
+	int rollbackFrames = 0;
+	unsigned int seed = 1;
+	const char *moviePath = nullptr;
+	const char *reportPath = nullptr;
+
+	for (int i=1; i<argc; i++)
+	{
+		if ( (strcmp(argv[i], "--netplay-sim") == 0) && (i+1 < argc) )
+		{
+			target = argv[++i];
+		}
+		else if ( (strcmp(argv[i], "--sim-clients") == 0) && (i+1 < argc) )
+		{
+			numClients = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--sim-movie") == 0) && (i+1 < argc) )
+		{
+			moviePath = argv[++i];
+		}
+		else if ( (strcmp(argv[i], "--sim-duration") == 0) && (i+1 < argc) )
+		{
+			duration = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--sim-delay") == 0) && (i+1 < argc) )
+		{
+			netPlaySimLink.delayMs = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--sim-jitter") == 0) && (i+1 < argc) )
+		{
+			netPlaySimLink.jitterMs = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--sim-loss") == 0) && (i+1 < argc) )
+		{
+			netPlaySimLink.lossPercent = atof( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--sim-udp") == 0) && (i+1 < argc) )
+		{
+			udpRedundancy = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--sim-rollback") == 0) && (i+1 < argc) )
+		{
+			rollbackFrames = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--sim-port") == 0) && (i+1 < argc) )
+		{
+			hostPort = atoi( argv[++i] );
+		}
+		else if ( (strcmp(argv[i], "--sim-password") == 0) && (i+1 < argc) )
+		{
+			passwd = argv[++i];
+		}
+		else if ( (strcmp(argv[i], "--sim-seed") == 0) && (i+1 < argc) )
+		{
+			seed = static_cast<unsigned int>( strtoul( argv[++i], nullptr, 0 ) );
+		}
+		else if ( (strcmp(argv[i], "--sim-report") == 0) && (i+1 < argc) )
+		{
+			reportPath = argv[++i];
+		}
+	}
+	if ( target.isEmpty() || (numClients <= 0) || (duration <= 0) || (hostPort <= 0) )
+	{
+		fprintf( stderr, "Error: --netplay-sim needs a ROM file to host, or a host to join as host[:port]\n" );
+		return 1;
+	}
+	netPlaySimLink.rng.seed( seed );
+	netPlaySimClock.start();
+
+	// A ROM file is hosted by a child process, anything else is a running host
+	QProcess *hostProcess = nullptr;
+
+	if (QFileInfo(target).isFile())
+	{
+		QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+		QStringList args;
+
+		env.insert( "QT_QPA_PLATFORM", "offscreen" );
+
+		args << "--no-config" << "1" << "--sound" << "0" << "--server" << "1"
+		     << "--port" << QString::number(hostPort)
+		     << "--netplayUdp" << QString::number(udpRedundancy)
+		     << "--netplayRollback" << QString::number(rollbackFrames);
+		if (!passwd.isEmpty())
+		{
+			args << "--pass" << passwd;
+		}
+		args << target;
+
+		hostProcess = new QProcess();
+		hostProcess->setProcessEnvironment( env );
+		hostProcess->setStandardOutputFile( QProcess::nullDevice() );
+		hostProcess->setProcessChannelMode( QProcess::ForwardedErrorChannel );
+		hostProcess->start( QCoreApplication::applicationFilePath(), args );
+
+		if (!hostProcess->waitForStarted())
+		{
+			fprintf( stderr, "Error: Could not start the host: %s\n", hostProcess->errorString().toLocal8Bit().constData() );
+			return 1;
+		}
+		printf("Host started for %s on port %i\n", target.toLocal8Bit().constData(), hostPort);
+	}
+	else
+	{
+		int sep = target.lastIndexOf(':');
+
+		if (sep > 0)
+		{
+			hostPort = target.mid(sep+1).toInt();
+			target.truncate(sep);
+		}
+		hostName = target;
+	}
+
+	QTemporaryDir tmpDir;
+	QString inputPath;
+
+	if (!tmpDir.isValid())
+	{
+		fprintf( stderr, "Error: Could not create a directory for the clients\n" );
+		return 1;
+	}
+	if (moviePath != nullptr)
+	{
+		if (!QFileInfo(moviePath).isFile())
+		{
+			fprintf( stderr, "Error: Could not read movie: %s\n", moviePath );
+			return 1;
+		}
+		inputPath = QFileInfo(moviePath).absoluteFilePath();
+	}
+	else
+	{
+		std::vector <std::vector<uint8_t>> buttons(4);
+
+		for (size_t i=0; i<buttons.size(); i++)
+		{
+			std::mt19937 rng( seed + static_cast<unsigned int>(i) );
+
+			netPlaySimMakeButtons( rng, buttons[i] );
+		}
+		inputPath = tmpDir.filePath("input.fm2");
+
+		if (!netPlaySimWriteInput( inputPath, buttons ))
+		{
+			fprintf( stderr, "Error: Could not write the input of the clients: %s\n", inputPath.toLocal8Bit().constData() );
+			return 1;
+		}
+	}
+
+	std::vector <NetPlaySimClient*> clients;
+
+	for (int i=0; i<numClients; i++)
+	{
+		NetPlaySimClient *client = new NetPlaySimClient();
+
+		client->name      = QString("Sim%1").arg(i+1);
+		client->inputPath = inputPath;
+
+		// The first four clients are the players, the rest spectators
+		if (i < 4)
+		{
+			client->player = i + 1;
+		}
+		clients.push_back( client );
+
+		if (!client->start( hostName, hostPort, passwd, tmpDir.filePath(client->name) ))
+		{
+			for (auto& c : clients)
+			{
+				delete c;
+			}
+			return 1;
+		}
+	}
+	printf("Simulating %i clients: delay %i ms, jitter %i ms, loss %.1f%%\n", numClients,
+			netPlaySimLink.delayMs, netPlaySimLink.jitterMs, netPlaySimLink.lossPercent);
+
+	// The proxies pass data on as it falls due
+	QTimer timer;
+
+	timer.setTimerType( Qt::PreciseTimer );
+
+	QObject::connect( &timer, &QTimer::timeout, [&]
+	{
+		const qint64 now = netPlaySimNow();
+
+		for (auto& client : clients)
+		{
+			client->proxy.update( now );
+		}
+	});
+	timer.start(1);
+
+	// The run starts once every client has a state
+	qint64 startTime = -1;
+	QTimer sessionTimer;
+
+	QObject::connect( &sessionTimer, &QTimer::timeout, [&]
+	{
+		const qint64 now = netPlaySimNow();
+
+		if (startTime < 0)
+		{
+			if (std::all_of( clients.begin(), clients.end(), [](NetPlaySimClient *c){ return c->isSynced(); } ))
+			{
+				startTime = now;
+			}
+			else if (now > 60000000)
+			{
+				fprintf( stderr, "Error: Not every client got a state from the host within a minute\n" );
+				QCoreApplication::exit(1);
+			}
+			return;
+		}
+		if ( (now - startTime) < (static_cast<qint64>(duration) * 1000000) )
+		{
+			return;
+		}
+		timer.stop();
+		sessionTimer.stop();
+
+		std::string report;
+
+		report += "{\n  \"host\": \"" + std::string(hostName.toLocal8Bit().constData()) + ":" + std::to_string(hostPort) + "\"";
+		report += ",\n  \"clients\": " + std::to_string(numClients);
+		report += ",\n  \"duration\": " + std::to_string(duration);
+		report += ",\n  \"delay_ms\": " + std::to_string(netPlaySimLink.delayMs);
+		report += ",\n  \"jitter_ms\": " + std::to_string(netPlaySimLink.jitterMs);
+		report += netPlaySimNumber( ",\n  \"loss_percent\": %.2f", netPlaySimLink.lossPercent );
+		report += ",\n  \"results\": [\n";
+
+		for (size_t i=0; i<clients.size(); i++)
+		{
+			report += clients[i]->report();
+			report += (i+1 < clients.size()) ? ",\n" : "\n";
+		}
+		report += "  ]\n}\n";
+
+		if (reportPath != nullptr)
+		{
+			FILE *fp = ::fopen( reportPath, "w" );
+
+			if (fp == nullptr)
+			{
+				fprintf( stderr, "Error: Could not write report: %s\n", reportPath );
+				QCoreApplication::exit(1);
+				return;
+			}
+			fputs( report.c_str(), fp );
+			::fclose(fp);
+		}
+		else
+		{
+			fputs( report.c_str(), stdout );
+		}
+		QCoreApplication::exit(0);
+	});
+	sessionTimer.start(100);
+
+	int retval = app.exec();
+
+	for (auto& client : clients)
+	{
+		delete client;
+	}
+	if (hostProcess != nullptr)
+	{
+		hostProcess->terminate();
+
+		if (!hostProcess->waitForFinished(3000))
+		{
+			hostProcess->kill();
+			hostProcess->waitForFinished(1000);
+		}
+		delete hostProcess;
+	}
+	return retval;
+}
@@ -0,0 +1,8 @@
+// NetPlaySim.h
+//
+#pragma once
+
+// True if the command line asks for a NetPlay network simulation, which runs without any GUI.
+bool netPlaySimRequested( int argc, char *argv[] );
+
+int  netPlaySimMain( int argc, char *argv[] );
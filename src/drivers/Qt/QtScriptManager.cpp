@@ -1642,6 +1642,75 @@ void MemoryScriptObject::setRegisterP(uint8_t v)
 	X.P = v;
 }
 //----------------------------------------------------
+void MemoryScriptObject::updateMemHook(int type)
+{
+	QJSValue** funcArray = nullptr;
+	void (*callback)(unsigned int address, unsigned int value, void *userData) = nullptr;
+
+	switch (type)
+	{
+		default:
+		case X6502_MemHook::Read:
+			type = X6502_MemHook::Read;
+			funcArray = readFunc;
+			callback = addressReadCallback;
+		break;
+		case X6502_MemHook::Write:
+			funcArray = writeFunc;
+			callback = addressWriteCallback;
+		break;
+		case X6502_MemHook::Exec:
+			funcArray = execFunc;
+			callback = addressExecCallback;
+		break;
+	}
+	X6502_MemHook::Type hookType = static_cast<X6502_MemHook::Type>(type);
+
+	// Only hook the runs of addresses that have a function, so the CPU
+	// does not call into the script for every other access.
+	std::vector<std::pair<int,int>> newRanges;
+	int start = -1;
+
+	for (int i=0; i<=AddressRange; i++)
+	{
+		bool used = (i < AddressRange) && (funcArray[i] != nullptr);
+
+		if (used && (start < 0))
+		{
+			start = i;
+		}
+		else if (!used && (start >= 0))
+		{
+			newRanges.push_back( std::make_pair(start, i-1) );
+			start = -1;
+		}
+	}
+
+	// Both lists are sorted by address, so only the runs that changed are
+	// taken back from or handed to X6502_MemHook.
+	std::vector<std::pair<int,int>>& oldRanges = hookRanges[type];
+	size_t i = 0, j = 0;
+
+	while ( (i < oldRanges.size()) || (j < newRanges.size()) )
+	{
+		if ( (i < oldRanges.size()) && (j < newRanges.size()) && (oldRanges[i] == newRanges[j]) )
+		{
+			i++; j++;
+		}
+		else if ( (j == newRanges.size()) || ((i < oldRanges.size()) && (oldRanges[i] < newRanges[j])) )
+		{
+			X6502_MemHook::Remove(hookType, callback, this, oldRanges[i].first, oldRanges[i].second);
+			i++;
+		}
+		else
+		{
+			X6502_MemHook::Add(hookType, callback, this, newRanges[j].first, newRanges[j].second);
+			j++;
+		}
+	}
+	oldRanges.swap(newRanges);
+}
+//----------------------------------------------------
 void MemoryScriptObject::registerCallback(int type, const QJSValue& func, int address, int size)
 {
 	int n=0;
@@ -1654,17 +1723,14 @@ void MemoryScriptObject::registerCallback(int type, const QJSValue& func, int ad
 		case X6502_MemHook::Read:
 			funcArray = readFunc;
 			numFuncsRegistered = &numReadFuncsRegistered;
-			X6502_MemHook::Add(X6502_MemHook::Read, addressReadCallback, this);
 		break;
 		case X6502_MemHook::Write:
 			funcArray = writeFunc;
 			numFuncsRegistered = &numWriteFuncsRegistered;
-			X6502_MemHook::Add(X6502_MemHook::Write, addressWriteCallback, this);
 		break;
 		case X6502_MemHook::Exec:
 			funcArray = execFunc;
 			numFuncsRegistered = &numExecFuncsRegistered;
-			X6502_MemHook::Add(X6502_MemHook::Exec, addressExecCallback, this);
 		break;
 	}
 	n = *numFuncsRegistered;
@@ -1705,6 +1771,8 @@ void MemoryScriptObject::registerCallback(int type, const QJSValue& func, int ad
 		}
 	}
 	*numFuncsRegistered = n;
+
+	updateMemHook(type);
 }
 //----------------------------------------------------
 void MemoryScriptObject::registerRead(const QJSValue& func, int address, int size)
@@ -1782,18 +1850,7 @@ void MemoryScriptObject::unregisterCallback(int type, const QJSValue& func, int
 	}
 	*numFuncsRegistered = n;
 
-	if (0 <= numReadFuncsRegistered)
-	{
-		X6502_MemHook::Remove(X6502_MemHook::Read, addressReadCallback, this);
-	}
-	if (0 <= numWriteFuncsRegistered)
-	{
-		X6502_MemHook::Remove(X6502_MemHook::Write, addressWriteCallback, this);
-	}
-	if (0 <= numExecFuncsRegistered)
-	{
-		X6502_MemHook::Remove(X6502_MemHook::Exec, addressExecCallback, this);
-	}
+	updateMemHook(type);
 }
 //----------------------------------------------------
 void MemoryScriptObject::unregisterRead(const QJSValue& func, int address, int size)
@@ -1813,9 +1870,21 @@ void MemoryScriptObject::unregisterExec(const QJSValue& func, int address, int s
 //----------------------------------------------------
 void MemoryScriptObject::unregisterAll()
 {
-	X6502_MemHook::Remove(X6502_MemHook::Read, addressReadCallback, this);
-	X6502_MemHook::Remove(X6502_MemHook::Write, addressWriteCallback, this);
-	X6502_MemHook::Remove(X6502_MemHook::Exec, addressExecCallback, this);
+	for (auto& range : hookRanges[X6502_MemHook::Read])
+	{
+		X6502_MemHook::Remove(X6502_MemHook::Read, addressReadCallback, this, range.first, range.second);
+	}
+	for (auto& range : hookRanges[X6502_MemHook::Write])
+	{
+		X6502_MemHook::Remove(X6502_MemHook::Write, addressWriteCallback, this, range.first, range.second);
+	}
+	for (auto& range : hookRanges[X6502_MemHook::Exec])
+	{
+		X6502_MemHook::Remove(X6502_MemHook::Exec, addressExecCallback, this, range.first, range.second);
+	}
+	hookRanges[X6502_MemHook::Read].clear();
+	hookRanges[X6502_MemHook::Write].clear();
+	hookRanges[X6502_MemHook::Exec].clear();
 
 	for (int i=0; i<AddressRange; i++)
 	{
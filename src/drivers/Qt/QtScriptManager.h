@@ -8,6 +8,9 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#include <vector>
+#include <utility>
+
 #include <QFile>
 #include <QColor>
 #include <QWidget>
@@ -471,7 +474,9 @@ private:
 	int numReadFuncsRegistered = 0;
 	int numWriteFuncsRegistered = 0;
 	int numExecFuncsRegistered = 0;
+	std::vector<std::pair<int,int>> hookRanges[3]; // Address runs currently added to X6502_MemHook, per type
 
+	void updateMemHook(int type);
 	void registerCallback(int type, const QJSValue& func, int address, int size = 1);
 	void unregisterCallback(int type, const QJSValue& func, int address, int size = 1);
 
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <algorithm>
 
 #include <QCloseEvent>
 #include <QGridLayout>
@@ -59,6 +60,7 @@ StateRecorderDialog_t::StateRecorderDialog_t(QWidget *parent)
 	snapMinutes     = new QSpinBox();
 	snapSeconds     = new QSpinBox();
 	historyDuration = new QSpinBox();
+	memoryBudget    = new QSpinBox();
 	snapFrameSelBtn = new QRadioButton( tr("By Frames") );
 	snapTimeSelBtn  = new QRadioButton( tr("By Time") );
 
@@ -73,7 +75,9 @@ StateRecorderDialog_t::StateRecorderDialog_t(QWidget *parent)
 	snapMinutes->setMinimum(0);
 	snapMinutes->setMaximum(60);
 	historyDuration->setMinimum(1);
-	historyDuration->setMaximum(180);
+	historyDuration->setMaximum(1440);
+	memoryBudget->setMinimum(16);
+	memoryBudget->setMaximum(16384);
 
 	opt = 10;
 	g_config->getOption("SDL.StateRecorderFramesBetweenSnaps", &opt);
@@ -83,6 +87,10 @@ StateRecorderDialog_t::StateRecorderDialog_t(QWidget *parent)
 	g_config->getOption("SDL.StateRecorderHistoryDurationMin", &opt );
 	historyDuration->setValue(opt);
 
+	opt = 256;
+	g_config->getOption("SDL.StateRecorderMemoryBudgetMB", &opt );
+	memoryBudget->setValue(opt);
+
 	opt = 0;
 	g_config->getOption("SDL.StateRecorderTimeBetweenSnapsMin", &opt);
 	snapMinutes->setValue(opt);
@@ -102,6 +110,7 @@ StateRecorderDialog_t::StateRecorderDialog_t(QWidget *parent)
 	connect(     snapSeconds, SIGNAL(valueChanged(int)), this, SLOT(spinBoxValueChanged(int)) );
 	connect(     snapMinutes, SIGNAL(valueChanged(int)), this, SLOT(spinBoxValueChanged(int)) );
 	connect( historyDuration, SIGNAL(valueChanged(int)), this, SLOT(spinBoxValueChanged(int)) );
+	connect(    memoryBudget, SIGNAL(valueChanged(int)), this, SLOT(spinBoxValueChanged(int)) );
 
 	frame = new QGroupBox(tr("Retain History For:"));
 	hbox  = new QHBoxLayout();
@@ -114,6 +123,17 @@ StateRecorderDialog_t::StateRecorderDialog_t(QWidget *parent)
 	grid->addWidget( recorderEnable, 0, 0 );
 	grid->addWidget( frame         , 1, 0 );
 
+	frame = new QGroupBox(tr("Memory Budget:"));
+	hbox  = new QHBoxLayout();
+
+	memoryBudget->setToolTip( tr("Oldest history is discarded when the recorder grows beyond this size.") );
+	hbox->addWidget( memoryBudget );
+	hbox->addWidget( new QLabel( tr("MB") ) );
+
+	frame->setLayout(hbox);
+
+	grid->addWidget( frame, 0, 1 );
+
 	frame = new QGroupBox(tr("Compression Level:"));
 	hbox  = new QHBoxLayout();
 
@@ -288,6 +308,11 @@ StateRecorderDialog_t::StateRecorderDialog_t(QWidget *parent)
 	hbox->addWidget( new QLabel(tr("Buffer Size:")), 1 );
 	hbox->addWidget( recBufSizeLbl, 1 );
 
+	recHistoryLbl = new QLineEdit();
+	recHistoryLbl->setReadOnly(true);
+	hbox->addWidget( new QLabel(tr("History:")), 1 );
+	hbox->addWidget( recHistoryLbl, 1 );
+
 	frame = new QGroupBox( tr("Buffer Use:") );
 	hbox  = new QHBoxLayout();
 
@@ -295,7 +320,7 @@ StateRecorderDialog_t::StateRecorderDialog_t(QWidget *parent)
 	frame->setLayout(hbox);
 
 	bufUsage = new QProgressBar();
-	bufUsage->setToolTip( tr("% use of history record buffer.") );
+	bufUsage->setToolTip( tr("% use of history record memory budget.") );
 	bufUsage->setOrientation( Qt::Horizontal );
 	bufUsage->setMinimum(   0 );
 	bufUsage->setMaximum( 100 );
@@ -380,6 +405,7 @@ void StateRecorderDialog_t::packConfig( StateRecorderConfigData &config )
 	config.compressionLevel = cmprLvlCbox->currentData().toInt();
 	config.loadPauseTimeSeconds = pauseDuration->value();
 	config.pauseOnLoad = static_cast<StateRecorderConfigData::PauseType>( pauseOnLoadCbox->currentData().toInt() );
+	config.memoryBudgetMB = memoryBudget->value();
 }
 //----------------------------------------------------------------------------
 bool StateRecorderDialog_t::dataSavedCheck(void)
@@ -445,6 +471,7 @@ void StateRecorderDialog_t::applyChanges(void)
 	g_config->setOption("SDL.StateRecorderCompressionLevel", config.compressionLevel);
 	g_config->setOption("SDL.StateRecorderPauseOnLoad", config.pauseOnLoad);
 	g_config->setOption("SDL.StateRecorderPauseDuration", config.loadPauseTimeSeconds);
+	g_config->setOption("SDL.StateRecorderMemoryBudgetMB", config.memoryBudgetMB);
 	g_config->setOption("SDL.StateRecorderEnable", recorderEnable->isChecked() );
 	g_config->save();
 }
@@ -504,19 +531,28 @@ void StateRecorderDialog_t::updateStartStopBuffon(void)
 void StateRecorderDialog_t::updateBufferSizeStatus(void)
 {
 	char stmp[64];
+	constexpr double oneMegaByte = 1024.0 * 1024.0;
 
 	int numSnapsSaved = FCEU_StateRecorderGetNumSnapsSaved();
-	int maxSnaps      = FCEU_StateRecorderGetMaxSnaps();
+	size_t memUsage   = FCEU_StateRecorderGetMemoryUsage();
+	size_t memBudget  = FCEU_StateRecorderGetMemoryBudget();
 
-	snprintf( stmp, sizeof(stmp), "%i", maxSnaps );
+	snprintf( stmp, sizeof(stmp), "%.01f / %.0f MB", static_cast<double>(memUsage) / oneMegaByte,
+			static_cast<double>(memBudget) / oneMegaByte );
 
 	recBufSizeLbl->setText( tr(stmp) );
 
-	if (maxSnaps > 0)
-	{
-		bufUsage->setMaximum( maxSnaps );
-	}
-	bufUsage->setValue( numSnapsSaved );
+	int32_t fps = FCEUI_GetDesiredFPS(); // Do >> 24 to get in Hz
+	double hz = ( ((double)fps) / 16777216.0 );
+	int histSec = static_cast<int>( static_cast<double>(FCEU_StateRecorderGetHistoryFrames()) / hz );
+
+	snprintf( stmp, sizeof(stmp), "%i:%02i:%02i (%i snaps)", histSec / 3600, (histSec / 60) % 60, histSec % 60, numSnapsSaved );
+
+	recHistoryLbl->setText( tr(stmp) );
+
+	// Progress bar is in kB so that large budgets do not overflow it
+	bufUsage->setMaximum( static_cast<int>(memBudget / 1024) );
+	bufUsage->setValue( static_cast<int>( std::min(memUsage, memBudget) / 1024) );
 }
 //----------------------------------------------------------------------------
 void StateRecorderDialog_t::updateRecorderStatusLabel(void)
@@ -582,29 +618,18 @@ void StateRecorderDialog_t::recalcMemoryUsage(void)
 {
 	char stmp[64];
 
-	float fsnapMin = 1.0;
-	float fhistMin = static_cast<float>( historyDuration->value() );
-
-	if (snapUseTime)
-	{
-		fsnapMin =   static_cast<float>( snapMinutes->value() ) +
-		        ( static_cast<float>( snapSeconds->value() ) / 60.0f );
-	}
-	else
-	{
-		int32_t fps = FCEUI_GetDesiredFPS(); // Do >> 24 to get in Hz
-		double hz = ( ((double)fps) / 16777216.0 );
-
-		fsnapMin  = static_cast<double>(snapFrames->value()) / (hz * 60.0);
-	}
-
-	float fnumSnaps = fhistMin / fsnapMin;
 	float fsnapSize = 10.0f * 1024.0f;
 	float ftotalSize;
 	constexpr float oneKiloByte = 1024.0f;
 	constexpr float oneMegaByte = 1024.0f * 1024.0f;
 
-	int inumSnaps = static_cast<int>( fnumSnaps + 0.5f );
+	// Older history is kept at progressively lower density, so the number of
+	// snapshots grows much slower than the history duration.
+	StateRecorderConfigData config;
+
+	packConfig( config );
+
+	int inumSnaps = FCEU_StateRecorderCalcMaxSnaps( config );
 
 	snprintf( stmp, sizeof(stmp), "%i", inumSnaps );
 	
@@ -653,6 +678,9 @@ void StateRecorderDialog_t::recalcMemoryUsage(void)
 
 	ftotalSize = fsnapSize * static_cast<float>(inumSnaps);
 
+	// Anything beyond the budget gets evicted
+	ftotalSize = std::min( ftotalSize, static_cast<float>(memoryBudget->value()) * oneMegaByte );
+
 	if (ftotalSize >= oneMegaByte)
 	{
 		snprintf( stmp, sizeof(stmp), "%.02f MB", ftotalSize / oneMegaByte );
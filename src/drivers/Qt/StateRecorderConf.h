@@ -37,6 +37,7 @@ protected:
 	QSpinBox     *snapSeconds;
 	QSpinBox     *snapFrames;
 	QSpinBox     *historyDuration;
+	QSpinBox     *memoryBudget;
 	QSpinBox     *pauseDuration;
 	QCheckBox    *recorderEnable;
 	QLineEdit    *numSnapsLbl;
@@ -53,6 +54,7 @@ protected:
 	QRadioButton *snapTimeSelBtn;
 	QLineEdit    *recStatusLbl;
 	QLineEdit    *recBufSizeLbl;
+	QLineEdit    *recHistoryLbl;
 	QPushButton  *startStopButton;
 	QProgressBar *bufUsage;
 	QTimer       *updateTimer;
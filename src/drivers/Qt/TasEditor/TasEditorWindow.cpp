@@ -749,6 +749,15 @@ QMenuBar *TasEditorWindow::buildMenuBar(void)
 
 	confMenu->addAction(act);
 
+	// Config -> Set Greenzone Memory Budget
+	act = new QAction(tr("Set Greenzone Memory Budget"), this);
+	//act->setShortcut(QKeySequence(tr("Ctrl+N")));
+	act->setStatusTip(tr("Set Greenzone Memory Budget"));
+	//act->setIcon( style()->standardIcon( QStyle::SP_FileDialogStart ) );
+	connect(act, SIGNAL(triggered()), this, SLOT(setGreenzoneMemoryBudget(void)) );
+
+	confMenu->addAction(act);
+
 	confMenu->addSeparator();
 
 	// Config -> Enable Greenzoneing
@@ -761,6 +770,15 @@ QMenuBar *TasEditorWindow::buildMenuBar(void)
 
 	confMenu->addAction(act);
 
+	// Config -> Regenerate Greenzone in Background
+	bgGrnznAct = act = new QAction(tr("Regenerate Greenzone in Background"), this);
+	act->setCheckable(true);
+	act->setStatusTip(tr("Re-emulate frames invalidated by Input changes in a separate process"));
+	act->setEnabled( GREENZONE_WORKER::isSupported() );
+	connect(act, SIGNAL(triggered(bool)), this, SLOT(bgGrnznActChanged(bool)) );
+
+	confMenu->addAction(act);
+
 	// Config -> Autofire Pattern skips Lag
 	afPtrnSkipLagAct = act = new QAction(tr("Autofire Pattern skips Lag"), this);
 	act->setCheckable(true);
@@ -1371,6 +1389,7 @@ void TasEditorWindow::updateCheckedItems(void)
 	//autoLuaCBox->setChecked( taseditorConfig.enableLuaAutoFunction );
 	autoLuaAct->setChecked( taseditorConfig.enableLuaAutoFunction );
 	enaGrnznAct->setChecked( taseditorConfig.enableGreenzoning );
+	bgGrnznAct->setChecked( taseditorConfig.regenerateGreenzoneInBackground );
 	afPtrnSkipLagAct->setChecked( taseditorConfig.autofirePatternSkipsLag );
 	adjInputLagAct->setChecked( taseditorConfig.autoAdjustInputAccordingToLag );
 	drawInputDragAct->setChecked( taseditorConfig.drawInputByDragging );
@@ -1508,6 +1527,7 @@ int TasEditorWindow::initModules(void)
 	history.reset();
 	// reset Taseditor variables
 	mustCallManualLuaFunction = false;
+	nextSeekRedrawTime = 0;
 	
 	//SetFocus(history.hwndHistoryList);		// set focus only once, to show blue selection cursor
 	//SetFocus(pianoRoll.hwndList);
@@ -1555,7 +1575,12 @@ void TasEditorWindow::frameUpdate(void)
 	}
 #endif
 
-	pianoRoll->update();
+	// while fast seeking, the rows change every frame, a few redraws per second are enough
+	if ( !PLAYBACK::isFastSeeking() || (tasEditorTimeStamp >= nextSeekRedrawTime) )
+	{
+		pianoRoll->update();
+		nextSeekRedrawTime = tasEditorTimeStamp + FAST_SEEK_REDRAW_INTERVAL;
+	}
 
 	if ( recentProjectMenuReset )
 	{
@@ -2954,6 +2979,11 @@ void TasEditorWindow::enaGrnznActChanged(bool val)
 	taseditorConfig.enableGreenzoning = val;
 }
 //----------------------------------------------------------------------------
+void TasEditorWindow::bgGrnznActChanged(bool val)
+{
+	taseditorConfig.regenerateGreenzoneInBackground = val;
+}
+//----------------------------------------------------------------------------
 void TasEditorWindow::afPtrnSkipLagActChanged(bool val)
 {
 	taseditorConfig.autofirePatternSkipsLag = val;
@@ -3205,7 +3235,7 @@ void TasEditorWindow::playbackTurboSeekCb(bool val)
 	// if currently seeking, apply this option immediately
 	if (playback.getPauseFrame() >= 0)
 	{
-		turbo = taseditorConfig.turboSeek;
+		playback.setTurboSeeking( taseditorConfig.turboSeek );
 	}
 }
 // ----------------------------------------------------------------------------------------------
@@ -3462,6 +3492,41 @@ void TasEditorWindow::setGreenzoneCapacity(void)
 	}
 }
 // ----------------------------------------------------------------------------------------------
+void TasEditorWindow::setGreenzoneMemoryBudget(void)
+{
+	int ret;
+	int newValue = taseditorConfig.greenzoneMemoryBudget;
+	QInputDialog dialog(this);
+	FCEU_CRITICAL_SECTION( emuLock );
+
+	dialog.setWindowTitle( tr("Greenzone Memory Budget") );
+	dialog.setInputMode( QInputDialog::IntInput );
+	dialog.setIntRange( GREENZONE_MEMORY_BUDGET_MIN, GREENZONE_MEMORY_BUDGET_MAX );
+	dialog.setLabelText( tr("How many megabytes of RAM may the Greenzone use?\n(savestates over the budget are moved to a temporary file)") );
+	dialog.setIntValue( newValue );
+
+	ret = dialog.exec();
+
+	if ( ret == QDialog::Accepted )
+	{
+		newValue = dialog.intValue();
+
+		if (newValue < GREENZONE_MEMORY_BUDGET_MIN)
+		{
+			newValue = GREENZONE_MEMORY_BUDGET_MIN;
+		}
+		else if (newValue > GREENZONE_MEMORY_BUDGET_MAX)
+		{
+			newValue = GREENZONE_MEMORY_BUDGET_MAX;
+		}
+		if (newValue != taseditorConfig.greenzoneMemoryBudget)
+		{
+			taseditorConfig.greenzoneMemoryBudget = newValue;
+			greenzone.runGreenzoneCleaning();
+		}
+	}
+}
+// ----------------------------------------------------------------------------------------------
 void TasEditorWindow::setMaxUndoCapacity(void)
 {
 	int ret;
@@ -446,6 +446,7 @@ class TasEditorWindow : public QDialog
 		QAction   *dpyBrnchDescAct;
 		QAction   *dpyBrnchScrnAct;
 		QAction   *enaGrnznAct;
+		QAction   *bgGrnznAct;
 		QAction   *afPtrnSkipLagAct;
 		QAction   *adjInputLagAct;
 		QAction   *drawInputDragAct;
@@ -523,6 +524,7 @@ class TasEditorWindow : public QDialog
 
 		bool mustCallManualLuaFunction;
 		bool recentProjectMenuReset;
+		uint64_t nextSeekRedrawTime;
 	private:
 
 		int initModules(void);
@@ -588,6 +590,7 @@ class TasEditorWindow : public QDialog
 		void followUndoActChanged(bool);
 		void followMkrActChanged(bool);
 		void enaGrnznActChanged(bool);
+		void bgGrnznActChanged(bool);
 		void afPtrnSkipLagActChanged(bool);
 		void adjInputLagActChanged(bool);
 		void drawInputDragActChanged(bool);
@@ -609,6 +612,7 @@ class TasEditorWindow : public QDialog
 		void playbackTurboSeekCb(bool);
 		void openProjectSaveOptions(void);
 		void setGreenzoneCapacity(void);
+		void setGreenzoneMemoryBudget(void);
 		void setMaxUndoCapacity(void);
 		void setCurrentPattern(int);
 		void tabViewChanged(int);
@@ -65,7 +65,7 @@ bool BOOKMARK::isDifferentFromCurrentMovie()
 void BOOKMARK::set()
 {
 	// copy Input and Hotchanges
-	snapshot.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges);
+	snapshot.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges, -1, &history->getCurrentSnapshot());
 	snapshot.keyFrame = currFrameCounter;
 	if (taseditorConfig->enableHotChanges)
 		snapshot.inputlog.copyHotChanges(&history->getCurrentSnapshot().inputlog);
@@ -15,7 +15,9 @@ Greenzone - Access zone
 * saves and loads the data from a project file. On error: truncates Greenzone to last successfully read savestate
 * regularly checks if there's a savestate of current emulation state, if there's no such savestate in array then creates one and updates lag info for previous frame
 * implements the working of "Auto-adjust Input according to lag" feature
-* regularly runs gradual cleaning of the savestates array (for memory saving), deleting oldest savestates
+* regularly runs gradual cleaning of the savestates array (for memory saving), deleting oldest savestates except keyframes
+* keeps the savestates within the memory budget by handing colder frames to GreenzoneStorage for recompression or spilling to disk
+* optionally regenerates the invalidated frames in the background with GreenzoneWorker and lets Playback seeking skip over them
 * on demand: (when movie Input was changed) truncates the size of Greenzone, deleting savestates that became irrelevant because of new Input. After truncating it may also move Playback cursor (which must always reside within Greenzone) and may launch Playback seeking
 * stores resources: save id, properties of gradual cleaning, timing of cleaning
 ------------------------------------------------------------------------------------ */
@@ -25,6 +27,8 @@ Greenzone - Access zone
 #include "fceu.h"
 #include "state.h"
 #include "driver.h"
+#include "fceulua.h"
+#include "Qt/ConsoleDebugger.h"
 #include "Qt/TasEditor/taseditor_project.h"
 #include "Qt/TasEditor/TasEditorWindow.h"
 
@@ -36,16 +40,24 @@ static char greenzone_skipsave_id[GREENZONE_ID_LEN] = "GREENZONX";
 GREENZONE::GREENZONE()
 {
 	nextCleaningTime = 0;
+	workerPending = false;
+	workerStartFrame = 0;
+	workerEndFrame = -1;
+	workerStartTime = 0;
 }
 
 void GREENZONE::init()
 {
 	reset();
+	updateMemoryBudget();
 	nextCleaningTime = getTasEditorTime() + TIME_BETWEEN_CLEANINGS;
 }
 void GREENZONE::free()
 {
-	savestates.resize(0);
+	worker.stop();
+	workerPending = false;
+	workerEndFrame = -1;
+	savestates.reset();
 	greenzoneSize = 0;
 	lagLog.reset();
 }
@@ -66,8 +78,8 @@ void GREENZONE::update()
 			greenzoneSize = currFrameCounter + 1;
 	}
 
-	// run cleaning from time to time
-	if (getTasEditorTime() > nextCleaningTime)
+	// run cleaning from time to time, or right away if the savestates outgrew the memory budget
+	if (getTasEditorTime() > nextCleaningTime || savestates.isOverBudget())
 		runGreenzoneCleaning();
 
 	// also log lag frames
@@ -102,18 +114,25 @@ void GREENZONE::update()
 			}
 		}
 	}
+
+	// take the savestates regenerated in the background
+	updateRegeneration();
 }
 
 void GREENZONE::collectCurrentState()
 {
-	if ((int)savestates.size() <= currFrameCounter)
+	if (savestates.size() <= currFrameCounter)
 		savestates.resize(currFrameCounter + 1);
+	// fast seeking only needs the keyframes on its way, the frames just before the target are still collected for rewinding
+	bool sparse = PLAYBACK::isFastSeeking() && (currFrameCounter & GREENZONE_KEYFRAME_MASK)
+		&& currFrameCounter < playback->getPauseFrame() - FAST_SEEK_DENSE_GREENZONE_DISTANCE;
 	// if frame is not saved - log savestate
-	if (!savestates[currFrameCounter].size())
+	if (!sparse && !savestates.has(currFrameCounter))
 	{
-		EMUFILE_MEMORY ms(&savestates[currFrameCounter]);
-		FCEUSS_SaveMS(&ms, Z_DEFAULT_COMPRESSION);
-		ms.trim();
+		// fast compression, the frame is recompressed by GreenzoneStorage when it gets cold
+		EMUFILE_MEMORY ms;
+		FCEUSS_SaveMS(&ms, Z_BEST_SPEED);
+		savestates.store(currFrameCounter, ms.buf(), ms.size());
 	}
 	if (greenzoneSize <= currFrameCounter)
 		greenzoneSize = currFrameCounter + 1;
@@ -121,12 +140,17 @@ void GREENZONE::collectCurrentState()
 
 bool GREENZONE::loadSavestateOfFrame(unsigned int frame)
 {
-	if (frame >= savestates.size() || !savestates[frame].size())
+	if (!savestates.fetch(frame, savestateBuffer))
 		return false;
-	EMUFILE_MEMORY ms(&savestates[frame]);
+	EMUFILE_MEMORY ms(&savestateBuffer);
 	return FCEUSS_LoadFP(&ms, SSLOADPARAM_NOBACKUP);
 }
 
+void GREENZONE::updateMemoryBudget()
+{
+	savestates.setBudget((size_t)taseditorConfig->greenzoneMemoryBudget * 1024 * 1024);
+}
+
 void GREENZONE::runGreenzoneCleaning()
 {
 	bool changed = false;
@@ -168,12 +192,16 @@ void GREENZONE::runGreenzoneCleaning()
 		if (i & 0xF)
 			changed = changed | clearSavestateAndFreeMemory(i);
 	}
-	// clear all remaining
+	// clear all remaining, except keyframes, so that every frame can be reached without re-emulating from frame 0
 	for (; i > 0; i--)
 	{
-		changed = changed | clearSavestateAndFreeMemory(i);
+		if (i & GREENZONE_KEYFRAME_MASK)
+			changed = changed | clearSavestateAndFreeMemory(i);
 	}
 finish:
+	// recompress or spill what's left over the memory budget
+	updateMemoryBudget();
+	savestates.rebalance(currFrameCounter, taseditorConfig->greenzoneCapacity);
 	if (changed)
 	{
 		//pianoRoll.redraw();
@@ -186,29 +214,11 @@ finish:
 // returns true if actually cleared savestate data
 bool GREENZONE::clearSavestateOfFrame(unsigned int frame)
 {
-	if (frame < savestates.size() && savestates[frame].size())
-	{
-	    savestates[frame].resize(0);
-		return true;
-	}
-	else
-	{
-		return false;
-	}
+	return savestates.clear(frame);
 }
 bool GREENZONE::clearSavestateAndFreeMemory(unsigned int frame)
 {
-	if (frame < savestates.size() && savestates[frame].size())
-	{
-		//savestates[frame].swap(std::vector<uint8_t>()); //FIXME
-		savestates[frame].clear();
-		savestates[frame].shrink_to_fit();
-		return true;
-	}
-	else
-	{
-		return false;
-	}
+	return savestates.clear(frame);
 }
 
 void GREENZONE::ungreenzoneSelectedFrames()
@@ -252,84 +262,29 @@ void GREENZONE::save(EMUFILE *os, int save_type)
 
 		setTasProjectProgressBar( 0, greenzoneSize );
 	}
-	int frame, size;
-	int last_tick = -1;
+	int frame;
+	std::vector<int> frames;
 
 	switch (save_type)
 	{
 		case GREENZONE_SAVING_MODE_ALL:
 		{
-			// write savestates
 			for (frame = 0; frame < greenzoneSize; ++frame)
-			{
-				// update TASEditor progressbar from time to time
-				if (frame / PROGRESSBAR_UPDATE_RATE > last_tick)
-				{
-					setTasProjectProgressBar( frame, greenzoneSize );
-					playback->setProgressbar(frame, greenzoneSize);
-					last_tick = frame / PROGRESSBAR_UPDATE_RATE;
-				}
-				if (!savestates[frame].size()) continue;
-				write32le(frame, os);
-				// write savestate
-				size = savestates[frame].size();
-				write32le(size, os);
-				os->fwrite(&savestates[frame][0], size);
-			}
-			// write -1 as eof for greenzone
-			write32le(-1, os);
+				frames.push_back(frame);
 			break;
 		}
 		case GREENZONE_SAVING_MODE_16TH:
 		{
-			// write savestates
 			for (frame = 0; frame < greenzoneSize; ++frame)
-			{
 				if (!(frame & 0xF) || frame == currFrameCounter)
-				{
-					// update TASEditor progressbar from time to time
-					if (frame / PROGRESSBAR_UPDATE_RATE > last_tick)
-					{
-						setTasProjectProgressBar( frame, greenzoneSize );
-						playback->setProgressbar(frame, greenzoneSize);
-						last_tick = frame / PROGRESSBAR_UPDATE_RATE;
-					}
-					if (!savestates[frame].size()) continue;
-					write32le(frame, os);
-					// write savestate
-					size = savestates[frame].size();
-					write32le(size, os);
-					os->fwrite(&savestates[frame][0], size);
-				}
-			}
-			// write -1 as eof for greenzone
-			write32le(-1, os);
+					frames.push_back(frame);
 			break;
 		}
 		case GREENZONE_SAVING_MODE_MARKED:
 		{
-			// write savestates
 			for (frame = 0; frame < greenzoneSize; ++frame)
-			{
 				if (markersManager->getMarkerAtFrame(frame) || frame == currFrameCounter)
-				{
-					// update TASEditor progressbar from time to time
-					if (frame / PROGRESSBAR_UPDATE_RATE > last_tick)
-					{
-						setTasProjectProgressBar( frame, greenzoneSize );
-						playback->setProgressbar(frame, greenzoneSize);
-						last_tick = frame / PROGRESSBAR_UPDATE_RATE;
-					}
-					if (!savestates[frame].size()) continue;
-					write32le(frame, os);
-					// write savestate
-					size = savestates[frame].size();
-					write32le(size, os);
-					os->fwrite(&savestates[frame][0], size);
-				}
-			}
-			// write -1 as eof for greenzone
-			write32le(-1, os);
+					frames.push_back(frame);
 			break;
 		}
 		case GREENZONE_SAVING_MODE_NO:
@@ -344,23 +299,61 @@ void GREENZONE::save(EMUFILE *os, int save_type)
 			{
 				// write ONE savestate for currFrameCounter
 				collectCurrentState();
-				int size = savestates[currFrameCounter].size();
-				write32le(size, os);
-				os->fwrite(&savestates[currFrameCounter][0], size);
+				if (!savestates.has(currFrameCounter))
+				{
+					// fast seeking skips the frames between keyframes, but this one is needed
+					EMUFILE_MEMORY ms;
+					FCEUSS_SaveMS(&ms, Z_BEST_SPEED);
+					savestates.store(currFrameCounter, ms.buf(), ms.size());
+				}
+				if (savestates.fetch(currFrameCounter, savestateBuffer, Z_DEFAULT_COMPRESSION) && !savestateBuffer.empty())
+				{
+					int size = savestateBuffer.size();
+					write32le(size, os);
+					os->fwrite(&savestateBuffer[0], size);
+				} else
+				{
+					// no savestate, load() then starts from an empty Greenzone
+					write32le(0, os);
+				}
 			}
 			break;
 		}
 	}
 	if (save_type != GREENZONE_SAVING_MODE_NO)
 	{
+		// write savestates, a batch at a time, so that the progressbar keeps moving
+		for (size_t i = 0; i < frames.size(); i += PROGRESSBAR_UPDATE_RATE)
+		{
+			setTasProjectProgressBar( frames[i], greenzoneSize );
+			playback->setProgressbar(frames[i], greenzoneSize);
+			int count = frames.size() - i;
+			if (count > PROGRESSBAR_UPDATE_RATE)
+				count = PROGRESSBAR_UPDATE_RATE;
+			savestates.saveFrames(os, &frames[i], count, Z_DEFAULT_COMPRESSION);
+		}
+		// write -1 as eof for greenzone
+		write32le(-1, os);
 		setTasProjectProgressBar( greenzoneSize, greenzoneSize );
 	}
 }
+
+// called before the project file the Greenzone was loaded from is replaced by a newly saved one
+void GREENZONE::releaseProjectFile(const char* fileName)
+{
+#ifdef WIN32
+	// the file is still mapped and can't be replaced, so the savestates that are still in it have to move out
+	if (savestates.isSource(fileName))
+		savestates.detachSource();
+#endif
+}
 // returns true if couldn't load
-bool GREENZONE::load(EMUFILE *is, unsigned int offset)
+// if the name of the file is given, savestates aren't read at all, they are taken from the file when needed
+bool GREENZONE::load(EMUFILE *is, unsigned int offset, const char* fileName)
 {
 	int frame = 0, prev_frame = -1;
        	unsigned int size = 0;
+	size_t fileSize = 0;
 	int last_tick = -1;
 	char save_id[GREENZONE_ID_LEN];
 
@@ -391,11 +384,12 @@ bool GREENZONE::load(EMUFILE *is, unsigned int offset)
 			if (currFrameCounter)
 			{
 				// there must be one savestate in the file
-				if (read32le(&size, is) && size >= 0)
+				if (read32le(&size, is) && size > 0)
 				{
-					savestates[frame].resize(size);
-					if (is->fread(&savestates[frame][0], size) == size)
+					savestateBuffer.resize(size);
+					if (is->fread(&savestateBuffer[0], size) == size)
 					{
+						savestates.store(frame, savestateBuffer);
 						if (loadSavestateOfFrame(currFrameCounter))
 						{
 							FCEU_printf("No Greenzone in the file\n");
@@ -417,6 +411,9 @@ bool GREENZONE::load(EMUFILE *is, unsigned int offset)
 	if (strcmp(greenzone_save_id, save_id)) goto error;		// string is not valid
 
 	setTasProjectProgressBarText("Loading Greenzone...");
+	if (fileName && !savestates.attachSource(fileName))
+		fileName = NULL;
+	fileSize = is->size();
 	// read LagLog
 	lagLog.load(is);
 	// read size
@@ -448,7 +445,7 @@ bool GREENZONE::load(EMUFILE *is, unsigned int offset)
 				// read savestate
 				if (!read32le(&size, is)) break;
 				if (size < 0) break;
-				if (frame <= greenzone_tail_frame16
+				if ((frame <= greenzone_tail_frame16 && (frame & GREENZONE_KEYFRAME_MASK))
 					|| (frame <= greenzone_tail_frame8 && (frame & 0xF))
 					|| (frame <= greenzone_tail_frame4 && (frame & 0x7))
 					|| (frame <= greenzone_tail_frame2 && (frame & 0x3))
@@ -456,13 +453,22 @@ bool GREENZONE::load(EMUFILE *is, unsigned int offset)
 				{
 					// skip loading this savestate
 					if (is->fseek(size, SEEK_CUR) != 0) break;
+				} else if (fileName)
+				{
+					// only remember where this savestate is, it will be read from the file when needed
+					size_t pos = is->ftell();
+					if (!size || pos + size > fileSize || is->fseek(size, SEEK_CUR) != 0) break;
+					savestates.storeFromSource(frame, pos, size);
+					prev_frame = frame;
 				} else
 				{
 					// load this savestate
-					if ((int)savestates.size() <= frame)
-						savestates.resize(frame + 1);
-					savestates[frame].resize(size);
-					if (is->fread(&savestates[frame][0], size) < size) break;
+					savestateBuffer.resize(size);
+					if (!size || is->fread(&savestateBuffer[0], size) < size) break;
+					savestates.store(frame, savestateBuffer);
+					// keep within the memory budget while loading long projects
+					if (savestates.isOverBudget())
+						savestates.rebalance(currFrameCounter, taseditorConfig->greenzoneCapacity);
 					prev_frame = frame;			// successfully read one Greenzone frame info
 				}
 			}
@@ -604,11 +610,13 @@ void GREENZONE::invalidate(int after)
 		// clear all savestates that became irrelevant
 		for (int i = savestates.size() - 1; i > after; i--)
 			clearSavestateOfFrame(i);
+		int oldSize = greenzoneSize;
 		if (greenzoneSize > after + 1)
 		{
 			greenzoneSize = after + 1;
 			FCEUMOV_IncrementRerecordCount();
 		}
+		scheduleRegeneration(after, oldSize);
 	}
 	// redraw Piano Roll even if Greenzone didn't change
 	//pianoRoll.redraw();
@@ -624,10 +632,12 @@ void GREENZONE::invalidateAndUpdatePlayback(int after)
 		// clear all savestates that became irrelevant
 		for (int i = savestates.size() - 1; i > after; i--)
 			clearSavestateOfFrame(i);
+		int oldSize = greenzoneSize;
 		if (greenzoneSize > after + 1 || currFrameCounter > after)
 		{
 			greenzoneSize = after + 1;
 			FCEUMOV_IncrementRerecordCount();
+			scheduleRegeneration(after, oldSize);
 			// either set Playback cursor to be inside the Greenzone or run seeking to restore Playback cursor position
 			if (currFrameCounter >= greenzoneSize)
 			{
@@ -652,10 +662,113 @@ void GREENZONE::invalidateAndUpdatePlayback(int after)
 	bookmarks->redrawBookmarksList();
 }
 // -------------------------------------------------------------------------------------------------
+// restarts the background worker from the last savestate that survived the invalidation
+void GREENZONE::scheduleRegeneration(int after, int oldSize)
+{
+	bool active = workerPending || worker.isRunning();
+	// the Input was changed beyond the frames that the worker is going to produce
+	if (active && after >= workerEndFrame)
+		return;
+	int endFrame = oldSize - 1;
+	if (active && workerEndFrame > endFrame)
+		endFrame = workerEndFrame;
+	worker.stop();
+	workerPending = false;
+	workerEndFrame = -1;
+
+	if (!taseditorConfig->regenerateGreenzoneInBackground || !taseditorConfig->enableGreenzoning || !GREENZONE_WORKER::isSupported())
+		return;
+	if (endFrame >= currMovieData.getNumRecords())
+		endFrame = currMovieData.getNumRecords() - 1;
+	int startFrame = after;
+	if (startFrame >= greenzoneSize)
+		startFrame = greenzoneSize - 1;
+	while (startFrame >= 0 && !savestates.has(startFrame))
+		startFrame--;
+	if (startFrame < 0 || endFrame <= startFrame)
+		return;
+	// wait a bit, because the Input is often changed several times in a row (e.g. when drawing)
+	workerPending = true;
+	workerStartFrame = startFrame;
+	workerEndFrame = endFrame;
+	workerStartTime = getTasEditorTime() + GREENZONE_WORKER_START_DELAY;
+}
+
+void GREENZONE::updateRegeneration()
+{
+	// Recording edits the Input every frame and goes through History and Piano Roll, the worker must not run meanwhile
+	if (isTaseditorRecording())
+	{
+		if (worker.isRunning())
+		{
+			worker.stop();
+			workerEndFrame = -1;
+		}
+		return;
+	}
+	if (workerPending)
+	{
+		if (getTasEditorTime() < workerStartTime)
+			return;
+		workerPending = false;
+		// Lua scripts and the Debugger would be fooled by the frames emulated in the worker, leave them to Playback
+#ifdef _S9XLUA_H
+		if (FCEU_LuaRunning())
+			return;
+#endif
+		if (debuggerWindowIsOpen())
+			return;
+		if (!savestates.fetch(workerStartFrame, workerSavestate) || !worker.start(workerStartFrame, workerEndFrame, workerSavestate))
+			return;
+	}
+	if (!worker.isRunning())
+		return;
+
+	bool alive = worker.poll();
+	int frame;
+	bool lagged;
+	while (worker.nextState(frame, lagged, workerSavestate))
+	{
+		// the states must continue the Greenzone and stay within the movie
+		if (frame > greenzoneSize || frame >= currMovieData.getNumRecords())
+		{
+			worker.stop();
+			break;
+		}
+		// lag differs from what Playback saw, so the Input may have to be adjusted, which is up to Playback
+		int old_lagFlag = lagLog.getLagInfoAtFrame(frame - 1);
+		if (taseditorConfig->autoAdjustInputAccordingToLag && old_lagFlag != LAGGED_UNKNOWN && old_lagFlag != (lagged ? LAGGED_YES : LAGGED_NO))
+		{
+			worker.stop();
+			break;
+		}
+		if (savestates.size() <= frame)
+			savestates.resize(frame + 1);
+		if (!savestates.has(frame))
+			savestates.store(frame, workerSavestate);
+		if (greenzoneSize <= frame)
+			greenzoneSize = frame + 1;
+		lagLog.setLagInfo(frame - 1, lagged);
+		// keep current snapshot laglog in touch
+		history->getCurrentSnapshot().laglog.setLagInfo(frame - 1, lagged);
+	}
+	if (!alive)
+		workerEndFrame = -1;
+
+	// if Playback is seeking through the frames that are already regenerated, skip right to the end of them
+	int target = playback->getPauseFrame();
+	if (target >= 0)
+	{
+		int reach = (target < greenzoneSize - 1) ? target : greenzoneSize - 1;
+		if (reach >= currFrameCounter + GREENZONE_WORKER_JUMP_DISTANCE)
+			playback->jump(target, false, true, false);
+	}
+}
+
 int GREENZONE::findFirstGreenzonedFrame(int starting_index)
 {
 	for (int i = starting_index; i < greenzoneSize; ++i)
-		if (savestates[i].size()) return i;
+		if (savestates.has(i)) return i;
 	return -1;	// error
 }
 
@@ -666,25 +779,34 @@ int GREENZONE::getSize()
 }
 
 // this should only be used by Bookmark Set procedure
-std::vector<uint8>& GREENZONE::getSavestateOfFrame(int frame)
+std::vector<uint8_t> GREENZONE::getSavestateOfFrame(int frame)
 {
-	return savestates[frame];
+	std::vector<uint8_t> savestate;
+	savestates.fetch(frame, savestate, Z_DEFAULT_COMPRESSION);
+	return savestate;
 }
 // this function should only be used by Bookmark Deploy procedure
 void GREENZONE::writeSavestateForFrame(int frame, std::vector<uint8>& savestate)
 {
-	if ((int)savestates.size() <= frame)
-		savestates.resize(frame + 1);
-	savestates[frame] = savestate;
+	savestates.store(frame, savestate);
 	if (greenzoneSize <= frame)
 		greenzoneSize = frame + 1;
 }
 
 bool GREENZONE::isSavestateEmpty(unsigned int frame)
 {
-	if ((int)frame < greenzoneSize && frame < savestates.size() && savestates[frame].size())
+	if ((int)frame < greenzoneSize && savestates.has(frame))
 		return false;
 	else
 		return true;
 }
 
+size_t GREENZONE::getMemoryUsage()
+{
+	return savestates.getMemoryUsage();
+}
+size_t GREENZONE::getSpilledSize()
+{
+	return savestates.getSpilledSize();
+}
+
@@ -4,6 +4,8 @@
 #include <vector>
 
 #include "Qt/TasEditor/laglog.h"
+#include "Qt/TasEditor/greenzone_storage.h"
+#include "Qt/TasEditor/greenzone_worker.h"
 
 #define GREENZONE_ID_LEN 10
 
@@ -15,7 +17,7 @@
 #define EVERY4TH 0xFFFFFFFC
 #define EVERY2ND 0xFFFFFFFE
 
-#define PROGRESSBAR_UPDATE_RATE 1000	// progressbar is updated after every 1000 savestates loaded from FM3 file
+#define PROGRESSBAR_UPDATE_RATE 1000	// progressbar is updated after every 1000 savestates loaded from/saved to FM3 file
 
 class GREENZONE
 {
@@ -27,7 +29,8 @@ public:
 	void update();
 
 	void save(EMUFILE *os, int save_type = GREENZONE_SAVING_MODE_ALL);
-	bool load(EMUFILE *is, unsigned int offset);
+	bool load(EMUFILE *is, unsigned int offset, const char* fileName = NULL);
+	void releaseProjectFile(const char* fileName);
 
 	bool loadSavestateOfFrame(unsigned int frame);
 
@@ -41,10 +44,13 @@ public:
 	int findFirstGreenzonedFrame(int startingFrame = 0);
 
 	int getSize();
-	std::vector<uint8_t>& getSavestateOfFrame(int frame);
+	std::vector<uint8_t> getSavestateOfFrame(int frame);
 	void writeSavestateForFrame(int frame, std::vector<uint8>& savestate);
 	bool isSavestateEmpty(unsigned int frame);
 
+	size_t getMemoryUsage();
+	size_t getSpilledSize();
+
 	// saved data
 	LAGLOG lagLog;
 
@@ -52,15 +58,28 @@ private:
 	void collectCurrentState();
 	bool clearSavestateOfFrame(unsigned int frame);
 	bool clearSavestateAndFreeMemory(unsigned int frame);
+	void updateMemoryBudget();
+
+	void scheduleRegeneration(int after, int oldSize);
+	void updateRegeneration();
 
 	void adjustUp();
 	void adjustDown();
 
 	// saved data
 	int greenzoneSize;
-	std::vector<std::vector<uint8_t>> savestates;
+	GREENZONE_STORAGE savestates;
 
 	// not saved data
 	uint64_t nextCleaningTime;
+	std::vector<uint8_t> savestateBuffer;
+
+	// background regeneration of the frames invalidated by the last Input change
+	GREENZONE_WORKER worker;
+	bool workerPending;
+	int workerStartFrame;
+	int workerEndFrame;
+	uint64_t workerStartTime;
+	std::vector<uint8_t> workerSavestate;
 	
 };
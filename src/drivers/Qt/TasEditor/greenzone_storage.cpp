@@ -0,0 +1,778 @@
+/* ---------------------------------------------------------------------------------
+Implementation file of GreenzoneStorage class
+
+(The MIT License)
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+------------------------------------------------------------------------------------
+GreenzoneStorage - Savestate storage of the Greenzone
+[Single instance]
+
+* stores one savestate per frame under a byte budget
+* frames near the Playback cursor are kept as they were taken (fast compression)
+* colder frames are recompressed harder, frames between keyframes are stored as a delta against their keyframe
+* when the budget is exceeded, the frames farthest from the Playback cursor are spilled to a scratch file, which is read back through a memory mapping
+* every stored frame can be rebuilt into a regular savestate, no matter which tier it's in
+* savestates of a loaded project stay in the project file (read through a memory mapping) until they are changed
+* rebuilds the savestates for saving in several threads
+------------------------------------------------------------------------------------ */
+
+#include <zlib.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QCoreApplication>
+
+#include "fceu.h"
+#include "driver.h"
+#include "Qt/TasEditor/greenzone_storage.h"
+
+#define FCSX_HEADER_SIZE 16
+
+static uint32_t readLE32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static void writeLE32(uint8_t* p, uint32_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+
+// extracts the chunk stream of an FCSX savestate
+static bool unpackSavestate(const uint8_t* savestate, size_t len, std::vector<uint8_t>& raw)
+{
+	if (len < FCSX_HEADER_SIZE || memcmp(savestate, "FCSX", 4))
+		return false;
+	uint32_t totalSize = readLE32(savestate + 4);
+	uint32_t comprLen = readLE32(savestate + 12);
+	raw.resize(totalSize);
+	if (comprLen == 0xFFFFFFFF)
+	{
+		if (len < FCSX_HEADER_SIZE + (size_t)totalSize)
+			return false;
+		if (totalSize)
+			memcpy(&raw[0], savestate + FCSX_HEADER_SIZE, totalSize);
+		return true;
+	}
+	if (len < FCSX_HEADER_SIZE + (size_t)comprLen)
+		return false;
+	uLongf destLen = totalSize;
+	if (uncompress(&raw[0], &destLen, savestate + FCSX_HEADER_SIZE, comprLen) != Z_OK || destLen != totalSize)
+		return false;
+	return true;
+}
+// builds an FCSX savestate around a chunk stream, taking magic, size and version from the given header
+static bool packSavestate(const uint8_t* header, const std::vector<uint8_t>& raw, int compressionLevel, std::vector<uint8_t>& out)
+{
+	if (compressionLevel == Z_NO_COMPRESSION)
+	{
+		out.resize(FCSX_HEADER_SIZE + raw.size());
+		memcpy(&out[0], header, 12);
+		writeLE32(&out[12], 0xFFFFFFFF);
+		if (raw.size())
+			memcpy(&out[FCSX_HEADER_SIZE], &raw[0], raw.size());
+		return true;
+	}
+	uLongf comprLen = compressBound(raw.size());
+	out.resize(FCSX_HEADER_SIZE + comprLen);
+	if (compress2(&out[FCSX_HEADER_SIZE], &comprLen, raw.size() ? &raw[0] : NULL, raw.size(), compressionLevel) != Z_OK)
+		return false;
+	out.resize(FCSX_HEADER_SIZE + comprLen);
+	memcpy(&out[0], header, 12);
+	writeLE32(&out[12], comprLen);
+	return true;
+}
+
+// a part of the savestates being saved, with copies of everything needed to rebuild them, so that the thread never touches the storage
+struct SAVE_ITEM
+{
+	int frame;			// -1 for a keyframe which is only needed to rebuild the deltas after it
+	uint8_t isDelta;
+	size_t offset;		// in SAVE_JOB::input
+	size_t len;
+};
+struct SAVE_JOB
+{
+	std::vector<SAVE_ITEM> items;
+	std::vector<uint8_t> input;
+	std::vector<uint8_t> output;		// ready to be written records
+};
+
+static void addSaveItem(SAVE_JOB& job, int frame, uint8_t isDelta, const uint8_t* data, size_t len)
+{
+	SAVE_ITEM item = { frame, isDelta, job.input.size(), len };
+	job.items.push_back(item);
+	job.input.insert(job.input.end(), data, data + len);
+}
+static void addSaveRecord(SAVE_JOB& job, int frame, const uint8_t* savestate, size_t len)
+{
+	size_t pos = job.output.size();
+	job.output.resize(pos + 8 + len);
+	writeLE32(&job.output[pos], frame);
+	writeLE32(&job.output[pos + 4], len);
+	memcpy(&job.output[pos + 8], savestate, len);
+}
+static void runSaveJob(SAVE_JOB& job, int compressionLevel)
+{
+	std::vector<uint8_t> keyframeRaw, raw, packed;
+	bool haveKeyframe = false;
+	for (size_t i = 0; i < job.items.size(); ++i)
+	{
+		SAVE_ITEM& item = job.items[i];
+		const uint8_t* data = &job.input[item.offset];
+		if (item.frame < 0)
+		{
+			haveKeyframe = unpackSavestate(data, item.len, keyframeRaw);
+			continue;
+		}
+		if (!item.isDelta)
+		{
+			addSaveRecord(job, item.frame, data, item.len);
+			continue;
+		}
+		// same as GREENZONE_STORAGE::readRaw(), frames that can't be rebuilt are not saved
+		if (!haveKeyframe || item.len < FCSX_HEADER_SIZE)
+			continue;
+		uint32_t totalSize = readLE32(data + 4);
+		if (totalSize != keyframeRaw.size())
+			continue;
+		raw.resize(totalSize);
+		uLongf destLen = totalSize;
+		if (uncompress(totalSize ? &raw[0] : NULL, &destLen, data + FCSX_HEADER_SIZE, item.len - FCSX_HEADER_SIZE) != Z_OK || destLen != totalSize)
+			continue;
+		for (size_t j = 0; j < raw.size(); ++j)
+			raw[j] ^= keyframeRaw[j];
+		if (packSavestate(data, raw, compressionLevel, packed))
+			addSaveRecord(job, item.frame, &packed[0], packed.size());
+	}
+	job.input.clear();
+}
+
+GREENZONE_STORAGE::GREENZONE_STORAGE()
+{
+	memoryUsage = 0;
+	budget = (size_t)-1;
+	spillFile = NULL;
+	spillMap = NULL;
+	spillSize = 0;
+	spillGarbage = 0;
+	spillFileCount = 0;
+	spillMapStale = true;
+	spillFailed = false;
+	sourceFile = NULL;
+	sourceMap = NULL;
+	keyframeRawFrame = -1;
+	memset(rawHeader, 0, sizeof(rawHeader));
+}
+GREENZONE_STORAGE::~GREENZONE_STORAGE()
+{
+	closeSpillFile();
+	closeSource();
+}
+
+void GREENZONE_STORAGE::reset()
+{
+	entries.clear();
+	entries.shrink_to_fit();
+	memoryUsage = 0;
+	keyframeRawFrame = -1;
+	closeSpillFile();
+	closeSource();
+	spillFailed = false;
+}
+void GREENZONE_STORAGE::resize(int frames)
+{
+	if (frames < 0)
+		frames = 0;
+	// drop from the end, so that deltas go before their keyframes
+	for (int i = (int)entries.size() - 1; i >= frames; i--)
+		release(i);
+	Entry empty = { std::vector<uint8_t>(), 0, 0, GREENZONE_TIER_NONE, 0 };
+	entries.resize(frames, empty);
+}
+
+void GREENZONE_STORAGE::setBudget(size_t bytes)
+{
+	budget = bytes;
+}
+size_t GREENZONE_STORAGE::getBudget()
+{
+	return budget;
+}
+size_t GREENZONE_STORAGE::getMemoryUsage()
+{
+	return memoryUsage;
+}
+size_t GREENZONE_STORAGE::getSpilledSize()
+{
+	return (size_t)(spillSize - spillGarbage);
+}
+// without a spill file rebalance can't do much more than dropping frames, so don't keep asking for it
+bool GREENZONE_STORAGE::isOverBudget()
+{
+	return memoryUsage > budget && !spillFailed;
+}
+
+int GREENZONE_STORAGE::size()
+{
+	return entries.size();
+}
+bool GREENZONE_STORAGE::has(unsigned int frame)
+{
+	return frame < entries.size() && entries[frame].tier != GREENZONE_TIER_NONE;
+}
+int GREENZONE_STORAGE::getTier(unsigned int frame)
+{
+	if (frame < entries.size())
+		return entries[frame].tier;
+	return GREENZONE_TIER_NONE;
+}
+
+void GREENZONE_STORAGE::store(unsigned int frame, const uint8_t* savestate, size_t len)
+{
+	if (!len)
+		return;
+	if (frame >= entries.size())
+		resize(frame + 1);
+	release(frame);
+	Entry& e = entries[frame];
+	setData(e, savestate, len);
+	e.tier = GREENZONE_TIER_HOT;
+	e.isDelta = 0;
+}
+void GREENZONE_STORAGE::store(unsigned int frame, std::vector<uint8_t>& savestate)
+{
+	if (savestate.size())
+		store(frame, &savestate[0], savestate.size());
+}
+
+bool GREENZONE_STORAGE::fetch(unsigned int frame, std::vector<uint8_t>& savestate, int compressionLevel)
+{
+	if (!has(frame))
+		return false;
+	if (!entries[frame].isDelta)
+	{
+		const uint8_t* data;
+		size_t len;
+		if (!readStored(frame, data, len))
+			return false;
+		savestate.assign(data, data + len);
+		return true;
+	}
+	if (!readRaw(frame, work))
+		return false;
+	return packSavestate(rawHeader, work, compressionLevel, savestate);
+}
+
+bool GREENZONE_STORAGE::clear(unsigned int frame)
+{
+	if (!has(frame))
+		return false;
+	release(frame);
+	if (spillSize && spillGarbage == spillSize)
+		// nothing alive in the spill file anymore
+		closeSpillFile();
+	else if (spillGarbage > spillSize / 2 && spillSize > GREENZONE_SPILL_COMPACT_SIZE)
+		compactSpillFile();
+	return true;
+}
+
+void GREENZONE_STORAGE::rebalance(int cursorFrame, int hotDistance)
+{
+	int numFrames = entries.size();
+	for (int i = 0; i < numFrames; ++i)
+	{
+		if (entries[i].tier == GREENZONE_TIER_HOT && abs(i - cursorFrame) > hotDistance)
+			demote(i);
+	}
+	if (memoryUsage <= budget)
+		return;
+
+	// spill the frames farthest from the Playback cursor, leaving some room before the next rebalance
+	size_t target = budget - budget / 8;
+	int lo = 0, hi = numFrames - 1;
+	while (memoryUsage > target && lo <= hi)
+	{
+		int frame;
+		if (cursorFrame - lo >= hi - cursorFrame)
+			frame = lo++;
+		else
+			frame = hi--;
+		if (frame == cursorFrame || !has(frame) || entries[frame].tier == GREENZONE_TIER_COLD || entries[frame].tier == GREENZONE_TIER_SOURCE)
+			continue;
+		if (!spillFailed && spill(frame))
+			continue;
+		// no spill file, so the budget can only be met by dropping frames; keyframes always stay
+		if (frame & GREENZONE_KEYFRAME_MASK)
+			release(frame);
+	}
+}
+
+bool GREENZONE_STORAGE::attachSource(const std::string& fileName)
+{
+	closeSource();
+	sourceMap = new EMUFILE_MMAP(fileName);
+	if (!sourceMap->is_open())
+	{
+		// the file can't be mapped, read it instead
+		delete sourceMap;
+		sourceMap = NULL;
+		sourceFile = new EMUFILE_FILE(fileName, "rb");
+		if (!sourceFile->is_open())
+		{
+			delete sourceFile;
+			sourceFile = NULL;
+			return false;
+		}
+	}
+	sourceFileName = fileName;
+	return true;
+}
+bool GREENZONE_STORAGE::isSource(const std::string& fileName)
+{
+	if (!sourceMap && !sourceFile)
+		return false;
+	return QFileInfo(QString::fromStdString(fileName)) == QFileInfo(QString::fromStdString(sourceFileName));
+}
+void GREENZONE_STORAGE::storeFromSource(unsigned int frame, uint64_t offset, uint32_t len)
+{
+	if (!len)
+		return;
+	if (frame >= entries.size())
+		resize(frame + 1);
+	release(frame);
+	Entry& e = entries[frame];
+	e.fileOffset = offset;
+	e.storedSize = len;
+	e.tier = GREENZONE_TIER_SOURCE;
+	e.isDelta = 0;
+}
+void GREENZONE_STORAGE::detachSource()
+{
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (entries[i].tier != GREENZONE_TIER_SOURCE)
+			continue;
+		const uint8_t* data;
+		size_t len;
+		if (!readStored(i, data, len))
+		{
+			freeData(entries[i]);
+			continue;
+		}
+		setData(entries[i], data, len);
+		entries[i].tier = GREENZONE_TIER_WARM;
+		if (memoryUsage > budget && !spillFailed)
+			spill(i);
+	}
+	closeSource();
+}
+
+void GREENZONE_STORAGE::saveFrames(EMUFILE* os, const int* frames, int count, int compressionLevel)
+{
+	// gather the stored data on this thread, everything after that can be done in parallel
+	int numJobs = (count + GREENZONE_SAVE_JOB_FRAMES - 1) / GREENZONE_SAVE_JOB_FRAMES;
+	std::vector<SAVE_JOB> jobs(numJobs);
+	for (int j = 0; j < numJobs; ++j)
+	{
+		SAVE_JOB& job = jobs[j];
+		int keyframe = -1;
+		int end = (j + 1) * GREENZONE_SAVE_JOB_FRAMES;
+		if (end > count)
+			end = count;
+		for (int i = j * GREENZONE_SAVE_JOB_FRAMES; i < end; ++i)
+		{
+			unsigned int frame = frames[i];
+			if (!has(frame))
+				continue;
+			const uint8_t* data;
+			size_t len;
+			if (entries[frame].isDelta)
+			{
+				unsigned int frameKeyframe = frame & ~GREENZONE_KEYFRAME_MASK;
+				if ((int)frameKeyframe != keyframe)
+				{
+					if (!has(frameKeyframe) || entries[frameKeyframe].isDelta || !readStored(frameKeyframe, data, len))
+						continue;
+					addSaveItem(job, -1, 0, data, len);
+					keyframe = frameKeyframe;
+				}
+			}
+			if (readStored(frame, data, len))
+				addSaveItem(job, frame, entries[frame].isDelta, data, len);
+		}
+	}
+
+	int numThreads = std::thread::hardware_concurrency();
+	if (numThreads > numJobs)
+		numThreads = numJobs;
+	std::atomic<int> nextJob(0);
+	auto work = [&jobs, &nextJob, numJobs, compressionLevel]()
+	{
+		int j;
+		while ((j = nextJob++) < numJobs)
+			runSaveJob(jobs[j], compressionLevel);
+	};
+	std::vector<std::thread> threads;
+	for (int i = 1; i < numThreads; ++i)
+		threads.push_back(std::thread(work));
+	work();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+
+	for (int j = 0; j < numJobs; ++j)
+		if (jobs[j].output.size())
+			os->fwrite(&jobs[j].output[0], jobs[j].output.size());
+}
+// -------------------------------------------------------------------------------------------------
+void GREENZONE_STORAGE::release(unsigned int frame)
+{
+	if (!has(frame))
+		return;
+	if (!(frame & GREENZONE_KEYFRAME_MASK))
+		materializeDependents(frame);
+	freeData(entries[frame]);
+	if (keyframeRawFrame == (int)frame)
+		keyframeRawFrame = -1;
+}
+
+// frames stored as delta against this keyframe are turned into full savestates
+void GREENZONE_STORAGE::materializeDependents(unsigned int keyframe)
+{
+	unsigned int last = keyframe + GREENZONE_KEYFRAME_MASK;
+	if (last >= entries.size())
+		last = entries.size() - 1;
+	for (unsigned int frame = keyframe + 1; frame <= last; ++frame)
+	{
+		if (!has(frame) || !entries[frame].isDelta)
+			continue;
+		bool ok = readRaw(frame, work) && packSavestate(rawHeader, work, Z_BEST_COMPRESSION, encoded);
+		freeData(entries[frame]);
+		if (ok)
+		{
+			setData(entries[frame], &encoded[0], encoded.size());
+			entries[frame].tier = GREENZONE_TIER_WARM;
+		}
+	}
+}
+
+bool GREENZONE_STORAGE::demote(unsigned int frame)
+{
+	Entry& e = entries[frame];
+	if (e.tier != GREENZONE_TIER_HOT)
+		return false;
+	unsigned int keyframe = frame & ~GREENZONE_KEYFRAME_MASK;
+	if (!readRaw(frame, work))
+	{
+		// not something we can recompress, keep it as it is
+		e.tier = GREENZONE_TIER_WARM;
+		return true;
+	}
+	if (keyframe != frame && readKeyframeRaw(keyframe) && keyframeRaw.size() == work.size())
+	{
+		// consecutive savestates differ in very few bytes, so the xor against the keyframe is mostly zeroes
+		for (size_t i = 0; i < work.size(); ++i)
+			work[i] ^= keyframeRaw[i];
+		uLongf comprLen = compressBound(work.size());
+		encoded.resize(FCSX_HEADER_SIZE + comprLen);
+		if (compress2(&encoded[FCSX_HEADER_SIZE], &comprLen, work.size() ? &work[0] : NULL, work.size(), Z_BEST_COMPRESSION) == Z_OK)
+		{
+			memcpy(&encoded[0], rawHeader, FCSX_HEADER_SIZE);
+			setData(e, &encoded[0], FCSX_HEADER_SIZE + comprLen);
+			e.isDelta = 1;
+			e.tier = GREENZONE_TIER_WARM;
+			return true;
+		}
+		for (size_t i = 0; i < work.size(); ++i)
+			work[i] ^= keyframeRaw[i];
+	}
+	if (!packSavestate(rawHeader, work, Z_BEST_COMPRESSION, encoded))
+		return false;
+	setData(e, &encoded[0], encoded.size());
+	e.tier = GREENZONE_TIER_WARM;
+	return true;
+}
+
+bool GREENZONE_STORAGE::spill(unsigned int frame)
+{
+	Entry& e = entries[frame];
+	if (!spillFile && !openSpillFile())
+		return false;
+	size_t len = e.data.size();
+	spillFile->fseek(0, SEEK_END);
+	spillFile->fwrite(&e.data[0], len);
+	if (spillFile->fail())
+	{
+		FCEU_printf("Greenzone: could not write to %s, no more frames will be spilled\n", spillFileName.c_str());
+		spillFailed = true;
+		return false;
+	}
+	e.fileOffset = spillSize;
+	e.storedSize = len;
+	spillSize += len;
+	memoryUsage -= len;
+	e.data.clear();
+	e.data.shrink_to_fit();
+	e.tier = GREENZONE_TIER_COLD;
+	spillMapStale = true;
+	return true;
+}
+// -------------------------------------------------------------------------------------------------
+void GREENZONE_STORAGE::setData(Entry& e, const uint8_t* data, size_t len)
+{
+	freeData(e);
+	e.data.assign(data, data + len);
+	memoryUsage += len;
+}
+void GREENZONE_STORAGE::freeData(Entry& e)
+{
+	if (e.tier == GREENZONE_TIER_COLD)
+		spillGarbage += e.storedSize;
+	else
+		memoryUsage -= e.data.size();
+	e.data.clear();
+	e.data.shrink_to_fit();
+	e.fileOffset = 0;
+	e.storedSize = 0;
+	e.tier = GREENZONE_TIER_NONE;
+	e.isDelta = 0;
+}
+
+bool GREENZONE_STORAGE::readStored(unsigned int frame, const uint8_t*& data, size_t& len)
+{
+	Entry& e = entries[frame];
+	if (e.tier == GREENZONE_TIER_SOURCE)
+	{
+		if (sourceMap && e.fileOffset + e.storedSize <= sourceMap->size())
+		{
+			data = sourceMap->map() + e.fileOffset;
+			len = e.storedSize;
+			return true;
+		}
+		if (!sourceFile)
+			return false;
+		stored.resize(e.storedSize);
+		sourceFile->fseek((long)e.fileOffset, SEEK_SET);
+		if (sourceFile->fread(&stored[0], e.storedSize) != e.storedSize)
+		{
+			sourceFile->unfail();
+			return false;
+		}
+		data = &stored[0];
+		len = e.storedSize;
+		return true;
+	}
+	if (e.tier != GREENZONE_TIER_COLD)
+	{
+		data = e.data.size() ? &e.data[0] : NULL;
+		len = e.data.size();
+		return len != 0;
+	}
+	if (!spillFile)
+		return false;
+	if (spillMapStale)
+	{
+		delete spillMap;
+		spillFile->fflush();
+		spillMap = new EMUFILE_MMAP(spillFileName);
+		if (!spillMap->is_open())
+		{
+			// the file can't be mapped (e.g. it's still open for writing on Windows), read it instead
+			delete spillMap;
+			spillMap = NULL;
+		}
+		spillMapStale = false;
+	}
+	if (spillMap && e.fileOffset + e.storedSize <= spillMap->size())
+	{
+		data = spillMap->map() + e.fileOffset;
+		len = e.storedSize;
+		return true;
+	}
+	stored.resize(e.storedSize);
+	spillFile->fseek((long)e.fileOffset, SEEK_SET);
+	if (spillFile->fread(&stored[0], e.storedSize) != e.storedSize)
+	{
+		spillFile->unfail();
+		return false;
+	}
+	data = &stored[0];
+	len = e.storedSize;
+	return true;
+}
+
+// unpacks the chunk stream of a frame, applying the delta if needed; rawHeader receives its FCSX header
+bool GREENZONE_STORAGE::readRaw(unsigned int frame, std::vector<uint8_t>& raw)
+{
+	if (!has(frame))
+		return false;
+	const uint8_t* data;
+	size_t len;
+	if (!entries[frame].isDelta)
+	{
+		if (!readStored(frame, data, len) || !unpackSavestate(data, len, raw))
+			return false;
+		memcpy(rawHeader, data, FCSX_HEADER_SIZE);
+		return true;
+	}
+	// the keyframe goes first, as reading it may reuse the buffer of a spilled frame
+	if (!readKeyframeRaw(frame & ~GREENZONE_KEYFRAME_MASK))
+		return false;
+	if (!readStored(frame, data, len) || len < FCSX_HEADER_SIZE)
+		return false;
+	uint32_t totalSize = readLE32(data + 4);
+	if (totalSize != keyframeRaw.size())
+		return false;
+	raw.resize(totalSize);
+	uLongf destLen = totalSize;
+	if (uncompress(totalSize ? &raw[0] : NULL, &destLen, data + FCSX_HEADER_SIZE, len - FCSX_HEADER_SIZE) != Z_OK || destLen != totalSize)
+		return false;
+	for (size_t i = 0; i < raw.size(); ++i)
+		raw[i] ^= keyframeRaw[i];
+	memcpy(rawHeader, data, FCSX_HEADER_SIZE);
+	return true;
+}
+
+bool GREENZONE_STORAGE::readKeyframeRaw(unsigned int keyframe)
+{
+	if (keyframeRawFrame == (int)keyframe)
+		return true;
+	if (!has(keyframe) || entries[keyframe].isDelta)
+		return false;
+	const uint8_t* data;
+	size_t len;
+	keyframeRawFrame = -1;
+	if (!readStored(keyframe, data, len) || !unpackSavestate(data, len, keyframeRaw))
+		return false;
+	keyframeRawFrame = keyframe;
+	return true;
+}
+// -------------------------------------------------------------------------------------------------
+std::string GREENZONE_STORAGE::makeSpillFileName()
+{
+	QString name = QDir::tempPath() + QString("/fceux-greenzone-%1-%2.tmp").arg(QCoreApplication::applicationPid()).arg(spillFileCount++);
+	return QDir::toNativeSeparators(name).toStdString();
+}
+
+bool GREENZONE_STORAGE::openSpillFile()
+{
+	spillFileName = makeSpillFileName();
+	spillFile = new EMUFILE_FILE(spillFileName, "w+b");
+	if (!spillFile->is_open())
+	{
+		FCEU_printf("Greenzone: could not create %s, frames over the memory budget will be dropped\n", spillFileName.c_str());
+		delete spillFile;
+		spillFile = NULL;
+		spillFailed = true;
+		return false;
+	}
+	spillSize = 0;
+	spillGarbage = 0;
+	spillMapStale = true;
+	return true;
+}
+
+void GREENZONE_STORAGE::closeSpillFile()
+{
+	delete spillMap;
+	spillMap = NULL;
+	if (spillFile)
+	{
+		delete spillFile;
+		spillFile = NULL;
+		QFile::remove(QString::fromStdString(spillFileName));
+	}
+	// any frames that were still in the file are gone now
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (entries[i].tier == GREENZONE_TIER_COLD)
+		{
+			entries[i].tier = GREENZONE_TIER_NONE;
+			entries[i].isDelta = 0;
+			entries[i].fileOffset = 0;
+			entries[i].storedSize = 0;
+		}
+	}
+	spillSize = 0;
+	spillGarbage = 0;
+	spillMapStale = true;
+	keyframeRawFrame = -1;
+}
+
+void GREENZONE_STORAGE::closeSource()
+{
+	delete sourceMap;
+	sourceMap = NULL;
+	delete sourceFile;
+	sourceFile = NULL;
+	sourceFileName.clear();
+	// frames that were never read from the file are gone now
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (entries[i].tier == GREENZONE_TIER_SOURCE)
+		{
+			entries[i].tier = GREENZONE_TIER_NONE;
+			entries[i].fileOffset = 0;
+			entries[i].storedSize = 0;
+		}
+	}
+	keyframeRawFrame = -1;
+}
+
+// copies the frames that are still alive into a fresh spill file
+void GREENZONE_STORAGE::compactSpillFile()
+{
+	std::string newName = makeSpillFileName();
+	EMUFILE_FILE* newFile = new EMUFILE_FILE(newName, "w+b");
+	if (!newFile->is_open())
+	{
+		delete newFile;
+		return;
+	}
+	std::vector<uint64_t> newOffsets(entries.size(), 0);
+	uint64_t newSize = 0;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (entries[i].tier != GREENZONE_TIER_COLD)
+			continue;
+		const uint8_t* data;
+		size_t len;
+		if (!readStored(i, data, len))
+		{
+			freeData(entries[i]);
+			continue;
+		}
+		newFile->fwrite(data, len);
+		newOffsets[i] = newSize;
+		newSize += len;
+	}
+	if (newFile->fail())
+	{
+		delete newFile;
+		QFile::remove(QString::fromStdString(newName));
+		return;
+	}
+	delete spillMap;
+	spillMap = NULL;
+	delete spillFile;
+	QFile::remove(QString::fromStdString(spillFileName));
+
+	spillFile = newFile;
+	spillFileName = newName;
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		if (entries[i].tier == GREENZONE_TIER_COLD)
+			entries[i].fileOffset = newOffsets[i];
+	}
+	spillSize = newSize;
+	spillGarbage = 0;
+	spillMapStale = true;
+}
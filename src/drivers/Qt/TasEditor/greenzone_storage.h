@@ -0,0 +1,124 @@
+// Specification file for GreenzoneStorage class
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "emufile.h"
+
+// every 16th frame is a keyframe, warm frames in between are stored as a delta against it
+#define GREENZONE_KEYFRAME_INTERVAL 16
+#define GREENZONE_KEYFRAME_MASK (GREENZONE_KEYFRAME_INTERVAL - 1)
+
+// the spill file is compacted when more than half of it is dead and it's larger than this
+#define GREENZONE_SPILL_COMPACT_SIZE (64 * 1024 * 1024)
+
+// savestates rebuilt by one saving thread at a time
+#define GREENZONE_SAVE_JOB_FRAMES 64
+
+enum GREENZONE_TIERS
+{
+	GREENZONE_TIER_NONE = 0,
+	GREENZONE_TIER_HOT,		// full savestate, fast compression
+	GREENZONE_TIER_WARM,	// full savestate with strong compression, or delta against its keyframe
+	GREENZONE_TIER_COLD,	// same as warm, but the bytes live in the spill file
+	GREENZONE_TIER_SOURCE,	// full savestate that wasn't touched since it was loaded, the bytes are still in the project file
+};
+
+class GREENZONE_STORAGE
+{
+public:
+	GREENZONE_STORAGE();
+	~GREENZONE_STORAGE();
+
+	void reset();
+	void resize(int frames);
+
+	void setBudget(size_t bytes);
+	size_t getBudget();
+	size_t getMemoryUsage();
+	size_t getSpilledSize();
+	bool isOverBudget();
+
+	int size();
+	bool has(unsigned int frame);
+	int getTier(unsigned int frame);
+
+	// savestate is a complete FCSX savestate as written by FCEUSS_SaveMS
+	void store(unsigned int frame, const uint8_t* savestate, size_t len);
+	void store(unsigned int frame, std::vector<uint8_t>& savestate);
+	// rebuilds the savestate; frames stored as delta are compressed at compressionLevel
+	bool fetch(unsigned int frame, std::vector<uint8_t>& savestate, int compressionLevel = 0);
+	// returns true if actually cleared savestate data
+	bool clear(unsigned int frame);
+
+	// demotes frames far from the Playback cursor and spills the coldest ones until the budget is met
+	void rebalance(int cursorFrame, int hotDistance);
+
+	// savestates of a loaded project are only read from the file when they are needed
+	bool attachSource(const std::string& fileName);
+	bool isSource(const std::string& fileName);
+	void storeFromSource(unsigned int frame, uint64_t offset, uint32_t len);
+	// moves the frames that are still in the source file to the spill file (or memory), so that the file can be overwritten
+	void detachSource();
+
+	// writes "frame, size, savestate" records for the given frames, like fetch() would return them
+	// frames stored as delta are rebuilt by a pool of threads, the records are written in order
+	void saveFrames(EMUFILE* os, const int* frames, int count, int compressionLevel);
+
+private:
+	struct Entry
+	{
+		std::vector<uint8_t> data;
+		uint64_t fileOffset;
+		uint32_t storedSize;
+		uint8_t tier;
+		uint8_t isDelta;
+	};
+
+	void release(unsigned int frame);
+	void materializeDependents(unsigned int keyframe);
+	bool demote(unsigned int frame);
+	bool spill(unsigned int frame);
+
+	void setData(Entry& e, const uint8_t* data, size_t len);
+	void freeData(Entry& e);
+
+	bool readStored(unsigned int frame, const uint8_t*& data, size_t& len);
+	bool readRaw(unsigned int frame, std::vector<uint8_t>& raw);
+	bool readKeyframeRaw(unsigned int keyframe);
+
+	bool openSpillFile();
+	void closeSpillFile();
+	void compactSpillFile();
+	std::string makeSpillFileName();
+	void closeSource();
+
+	std::vector<Entry> entries;
+	size_t memoryUsage;
+	size_t budget;
+
+	// spill file, reads go through a read-only mapping that is dropped whenever the file grows
+	std::string spillFileName;
+	EMUFILE_FILE* spillFile;
+	EMUFILE_MMAP* spillMap;
+	uint64_t spillSize;
+	uint64_t spillGarbage;
+	int spillFileCount;
+	bool spillMapStale;
+	bool spillFailed;
+
+	// project file the savestates were loaded from
+	std::string sourceFileName;
+	EMUFILE_FILE* sourceFile;
+	EMUFILE_MMAP* sourceMap;
+
+	// decode buffers
+	std::vector<uint8_t> stored;
+	std::vector<uint8_t> work;
+	std::vector<uint8_t> encoded;
+	std::vector<uint8_t> keyframeRaw;
+	int keyframeRawFrame;
+	uint8_t rawHeader[16];		// FCSX header of the last frame unpacked by readRaw
+};
@@ -0,0 +1,456 @@
+/* ---------------------------------------------------------------------------------
+Implementation file of GreenzoneWorker class
+
+(The MIT License)
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+------------------------------------------------------------------------------------
+GreenzoneWorker - Background regeneration of the Greenzone
+[Single instance]
+
+* after Input was changed, re-emulates the invalidated part of the Greenzone in a separate headless fceux process
+* the process loads the same ROM, settings and cheats, and the last savestate that survived the change, so it follows the new Input exactly like Playback would
+* everything it needs is passed in a job file, savestates are sent back through a pipe and taken by the Greenzone in frame order, while the GUI stays responsive
+* the worker is simply killed when Input changes again or the states are not needed anymore
+* it is never started while Recording, Lua or the Debugger are active
+* only available on systems with posix_spawn(), elsewhere the Greenzone is regenerated by Playback as before
+------------------------------------------------------------------------------------ */
+
+#include <zlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#include <QCoreApplication>
+#include <QDir>
+
+#include "fceu.h"
+#include "state.h"
+#include "input.h"
+#include "movie.h"
+#include "driver.h"
+#include "cheat.h"
+#include "utils/endian.h"
+#include "Qt/config.h"
+#include "Qt/fceuWrapper.h"
+#include "Qt/TasEditor/greenzone_worker.h"
+
+// every record sent by the worker: u32 frame, u32 size, u8 lagged, then the savestate
+#define WORKER_RECORD_HEADER_SIZE 9
+
+// the job file starts with this, followed by the fields written in writeJob()
+#define WORKER_JOB_MAGIC "FCEUGZW1"
+
+#ifndef WIN32
+extern char **environ;
+#endif
+extern int EnableAutosave;
+extern int globalCheatDisabled;
+
+static void writeLE32(uint8_t* p, uint32_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = (v >> 24) & 0xFF;
+}
+static uint32_t readLE32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+GREENZONE_WORKER::GREENZONE_WORKER()
+{
+	pid = -1;
+	fd = -1;
+	startFrame = endFrame = 0;
+	receivedPos = 0;
+}
+
+GREENZONE_WORKER::~GREENZONE_WORKER()
+{
+	stop();
+}
+
+bool GREENZONE_WORKER::isSupported()
+{
+#ifdef WIN32
+	return false;
+#else
+	return true;
+#endif
+}
+
+bool GREENZONE_WORKER::isRunning()
+{
+	return fd >= 0;
+}
+
+int GREENZONE_WORKER::getEndFrame()
+{
+	return endFrame;
+}
+
+static int collectCheat(const char *name, uint32 a, uint8 v, int compare, int s, int type, void *data)
+{
+	if (s)
+	{
+		EMUFILE* os = (EMUFILE*)data;
+		write32le(a, os);
+		os->fputc(v);
+		write32le(compare, os);
+		write32le(type, os);
+	}
+	return 1;
+}
+
+static int countCheat(const char *name, uint32 a, uint8 v, int compare, int s, int type, void *data)
+{
+	if (s)
+		(*(uint32*)data)++;
+	return 1;
+}
+
+// everything the worker process needs to emulate exactly like this one: the ROM, the settings that affect emulation,
+// the enabled cheats, the savestate of startFrame and the Input of the frames to regenerate
+bool GREENZONE_WORKER::writeJob(std::vector<uint8_t>& savestate)
+{
+	const char* romPath = NULL;
+	if (GameInfo)
+		romPath = GameInfo->archiveFilename ? GameInfo->archiveFilename : GameInfo->filename;
+	if (romPath == NULL)
+		return false;
+#ifdef WIN32
+	return false;
+#else
+	std::string path = std::string(QDir::tempPath().toLocal8Bit().constData()) + "/fceux-greenzone-XXXXXX";
+	int jobFd = mkstemp(&path[0]);
+	if (jobFd < 0)
+		return false;
+	close(jobFd);
+	jobPath = path;
+
+	EMUFILE_FILE os(jobPath, "wb");
+	if (!os.is_open())
+		return false;
+	os.fwrite(WORKER_JOB_MAGIC, 8);
+	write32le(strlen(romPath), &os);
+	os.fwrite(romPath, strlen(romPath));
+	write32le(startFrame, &os);
+	write32le(endFrame, &os);
+	write32le(FCEUI_GetRegion(), &os);
+	write32le(newppu, &os);
+	os.fputc(overclock_enabled ? 1 : 0);
+	os.fputc(skip_7bit_overclocking ? 1 : 0);
+	write32le(postrenderscanlines, &os);
+	write32le(vblankscanlines, &os);
+	os.fputc(currMovieData.fourscore ? 1 : 0);
+	os.fputc(currMovieData.microphone ? 1 : 0);
+	for (int i = 0; i < 3; ++i)
+		write32le(currMovieData.ports[i], &os);
+	uint32 cheats = 0;
+	if (!globalCheatDisabled)
+		FCEUI_ListCheats(countCheat, &cheats);
+	write32le(cheats, &os);
+	if (cheats)
+		FCEUI_ListCheats(collectCheat, &os);
+	write32le(savestate.size(), &os);
+	os.fwrite(&savestate[0], savestate.size());
+	// commands and the 4 joysticks of every frame from startFrame up to the last one to emulate
+	for (int frame = startFrame; frame < endFrame; ++frame)
+	{
+		MovieRecord& mr = currMovieData.records[frame];
+		os.fputc(mr.commands);
+		for (int i = 0; i < 4; ++i)
+			os.fputc(mr.joysticks[i]);
+	}
+	return !os.fail();
+#endif
+}
+
+bool GREENZONE_WORKER::start(int startFrame, int endFrame, std::vector<uint8_t>& savestate)
+{
+	stop();
+	if (!isSupported() || endFrame <= startFrame || savestate.empty() || endFrame > currMovieData.getNumRecords())
+		return false;
+#ifdef WIN32
+	return false;
+#else
+	this->startFrame = startFrame;
+	this->endFrame = endFrame;
+	if (!writeJob(savestate))
+	{
+		stop();
+		return false;
+	}
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		stop();
+		return false;
+	}
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	// the worker gets the write end as fd 3, its own output goes nowhere so that it can't be mistaken for a savestate
+	std::string exe = QCoreApplication::applicationFilePath().toLocal8Bit().constData();
+	char arg0[] = "fceux";
+	char arg1[] = "--greenzone-worker";
+	char arg3[] = "3";
+	char* argv[] = { arg0, arg1, &jobPath[0], arg3, NULL };
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[1], 3);
+	posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+	pid_t childPid = -1;
+	int result = posix_spawn(&childPid, exe.c_str(), &actions, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(fds[1]);
+	if (result != 0)
+	{
+		close(fds[0]);
+		stop();
+		return false;
+	}
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	pid = childPid;
+	fd = fds[0];
+	received.resize(0);
+	receivedPos = 0;
+	return true;
+#endif
+}
+
+void GREENZONE_WORKER::stop()
+{
+#ifndef WIN32
+	if (pid > 0)
+	{
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+	}
+	if (fd >= 0)
+		close(fd);
+#endif
+	if (!jobPath.empty())
+		remove(jobPath.c_str());
+	jobPath.clear();
+	pid = -1;
+	fd = -1;
+	received.resize(0);
+	receivedPos = 0;
+}
+
+bool GREENZONE_WORKER::poll()
+{
+	if (fd < 0)
+		return false;
+#ifdef WIN32
+	return false;
+#else
+	// drop what was already taken, so that the buffer doesn't grow for the whole run
+	if (receivedPos)
+	{
+		received.erase(received.begin(), received.begin() + receivedPos);
+		receivedPos = 0;
+	}
+	uint8_t buf[65536];
+	while (true)
+	{
+		ssize_t len = read(fd, buf, sizeof(buf));
+		if (len > 0)
+		{
+			received.insert(received.end(), buf, buf + len);
+			continue;
+		}
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return true;
+		// the worker finished or died, whatever it sent is still in the buffer
+		close(fd);
+		fd = -1;
+		if (pid > 0)
+			waitpid(pid, NULL, 0);
+		pid = -1;
+		if (!jobPath.empty())
+			remove(jobPath.c_str());
+		jobPath.clear();
+		return false;
+	}
+#endif
+}
+
+bool GREENZONE_WORKER::nextState(int& frame, bool& lagged, std::vector<uint8_t>& savestate)
+{
+	size_t available = received.size() - receivedPos;
+	if (available < WORKER_RECORD_HEADER_SIZE)
+		return false;
+	const uint8_t* p = &received[receivedPos];
+	uint32_t size = readLE32(p + 4);
+	if (available - WORKER_RECORD_HEADER_SIZE < size)
+		return false;
+	frame = readLE32(p);
+	lagged = p[8] != 0;
+	savestate.assign(p + WORKER_RECORD_HEADER_SIZE, p + WORKER_RECORD_HEADER_SIZE + size);
+	receivedPos += WORKER_RECORD_HEADER_SIZE + size;
+	return true;
+}
+
+bool greenzoneWorkerRequested(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--greenzone-worker") == 0)
+			return true;
+	}
+	return false;
+}
+
+// the worker process: a fresh emulator without GUI, which only reads the job file and writes savestates to the pipe
+int greenzoneWorkerMain(int argc, char *argv[])
+{
+#ifdef WIN32
+	return 1;
+#else
+	const char* jobFile = NULL;
+	int outFd = -1;
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "--greenzone-worker") == 0) && (i + 2 < argc))
+		{
+			jobFile = argv[i + 1];
+			outFd = atoi(argv[i + 2]);
+		}
+	}
+	if (jobFile == NULL || outFd < 0)
+		return 1;
+	signal(SIGPIPE, SIG_IGN);
+
+	EMUFILE_FILE is(jobFile, "rb");
+	char magic[8];
+	if (!is.is_open() || is.fread(magic, 8) != 8 || memcmp(magic, WORKER_JOB_MAGIC, 8) != 0)
+		return 1;
+	uint32 len = 0, startFrame = 0, endFrame = 0, region = 0, ppu = 0, postrender = 0, vblank = 0;
+	read32le(&len, &is);
+	std::string romPath(len, '\0');
+	if (len == 0 || is.fread(&romPath[0], len) != len)
+		return 1;
+	read32le(&startFrame, &is);
+	read32le(&endFrame, &is);
+	read32le(&region, &is);
+	read32le(&ppu, &is);
+	bool overclock = is.fgetc() == 1;
+	bool skip7bit = is.fgetc() == 1;
+	read32le(&postrender, &is);
+	read32le(&vblank, &is);
+	bool fourscore = is.fgetc() == 1;
+	bool microphone = is.fgetc() == 1;
+	uint32 ports[3] = { 0 };
+	for (int i = 0; i < 3; ++i)
+		read32le(&ports[i], &is);
+	if (is.fail() || endFrame <= startFrame)
+		return 1;
+
+	// only the defaults, the job carries every setting that changes what is emulated
+	g_config = InitConfig();
+	if (g_config == NULL || FCEUI_Initialize() != 1)
+		return 1;
+	disableAutoLSCheats = 2;
+	EnableAutosave = 0;
+	newppu = ppu;
+	if (FCEUI_LoadGame(romPath.c_str(), 1, true) == NULL)
+		return 1;
+	// the region also works out the scanline count from the overclocking settings
+	overclock_enabled = overclock;
+	skip_7bit_overclocking = skip7bit;
+	postrenderscanlines = postrender;
+	vblankscanlines = vblank;
+	FCEUI_SetRegion(region, 0);
+
+	uint32 cheats = 0;
+	read32le(&cheats, &is);
+	for (uint32 i = 0; i < cheats && !is.fail(); ++i)
+	{
+		uint32 a = 0, compare = 0, type = 0;
+		read32le(&a, &is);
+		uint8 v = is.fgetc();
+		read32le(&compare, &is);
+		read32le(&type, &is);
+		FCEUI_AddCheat("", a, v, (int)compare, (int)type);
+	}
+	uint32 size = 0;
+	read32le(&size, &is);
+	std::vector<uint8> savestate(size);
+	if (is.fail() || size == 0 || is.fread(&savestate[0], size) != size)
+		return 1;
+
+	// the Input of the frames to emulate, played the way TAS Editor plays it
+	currMovieData = MovieData();
+	currMovieData.fourscore = fourscore;
+	currMovieData.microphone = microphone;
+	for (int i = 0; i < 3; ++i)
+		currMovieData.ports[i] = ports[i];
+	currMovieData.records.resize(endFrame + 1);
+	for (uint32 frame = startFrame; frame < endFrame; ++frame)
+	{
+		MovieRecord& mr = currMovieData.records[frame];
+		mr.commands = is.fgetc();
+		for (int i = 0; i < 4; ++i)
+			mr.joysticks[i] = is.fgetc();
+	}
+	if (is.fail())
+		return 1;
+	FCEUD_SetInput(fourscore, microphone, (ESI)ports[0], (ESI)ports[1], (ESIFC)ports[2]);
+	movie_readonly = true;
+	movieMode = MOVIEMODE_TASEDITOR;
+
+	EMUFILE_MEMORY seed(&savestate);
+	if (!FCEUSS_LoadFP(&seed, SSLOADPARAM_NOBACKUP))
+		return 1;
+	// TAS Editor savestates don't carry the frame counter
+	currFrameCounter = startFrame;
+
+	uint8* gfx = 0;
+	int32* sound = 0;
+	int32 ssize = 0;
+	std::vector<uint8_t> record;
+	for (uint32 frame = startFrame + 1; frame <= endFrame; ++frame)
+	{
+		if (FCEUI_EmulationPaused())
+			FCEUI_ToggleEmulationPause();
+		FCEUI_Emulate(&gfx, &sound, &ssize, 2);
+		EMUFILE_MEMORY ms;
+		FCEUSS_SaveMS(&ms, Z_BEST_SPEED);
+		std::vector<uint8>& data = *ms.get_vec();
+		record.resize(WORKER_RECORD_HEADER_SIZE + data.size());
+		writeLE32(&record[0], frame);
+		writeLE32(&record[4], data.size());
+		record[8] = lagFlag ? 1 : 0;
+		memcpy(&record[WORKER_RECORD_HEADER_SIZE], &data[0], data.size());
+		size_t written = 0;
+		while (written < record.size())
+		{
+			ssize_t len = write(outFd, &record[written], record.size() - written);
+			if (len < 0 && errno == EINTR)
+				continue;
+			if (len <= 0)
+				return 1;
+			written += len;
+		}
+	}
+	close(outFd);
+	return 0;
+#endif
+}
@@ -0,0 +1,50 @@
+// Specification file for GreenzoneWorker class
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// delay after the last Input change before a worker is started, so that drawing Input doesn't start a process on every row
+#define GREENZONE_WORKER_START_DELAY 250
+
+// Playback only jumps ahead to the worker's savestates if that skips at least this many frames
+#define GREENZONE_WORKER_JUMP_DISTANCE 30
+
+class GREENZONE_WORKER
+{
+public:
+	GREENZONE_WORKER();
+	~GREENZONE_WORKER();
+
+	static bool isSupported();
+	bool isRunning();
+
+	// starts a separate headless fceux which loads the ROM and the savestate of startFrame
+	// and re-emulates up to endFrame, sending back a savestate for every frame
+	bool start(int startFrame, int endFrame, std::vector<uint8_t>& savestate);
+	void stop();
+
+	// reads whatever the worker has sent so far, returns false when it won't send anything more
+	bool poll();
+	// takes the next complete savestate out of the received data
+	bool nextState(int& frame, bool& lagged, std::vector<uint8_t>& savestate);
+
+	int getEndFrame();
+
+private:
+	bool writeJob(std::vector<uint8_t>& savestate);
+
+	int pid;
+	int fd;
+	int startFrame;
+	int endFrame;
+	std::string jobPath;
+
+	std::vector<uint8_t> received;
+	size_t receivedPos;
+};
+
+// true if the command line starts a worker process (fceux --greenzone-worker job fd), which runs without any GUI
+bool greenzoneWorkerRequested(int argc, char *argv[]);
+int greenzoneWorkerMain(int argc, char *argv[]);
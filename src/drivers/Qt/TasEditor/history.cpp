@@ -474,7 +474,7 @@ int HISTORY::registerChanges(int mod_type, int start, int end, int size, const c
 {
 	// create new snapshot
 	SNAPSHOT snap;
-	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges);
+	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges, -1, &getCurrentSnapshot());
 	// check if there are Input differences from latest snapshot
 	int real_pos = (historyStartPos + historyCursorPos) % historySize;
 	int first_changes = snap.inputlog.findFirstChange(snapshots[real_pos].inputlog, start, end);
@@ -631,7 +631,7 @@ int HISTORY::registerAdjustLag(int start, int size)
 {
 	// create new snapshot
 	SNAPSHOT snap;
-	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges);
+	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges, -1, &getCurrentSnapshot());
 	// check if there are Input differences from latest snapshot
 	int real_pos = (historyStartPos + historyCursorPos) % historySize;
 	SNAPSHOT& current_snap = snapshots[real_pos];
@@ -671,7 +671,7 @@ void HISTORY::registerMarkersChange(int modificationType, int start, int end, co
 {
 	// create new snapshot
 	SNAPSHOT snap;
-	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges);
+	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges, -1, &getCurrentSnapshot());
 	// fill description:
 	snap.modificationType = modificationType;
 	strcat(snap.description, modCaptions[modificationType]);
@@ -711,7 +711,7 @@ void HISTORY::registerBookmarkSet(int slot, BOOKMARK& backupCopy, int oldCurrent
 {
 	// create new snapshot
 	SNAPSHOT snap;
-	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges);
+	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges, -1, &getCurrentSnapshot());
 	// fill description: modification type + keyframe of the Bookmark
 	snap.modificationType = MODTYPE_BOOKMARK_0 + slot;
 	strcat(snap.description, modCaptions[snap.modificationType]);
@@ -729,7 +729,7 @@ int HISTORY::registerBranching(int slot, bool markers_changed)
 {
 	// create new snapshot
 	SNAPSHOT snap;
-	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges);
+	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges, -1, &getCurrentSnapshot());
 	// check if there are Input differences from latest snapshot
 	int real_pos = (historyStartPos + historyCursorPos) % historySize;
 	int first_changes = snap.inputlog.findFirstChange(snapshots[real_pos].inputlog);
@@ -836,7 +836,7 @@ void HISTORY::registerRecording(int frameOfChange, uint32 joypadDifferenceBits)
 	{
 		// not consecutive - create new snapshot and add it to history
 		SNAPSHOT snap;
-		snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges);
+		snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges, -1, &getCurrentSnapshot());
 		snap.recordedJoypadDifferenceBits = joypadDifferenceBits;
 		// fill description:
 		snap.modificationType = MODTYPE_RECORD;
@@ -877,7 +877,7 @@ int HISTORY::registerImport(MovieData& md, const char* filename)
 {
 	// create new snapshot
 	SNAPSHOT snap;
-	snap.init(md, greenzone->lagLog, taseditorConfig->enableHotChanges, getInputType(currMovieData));
+	snap.init(md, greenzone->lagLog, taseditorConfig->enableHotChanges, getInputType(currMovieData), &getCurrentSnapshot());
 	// check if there are Input differences from latest snapshot
 	int real_pos = (historyStartPos + historyCursorPos) % historySize;
 	int first_changes = snap.inputlog.findFirstChange(snapshots[real_pos].inputlog);
@@ -911,7 +911,7 @@ int HISTORY::registerLuaChanges(const char* name, int start, bool insertionOrDel
 {
 	// create new snapshot
 	SNAPSHOT snap;
-	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges);
+	snap.init(currMovieData, greenzone->lagLog, taseditorConfig->enableHotChanges, -1, &getCurrentSnapshot());
 	// check if there are Input differences from latest snapshot
 	int real_pos = (historyStartPos + historyCursorPos) % historySize;
 	int first_changes = snap.inputlog.findFirstChange(snapshots[real_pos].inputlog, start);
@@ -13,7 +13,8 @@ InputLog - Log of Input
 * optionally can store map of Hot Changes
 * implements InputLog creation: copying Input, copying Hot Changes
 * implements full/partial restoring of data from InputLog: Input, Hot Changes
-* implements compression and decompression of stored data
+* implements compression and decompression of stored data, only the blocks changed since the last compression are compressed again
+* shares unchanged blocks of Input with the InputLog it was created from, so that History snapshots don't duplicate the whole movie
 * saves and loads the data from a project file. On error: sends warning to caller
 * implements searching of first mismatch comparing two InputLogs or comparing this InputLog to a movie
 * provides interface for reading specific data: reading Input of any given frame, reading value at any point of Hot Changes map
@@ -33,10 +34,9 @@ INPUTLOG::INPUTLOG()
 	size = 0;
 	inputType = 0;
 	hasHotChanges = 0;
-	alreadyCompressed = false;
 }
 
-void INPUTLOG::init(MovieData& md, bool hotchanges, int force_input_type)
+void INPUTLOG::init(MovieData& md, bool hotchanges, int force_input_type, INPUTLOG* baseLog)
 {
 	hasHotChanges = hotchanges;
 	if (force_input_type < 0)
@@ -46,20 +46,30 @@ void INPUTLOG::init(MovieData& md, bool hotchanges, int force_input_type)
 	int num_joys = joysticksPerFrame[inputType];
 	// retrieve Input data from movie data
 	size = md.getNumRecords();
-	joysticks.resize(BYTES_PER_JOYSTICK * num_joys * size);		// it's much faster to have this format than have [frame][joy] or other structures
-	commands.resize(size);				// commands take 1 byte per frame
-	if (hasHotChanges)
-		initHotChanges();
-
-	// fill Input vector
+	std::vector<uint8_t> joysticksData(BYTES_PER_JOYSTICK * num_joys * size);		// it's much faster to have this format than have [frame][joy] or other structures
+	std::vector<uint8_t> commandsData(size);		// commands take 1 byte per frame
 	int joy;
 	for (int frame = 0; frame < size; ++frame)
 	{
 		for (joy = num_joys - 1; joy >= 0; joy--)
-			joysticks[frame * num_joys * BYTES_PER_JOYSTICK + joy * BYTES_PER_JOYSTICK] = md.records[frame].joysticks[joy];
-		commands[frame] = md.records[frame].commands;
+			joysticksData[frame * num_joys * BYTES_PER_JOYSTICK + joy * BYTES_PER_JOYSTICK] = md.records[frame].joysticks[joy];
+		commandsData[frame] = md.records[frame].commands;
 	}
-	alreadyCompressed = false;
+	joysticks.setUnitSize(BYTES_PER_JOYSTICK * num_joys);
+	commands.setUnitSize(1);
+	if (baseLog && baseLog->inputType == inputType)
+	{
+		// usually only a small part of Input differs from the previous snapshot
+		joysticks.assignShared(joysticksData.data(), size, baseLog->joysticks);
+		commands.assignShared(commandsData.data(), size, baseLog->commands);
+	} else
+	{
+		joysticks.assign(joysticksData.data(), size);
+		commands.assign(commandsData.data(), size);
+	}
+	hotChanges.setUnitSize(num_joys * HOTCHANGE_BYTES_PER_JOY);
+	if (hasHotChanges)
+		initHotChanges();
 }
 
 // this function only updates one frame of Input Log and Hot Changes data
@@ -71,8 +81,8 @@ void INPUTLOG::reinit(MovieData& md, bool hotchanges, int frame_of_change)
 	int joy;
 	// retrieve Input data from movie data
 	size = md.getNumRecords();
-	joysticks.resize(BYTES_PER_JOYSTICK * num_joys * size, 0);
-	commands.resize(size);
+	joysticks.resize(size, 0);
+	commands.resize(size, 0);
 	if (hasHotChanges)
 	{
 		// resize Hot Changes
@@ -94,9 +104,8 @@ void INPUTLOG::reinit(MovieData& md, bool hotchanges, int frame_of_change)
 
 	// update Input vector
 	for (joy = num_joys - 1; joy >= 0; joy--)
-		joysticks[frame_of_change * num_joys * BYTES_PER_JOYSTICK + joy * BYTES_PER_JOYSTICK] = md.records[frame_of_change].joysticks[joy];
-	commands[frame_of_change] = md.records[frame_of_change].commands;
-	alreadyCompressed = false;
+		joysticks.at(frame_of_change, joy * BYTES_PER_JOYSTICK) = md.records[frame_of_change].joysticks[joy];
+	commands.at(frame_of_change, 0) = md.records[frame_of_change].commands;
 }
 
 void INPUTLOG::toMovie(MovieData& md, int start, int end)
@@ -109,40 +118,22 @@ void INPUTLOG::toMovie(MovieData& md, int start, int end)
 	for (int frame = start; frame <= end; ++frame)
 	{
 		for (joy = num_joys - 1; joy >= 0; joy--)
-			md.records[frame].joysticks[joy] = joysticks[frame * num_joys * BYTES_PER_JOYSTICK + joy * BYTES_PER_JOYSTICK];
-		md.records[frame].commands = commands[frame];
+			md.records[frame].joysticks[joy] = joysticks.get(frame, joy * BYTES_PER_JOYSTICK);
+		md.records[frame].commands = commands.get(frame, 0);
 	}
 }
 
 void INPUTLOG::compressData()
 {
-	// compress joysticks
-	int len = joysticks.size();
-	uLongf comprlen = (len>>9)+12 + len;
-	compressedJoysticks.resize(comprlen);
-	compress(&compressedJoysticks[0], &comprlen, &joysticks[0], len);
-	compressedJoysticks.resize(comprlen);
-	// compress commands
-	len = commands.size();
-	comprlen = (len>>9)+12 + len;
-	compressedCommands.resize(comprlen);
-	compress(&compressedCommands[0], &comprlen, &commands[0], len);
-	compressedCommands.resize(comprlen);
+	// blocks that are shared with other snapshots were already compressed by them
+	joysticks.compress();
+	commands.compress();
 	if (hasHotChanges)
-	{
-		// compress hot_changes
-		len = hotChanges.size();
-		comprlen = (len>>9)+12 + len;
-		compressedHotChanges.resize(comprlen);
-		compress(&compressedHotChanges[0], &comprlen, &hotChanges[0], len);
-		compressedHotChanges.resize(comprlen);
-	}
-	// don't recompress anymore
-	alreadyCompressed = true;
+		hotChanges.compress();
 }
 bool INPUTLOG::isAlreadyCompressed()
 {
-	return alreadyCompressed;
+	return joysticks.isCompressed() && commands.isCompressed() && (!hasHotChanges || hotChanges.isCompressed());
 }
 
 void INPUTLOG::save(EMUFILE *os)
@@ -150,21 +141,19 @@ void INPUTLOG::save(EMUFILE *os)
 	// write vars
 	write32le(size, os);
 	write8le(inputType, os);
-	// write data
-	if (!alreadyCompressed)
-		compressData();
+	// write data, every array is written as a single zlib stream assembled from the compressed blocks
 	// save joysticks data
-	write32le(compressedJoysticks.size(), os);
-	os->fwrite(&compressedJoysticks[0], compressedJoysticks.size());
+	write32le(joysticks.getCompressedSize(), os);
+	joysticks.writeCompressed(os);
 	// save commands data
-	write32le(compressedCommands.size(), os);
-	os->fwrite(&compressedCommands[0], compressedCommands.size());
+	write32le(commands.getCompressedSize(), os);
+	commands.writeCompressed(os);
 	if (hasHotChanges)
 	{
 		write8le((uint8)1, os);
 		// save hot_changes data
-		write32le(compressedHotChanges.size(), os);
-		os->fwrite(&compressedHotChanges[0], compressedHotChanges.size());
+		write32le(hotChanges.getCompressedSize(), os);
+		hotChanges.writeCompressed(os);
 	} else
 	{
 		write8le((uint8)0, os);
@@ -178,48 +167,39 @@ bool INPUTLOG::load(EMUFILE *is)
 	if (!read32le(&size, is)) return true;
 	if (!read8le(&tmp, is)) return true;
 	inputType = tmp;
-	// read data
-	alreadyCompressed = true;
-	unsigned int comprlen;
-	uLongf destlen;
 	// read and uncompress joysticks data
-	destlen = size * BYTES_PER_JOYSTICK * joysticksPerFrame[inputType];
-	joysticks.resize(destlen);
-	// read size
-	if (!read32le(&comprlen, is)) return true;
-	if (comprlen == 0) return true;
-	compressedJoysticks.resize(comprlen);
-	if (is->fread(&compressedJoysticks[0], comprlen) != comprlen) return true;
-	int e = uncompress(&joysticks[0], &destlen, &compressedJoysticks[0], comprlen);
-	if (e != Z_OK && e != Z_BUF_ERROR) return true;
+	if (loadBlocks(is, joysticks, BYTES_PER_JOYSTICK * joysticksPerFrame[inputType])) return true;
 	// read and uncompress commands data
-	destlen = size;
-	commands.resize(destlen);
-	// read size
-	if (!read32le(&comprlen, is)) return true;
-	if (comprlen <= 0) return true;
-	compressedCommands.resize(comprlen);
-	if (is->fread(&compressedCommands[0], comprlen) != comprlen) return true;
-	e = uncompress(&commands[0], &destlen, &compressedCommands[0], comprlen);
-	if (e != Z_OK && e != Z_BUF_ERROR) return true;
+	if (loadBlocks(is, commands, 1)) return true;
 	// read hotchanges
 	if (!read8le(&tmp, is)) return true;
 	hasHotChanges = (tmp != 0);
+	hotChanges.setUnitSize(joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY);
 	if (hasHotChanges)
 	{
 		// read and uncompress hot_changes data
-		destlen = size * joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-		hotChanges.resize(destlen);
-		// read size
-		if (!read32le(&comprlen, is)) return true;
-		if (comprlen == 0) return true;
-		compressedHotChanges.resize(comprlen);
-		if (is->fread(&compressedHotChanges[0], comprlen) != comprlen) return true;
-		e = uncompress(&hotChanges[0], &destlen, &compressedHotChanges[0], comprlen);
-		if (e != Z_OK && e != Z_BUF_ERROR) return true;
+		if (loadBlocks(is, hotChanges, joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY)) return true;
 	}
 	return false;
 }
+// returns true if couldn't load
+bool INPUTLOG::loadBlocks(EMUFILE *is, INPUTLOG_BLOCKS& blocks, int unitSize)
+{
+	unsigned int comprlen;
+	uLongf destlen = size * unitSize;
+	std::vector<uint8_t> data(destlen);
+	// read size
+	if (!read32le(&comprlen, is)) return true;
+	if (comprlen == 0) return true;
+	std::vector<uint8_t> compressedData(comprlen);
+	if (is->fread(&compressedData[0], comprlen) != comprlen) return true;
+	int e = uncompress(data.data(), &destlen, &compressedData[0], comprlen);
+	if (e != Z_OK && e != Z_BUF_ERROR) return true;
+	blocks.setUnitSize(unitSize);
+	blocks.assign(data.data(), size);
+	// the blocks will be compressed again when needed, the whole stream can't be split back into them
+	return false;
+}
 bool INPUTLOG::skipLoad(EMUFILE *is)
 {
 	unsigned int tmp;
@@ -253,7 +233,22 @@ int INPUTLOG::findFirstChange(INPUTLOG& theirLog, int start, int end)
 
 	int joy;
 	int num_joys = joysticksPerFrame[inputType];
-	for (int frame = start; frame <= end; ++frame)
+	int frame = start;
+	if (theirLog.inputType == inputType)
+	{
+		// compare the frames that both InputLogs have, blocks shared by them are skipped without looking inside
+		int common_end = (end < their_log_end - 1) ? end : their_log_end - 1;
+		int joysticks_change = joysticks.findFirstDifference(theirLog.joysticks, start, common_end);
+		int commands_change = commands.findFirstDifference(theirLog.commands, start, common_end);
+		if (joysticks_change >= 0 && (commands_change < 0 || joysticks_change < commands_change))
+			return joysticks_change;
+		if (commands_change >= 0)
+			return commands_change;
+		// the rest of this InputLog is compared to empty Input
+		if (frame < their_log_end)
+			frame = their_log_end;
+	}
+	for (; frame <= end; ++frame)
 	{
 		for (joy = num_joys - 1; joy >= 0; joy--)
 			if (getJoystickData(frame, joy) != theirLog.getJoystickData(frame, joy)) return frame;
@@ -296,15 +291,15 @@ int INPUTLOG::getJoystickData(int frame, int joy)
 {
 	if (frame < 0 || frame >= size)
 		return 0;
-	if (joy > joysticksPerFrame[inputType])
+	if (joy < 0 || joy >= joysticksPerFrame[inputType])
 		return 0;
-	return joysticks[frame * BYTES_PER_JOYSTICK * joysticksPerFrame[inputType] + joy];
+	return joysticks.get(frame, joy * BYTES_PER_JOYSTICK);
 }
 int INPUTLOG::getCommandsData(int frame)
 {
 	if (frame < 0 || frame >= size)
 		return 0;
-	return commands[frame];
+	return commands.get(frame, 0);
 }
 
 void INPUTLOG::insertFrames(int at, int frames)
@@ -314,54 +309,34 @@ void INPUTLOG::insertFrames(int at, int frames)
 	{
 		// append frames to the end
 		commands.resize(size);
-		joysticks.resize(BYTES_PER_JOYSTICK * joysticksPerFrame[inputType] * size);
+		joysticks.resize(size);
+		// fill new hotchanges with max value
 		if (hasHotChanges)
-		{
-			hotChanges.resize(joysticksPerFrame[inputType] * size * HOTCHANGE_BYTES_PER_JOY);
-			// fill new hotchanges with max value
-			int lower_limit = joysticksPerFrame[inputType] * (size - frames) * HOTCHANGE_BYTES_PER_JOY;
-			for (int i = hotChanges.size() - 1; i >= lower_limit; i--)
-				hotChanges[i] = BYTE_VALUE_CONTAINING_MAX_HOTCHANGES;
-		}
+			hotChanges.resize(size, BYTE_VALUE_CONTAINING_MAX_HOTCHANGES);
 	} else
 	{
 		// insert frames
-		// insert 1 byte of commands
-		commands.insert(commands.begin() + at, frames, 0);
-		// insert X bytes of joystics
-		int bytes = BYTES_PER_JOYSTICK * joysticksPerFrame[inputType];
-		joysticks.insert(joysticks.begin() + (at * bytes), frames * bytes, 0);
+		commands.insert(at, frames, 0);
+		joysticks.insert(at, frames, 0);
 		if (hasHotChanges)
-		{
-			// insert X bytes of hot_changes
-			bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-			hotChanges.insert(hotChanges.begin() + (at * bytes), frames * bytes, BYTE_VALUE_CONTAINING_MAX_HOTCHANGES);
-		}
+			hotChanges.insert(at, frames, BYTE_VALUE_CONTAINING_MAX_HOTCHANGES);
 	}
-	// data was changed
-	alreadyCompressed = false;
 }
 void INPUTLOG::eraseFrame(int frame)
 {
-	// erase 1 byte of commands
-	commands.erase(commands.begin() + frame);
-	// erase X bytes of joystics
-	int bytes = BYTES_PER_JOYSTICK * joysticksPerFrame[inputType];
-	joysticks.erase(joysticks.begin() + (frame * bytes), joysticks.begin() + ((frame + 1) * bytes));
+	commands.erase(frame, 1);
+	joysticks.erase(frame, 1);
 	if (hasHotChanges)
-	{
-		// erase X bytes of hot_changes
-		bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-		hotChanges.erase(hotChanges.begin() + (frame * bytes), hotChanges.begin() + ((frame + 1) * bytes));
-	}
+		hotChanges.erase(frame, 1);
 	size--;
-	// data was changed
-	alreadyCompressed = false;
 }
 // -----------------------------------------------------------------------------------------------
 void INPUTLOG::initHotChanges()
 {
-	hotChanges.resize(joysticksPerFrame[inputType] * size * HOTCHANGE_BYTES_PER_JOY);
+	int bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
+	if (hotChanges.getUnitSize() != bytes)
+		hotChanges.setUnitSize(bytes);
+	hotChanges.resize(size);
 }
 
 void INPUTLOG::copyHotChanges(INPUTLOG* sourceOfHotChanges, int limiterFrameOfSource)
@@ -376,8 +351,7 @@ void INPUTLOG::copyHotChanges(INPUTLOG* sourceOfHotChanges, int limiterFrameOfSo
 		if (limiterFrameOfSource >= 0 && frames_to_copy > limiterFrameOfSource)
 			frames_to_copy = limiterFrameOfSource;
 
-		int bytes_to_copy = frames_to_copy * joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-		memcpy(&hotChanges[0], &sourceOfHotChanges->hotChanges[0], bytes_to_copy);
+		hotChanges.copy(0, sourceOfHotChanges->hotChanges, 0, frames_to_copy);
 	}
 } 
 void INPUTLOG::inheritHotChanges(INPUTLOG* sourceOfHotChanges)
@@ -389,8 +363,7 @@ void INPUTLOG::inheritHotChanges(INPUTLOG* sourceOfHotChanges)
 		if (frames_to_copy > size)
 			frames_to_copy = size;
 
-		int bytes_to_copy = frames_to_copy * joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-		memcpy(&hotChanges[0], &sourceOfHotChanges->hotChanges[0], bytes_to_copy);
+		hotChanges.copy(0, sourceOfHotChanges->hotChanges, 0, frames_to_copy);
 		fadeHotChanges();
 	}
 } 
@@ -399,26 +372,26 @@ void INPUTLOG::inheritHotChanges_DeleteSelection(INPUTLOG* sourceOfHotChanges, R
 	// copy hot changes from source InputLog, but omit deleted frames (which are represented by the "frameset")
 	if (sourceOfHotChanges && sourceOfHotChanges->hasHotChanges && sourceOfHotChanges->inputType == inputType)
 	{
-		int bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-		int frame = 0, pos = 0, source_pos = 0;
+		int pos = 0, source_pos = 0, frames_to_copy;
 		int this_size = hotChanges.size(), source_size = sourceOfHotChanges->hotChanges.size();
-		RowsSelection::iterator it(frameset->begin());
-		RowsSelection::iterator frameset_end(frameset->end());
-		while (pos < this_size && source_pos < source_size)
+		const std::vector<ROWS_RANGE>& ranges = frameset->getRanges();
+		for (size_t i = 0; i <= ranges.size() && pos < this_size && source_pos < source_size; ++i)
 		{
-			if (it != frameset_end && frame == *it)
+			// copy hotchanges of all frames up to the next omitted region
+			frames_to_copy = ((i < ranges.size()) ? ranges[i].start : source_size) - source_pos;
+			if (frames_to_copy > source_size - source_pos)
+				frames_to_copy = source_size - source_pos;
+			if (frames_to_copy > this_size - pos)
+				frames_to_copy = this_size - pos;
+			if (frames_to_copy > 0)
 			{
-				// omit the frame
-				it++;
-				source_pos += bytes;
-			} else
-			{
-				// copy hotchanges of this frame
-				memcpy(&hotChanges[pos], &sourceOfHotChanges->hotChanges[source_pos], bytes);
-				pos += bytes;
-				source_pos += bytes;
+				hotChanges.copy(pos, sourceOfHotChanges->hotChanges, source_pos, frames_to_copy);
+				pos += frames_to_copy;
+				source_pos += frames_to_copy;
 			}
-			frame++;
+			// omit the region
+			if (i < ranges.size() && ranges[i].end > source_pos)
+				source_pos = ranges[i].end;
 		}
 		fadeHotChanges();
 	}
@@ -426,161 +399,150 @@ void INPUTLOG::inheritHotChanges_DeleteSelection(INPUTLOG* sourceOfHotChanges, R
 void INPUTLOG::inheritHotChanges_InsertSelection(INPUTLOG* sourceOfHotChanges, RowsSelection* frameset)
 {
 	// copy hot changes from source InputLog, but insert filled lines for inserted frames (which are represented by the "frameset")
-	RowsSelection::iterator it(frameset->begin());
-	RowsSelection::iterator frameset_end(frameset->end());
+	// every selected region was inserted before the frames it selected, so the regions are positions in the source InputLog
+	const std::vector<ROWS_RANGE>& ranges = frameset->getRanges();
+	int pos = 0, source_pos = 0, frames_to_copy, region_len;
+	int this_size = hotChanges.size();
 	if (sourceOfHotChanges && sourceOfHotChanges->hasHotChanges && sourceOfHotChanges->inputType == inputType)
 	{
-		int bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-		int frame = 0, region_len = 0, pos = 0, source_pos = 0;
-		int this_size = hotChanges.size(), source_size = sourceOfHotChanges->hotChanges.size();
-		while (pos < this_size)
+		int source_size = sourceOfHotChanges->hotChanges.size();
+		for (size_t i = 0; i <= ranges.size() && pos < this_size; ++i)
 		{
-			if (it != frameset_end && frame == *it)
+			// copy hotchanges of all frames up to the next selected region
+			int region_start = (i < ranges.size()) ? ranges[i].start : source_size;
+			frames_to_copy = region_start - source_pos;
+			if (frames_to_copy > source_size - source_pos)
+				frames_to_copy = source_size - source_pos;
+			if (frames_to_copy > this_size - pos)
+				frames_to_copy = this_size - pos;
+			if (frames_to_copy > 0)
 			{
-				// omit the frame
-				it++;
-				region_len++;
-				// set filled line to the frame
-				memset(&hotChanges[pos], BYTE_VALUE_CONTAINING_MAX_HOTCHANGES, bytes);
-			} else if (source_pos < source_size)
+				hotChanges.copy(pos, sourceOfHotChanges->hotChanges, source_pos, frames_to_copy);
+				fadeHotChanges(pos, pos + frames_to_copy);
+				source_pos += frames_to_copy;
+				pos += frames_to_copy;
+			}
+			// frames that the source doesn't have are left as they are
+			if (region_start > source_pos)
 			{
-				// this frame should be copied
-				frame -= region_len;
-				region_len = 0;
-				// copy hotchanges of this frame
-				memcpy(&hotChanges[pos], &sourceOfHotChanges->hotChanges[source_pos], bytes);
-				fadeHotChanges(pos, pos + bytes);
-				source_pos += bytes;
+				pos += region_start - source_pos;
+				source_pos = region_start;
 			}
-			pos += bytes;
-			frame++;
+			if (i == ranges.size()) break;
+			// set filled lines to the inserted frames
+			region_len = ranges[i].end - ranges[i].start;
+			if (region_len > this_size - pos)
+				region_len = this_size - pos;
+			if (region_len > 0)
+				hotChanges.fill(pos, region_len, BYTE_VALUE_CONTAINING_MAX_HOTCHANGES);
+			pos += ranges[i].end - ranges[i].start;
 		}
 	} else
 	{
 		// no old data, just fill "frameset" lines
-		int bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-		int frame = 0, region_len = 0, pos = 0;
-		int this_size = hotChanges.size();
-		while (pos < this_size)
+		int inserted = 0;
+		for (size_t i = 0; i < ranges.size(); ++i)
 		{
-			if (it != frameset_end && frame == *it)
-			{
-				// this frame is selected
-				it++;
-				region_len++;
-				// set filled line to the frame
-				memset(&hotChanges[pos], BYTE_VALUE_CONTAINING_MAX_HOTCHANGES, bytes);
-				// exit loop when all frames in the Selection are handled
-				if (it == frameset_end) break;
-			} else
-			{
-				// this frame is not selected
-				frame -= region_len;
-				region_len = 0;
-				// leave zeros in this frame
-			}
-			pos += bytes;
-			frame++;
+			pos = ranges[i].start + inserted;
+			region_len = ranges[i].end - ranges[i].start;
+			if (pos >= this_size) break;
+			if (region_len > this_size - pos)
+				region_len = this_size - pos;
+			hotChanges.fill(pos, region_len, BYTE_VALUE_CONTAINING_MAX_HOTCHANGES);
+			inserted += ranges[i].end - ranges[i].start;
 		}
 	}
 }
 void INPUTLOG::inheritHotChanges_DeleteNum(INPUTLOG* sourceOfHotChanges, int start, int frames, bool fadeOld)
 {
-	int bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
 	// copy hot changes from source InputLog up to "start" and from "start+frames" to end
 	if (sourceOfHotChanges && sourceOfHotChanges->hasHotChanges && sourceOfHotChanges->inputType == inputType)
 	{
 		int this_size = hotChanges.size(), source_size = sourceOfHotChanges->hotChanges.size();
-		int bytes_to_copy = bytes * start;
+		int frames_to_copy = start;
 		int dest_pos = 0, source_pos = 0;
-		if (bytes_to_copy > source_size)
-			bytes_to_copy = source_size;
-		memcpy(&hotChanges[dest_pos], &sourceOfHotChanges->hotChanges[source_pos], bytes_to_copy);
-		dest_pos += bytes_to_copy;
-		source_pos += bytes_to_copy + bytes * frames;
-		bytes_to_copy = this_size - dest_pos;
-		if (bytes_to_copy > source_size - source_pos)
-			bytes_to_copy = source_size - source_pos;
-		memcpy(&hotChanges[dest_pos], &sourceOfHotChanges->hotChanges[source_pos], bytes_to_copy);
+		if (frames_to_copy > source_size)
+			frames_to_copy = source_size;
+		hotChanges.copy(dest_pos, sourceOfHotChanges->hotChanges, source_pos, frames_to_copy);
+		dest_pos += frames_to_copy;
+		source_pos += frames_to_copy + frames;
+		frames_to_copy = this_size - dest_pos;
+		if (frames_to_copy > source_size - source_pos)
+			frames_to_copy = source_size - source_pos;
+		hotChanges.copy(dest_pos, sourceOfHotChanges->hotChanges, source_pos, frames_to_copy);
 		if (fadeOld)
 			fadeHotChanges();
 	}
 } 
 void INPUTLOG::inheritHotChanges_InsertNum(INPUTLOG* sourceOfHotChanges, int start, int frames, bool fadeOld)
 {
-	int bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
 	// copy hot changes from source InputLog up to "start", then make a gap, then copy from "start+frames" to end
 	if (sourceOfHotChanges && sourceOfHotChanges->hasHotChanges && sourceOfHotChanges->inputType == inputType)
 	{
 		int this_size = hotChanges.size(), source_size = sourceOfHotChanges->hotChanges.size();
-		int bytes_to_copy = bytes * start;
+		int frames_to_copy = start;
 		int dest_pos = 0, source_pos = 0;
-		if (bytes_to_copy > source_size)
-			bytes_to_copy = source_size;
-		memcpy(&hotChanges[dest_pos], &sourceOfHotChanges->hotChanges[source_pos], bytes_to_copy);
-		dest_pos += bytes_to_copy + bytes * frames;
-		source_pos += bytes_to_copy;
-		bytes_to_copy = this_size - dest_pos;
-		if (bytes_to_copy > source_size - source_pos)
-			bytes_to_copy = source_size - source_pos;
-		memcpy(&hotChanges[dest_pos], &sourceOfHotChanges->hotChanges[source_pos], bytes_to_copy);
+		if (frames_to_copy > source_size)
+			frames_to_copy = source_size;
+		hotChanges.copy(dest_pos, sourceOfHotChanges->hotChanges, source_pos, frames_to_copy);
+		dest_pos += frames_to_copy + frames;
+		source_pos += frames_to_copy;
+		frames_to_copy = this_size - dest_pos;
+		if (frames_to_copy > source_size - source_pos)
+			frames_to_copy = source_size - source_pos;
+		hotChanges.copy(dest_pos, sourceOfHotChanges->hotChanges, source_pos, frames_to_copy);
 		if (fadeOld)
 			fadeHotChanges();
 	}
 	// fill the gap with max_hot lines on frames from "start" to "start+frames"
-	memset(&hotChanges[bytes * start], BYTE_VALUE_CONTAINING_MAX_HOTCHANGES, bytes * frames);
+	hotChanges.fill(start, frames, BYTE_VALUE_CONTAINING_MAX_HOTCHANGES);
 }
 void INPUTLOG::inheritHotChanges_PasteInsert(INPUTLOG* sourceOfHotChanges, RowsSelection* insertedSet)
 {
 	// copy hot changes from source InputLog and insert filled lines for inserted frames (which are represented by "inserted_set")
-	int bytes = joysticksPerFrame[inputType] * HOTCHANGE_BYTES_PER_JOY;
-	int frame = 0, pos = 0;
+	int pos = 0, frames_to_copy, region_start, region_end;
 	int this_size = hotChanges.size();
-	RowsSelection::iterator it(insertedSet->begin());
-	RowsSelection::iterator inserted_set_end(insertedSet->end());
+	const std::vector<ROWS_RANGE>& ranges = insertedSet->getRanges();
 
 	if (sourceOfHotChanges && sourceOfHotChanges->hasHotChanges && sourceOfHotChanges->inputType == inputType)
 	{
 		int source_pos = 0;
 		int source_size = sourceOfHotChanges->hotChanges.size();
-		while (pos < this_size)
+		for (size_t i = 0; i <= ranges.size() && pos < this_size; ++i)
 		{
-			if (it != inserted_set_end && frame == *it)
+			region_start = (i < ranges.size()) ? ranges[i].start : this_size;
+			if (region_start > this_size)
+				region_start = this_size;
+			// copy hotchanges of all frames up to the next inserted region
+			frames_to_copy = region_start - pos;
+			if (frames_to_copy > source_size - source_pos)
+				frames_to_copy = source_size - source_pos;
+			if (frames_to_copy > 0)
 			{
-				// this frame was inserted
-				it++;
-				// set filled line to the frame
-				memset(&hotChanges[pos], BYTE_VALUE_CONTAINING_MAX_HOTCHANGES, bytes);
-			} else if (source_pos < source_size)
+				hotChanges.copy(pos, sourceOfHotChanges->hotChanges, source_pos, frames_to_copy);
+				fadeHotChanges(pos, pos + frames_to_copy);
+				source_pos += frames_to_copy;
+			}
+			if (region_start > pos)
+				pos = region_start;
+			if (i == ranges.size()) break;
+			// set filled lines to the inserted frames
+			region_end = (ranges[i].end < this_size) ? ranges[i].end : this_size;
+			if (region_end > pos)
 			{
-				// copy hotchanges of this frame
-				memcpy(&hotChanges[pos], &sourceOfHotChanges->hotChanges[source_pos], bytes);
-				fadeHotChanges(pos, pos + bytes);
-				source_pos += bytes;
+				hotChanges.fill(pos, region_end - pos, BYTE_VALUE_CONTAINING_MAX_HOTCHANGES);
+				pos = region_end;
 			}
-			pos += bytes;
-			frame++;
 		}
 	} else
 	{
 		// no old data, just fill selected lines
-		while (pos < this_size)
+		for (size_t i = 0; i < ranges.size() && ranges[i].start < this_size; ++i)
 		{
-			if (it != inserted_set_end && frame == *it)
-			{
-				// this frame was inserted
-				it++;
-				// set filled line to the frame
-				memset(&hotChanges[pos], BYTE_VALUE_CONTAINING_MAX_HOTCHANGES, bytes);
-				pos += bytes;
-				// exit loop when all inserted_set frames are handled
-				if (it == inserted_set_end) break;
-			} else
-			{
-				// leave zeros in this frame
-				pos += bytes;
-			}
-			frame++;
+			region_start = (ranges[i].start > 0) ? ranges[i].start : 0;
+			region_end = (ranges[i].end < this_size) ? ranges[i].end : this_size;
+			if (region_end > region_start)
+				hotChanges.fill(region_start, region_end - region_start, BYTE_VALUE_CONTAINING_MAX_HOTCHANGES);
 		}
 	}
 } 
@@ -589,14 +551,33 @@ void INPUTLOG::fillHotChanges(INPUTLOG& theirLog, int start, int end)
 	// compare InputLogs to the specified end (or to the end of this InputLog)
 	if (end < 0 || end >= size) end = size-1;
 	uint8 my_joy, their_joy;
-	for (int joy = joysticksPerFrame[inputType] - 1; joy >= 0; joy--)
+	int num_joys = joysticksPerFrame[inputType];
+	int frame = start;
+	if (theirLog.inputType == inputType)
 	{
-		for (int frame = start; frame <= end; ++frame)
+		// jump from one difference to the next, blocks shared by both InputLogs are skipped
+		while ((frame = joysticks.findFirstDifference(theirLog.joysticks, frame, end)) >= 0)
 		{
-			my_joy = getJoystickData(frame, joy);
-			their_joy = theirLog.getJoystickData(frame, joy);
+			for (int joy = num_joys - 1; joy >= 0; joy--)
+			{
+				my_joy = getJoystickData(frame, joy);
+				their_joy = theirLog.getJoystickData(frame, joy);
+				if (my_joy != their_joy)
+					setMaxHotChangeBits(frame, joy, my_joy ^ their_joy);
+			}
+			frame++;
+		}
+		// the rest of this InputLog is compared to empty Input
+		frame = (start > theirLog.size) ? start : theirLog.size;
+	}
+	for (int joy = num_joys - 1; joy >= 0; joy--)
+	{
+		for (int f = frame; f <= end; ++f)
+		{
+			my_joy = getJoystickData(f, joy);
+			their_joy = theirLog.getJoystickData(f, joy);
 			if (my_joy != their_joy)
-				setMaxHotChangeBits(frame, joy, my_joy ^ their_joy);
+				setMaxHotChangeBits(f, joy, my_joy ^ their_joy);
 		}						
 	}
 }
@@ -617,26 +598,38 @@ void INPUTLOG::setMaxHotChanges(int frame, int absoluteButtonNumber)
 	if (frame < 0 || frame >= size || !hasHotChanges) return;
 	// set max value to the button hotness
 	if (absoluteButtonNumber & 1)
-		hotChanges[frame * (HOTCHANGE_BYTES_PER_JOY * joysticksPerFrame[inputType]) + (absoluteButtonNumber >> 1)] |= BYTE_VALUE_CONTAINING_MAX_HOTCHANGE_HI;
+		hotChanges.at(frame, absoluteButtonNumber >> 1) |= BYTE_VALUE_CONTAINING_MAX_HOTCHANGE_HI;
 	else
-		hotChanges[frame * (HOTCHANGE_BYTES_PER_JOY * joysticksPerFrame[inputType]) + (absoluteButtonNumber >> 1)] |= BYTE_VALUE_CONTAINING_MAX_HOTCHANGE_LO;
+		hotChanges.at(frame, absoluteButtonNumber >> 1) |= BYTE_VALUE_CONTAINING_MAX_HOTCHANGE_LO;
 }
 
-void INPUTLOG::fadeHotChanges(int startByte, int endByte)
+void INPUTLOG::fadeHotChanges(int startFrame, int endFrame)
 {
-	uint8 hi_half, low_half;
-	if (endByte < 0)
-		endByte = hotChanges.size();
-	for (int i = endByte - 1; i >= startByte; i--)
+	if (endFrame < 0 || endFrame > hotChanges.size())
+		endFrame = hotChanges.size();
+	// Hot Changes are mostly zeros, so only the parts that aren't get written (and unshared)
+	for (int frame = startFrame; frame < endFrame; frame += INPUTLOG_MIN_BLOCK_FRAMES)
 	{
-		if (hotChanges[i])
+		int stop = frame + INPUTLOG_MIN_BLOCK_FRAMES;
+		if (stop > endFrame)
+			stop = endFrame;
+		if (!hotChanges.hasNonZero(frame, stop))
+			continue;
+		hotChanges.forEachWritable(frame, stop, [](uint8_t* data, size_t len)
 		{
-			hi_half = hotChanges[i] >> HOTCHANGE_BITS_PER_VALUE;
-			low_half = hotChanges[i] & HOTCHANGE_BITMASK;
-			if (hi_half) hi_half--;
-			if (low_half) low_half--;
-			hotChanges[i] = (hi_half << HOTCHANGE_BITS_PER_VALUE) | low_half;
-		}
+			uint8 hi_half, low_half;
+			for (size_t i = 0; i < len; ++i)
+			{
+				if (data[i])
+				{
+					hi_half = data[i] >> HOTCHANGE_BITS_PER_VALUE;
+					low_half = data[i] & HOTCHANGE_BITMASK;
+					if (hi_half) hi_half--;
+					if (low_half) low_half--;
+					data[i] = (hi_half << HOTCHANGE_BITS_PER_VALUE) | low_half;
+				}
+			}
+		});
 	}
 }
 
@@ -645,7 +638,7 @@ int INPUTLOG::getHotChangesInfo(int frame, int absoluteButtonNumber)
 	if (!hasHotChanges || frame < 0 || frame >= size || absoluteButtonNumber < 0 || absoluteButtonNumber >= NUM_JOYPAD_BUTTONS * joysticksPerFrame[inputType])
 		return 0;
 
-	uint8 val = hotChanges[frame * (HOTCHANGE_BYTES_PER_JOY * joysticksPerFrame[inputType]) + (absoluteButtonNumber >> 1)];
+	uint8 val = hotChanges.get(frame, absoluteButtonNumber >> 1);
 
 	if (absoluteButtonNumber & 1)
 		// odd buttons (B, T, D, R) take upper 4 bits of the byte 
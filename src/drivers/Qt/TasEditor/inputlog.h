@@ -6,6 +6,7 @@
 #include "fceu.h"
 #include "movie.h"
 #include "Qt/TasEditor/selection.h"
+#include "Qt/TasEditor/inputlog_blocks.h"
 
 enum INPUT_TYPES
 {
@@ -33,7 +34,8 @@ class INPUTLOG
 {
 public:
 	INPUTLOG();
-	void init(MovieData& md, bool hotchanges, int force_input_type = -1);
+	// if baseLog is given, the blocks of Input that didn't change are shared with it instead of being copied
+	void init(MovieData& md, bool hotchanges, int force_input_type = -1, INPUTLOG* baseLog = NULL);
 	void reinit(MovieData& md, bool hotchanges, int frame_of_change);		// used when combining consecutive Recordings
 	void toMovie(MovieData& md, int start = 0, int end = -1);
 
@@ -67,7 +69,7 @@ public:
 	void setMaxHotChangeBits(int frame, int joypad, uint8_t joyBits);
 	void setMaxHotChanges(int frame, int absoluteButtonNumber);
 
-	void fadeHotChanges(int startByte = 0, int endByte = -1);
+	void fadeHotChanges(int startFrame = 0, int endFrame = -1);
 
 	int getHotChangesInfo(int frame, int absoluteButtonNumber);
 
@@ -77,17 +79,13 @@ public:
 	bool hasHotChanges;
 
 private:
-	
-	// also saved data
-	std::vector<uint8_t> compressedJoysticks;
-	std::vector<uint8_t> compressedCommands;
-	std::vector<uint8_t> compressedHotChanges;
-
-	// not saved data
-	std::vector<uint8_t> hotChanges;		// Format: buttons01joy0-for-frame0, buttons23joy0-for-frame0, buttons45joy0-for-frame0, buttons67joy0-for-frame0, buttons01joy1-for-frame0, ...
-	std::vector<uint8_t> joysticks;		// Format: joy0-for-frame0, joy1-for-frame0, joy2-for-frame0, joy3-for-frame0, joy0-for-frame1, joy1-for-frame1, ...
-	std::vector<uint8_t> commands;		// Format: commands-for-frame0, commands-for-frame1, ...
-	bool alreadyCompressed;			// to compress only once
+	bool loadBlocks(EMUFILE *is, INPUTLOG_BLOCKS& blocks, int unitSize);
+
+	// all arrays are copy-on-write, so snapshots of History share the blocks that weren't changed between them
+	// each block also keeps its compressed copy, so only changed blocks are compressed again
+	INPUTLOG_BLOCKS hotChanges;		// Format: buttons01joy0-for-frame0, buttons23joy0-for-frame0, buttons45joy0-for-frame0, buttons67joy0-for-frame0, buttons01joy1-for-frame0, ...
+	INPUTLOG_BLOCKS joysticks;		// Format: joy0-for-frame0, joy1-for-frame0, joy2-for-frame0, joy3-for-frame0, joy0-for-frame1, joy1-for-frame1, ...
+	INPUTLOG_BLOCKS commands;		// Format: commands-for-frame0, commands-for-frame1, ...
 };
 
 extern int joysticksPerFrame[INPUT_TYPES_TOTAL];
@@ -0,0 +1,435 @@
+/* ---------------------------------------------------------------------------------
+Implementation file of InputLogBlocks class
+
+(The MIT License)
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+------------------------------------------------------------------------------------
+InputLogBlocks - Storage of InputLog arrays
+
+* keeps per-frame data in blocks of a few thousand frames, blocks are reference counted and shared between copies
+* a block is duplicated only when it's written to, so History snapshots only own the blocks that their change touched
+* when an array is rebuilt from movie data, the unchanged blocks at its beginning and its end are taken from the previous version
+* every block is deflated on its own and only once, the blocks are concatenated into one regular zlib stream for saving
+------------------------------------------------------------------------------------ */
+
+#include <string.h>
+#include <algorithm>
+#include <zlib.h>
+
+#include "Qt/TasEditor/inputlog_blocks.h"
+
+INPUTLOG_BLOCKS::INPUTLOG_BLOCKS()
+{
+	unitSize = 1;
+	totalFrames = 0;
+	lastBlock = 0;
+}
+
+void INPUTLOG_BLOCKS::setUnitSize(int bytes)
+{
+	unitSize = (bytes > 0) ? bytes : 1;
+	blocks.clear();
+	updateStarts();
+}
+int INPUTLOG_BLOCKS::getUnitSize() const
+{
+	return unitSize;
+}
+int INPUTLOG_BLOCKS::size() const
+{
+	return totalFrames;
+}
+
+void INPUTLOG_BLOCKS::assign(const uint8_t* data, int frames)
+{
+	blocks.clear();
+	for (int frame = 0; frame < frames; frame += INPUTLOG_BLOCK_FRAMES)
+	{
+		int len = std::min(INPUTLOG_BLOCK_FRAMES, frames - frame);
+		blocks.push_back(newBlock(data + (size_t)frame * unitSize, len));
+	}
+	updateStarts();
+}
+
+void INPUTLOG_BLOCKS::assignShared(const uint8_t* data, int frames, const INPUTLOG_BLOCKS& base)
+{
+	if (base.unitSize != unitSize || !base.totalFrames)
+	{
+		assign(data, frames);
+		return;
+	}
+	int numBaseBlocks = base.blocks.size();
+	// leading blocks that didn't change
+	int head = 0, headEnd = 0;
+	while (head < numBaseBlocks)
+	{
+		int len = base.blockFrames(head);
+		if (headEnd + len > frames || memcmp(data + (size_t)headEnd * unitSize, &base.blocks[head]->data[0], (size_t)len * unitSize))
+			break;
+		headEnd += len;
+		head++;
+	}
+	// trailing blocks that didn't change, shifted by the number of inserted/deleted frames
+	int shift = frames - base.totalFrames;
+	int tail = numBaseBlocks, tailStart = frames;
+	while (tail > head)
+	{
+		int len = base.blockFrames(tail - 1);
+		int start = base.starts[tail - 1] + shift;
+		if (start < headEnd || memcmp(data + (size_t)start * unitSize, &base.blocks[tail - 1]->data[0], (size_t)len * unitSize))
+			break;
+		tailStart = start;
+		tail--;
+	}
+
+	std::vector<BlockPtr> result(base.blocks.begin(), base.blocks.begin() + head);
+	int changed = tailStart - headEnd;
+	if (changed > 0 && changed <= INPUTLOG_MAX_BLOCK_FRAMES)
+	{
+		result.push_back(newBlock(data + (size_t)headEnd * unitSize, changed));
+	} else
+	{
+		for (int frame = headEnd; frame < tailStart; frame += INPUTLOG_BLOCK_FRAMES)
+			result.push_back(newBlock(data + (size_t)frame * unitSize, std::min(INPUTLOG_BLOCK_FRAMES, tailStart - frame)));
+	}
+	result.insert(result.end(), base.blocks.begin() + tail, base.blocks.end());
+	blocks.swap(result);
+	updateStarts();
+	if (changed > 0 && changed < INPUTLOG_MIN_BLOCK_FRAMES)
+		mergeSmallAround(head);
+}
+
+uint8_t INPUTLOG_BLOCKS::get(int frame, int offset) const
+{
+	if (frame < 0 || frame >= totalFrames)
+		return 0;
+	int index = findBlock(frame);
+	return blocks[index]->data[(size_t)(frame - starts[index]) * unitSize + offset];
+}
+uint8_t& INPUTLOG_BLOCKS::at(int frame, int offset)
+{
+	int index = findBlock(frame);
+	return writableBlock(index).data[(size_t)(frame - starts[index]) * unitSize + offset];
+}
+
+void INPUTLOG_BLOCKS::resize(int frames, uint8_t fillValue)
+{
+	if (frames > totalFrames)
+		insert(totalFrames, frames - totalFrames, fillValue);
+	else if (frames < totalFrames)
+		erase(frames, totalFrames - frames);
+}
+
+void INPUTLOG_BLOCKS::insert(int at, int frames, uint8_t fillValue)
+{
+	if (frames <= 0)
+		return;
+	if (at < 0 || at > totalFrames)
+		at = totalFrames;
+	if (frames < INPUTLOG_MIN_BLOCK_FRAMES && totalFrames)
+	{
+		// few frames go right into the block
+		int index = (at < totalFrames) ? findBlock(at) : blocks.size() - 1;
+		INPUTLOG_BLOCK& b = writableBlock(index);
+		b.data.insert(b.data.begin() + (size_t)(at - starts[index]) * unitSize, (size_t)frames * unitSize, fillValue);
+		updateStarts();
+		if (blockFrames(index) > INPUTLOG_MAX_BLOCK_FRAMES)
+			splitAt(starts[index] + blockFrames(index) / 2);
+		return;
+	}
+	splitAt(at);
+	int index = (at < totalFrames) ? findBlock(at) : blocks.size();
+	std::vector<BlockPtr> added;
+	for (int frame = 0; frame < frames; frame += INPUTLOG_BLOCK_FRAMES)
+		added.push_back(newBlock(NULL, std::min(INPUTLOG_BLOCK_FRAMES, frames - frame), fillValue));
+	blocks.insert(blocks.begin() + index, added.begin(), added.end());
+	updateStarts();
+	mergeSmallAround(index + added.size() - 1);
+	mergeSmallAround(index);
+}
+
+void INPUTLOG_BLOCKS::erase(int at, int frames)
+{
+	if (at < 0)
+	{
+		frames += at;
+		at = 0;
+	}
+	if (at + frames > totalFrames)
+		frames = totalFrames - at;
+	if (frames <= 0)
+		return;
+	int index = findBlock(at);
+	if (at + frames <= starts[index] + blockFrames(index) && frames < blockFrames(index))
+	{
+		// the frames are inside one block
+		INPUTLOG_BLOCK& b = writableBlock(index);
+		size_t pos = (size_t)(at - starts[index]) * unitSize;
+		b.data.erase(b.data.begin() + pos, b.data.begin() + pos + (size_t)frames * unitSize);
+		updateStarts();
+		mergeSmallAround(index);
+		return;
+	}
+	splitAt(at);
+	splitAt(at + frames);
+	int first = findBlock(at);
+	int last = (at + frames < totalFrames) ? findBlock(at + frames) : blocks.size();
+	blocks.erase(blocks.begin() + first, blocks.begin() + last);
+	updateStarts();
+	if (!blocks.empty())
+		mergeSmallAround(std::min(first, (int)blocks.size() - 1));
+}
+
+void INPUTLOG_BLOCKS::fill(int at, int frames, uint8_t value)
+{
+	forEachWritable(at, at + frames, [value](uint8_t* data, size_t len) { memset(data, value, len); });
+}
+
+void INPUTLOG_BLOCKS::copy(int at, const INPUTLOG_BLOCKS& src, int srcAt, int frames)
+{
+	if (at < 0 || srcAt < 0)
+		return;
+	if (srcAt + frames > src.totalFrames)
+		frames = src.totalFrames - srcAt;
+	if (at + frames > totalFrames)
+		frames = totalFrames - at;
+	if (frames <= 0)
+		return;
+	if (frames < INPUTLOG_MIN_BLOCK_FRAMES || src.unitSize != unitSize)
+	{
+		// not worth sharing, just copy the bytes
+		std::vector<uint8_t> bytes;
+		src.forEachReadable(srcAt, srcAt + frames, [&bytes](const uint8_t* data, size_t len) { bytes.insert(bytes.end(), data, data + len); });
+		size_t pos = 0;
+		forEachWritable(at, at + frames, [&bytes, &pos](uint8_t* data, size_t len) { memcpy(data, &bytes[pos], len); pos += len; });
+		return;
+	}
+	// whole blocks of the source are shared, only the partially covered ones at the edges are copied
+	std::vector<BlockPtr> pieces;
+	int frame = srcAt, end = srcAt + frames;
+	while (frame < end)
+	{
+		int index = src.findBlock(frame);
+		int blockStart = src.starts[index], blockEnd = blockStart + src.blockFrames(index);
+		int stop = std::min(blockEnd, end);
+		if (frame == blockStart && stop == blockEnd)
+			pieces.push_back(src.blocks[index]);
+		else
+			pieces.push_back(newBlock(&src.blocks[index]->data[(size_t)(frame - blockStart) * unitSize], stop - frame));
+		frame = stop;
+	}
+	splitAt(at);
+	splitAt(at + frames);
+	int first = findBlock(at);
+	int last = (at + frames < totalFrames) ? findBlock(at + frames) : blocks.size();
+	blocks.erase(blocks.begin() + first, blocks.begin() + last);
+	blocks.insert(blocks.begin() + first, pieces.begin(), pieces.end());
+	updateStarts();
+	mergeSmallAround(first + pieces.size() - 1);
+	mergeSmallAround(first);
+}
+
+int INPUTLOG_BLOCKS::findFirstDifference(const INPUTLOG_BLOCKS& other, int start, int end) const
+{
+	if (start < 0)
+		start = 0;
+	if (end >= totalFrames)
+		end = totalFrames - 1;
+	if (end >= other.totalFrames)
+		end = other.totalFrames - 1;
+	int frame = start;
+	while (frame <= end)
+	{
+		int mine = findBlock(frame), theirs = other.findBlock(frame);
+		int stop = std::min(starts[mine] + blockFrames(mine), other.starts[theirs] + other.blockFrames(theirs));
+		if (stop > end + 1)
+			stop = end + 1;
+		if (blocks[mine] != other.blocks[theirs] || starts[mine] != other.starts[theirs])
+		{
+			const uint8_t* a = &blocks[mine]->data[(size_t)(frame - starts[mine]) * unitSize];
+			const uint8_t* b = &other.blocks[theirs]->data[(size_t)(frame - other.starts[theirs]) * unitSize];
+			size_t len = (size_t)(stop - frame) * unitSize;
+			if (memcmp(a, b, len))
+			{
+				for (size_t i = 0; i < len; ++i)
+					if (a[i] != b[i])
+						return frame + i / unitSize;
+			}
+		}
+		frame = stop;
+	}
+	return -1;
+}
+
+bool INPUTLOG_BLOCKS::hasNonZero(int start, int end) const
+{
+	bool found = false;
+	forEachReadable(start, end, [&found](const uint8_t* data, size_t len)
+	{
+		for (size_t i = 0; i < len && !found; ++i)
+			if (data[i])
+				found = true;
+	});
+	return found;
+}
+// -------------------------------------------------------------------------------------------------
+void INPUTLOG_BLOCKS::compress()
+{
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		INPUTLOG_BLOCK& b = *blocks[i];
+		if (b.isDeflated)
+			continue;
+		// the data doesn't change here, so a shared block may get its deflated copy as well
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+		b.deflated.resize(deflateBound(&zs, b.data.size()) + 16);
+		zs.next_in = b.data.size() ? &b.data[0] : NULL;
+		zs.avail_in = b.data.size();
+		zs.next_out = &b.deflated[0];
+		zs.avail_out = b.deflated.size();
+		// sync flush ends the data on a byte boundary without marking it as the last deflate block
+		while (deflate(&zs, Z_SYNC_FLUSH) == Z_OK && zs.avail_out == 0)
+		{
+			size_t used = b.deflated.size();
+			b.deflated.resize(used * 2);
+			zs.next_out = &b.deflated[used];
+			zs.avail_out = used;
+		}
+		b.deflated.resize(zs.total_out);
+		deflateEnd(&zs);
+		b.adler = adler32(adler32(0, NULL, 0), b.data.size() ? &b.data[0] : NULL, b.data.size());
+		b.isDeflated = true;
+	}
+}
+bool INPUTLOG_BLOCKS::isCompressed() const
+{
+	for (size_t i = 0; i < blocks.size(); ++i)
+		if (!blocks[i]->isDeflated)
+			return false;
+	return true;
+}
+
+size_t INPUTLOG_BLOCKS::getCompressedSize()
+{
+	compress();
+	size_t len = 2 + 2 + 4;		// zlib header, last empty deflate block, adler32
+	for (size_t i = 0; i < blocks.size(); ++i)
+		len += blocks[i]->deflated.size();
+	return len;
+}
+void INPUTLOG_BLOCKS::writeCompressed(EMUFILE* os)
+{
+	compress();
+	static const uint8_t header[2] = {0x78, 0x9C};
+	static const uint8_t lastBlock[2] = {0x03, 0x00};		// empty block with fixed codes and the "last" bit set
+	os->fwrite(header, 2);
+	uLong adler = adler32(0, NULL, 0);
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		INPUTLOG_BLOCK& b = *blocks[i];
+		if (b.deflated.size())
+			os->fwrite(&b.deflated[0], b.deflated.size());
+		adler = adler32_combine(adler, b.adler, b.data.size());
+	}
+	os->fwrite(lastBlock, 2);
+	uint8_t trailer[4] = {(uint8_t)(adler >> 24), (uint8_t)(adler >> 16), (uint8_t)(adler >> 8), (uint8_t)adler};
+	os->fwrite(trailer, 4);
+}
+// -------------------------------------------------------------------------------------------------
+INPUTLOG_BLOCKS::BlockPtr INPUTLOG_BLOCKS::newBlock(const uint8_t* data, int frames, uint8_t fillValue) const
+{
+	BlockPtr b = std::make_shared<INPUTLOG_BLOCK>();
+	size_t len = (size_t)frames * unitSize;
+	if (data)
+		b->data.assign(data, data + len);
+	else
+		b->data.assign(len, fillValue);
+	b->adler = 0;
+	b->isDeflated = false;
+	return b;
+}
+
+INPUTLOG_BLOCK& INPUTLOG_BLOCKS::writableBlock(int index)
+{
+	if (blocks[index].use_count() > 1)
+		blocks[index] = std::make_shared<INPUTLOG_BLOCK>(*blocks[index]);
+	INPUTLOG_BLOCK& b = *blocks[index];
+	b.isDeflated = false;
+	b.deflated.clear();
+	return b;
+}
+
+int INPUTLOG_BLOCKS::blockFrames(int index) const
+{
+	return blocks[index]->data.size() / unitSize;
+}
+
+int INPUTLOG_BLOCKS::findBlock(int frame) const
+{
+	int numBlocks = blocks.size();
+	if (lastBlock < numBlocks && frame >= starts[lastBlock])
+	{
+		if (frame < starts[lastBlock] + blockFrames(lastBlock))
+			return lastBlock;
+		if (lastBlock + 1 < numBlocks && frame < starts[lastBlock + 1] + blockFrames(lastBlock + 1))
+			return ++lastBlock;
+	}
+	lastBlock = std::upper_bound(starts.begin(), starts.end(), frame) - starts.begin() - 1;
+	if (lastBlock < 0)
+		lastBlock = 0;
+	return lastBlock;
+}
+
+void INPUTLOG_BLOCKS::splitAt(int frame)
+{
+	if (frame <= 0 || frame >= totalFrames)
+		return;
+	int index = findBlock(frame);
+	int offset = frame - starts[index];
+	if (!offset)
+		return;
+	const uint8_t* data = &blocks[index]->data[0];
+	BlockPtr second = newBlock(data + (size_t)offset * unitSize, blockFrames(index) - offset);
+	blocks[index] = newBlock(data, offset);
+	blocks.insert(blocks.begin() + index + 1, second);
+	updateStarts();
+}
+
+// tiny blocks left over from edits are merged with their smaller neighbour
+void INPUTLOG_BLOCKS::mergeSmallAround(int index)
+{
+	for (int i = index + 1; i >= index - 1; i--)
+	{
+		int numBlocks = blocks.size();
+		if (i < 0 || i >= numBlocks || blockFrames(i) >= INPUTLOG_MIN_BLOCK_FRAMES)
+			continue;
+		int neighbour = i - 1;
+		if (i + 1 < numBlocks && (neighbour < 0 || blockFrames(i + 1) < blockFrames(neighbour)))
+			neighbour = i + 1;
+		if (neighbour < 0 || blockFrames(i) + blockFrames(neighbour) > INPUTLOG_MAX_BLOCK_FRAMES)
+			continue;
+		int first = std::min(i, neighbour), second = std::max(i, neighbour);
+		BlockPtr merged = newBlock(&blocks[first]->data[0], blockFrames(first));
+		merged->data.insert(merged->data.end(), blocks[second]->data.begin(), blocks[second]->data.end());
+		blocks[first] = merged;
+		blocks.erase(blocks.begin() + second);
+	}
+	updateStarts();
+}
+
+void INPUTLOG_BLOCKS::updateStarts()
+{
+	starts.resize(blocks.size());
+	int frame = 0;
+	for (size_t i = 0; i < blocks.size(); ++i)
+	{
+		starts[i] = frame;
+		frame += blockFrames(i);
+	}
+	totalFrames = frame;
+	lastBlock = 0;
+}
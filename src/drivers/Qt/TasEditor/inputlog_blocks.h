@@ -0,0 +1,114 @@
+// Specification file for InputLogBlocks class
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <vector>
+
+#include "emufile.h"
+
+// frames per block when the data is built from scratch
+#define INPUTLOG_BLOCK_FRAMES 4096
+// blocks are never larger than this, and smaller than INPUTLOG_MIN_BLOCK_FRAMES they get merged with a neighbour
+#define INPUTLOG_MAX_BLOCK_FRAMES (INPUTLOG_BLOCK_FRAMES * 2)
+#define INPUTLOG_MIN_BLOCK_FRAMES 256
+
+struct INPUTLOG_BLOCK
+{
+	std::vector<uint8_t> data;
+	// raw deflate of the data, flushed to a byte boundary so that blocks can be concatenated into one zlib stream
+	std::vector<uint8_t> deflated;
+	uint32_t adler;
+	bool isDeflated;
+};
+
+// array of fixed size records (one per frame), kept in copy-on-write blocks
+// copies of the array share all blocks, a block is only duplicated when it is written to
+class INPUTLOG_BLOCKS
+{
+public:
+	INPUTLOG_BLOCKS();
+
+	void setUnitSize(int bytes);		// also clears the array
+	int getUnitSize() const;
+	int size() const;					// in frames
+
+	void assign(const uint8_t* data, int frames);
+	// same as assign(), but blocks at the beginning and at the end that didn't change are shared with the base
+	void assignShared(const uint8_t* data, int frames, const INPUTLOG_BLOCKS& base);
+
+	uint8_t get(int frame, int offset) const;
+	uint8_t& at(int frame, int offset);		// for writing
+
+	void resize(int frames, uint8_t fillValue = 0);
+	void insert(int at, int frames, uint8_t fillValue = 0);
+	void erase(int at, int frames);
+	void fill(int at, int frames, uint8_t value);
+	// overwrites frames starting at "at" with frames of src starting at "srcAt", whole blocks of src are shared
+	void copy(int at, const INPUTLOG_BLOCKS& src, int srcAt, int frames);
+
+	// returns first frame in [start, end] where the data differs, or -1; unchanged shared blocks are skipped
+	int findFirstDifference(const INPUTLOG_BLOCKS& other, int start, int end) const;
+	// returns true if any byte of frames [start, end) is not zero
+	bool hasNonZero(int start, int end) const;
+
+	// direct access to the bytes of frames [start, end), the callback is called once per block
+	template <class F> void forEachWritable(int start, int end, F func);
+	template <class F> void forEachReadable(int start, int end, F func) const;
+
+	// deflates the blocks that were changed since the last call
+	void compress();
+	bool isCompressed() const;
+	// writes the whole array as one zlib stream, built from the deflated blocks
+	size_t getCompressedSize();
+	void writeCompressed(EMUFILE* os);
+
+private:
+	typedef std::shared_ptr<INPUTLOG_BLOCK> BlockPtr;
+
+	BlockPtr newBlock(const uint8_t* data, int frames, uint8_t fillValue = 0) const;
+	INPUTLOG_BLOCK& writableBlock(int index);
+	int blockFrames(int index) const;
+	int findBlock(int frame) const;
+	void splitAt(int frame);
+	void mergeSmallAround(int index);
+	void updateStarts();
+
+	int unitSize;
+	int totalFrames;
+	std::vector<BlockPtr> blocks;
+	std::vector<int> starts;		// first frame of every block
+	mutable int lastBlock;			// most accesses go to the same block as the previous one
+};
+
+template <class F> void INPUTLOG_BLOCKS::forEachWritable(int start, int end, F func)
+{
+	if (start < 0)
+		start = 0;
+	if (end > totalFrames)
+		end = totalFrames;
+	while (start < end)
+	{
+		int index = findBlock(start);
+		int blockEnd = starts[index] + blockFrames(index);
+		int stop = (blockEnd < end) ? blockEnd : end;
+		INPUTLOG_BLOCK& b = writableBlock(index);
+		func(&b.data[(start - starts[index]) * unitSize], (size_t)(stop - start) * unitSize);
+		start = stop;
+	}
+}
+template <class F> void INPUTLOG_BLOCKS::forEachReadable(int start, int end, F func) const
+{
+	if (start < 0)
+		start = 0;
+	if (end > totalFrames)
+		end = totalFrames;
+	while (start < end)
+	{
+		int index = findBlock(start);
+		int blockEnd = starts[index] + blockFrames(index);
+		int stop = (blockEnd < end) ? blockEnd : end;
+		func(&blocks[index]->data[(start - starts[index]) * unitSize], (size_t)(stop - start) * unitSize);
+		start = stop;
+	}
+}
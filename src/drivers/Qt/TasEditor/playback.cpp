@@ -37,6 +37,7 @@ extern bool turbo;
 // resources
 static char upperMarkerText[] = "Marker ";
 int  PLAYBACK::pauseFrame = 0;
+bool PLAYBACK::turboSeeking = false;
 
 PLAYBACK::PLAYBACK()
 {
@@ -60,7 +61,7 @@ void PLAYBACK::reset()
 	forwardFullButtonOldState = forwardFullButtonState = false;
 	emuPausedOldState = emuPausedState = true;
 	stopSeeking();
-	turbo = false;
+	setTurboSeeking(false);
 }
 void PLAYBACK::update()
 {
@@ -362,7 +363,7 @@ void PLAYBACK::startSeekingToFrame(int frame)
 	if (taseditorConfig->turboSeek)
 	{
 		//printf("Turbo seek on\n");
-		turbo = true;
+		setTurboSeeking(true);
 	}
 	unpauseEmulation();
 }
@@ -374,7 +375,7 @@ void PLAYBACK::stopSeeking()
 	//{
 	//	printf("Turbo seek off\n");
 	//}
-	turbo = false;
+	setTurboSeeking(false);
 	pauseEmulation();
 	setProgressbar(1, 1);
 }
@@ -404,7 +405,7 @@ void PLAYBACK::handleForwardFrame()
 	{
 		pauseEmulation();
 	}
-	turbo = false;
+	setTurboSeeking(false);
 }
 void PLAYBACK::handleRewindFull(int speed)
 {
@@ -579,6 +580,19 @@ int PLAYBACK::getPauseFrame()
 {
 	return pauseFrame - 1;
 }
+// seeking with Turbo Seek, none of the frames before pauseframe are shown or heard
+// isFastSeeking must be thread safe too
+// the Turbo hotkey sets the same turbo flag, only a seek started with Turbo Seek counts here
+bool PLAYBACK::isFastSeeking()
+{
+	return pauseFrame && turboSeeking;
+}
+// Turbo Seek runs the seek with turbo on
+void PLAYBACK::setTurboSeeking(bool on)
+{
+	turboSeeking = on;
+	turbo = on;
+}
 int PLAYBACK::getFlashingPauseFrame()
 {
 	if (showPauseFrame)
@@ -11,6 +11,11 @@
 
 #define BUTTON_HOLD_REPEAT_DELAY (250) // in milliseconds
 
+// while seeking with Turbo Seek, Piano Roll is redrawn this often instead of every frame
+#define FAST_SEEK_REDRAW_INTERVAL (200)
+// while seeking with Turbo Seek, Greenzone only collects keyframes, except for this many frames before the target
+#define FAST_SEEK_DENSE_GREENZONE_DISTANCE (60)
+
 class UpperMarkerNoteEdit : public QLineEdit
 {
 	Q_OBJECT
@@ -63,6 +68,8 @@ public:
 	void setLastPosition(int frame);
 
 	static int getPauseFrame();
+	static bool isFastSeeking();
+	void setTurboSeeking(bool on);
 	int getFlashingPauseFrame();
 
 	void setProgressbar(int a, int b);
@@ -77,6 +84,7 @@ private:
 	bool setPlaybackAboveOrToFrame(int frame, bool forceStateReload = false);
 
 	static int pauseFrame;
+	static bool turboSeeking;	// turbo was turned on by Turbo Seek, not by the user
 	int lastPositionFrame;
 	bool lastPositionIsStable;	// for when Greenzone invalidates several times, but the end of current segment must remain the same
 
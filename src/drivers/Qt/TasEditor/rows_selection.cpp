@@ -0,0 +1,229 @@
+/* ---------------------------------------------------------------------------------
+Implementation file of RowsSelection class
+
+(The MIT License)
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+------------------------------------------------------------------------------------
+RowsSelection - Set of selected rows
+
+* stores the rows as a sorted list of disjoint ranges, neighbouring ranges are always merged
+* a Selection of the whole movie takes a single range, so it's cheap to copy into the Selection history
+* single rows can still be inserted, erased and iterated in order, like with std::set<int>
+* rows are usually added in increasing order (loading, selecting downwards), that case only appends to the list
+------------------------------------------------------------------------------------ */
+
+#include <algorithm>
+
+#include "Qt/TasEditor/rows_selection.h"
+
+static bool rangeEndsBefore(const ROWS_RANGE& range, int row)
+{
+	return range.end < row;
+}
+static bool rangeEndsAtOrBefore(const ROWS_RANGE& range, int row)
+{
+	return range.end <= row;
+}
+static bool rangeStartsAfter(int row, const ROWS_RANGE& range)
+{
+	return row < range.start;
+}
+static bool rangeStartsBefore(const ROWS_RANGE& range, int row)
+{
+	return range.start < row;
+}
+
+ROWS_SELECTION::const_iterator::const_iterator()
+{
+	ranges = 0;
+	range = 0;
+	row = 0;
+}
+ROWS_SELECTION::const_iterator::const_iterator(const std::vector<ROWS_RANGE>* ranges, size_t range, int row)
+{
+	this->ranges = ranges;
+	this->range = range;
+	this->row = row;
+}
+
+ROWS_SELECTION::const_iterator& ROWS_SELECTION::const_iterator::operator++()
+{
+	row++;
+	if (row >= (*ranges)[range].end)
+	{
+		range++;
+		row = (range < ranges->size()) ? (*ranges)[range].start : 0;
+	}
+	return *this;
+}
+ROWS_SELECTION::const_iterator ROWS_SELECTION::const_iterator::operator++(int)
+{
+	const_iterator old = *this;
+	++(*this);
+	return old;
+}
+ROWS_SELECTION::const_iterator& ROWS_SELECTION::const_iterator::operator--()
+{
+	if (range >= ranges->size() || row <= (*ranges)[range].start)
+	{
+		range--;
+		row = (*ranges)[range].end - 1;
+	} else
+	{
+		row--;
+	}
+	return *this;
+}
+ROWS_SELECTION::const_iterator ROWS_SELECTION::const_iterator::operator--(int)
+{
+	const_iterator old = *this;
+	--(*this);
+	return old;
+}
+// ----------------------------------------------------------
+ROWS_SELECTION::ROWS_SELECTION()
+{
+	totalRows = 0;
+}
+
+size_t ROWS_SELECTION::size() const
+{
+	return totalRows;
+}
+bool ROWS_SELECTION::empty() const
+{
+	return totalRows == 0;
+}
+void ROWS_SELECTION::clear()
+{
+	ranges.clear();
+	totalRows = 0;
+}
+
+ROWS_SELECTION::const_iterator ROWS_SELECTION::begin() const
+{
+	if (ranges.empty())
+		return end();
+	return const_iterator(&ranges, 0, ranges[0].start);
+}
+ROWS_SELECTION::const_iterator ROWS_SELECTION::end() const
+{
+	return const_iterator(&ranges, ranges.size(), 0);
+}
+ROWS_SELECTION::reverse_iterator ROWS_SELECTION::rbegin() const
+{
+	return reverse_iterator(end());
+}
+ROWS_SELECTION::reverse_iterator ROWS_SELECTION::rend() const
+{
+	return reverse_iterator(begin());
+}
+
+bool ROWS_SELECTION::insert(int row)
+{
+	size_t old_size = totalRows;
+	insertRange(row, row + 1);
+	return totalRows != old_size;
+}
+size_t ROWS_SELECTION::erase(int row)
+{
+	size_t old_size = totalRows;
+	eraseRange(row, row + 1);
+	return old_size - totalRows;
+}
+ROWS_SELECTION::const_iterator ROWS_SELECTION::find(int row) const
+{
+	std::vector<ROWS_RANGE>::const_iterator it = std::lower_bound(ranges.begin(), ranges.end(), row, rangeEndsAtOrBefore);
+	if (it != ranges.end() && it->start <= row)
+		return const_iterator(&ranges, it - ranges.begin(), row);
+	return end();
+}
+size_t ROWS_SELECTION::count(int row) const
+{
+	return (find(row) != end()) ? 1 : 0;
+}
+
+void ROWS_SELECTION::insertRange(int start, int end)
+{
+	if (start >= end) return;
+	// appending at the end of the set
+	if (ranges.empty() || start > ranges.back().end)
+	{
+		ROWS_RANGE range = { start, end };
+		ranges.push_back(range);
+		totalRows += end - start;
+		return;
+	}
+	if (start >= ranges.back().start)
+	{
+		if (end > ranges.back().end)
+		{
+			totalRows += end - ranges.back().end;
+			ranges.back().end = end;
+		}
+		return;
+	}
+	// ranges that overlap or touch the new one are merged with it
+	std::vector<ROWS_RANGE>::iterator first = std::lower_bound(ranges.begin(), ranges.end(), start, rangeEndsBefore);
+	std::vector<ROWS_RANGE>::iterator last = std::upper_bound(first, ranges.end(), end, rangeStartsAfter);
+	ROWS_RANGE merged = { start, end };
+	if (first != last)
+	{
+		merged.start = std::min(start, first->start);
+		merged.end = std::max(end, (last - 1)->end);
+		for (std::vector<ROWS_RANGE>::iterator it = first; it != last; ++it)
+			totalRows -= it->end - it->start;
+		first = ranges.erase(first + 1, last) - 1;
+		*first = merged;
+	} else
+	{
+		ranges.insert(first, merged);
+	}
+	totalRows += merged.end - merged.start;
+}
+void ROWS_SELECTION::eraseRange(int start, int end)
+{
+	if (start >= end || ranges.empty()) return;
+	std::vector<ROWS_RANGE>::iterator first = std::lower_bound(ranges.begin(), ranges.end(), start, rangeEndsAtOrBefore);
+	std::vector<ROWS_RANGE>::iterator last = std::lower_bound(first, ranges.end(), end, rangeStartsBefore);
+	if (first == last) return;
+	// parts of the first and the last range may stay
+	ROWS_RANGE left = { first->start, start };
+	ROWS_RANGE right = { end, (last - 1)->end };
+	for (std::vector<ROWS_RANGE>::iterator it = first; it != last; ++it)
+		totalRows -= it->end - it->start;
+	first = ranges.erase(first, last);
+	if (right.start < right.end)
+	{
+		first = ranges.insert(first, right);
+		totalRows += right.end - right.start;
+	}
+	if (left.start < left.end)
+	{
+		ranges.insert(first, left);
+		totalRows += left.end - left.start;
+	}
+}
+
+const std::vector<ROWS_RANGE>& ROWS_SELECTION::getRanges() const
+{
+	return ranges;
+}
+
+bool ROWS_SELECTION::operator==(const ROWS_SELECTION& other) const
+{
+	if (totalRows != other.totalRows || ranges.size() != other.ranges.size())
+		return false;
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		if (ranges[i].start != other.ranges[i].start || ranges[i].end != other.ranges[i].end)
+			return false;
+	}
+	return true;
+}
+bool ROWS_SELECTION::operator!=(const ROWS_SELECTION& other) const
+{
+	return !(*this == other);
+}
@@ -0,0 +1,80 @@
+// Specification file for RowsSelection class
+#pragma once
+#include <stddef.h>
+#include <iterator>
+#include <vector>
+
+struct ROWS_RANGE
+{
+	int start;
+	int end;		// first row after the range
+};
+
+// sorted set of rows, stored as a list of disjoint ranges
+// it can be iterated like std::set<int>, but selecting or erasing a region costs the same as a single row
+class ROWS_SELECTION
+{
+public:
+	class const_iterator
+	{
+	public:
+		typedef std::bidirectional_iterator_tag iterator_category;
+		typedef int value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const int* pointer;
+		typedef int reference;
+
+		const_iterator();
+
+		int operator*() const { return row; }
+		const_iterator& operator++();
+		const_iterator operator++(int);
+		const_iterator& operator--();
+		const_iterator operator--(int);
+
+		bool operator==(const const_iterator& other) const { return range == other.range && row == other.row; }
+		bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+	private:
+		friend class ROWS_SELECTION;
+		const_iterator(const std::vector<ROWS_RANGE>* ranges, size_t range, int row);
+
+		const std::vector<ROWS_RANGE>* ranges;
+		size_t range;
+		int row;
+	};
+	typedef const_iterator iterator;
+	typedef std::reverse_iterator<const_iterator> reverse_iterator;
+	typedef reverse_iterator const_reverse_iterator;
+
+	ROWS_SELECTION();
+
+	size_t size() const;				// number of rows, not ranges
+	bool empty() const;
+	void clear();
+
+	const_iterator begin() const;
+	const_iterator end() const;
+	reverse_iterator rbegin() const;
+	reverse_iterator rend() const;
+
+	// returns true if the row wasn't in the set yet
+	bool insert(int row);
+	// returns the number of erased rows (0 or 1)
+	size_t erase(int row);
+	const_iterator find(int row) const;
+	size_t count(int row) const;
+
+	// rows [start, end)
+	void insertRange(int start, int end);
+	void eraseRange(int start, int end);
+
+	const std::vector<ROWS_RANGE>& getRanges() const;
+
+	bool operator==(const ROWS_SELECTION& other) const;
+	bool operator!=(const ROWS_SELECTION& other) const;
+
+private:
+	std::vector<ROWS_RANGE> ranges;
+	size_t totalRows;
+};
@@ -138,15 +138,10 @@ void SELECTION::updateSelectionSize()
 	// keep Selection within Piano Roll limits
 	if (getCurrentRowsSelection().size())
 	{
-		int delete_index;
+		int last_index = *getCurrentRowsSelection().rbegin();
 		int movie_size = currMovieData.getNumRecords();
-		while (true)
-		{
-			delete_index = *getCurrentRowsSelection().rbegin();
-			if (delete_index < movie_size) break;
-			getCurrentRowsSelection().erase(delete_index);
-			if (!getCurrentRowsSelection().size()) break;
-		}
+		if (last_index >= movie_size)
+			getCurrentRowsSelection().eraseRange(movie_size, last_index + 1);
 	}
 }
 
@@ -368,12 +363,14 @@ error:
 
 void SELECTION::saveSelection(RowsSelection& selection, EMUFILE *os)
 {
+	// the file keeps the list of rows, as it was written before Selection was stored as ranges
 	write32le(selection.size(), os);
-	if (selection.size())
+	const std::vector<ROWS_RANGE>& ranges = selection.getRanges();
+	for (size_t i = 0; i < ranges.size(); ++i)
 	{
-		for(RowsSelection::iterator it(selection.begin()); it != selection.end(); it++)
+		for (int row = ranges[i].start; row < ranges[i].end; ++row)
 		{
-			write32le(*it, os);
+			write32le(row, os);
 		}
 	}
 }
@@ -405,17 +402,11 @@ void SELECTION::noteThatItemRangeChanged(int startItem, int endItem, int newValu
 
 	if (ON)
 	{
-		for(int i = startItem; i <= endItem; ++i)
-		{
-			getCurrentRowsSelection().insert(i);
-		}
+		getCurrentRowsSelection().insertRange(startItem, endItem + 1);
 	}
 	else
 	{
-		for(int i = startItem; i <= endItem; ++i)
-		{
-			getCurrentRowsSelection().erase(i);
-		}
+		getCurrentRowsSelection().eraseRange(startItem, endItem + 1);
 	}
 
 	splicer->mustRedrawInfoAboutSelection = true;
@@ -439,10 +430,7 @@ void SELECTION::noteThatItemChanged(int item, int newValue )
 		else if (ON)
 		{
 			// select all
-			for(int i = currMovieData.getNumRecords() - 1; i >= 0; i--)
-			{
-				getCurrentRowsSelection().insert(i);
-			}
+			getCurrentRowsSelection().insertRange(0, currMovieData.getNumRecords());
 		}
 	}
 	else
@@ -526,20 +514,13 @@ void SELECTION::redo()
 // ----------------------------------------------------------
 bool SELECTION::isRowSelected(int index)
 {
-	std::map <int, int>::iterator it;
 	/*
 	if (CurrentSelection().find(frame) == CurrentSelection().end())
 		return false;
 	return true;
 	*/
 	//return false; // ListView_GetItemState(pianoRoll.hwndList, index, LVIS_SELECTED) != 0;
-	it = selList.find(index);
-
-	if ( it != selList.end() )
-	{
-		return it->second ? true : false;
-	}
-	return false;
+	return selList.count(index) != 0;
 }
 
 void SELECTION::clearAllRowsSelection()
@@ -557,18 +538,11 @@ void SELECTION::clearSingleRowSelection(int index)
 	{
 		return;
 	}
-	std::map <int, int>::iterator it;
 	//ListView_SetItemState(pianoRoll.hwndList, index, 0, LVIS_SELECTED);
-	
-	it = selList.find(index);
 
-	if ( it != selList.end() )
+	if ( selList.erase(index) )
 	{
-		if ( it->second )
-		{
-			noteThatItemChanged(index, 0);
-		}
-		selList.erase(it);
+		noteThatItemChanged(index, 0);
 	}
 }
 void SELECTION::clearRegionOfRowsSelection(int start, int end)
@@ -577,25 +551,18 @@ void SELECTION::clearRegionOfRowsSelection(int start, int end)
 	{
 		return;
 	}
-	std::map <int, int>::iterator start_it, end_it;
 	//for (int i = start; i < end; ++i)
 	//	ListView_SetItemState(pianoRoll.hwndList, i, 0, LVIS_SELECTED);
-	
-	start_it = selList.find(start);
-	  end_it = selList.find(end);
 
-	if ( (start_it != selList.end()) )
+	if ( selList.count(start) )
 	{
-		if ( (end_it != selList.end()) )
+		if ( selList.count(end) )
 		{
-			selList.erase( start_it, end_it );
+			selList.eraseRange( start, end );
 		}
 		else
 		{
-			while (start_it != selList.end())
-			{
-				start_it = selList.erase( start_it );
-			}
+			selList.eraseRange( start, *selList.rbegin() + 1 );
 		}
 		noteThatItemRangeChanged(start, end, 0);
 	}
@@ -610,30 +577,14 @@ void SELECTION::selectAllRows(void)
 {
 	noteThatItemChanged(-1, 1);
 
-	for (size_t i = 0; i < currMovieData.records.size(); ++i)
-	{
-		selList[i] = 1;
-	}
+	selList.insertRange(0, currMovieData.records.size());
 	//ListView_SetItemState(pianoRoll.hwndList, -1, LVIS_SELECTED, LVIS_SELECTED);
 }
 void SELECTION::setRowSelection(int index)
 {
-	std::map <int, int>::iterator it;
-
-	it = selList.find(index);
-
-	if ( it != selList.end() )
-	{
-		if ( !it->second )
-		{
-			noteThatItemChanged(index, 1);
-			it->second = 1;
-		}
-	}
-	else
+	if ( selList.insert(index) )
 	{
 		noteThatItemChanged(index, 1);
-		selList[index] = 1;
 	}
 	//ListView_SetItemState(pianoRoll.hwndList, index, LVIS_SELECTED, LVIS_SELECTED);
 }
@@ -643,10 +594,7 @@ void SELECTION::setRegionOfRowsSelection(int start, int end)
 	//	ListView_SetItemState(pianoRoll.hwndList, i, LVIS_SELECTED, LVIS_SELECTED);
 	noteThatItemRangeChanged(start, end, 1);
 
-	for (int i = start; i < end; ++i)
-	{
-		selList[i] = 1;
-	}
+	selList.insertRange(start, end);
 }
 
 void SELECTION::setRegionOfRowsSelectionUsingPattern(int start, int end)
@@ -661,12 +609,12 @@ void SELECTION::setRegionOfRowsSelectionUsingPattern(int start, int end)
 		}
 		if (tasWin->patterns[current_pattern][pattern_offset])
 		{
-			selList[i] = 1;
+			selList.insert(i);
 			//ListView_SetItemState(pianoRoll.hwndList, i, LVIS_SELECTED, LVIS_SELECTED);
 		}
 		else
 		{
-			selList[i] = 0;
+			selList.erase(i);
 			//ListView_SetItemState(pianoRoll.hwndList, i, 0, LVIS_SELECTED);
 		}
 		pattern_offset++;
@@ -719,51 +667,31 @@ void SELECTION::selectAllRowsBetweenMarkers()
 	{
 		// 1 - default: select all between Markers, not including lower Marker
 		if (upper_marker < 0) upper_marker = 0;
-		for (int i = upper_marker; i < lower_marker; ++i)
-		{
-			//ListView_SetItemState(pianoRoll.hwndList, i, LVIS_SELECTED, LVIS_SELECTED);
-			selList[i] = 1;
-		}
+		selList.insertRange(upper_marker, lower_marker);
 	}
 	else if (upper_border == upper_marker && lower_border == lower_marker-1)
 	{
 		// 2 - selected all between Markers and upper Marker selected too: select all between Markers, not including Markers
-		for (int i = upper_marker+1; i < lower_marker; ++i)
-		{
-			//ListView_SetItemState(pianoRoll.hwndList, i, LVIS_SELECTED, LVIS_SELECTED);
-			selList[i] = 1;
-		}
+		selList.insertRange(upper_marker + 1, lower_marker);
 	}
 	else if (upper_border == upper_marker+1 && lower_border == lower_marker-1)
 	{
 		// 3 - selected all between Markers, nut including Markers: select all between Markers, not including upper Marker
 		if (lower_marker >= movie_size) lower_marker = movie_size - 1;
-		for (int i = upper_marker+1; i <= lower_marker; ++i)
-		{
-			//ListView_SetItemState(pianoRoll.hwndList, i, LVIS_SELECTED, LVIS_SELECTED);
-			selList[i] = 1;
-		}
+		selList.insertRange(upper_marker + 1, lower_marker + 1);
 	}
 	else if (upper_border == upper_marker+1 && lower_border == lower_marker)
 	{
 		// 4 - selected all between Markers and lower Marker selected too: select all bertween Markers, including Markers
 		if (upper_marker < 0) upper_marker = 0;
 		if (lower_marker >= movie_size) lower_marker = movie_size - 1;
-		for (int i = upper_marker; i <= lower_marker; ++i)
-		{
-			//ListView_SetItemState(pianoRoll.hwndList, i, LVIS_SELECTED, LVIS_SELECTED);
-			selList[i] = 1;
-		}
+		selList.insertRange(upper_marker, lower_marker + 1);
 	}
 	else
 	{
 		// return to 1
 		if (upper_marker < 0) upper_marker = 0;
-		for (int i = upper_marker; i < lower_marker; ++i)
-		{
-			//ListView_SetItemState(pianoRoll.hwndList, i, LVIS_SELECTED, LVIS_SELECTED);
-			selList[i] = 1;
-		}
+		selList.insertRange(upper_marker, lower_marker);
 	}
 }
 void SELECTION::reselectClipboard()
@@ -785,34 +713,19 @@ void SELECTION::transposeVertically(int shift)
 	if (current_selection->size())
 	{
 		clearAllRowsSelection();
-		int pos;
-		if (shift > 0)
-		{
-			int movie_size = currMovieData.getNumRecords();
-			RowsSelection::reverse_iterator current_selection_rend(current_selection->rend());
-			for(RowsSelection::reverse_iterator it(current_selection->rbegin()); it != current_selection_rend; it++)
-			{
-				pos = (*it) + shift;
-				if (pos < movie_size)
-				{
-					//ListView_SetItemState(pianoRoll.hwndList, pos, LVIS_SELECTED, LVIS_SELECTED);
-					selList[pos] = 1;
-					noteThatItemChanged(pos, 1);
-				}
-			}
-		}
-		else
-		{
-			RowsSelection::iterator current_selection_end(current_selection->end());
-			for(RowsSelection::iterator it(current_selection->begin()); it != current_selection_end; it++)
+		// move every selected region, the rows that would leave the Piano Roll are dropped
+		int movie_size = currMovieData.getNumRecords();
+		const std::vector<ROWS_RANGE>& ranges = current_selection->getRanges();
+		for (size_t i = 0; i < ranges.size(); ++i)
+		{
+			int start = ranges[i].start + shift;
+			int end = ranges[i].end + shift;
+			if (start < 0) start = 0;
+			if (end > movie_size) end = movie_size;
+			if (start < end)
 			{
-				pos = (*it) + shift;
-				if (pos >= 0)
-				{
-					//ListView_SetItemState(pianoRoll.hwndList, pos, LVIS_SELECTED, LVIS_SELECTED);
-					selList[pos] = 1;
-					noteThatItemChanged(pos, 1);
-				}
+				selList.insertRange(start, end);
+				noteThatItemRangeChanged(start, end - 1, 1);
 			}
 		}
 	}
@@ -822,11 +735,7 @@ void SELECTION::enforceRowsSelectionToList()
 {
 	trackSelectionChanges = false;
 	clearAllRowsSelection();
-	for(RowsSelection::reverse_iterator it(getCurrentRowsSelection().rbegin()); it != getCurrentRowsSelection().rend(); it++)
-	{
-		//ListView_SetItemState(pianoRoll.hwndList, *it, LVIS_SELECTED, LVIS_SELECTED);
-		selList[*it] = 1;
-	}
+	selList = getCurrentRowsSelection();
 	trackSelectionChanges = true;
 }
 
@@ -1,14 +1,14 @@
 // Specification file for SELECTION class
 #pragma once
 
-#include <set>
-#include <map>
 #include <vector>
 #include <time.h>
 
 #include <QLineEdit>
 
-typedef std::set<int> RowsSelection;
+#include "Qt/TasEditor/rows_selection.h"
+
+typedef ROWS_SELECTION RowsSelection;
 
 #define SELECTION_ID_LEN 10
 
@@ -115,5 +115,5 @@ private:
 
 	RowsSelection tempRowsSelection;
 
-	std::map <int, int> selList;
+	RowsSelection selList;
 };
@@ -33,9 +33,10 @@ SNAPSHOT::SNAPSHOT()
 	description[0] = 0;
 }
 
-void SNAPSHOT::init(MovieData& md, LAGLOG& lagLog, bool hotchanges, int enforceInputType)
+void SNAPSHOT::init(MovieData& md, LAGLOG& lagLog, bool hotchanges, int enforceInputType, SNAPSHOT* baseSnapshot)
 {
-	inputlog.init(md, hotchanges, enforceInputType);
+	// Input that didn't change since the base snapshot is shared with it
+	inputlog.init(md, hotchanges, enforceInputType, baseSnapshot ? &baseSnapshot->inputlog : NULL);
 
 	// make a copy of the given laglog
 	laglog = lagLog;
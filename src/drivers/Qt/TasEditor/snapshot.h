@@ -11,7 +11,7 @@ class SNAPSHOT
 {
 public:
 	SNAPSHOT();
-	void init(MovieData& md, LAGLOG& lagLog, bool hotChanges, int enforceInputType = -1);
+	void init(MovieData& md, LAGLOG& lagLog, bool hotChanges, int enforceInputType = -1, SNAPSHOT* baseSnapshot = NULL);
 	void reinit(MovieData& md, LAGLOG& lagLog, bool hotChanges, int frameOfChanges);	// used when combining consecutive Recordings
 
 	bool areMarkersDifferentFromCurrentMarkers();
@@ -37,6 +37,26 @@ static char numTextColumns[] = " columns";
 //static char clipboardText[] = "Clipboard: ";
 static char clipboardEmptyText[] = "empty";
 
+// inserts a run of pasted frames into the movie at once, returns true if Markers were shifted
+static bool insertPastedFrames(int at, std::vector<MovieRecord>& frames, RowsSelection& insertedSet)
+{
+	bool markers_changed = false;
+	int count = frames.size();
+	if (!count) return false;
+	currMovieData.records.insert(currMovieData.records.begin() + at, frames.begin(), frames.end());
+	greenzone->lagLog.insertFrame(at, false, count);
+	if (taseditorConfig->bindMarkersToInput)
+	{
+		if (markersManager->insertEmpty(at, count))
+		{
+			markers_changed = true;
+		}
+	}
+	insertedSet.insertRange(at, at + count);
+	frames.clear();
+	return markers_changed;
+}
+
 SPLICER::SPLICER()
 {
 }
@@ -114,37 +134,25 @@ void SPLICER::cloneSelectedFrames(void)
 	selection->clearAllRowsSelection();			// Selection will be moved down, so that same frames are selected
 	bool markers_changed = false;
 	currMovieData.records.reserve(currMovieData.getNumRecords() + frames);
-	// insert frames before each selection, but consecutive Selection lines are accounted as single region
-	RowsSelection::reverse_iterator next_it;
-	RowsSelection::reverse_iterator current_selection_rend = current_selection->rend();
+	// insert frames before each selected region, going backwards
+	const std::vector<ROWS_RANGE>& ranges = current_selection->getRanges();
 	int shift = frames;
-	frames = 1;
-	for(RowsSelection::reverse_iterator it(current_selection->rbegin()); it != current_selection_rend; it++)
+	for (int i = (int)ranges.size() - 1; i >= 0; i--)
 	{
-		next_it = it;
-		next_it++;
-		if (next_it == current_selection_rend || (int)*next_it < ((int)*it - 1))
+		int start = ranges[i].start;
+		frames = ranges[i].end - start;
+		currMovieData.cloneRegion(start, frames);
+		greenzone->lagLog.insertFrame(start, false, frames);
+		if (taseditorConfig->bindMarkersToInput)
 		{
-			// end of current region
-			currMovieData.cloneRegion(*it, frames);
-			greenzone->lagLog.insertFrame(*it, false, frames);
-			if (taseditorConfig->bindMarkersToInput)
+			// Markers are not cloned
+			if (markersManager->insertEmpty(start, frames))
 			{
-				// Markers are not cloned
-				if (markersManager->insertEmpty(*it,frames))
-				{
-					markers_changed = true;
-				}
+				markers_changed = true;
 			}
-			selection->setRegionOfRowsSelection((*it) + shift, (*it) + shift + frames);
-			shift -= frames;
-			// start accumulating next region
-			frames = 1;
-		}
-		else
-		{
-			frames++;
 		}
+		selection->setRegionOfRowsSelection(start + shift, start + shift + frames);
+		shift -= frames;
 	}
 	// check and register changes
 	int first_changes = history->registerChanges(MODTYPE_CLONE, *current_selection->begin(), -1, 0, NULL, 0, current_selection);
@@ -172,36 +180,24 @@ void SPLICER::insertSelectedFrames(void)
 	selection->clearAllRowsSelection();			// Selection will be moved down, so that same frames are selected
 	bool markers_changed = false;
 	currMovieData.records.reserve(currMovieData.getNumRecords() + frames);
-	// insert frames before each selection, but consecutive Selection lines are accounted as single region
-	RowsSelection::reverse_iterator next_it;
-	RowsSelection::reverse_iterator current_selection_rend = current_selection->rend();
+	// insert frames before each selected region, going backwards
+	const std::vector<ROWS_RANGE>& ranges = current_selection->getRanges();
 	int shift = frames;
-	frames = 1;
-	for(RowsSelection::reverse_iterator it(current_selection->rbegin()); it != current_selection_rend; it++)
+	for (int i = (int)ranges.size() - 1; i >= 0; i--)
 	{
-		next_it = it;
-		next_it++;
-		if (next_it == current_selection_rend || (int)*next_it < ((int)*it - 1))
+		int start = ranges[i].start;
+		frames = ranges[i].end - start;
+		currMovieData.insertEmpty(start, frames);
+		greenzone->lagLog.insertFrame(start, false, frames);
+		if (taseditorConfig->bindMarkersToInput)
 		{
-			// end of current region
-			currMovieData.insertEmpty(*it, frames);
-			greenzone->lagLog.insertFrame(*it, false, frames);
-			if (taseditorConfig->bindMarkersToInput)
+			if (markersManager->insertEmpty(start, frames))
 			{
-				if (markersManager->insertEmpty(*it, frames))
-				{
-					markers_changed = true;
-				}
+				markers_changed = true;
 			}
-			selection->setRegionOfRowsSelection((*it) + shift, (*it) + shift + frames);
-			shift -= frames;
-			// start accumulating next region
-			frames = 1;
-		}
-		else
-		{
-			frames++;
 		}
+		selection->setRegionOfRowsSelection(start + shift, start + shift + frames);
+		shift -= frames;
 	}
 	// check and register changes
 	int first_changes = history->registerChanges(MODTYPE_INSERT, *current_selection->begin(), -1, 0, NULL, 0, current_selection);
@@ -299,15 +295,17 @@ void SPLICER::deleteSelectedFrames(void)
 	bool markers_changed = false;
 	int start_index = *current_selection->begin();
 	//int end_index = *current_selection->rbegin();
-	RowsSelection::reverse_iterator current_selection_rend = current_selection->rend();
-	// delete frames on each selection, going backwards
-	for(RowsSelection::reverse_iterator it(current_selection->rbegin()); it != current_selection_rend; it++)
-	{
-		currMovieData.eraseRecords(*it);
-		greenzone->lagLog.eraseFrame(*it);
+	// delete frames of each selected region, going backwards
+	const std::vector<ROWS_RANGE>& ranges = current_selection->getRanges();
+	for (int i = (int)ranges.size() - 1; i >= 0; i--)
+	{
+		int start = ranges[i].start;
+		int frames = ranges[i].end - start;
+		currMovieData.eraseRecords(start, frames);
+		greenzone->lagLog.eraseFrame(start, frames);
 		if (taseditorConfig->bindMarkersToInput)
 		{
-			if (markersManager->eraseMarker(*it))
+			if (markersManager->eraseMarker(start, frames))
 			{
 				markers_changed = true;
 			}
@@ -351,10 +349,10 @@ void SPLICER::clearSelectedFrames(RowsSelection* currentSelectionOverride)
 	}
 
 	// clear Input on each selected frame
-	RowsSelection::iterator current_selection_end(currentSelectionOverride->end());
-	for(RowsSelection::iterator it(currentSelectionOverride->begin()); it != current_selection_end; it++)
+	const std::vector<ROWS_RANGE>& ranges = currentSelectionOverride->getRanges();
+	for (size_t i = 0; i < ranges.size(); ++i)
 	{
-		currMovieData.records[*it].clear();
+		currMovieData.clearRecordRange(ranges[i].start, ranges[i].end - ranges[i].start);
 	}
 	if (cut)
 	{
@@ -641,6 +639,9 @@ bool SPLICER::pasteInsertInputFromClipboard(void)
 		const char* frame;
 		//int joy=0;
 		std::vector<uint8> flash_joy(num_joypads);
+		// consecutive pasted frames are collected and inserted together, instead of shifting the rest of the movie for every frame
+		std::vector<MovieRecord> pasted_frames;
+		int pasted_frames_start = pos;
 		pos--;
 		while (pGlobal++ && *pGlobal!='\0')
 		{
@@ -648,7 +649,12 @@ bool SPLICER::pasteInsertInputFromClipboard(void)
 			frame = pGlobal;
 			if (frame[0]=='+')
 			{
+				if (insertPastedFrames(pasted_frames_start, pasted_frames, inserted_set))
+				{
+					markers_changed = true;
+				}
 				pos += atoi(frame+1);
+				pasted_frames_start = pos;
 				if (currMovieData.getNumRecords() < pos)
 				{
 					currMovieData.insertEmpty(currMovieData.getNumRecords(), pos - currMovieData.getNumRecords());
@@ -663,17 +669,9 @@ bool SPLICER::pasteInsertInputFromClipboard(void)
 				pos++;
 			}
 			
-			// insert new frame
-			currMovieData.insertEmpty(pos, 1);
-			greenzone->lagLog.insertFrame(pos, false, 1);
-			if (taseditorConfig->bindMarkersToInput)
-			{
-				if (markersManager->insertEmpty(pos, 1))
-				{
-					markers_changed = true;
-				}
-			}
-			inserted_set.insert(pos);
+			// new frame
+			pasted_frames.push_back(MovieRecord());
+			MovieRecord& record = pasted_frames.back();
 
 			// read this frame Input
 			int joy = 0;
@@ -689,7 +687,7 @@ bool SPLICER::pasteInsertInputFromClipboard(void)
 					{
 						if (*frame == buttonNames[bit][0])
 						{
-							currMovieData.records[pos].joysticks[joy] |= (1<<bit);
+							record.joysticks[joy] |= (1<<bit);
 							flash_joy[joy] |= (1<<bit);		// highlight buttons
 							break;
 						}
@@ -701,6 +699,10 @@ bool SPLICER::pasteInsertInputFromClipboard(void)
 
 			pGlobal = strchr(pGlobal, '\n');
 		}
+		if (insertPastedFrames(pasted_frames_start, pasted_frames, inserted_set))
+		{
+			markers_changed = true;
+		}
 		markersManager->update();
 		int first_changes = history->registerChanges(MODTYPE_PASTEINSERT, *current_selection_begin, -1, 0, NULL, 0, &inserted_set);
 		if (first_changes >= 0)
@@ -54,8 +54,10 @@ TASEDITOR_CONFIG::TASEDITOR_CONFIG(void)
 	followMarkerNoteContext = true;
 
 	greenzoneCapacity = GREENZONE_CAPACITY_DEFAULT;
+	greenzoneMemoryBudget = GREENZONE_MEMORY_BUDGET_DEFAULT;
 	maxUndoLevels = UNDO_LEVELS_DEFAULT;
 	enableGreenzoning = true;
+	regenerateGreenzoneInBackground = false;
 	autofirePatternSkipsLag = true;
 	autoAdjustInputAccordingToLag = true;
 	drawInputByDragging = true;
@@ -120,8 +122,10 @@ void TASEDITOR_CONFIG::load(void)
 	g_config->getOption("SDL.TasFollowUndoContext"                       , &followUndoContext  );
 	g_config->getOption("SDL.TasFollowMarkerNoteContext"                 , &followMarkerNoteContext  );
 	g_config->getOption("SDL.TasGreenzoneCapacity"                       , &greenzoneCapacity  );
+	g_config->getOption("SDL.TasGreenzoneMemoryBudget"                   , &greenzoneMemoryBudget  );
 	g_config->getOption("SDL.TasMaxUndoLevels"                           , &maxUndoLevels  );
 	g_config->getOption("SDL.TasEnableGreenzoning"                       , &enableGreenzoning  );
+	g_config->getOption("SDL.TasRegenerateGreenzoneInBackground"         , &regenerateGreenzoneInBackground  );
 	g_config->getOption("SDL.TasAutofirePatternSkipsLag"                 , &autofirePatternSkipsLag  );
 	g_config->getOption("SDL.TasAutoAdjustInputAccordingToLag"           , &autoAdjustInputAccordingToLag  );
 	g_config->getOption("SDL.TasDrawInputByDragging"                     , &drawInputByDragging  );
@@ -176,8 +180,10 @@ void TASEDITOR_CONFIG::save(void)
 	g_config->setOption("SDL.TasFollowUndoContext"                       , followUndoContext  );
 	g_config->setOption("SDL.TasFollowMarkerNoteContext"                 , followMarkerNoteContext  );
 	g_config->setOption("SDL.TasGreenzoneCapacity"                       , greenzoneCapacity  );
+	g_config->setOption("SDL.TasGreenzoneMemoryBudget"                   , greenzoneMemoryBudget  );
 	g_config->setOption("SDL.TasMaxUndoLevels"                           , maxUndoLevels  );
 	g_config->setOption("SDL.TasEnableGreenzoning"                       , enableGreenzoning  );
+	g_config->setOption("SDL.TasRegenerateGreenzoneInBackground"         , regenerateGreenzoneInBackground  );
 	g_config->setOption("SDL.TasAutofirePatternSkipsLag"                 , autofirePatternSkipsLag  );
 	g_config->setOption("SDL.TasAutoAdjustInputAccordingToLag"           , autoAdjustInputAccordingToLag  );
 	g_config->setOption("SDL.TasDrawInputByDragging"                     , drawInputByDragging  );
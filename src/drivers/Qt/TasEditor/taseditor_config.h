@@ -5,6 +5,10 @@
 #define GREENZONE_CAPACITY_MAX 50000	// this limitation is here just because we're running in 32-bit OS, so there's 2GB limit of RAM
 #define GREENZONE_CAPACITY_DEFAULT 10000
 
+#define GREENZONE_MEMORY_BUDGET_MIN 16			// in megabytes
+#define GREENZONE_MEMORY_BUDGET_MAX 65536
+#define GREENZONE_MEMORY_BUDGET_DEFAULT 512
+
 #define UNDO_LEVELS_MIN 1
 #define UNDO_LEVELS_MAX 1000			// this limitation is here just because we're running in 32-bit OS, so there's 2GB limit of RAM
 #define UNDO_LEVELS_DEFAULT 100
@@ -65,9 +69,11 @@ public:
 	bool followMarkerNoteContext;
 
 	int greenzoneCapacity;
+	int greenzoneMemoryBudget;
 	int maxUndoLevels;
 
 	bool enableGreenzoning;
+	bool regenerateGreenzoneInBackground;
 	bool autofirePatternSkipsLag;
 	bool autoAdjustInputAccordingToLag;
 	bool drawInputByDragging;
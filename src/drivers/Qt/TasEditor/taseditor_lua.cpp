@@ -30,6 +30,7 @@ TASEDITOR_LUA::TASEDITOR_LUA()
 void TASEDITOR_LUA::init()
 {
 	pending_changes.resize(0);
+	pending_input.resize(0);
 	reset();
 }
 void TASEDITOR_LUA::reset()
@@ -75,6 +76,15 @@ void TASEDITOR_LUA::insertAndDeleteRowsInSnaphot(SNAPSHOT& snapshot)
 					snapshot.inputlog.insertFrames(pending_changes[i].frame, pending_changes[i].data);
 					break;
 				}
+				case LUA_CHANGE_TYPE_INPUTRANGE:
+				{
+					// expand snapshot to fit the whole range
+					if (pending_changes[i].frame + pending_changes[i].data > snapshot.inputlog.size)
+					{
+						snapshot.inputlog.insertFrames(-1, pending_changes[i].frame + pending_changes[i].data - snapshot.inputlog.size);
+					}
+					break;
+				}
 				case LUA_CHANGE_TYPE_DELETEFRAMES:
 				{
 					for (int t = pending_changes[i].data; t > 0; t--)
@@ -312,6 +322,35 @@ int TASEDITOR_LUA::getinput(int frame, int joypad)
 	}
 }
 
+// string taseditor.getinputrange(int frame, int joypad, int number)
+bool TASEDITOR_LUA::getinputrange(int frame, int joypad, int number, std::vector<uint8_t>& placeholder)
+{
+	if (FCEUMOV_Mode(MOVIEMODE_TASEDITOR))
+	{
+		if (frame < 0 || number < 0) return false;
+		if (joypad < LUA_JOYPAD_COMMANDS || joypad > LUA_JOYPAD_4P) return false;
+		// the range is cut at the end of current input range
+		int end = currMovieData.getNumRecords();
+		if (number < end - frame)
+		{
+			end = frame + number;
+		}
+		for (int i = frame; i < end; ++i)
+		{
+			if (joypad == LUA_JOYPAD_COMMANDS)
+			{
+				placeholder.push_back(currMovieData.records[i].commands);
+			}
+			else
+			{
+				placeholder.push_back(currMovieData.records[i].joysticks[joypad - LUA_JOYPAD_1P]);
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
 // taseditor.submitinputchange(int frame, int joypad, int input)
 void TASEDITOR_LUA::submitinputchange(int frame, int joypad, int input)
 {
@@ -366,6 +405,29 @@ void TASEDITOR_LUA::submitdeleteframes(int frame, int number)
 	}
 }
 
+// taseditor.submitinputrange(int frame, int joypad, string|table input)
+void TASEDITOR_LUA::submitinputrange(int frame, int joypad, std::vector<uint8_t>& input)
+{
+	if (FCEUMOV_Mode(MOVIEMODE_TASEDITOR))
+	{
+		if (frame >= 0 && input.size())
+		{
+			if (joypad == LUA_JOYPAD_COMMANDS || joypad == LUA_JOYPAD_1P || joypad == LUA_JOYPAD_2P || joypad == LUA_JOYPAD_3P || joypad == LUA_JOYPAD_4P)
+			{
+				// the whole range is a single request, its Input is kept in one buffer for all ranges
+				PENDING_CHANGES new_change;
+				new_change.type = LUA_CHANGE_TYPE_INPUTRANGE;
+				new_change.frame = frame;
+				new_change.joypad = joypad;
+				new_change.data = input.size();
+				new_change.offset = pending_input.size();
+				pending_input.insert(pending_input.end(), input.begin(), input.end());
+				pending_changes.push_back(new_change);
+			}
+		}
+	}
+}
+
 // int taseditor.applyinputchanges([string name])
 int TASEDITOR_LUA::applyinputchanges(const char* name)
 {
@@ -428,16 +490,35 @@ int TASEDITOR_LUA::applyinputchanges(const char* name)
 					case LUA_CHANGE_TYPE_DELETEFRAMES:
 					{
 						InsertionDeletion_was_made = true;
-						for (int t = pending_changes[i].data; t > 0; t--)
+						currMovieData.eraseRecords(pending_changes[i].frame, pending_changes[i].data);
+						greenzone->lagLog.eraseFrame(pending_changes[i].frame, pending_changes[i].data);
+						if (taseditorConfig->bindMarkersToInput)
+						{
+							markersManager->eraseMarker(pending_changes[i].frame, pending_changes[i].data);
+						}
+						break;
+					}
+					case LUA_CHANGE_TYPE_INPUTRANGE:
+					{
+						int last_frame = pending_changes[i].frame + pending_changes[i].data - 1;
+						if (last_frame >= (int)currMovieData.getNumRecords())
+						{
+							// expand movie to fit the whole range
+							currMovieData.insertEmpty(-1, 1 + last_frame - currMovieData.getNumRecords());
+							markersManager->update();
+							InsertionDeletion_was_made = true;
+						}
+						const uint8_t* input = &pending_input[pending_changes[i].offset];
+						for (int t = 0; t < pending_changes[i].data; ++t)
 						{
-							if (pending_changes[i].frame < (int)currMovieData.getNumRecords())
+							MovieRecord& record = currMovieData.records[pending_changes[i].frame + t];
+							if (pending_changes[i].joypad == LUA_JOYPAD_COMMANDS)
 							{
-								currMovieData.eraseRecords(pending_changes[i].frame);
+								record.commands = input[t];
 							}
-							greenzone->lagLog.eraseFrame(pending_changes[i].frame);
-							if (taseditorConfig->bindMarkersToInput)
+							else
 							{
-								markersManager->eraseMarker(pending_changes[i].frame);
+								record.joysticks[pending_changes[i].joypad - LUA_JOYPAD_1P] = input[t];
 							}
 						}
 						break;
@@ -467,6 +548,7 @@ int TASEDITOR_LUA::applyinputchanges(const char* name)
 				greenzone->invalidateAndUpdatePlayback(currMovieData.getNumRecords() - 1);
 			}
 			pending_changes.resize(0);
+			pending_input.resize(0);
 			return result;
 		}
 		else
@@ -486,6 +568,7 @@ void TASEDITOR_LUA::clearinputchanges()
 	if (FCEUMOV_Mode(MOVIEMODE_TASEDITOR))
 	{
 		pending_changes.resize(0);
+		pending_input.resize(0);
 	}
 }
 // --------------------------------------------------------------------------------
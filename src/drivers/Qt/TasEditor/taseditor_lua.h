@@ -11,6 +11,7 @@ struct PENDING_CHANGES
 	int frame;
 	uint8_t joypad;
 	int data;
+	int offset;			// LUA_CHANGE_TYPE_INPUTRANGE: position of the range's Input in pending_input
 };
 
 enum LUA_CHANGE_TYPES
@@ -18,6 +19,7 @@ enum LUA_CHANGE_TYPES
 	LUA_CHANGE_TYPE_INPUTCHANGE,
 	LUA_CHANGE_TYPE_INSERTFRAMES,
 	LUA_CHANGE_TYPE_DELETEFRAMES,
+	LUA_CHANGE_TYPE_INPUTRANGE,
 };
 
 enum
@@ -60,14 +62,17 @@ public:
 	void getselection(std::vector<int>& placeholder);
 	void setselection(std::vector<int>& new_set);
 	int getinput(int frame, int joypad);
+	bool getinputrange(int frame, int joypad, int number, std::vector<uint8_t>& placeholder);
 	void submitinputchange(int frame, int joypad, int input);
 	void submitinsertframes(int frame, int number);
 	void submitdeleteframes(int frame, int number);
+	void submitinputrange(int frame, int joypad, std::vector<uint8_t>& input);
 	int applyinputchanges(const char* name);
 	void clearinputchanges();
 
 private:
 	std::vector<PENDING_CHANGES> pending_changes;
+	std::vector<uint8_t> pending_input;		// Input of all submitted ranges, one byte per frame
 
 	//HWND hwndRunFunctionButton;
 
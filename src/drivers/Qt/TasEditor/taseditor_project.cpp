@@ -12,11 +12,14 @@ Project - Manager of working project
 
 * stores the info about current project filename and about having unsaved changes
 * implements saving and loading project files from filesystem
+* saves into a temporary file which replaces the project file when it's complete, so the Greenzone can keep reading savestates from the old one
 * implements autosave function
 * stores resources: autosave period scale, default filename, fm3 format offsets
 ------------------------------------------------------------------------------------ */
 
 #include <QMessageBox>
+#include <stdio.h>
+#include <QFile>
 #include <QProgressDialog>
 #include <QGuiApplication>
 
@@ -36,6 +39,16 @@ extern bool saveProjectAs(bool save_compact = false);
 
 static QProgressDialog *progressDialog = NULL;
 
+static bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef WIN32
+	QFile::remove(QString::fromStdString(to));
+	return QFile::rename(QString::fromStdString(from), QString::fromStdString(to));
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
 TASEDITOR_PROJECT::TASEDITOR_PROJECT()
 {
 }
@@ -125,15 +138,10 @@ bool TASEDITOR_PROJECT::save(const char* differentName, bool inputInBinary, bool
 		}
 	}
 	// open file for write
-	EMUFILE_FILE* ofs = 0;
-	if (differentName)
-	{
-		ofs = FCEUD_UTF8_fstream(differentName, "wb");
-	}
-	else
-	{
-		ofs = FCEUD_UTF8_fstream(getProjectFile().c_str(), "wb");
-	}
+	std::string fileName = differentName ? differentName : getProjectFile();
+	std::string tempFileName = fileName + ".tmp";
+	greenzone->releaseProjectFile(fileName.c_str());
+	EMUFILE_FILE* ofs = FCEUD_UTF8_fstream(tempFileName.c_str(), "wb");
 	if (ofs)
 	{
 		progressDialog = new QProgressDialog( QObject::tr("Saving TAS Project"), QObject::tr("Cancel"), 0, 100, tasWin );
@@ -190,10 +198,17 @@ bool TASEDITOR_PROJECT::save(const char* differentName, bool inputInBinary, bool
 		write32le(pianoRollOffset, ofs);
 		write32le(selectionOffset, ofs);
 		// finish
+		bool failed = ofs->fail();
 		delete ofs;
+		if (failed || !replaceFile(tempFileName, fileName))
+		{
+			FCEU_PrintError("Error saving %s!", fileName.c_str());
+			QFile::remove(QString::fromStdString(tempFileName));
+			failed = true;
+		}
 		playback->updateProgressbar();
 		// also set project.changed to false, unless it was SaveCompact
-		if (!differentName)
+		if (!differentName && !failed)
 		{
 			reset();
 		}
@@ -206,7 +221,7 @@ bool TASEDITOR_PROJECT::save(const char* differentName, bool inputInBinary, bool
 		QGuiApplication::restoreOverrideCursor();
 
 		//taseditorWindow.mustUpdateMouseCursor = true;
-		return true;
+		return !failed;
 	}
 	else
 	{
@@ -365,7 +380,7 @@ bool TASEDITOR_PROJECT::load(const char* fullName)
 			pointerOffset += sizeof(unsigned int);
 		else
 			dataOffset = 0;
-		greenzone->load(&ifs, dataOffset);
+		greenzone->load(&ifs, dataOffset, fullName);
 
 		if (numberOfPointers-- && !(ifs.fseek(pointerOffset, SEEK_SET)) && read32le(&dataOffset, &ifs))
 			pointerOffset += sizeof(unsigned int);
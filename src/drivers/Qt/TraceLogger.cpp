@@ -59,7 +59,6 @@
 #include "common/os_utils.h"
 #include "utils/StringBuilder.h"
 
-#include "Qt/NetPlay.h"
 #include "Qt/ConsoleDebugger.h"
 #include "Qt/ConsoleWindow.h"
 #include "Qt/ConsoleUtilities.h"
@@ -1226,11 +1225,6 @@ void FCEUD_FlushTrace()
 //----------------------------------------------------
 void FCEUD_TraceInstruction(uint8 *opcode, int size)
 {
-	if (NetPlayActive())
-	{
-		NetPlayTraceInstruction(opcode, size);
-	}
-
 	if (!logging)
 		return;
 
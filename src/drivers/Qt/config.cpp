@@ -323,6 +323,12 @@ int getHotKeyConfig( int i, const char **nameOut, const char **keySeqOut, const
 		case HK_LOAD_NEXT_STATE:
 			name = "LoadNextState"; keySeq = ""; title = "Load Next Recorded State"; group = "State";
 		break;
+		case HK_LOAD_PREV_FRAME:
+			name = "LoadPrevFrame"; keySeq = ""; title = "Rewind One Recorded Frame"; group = "State";
+		break;
+		case HK_LOAD_NEXT_FRAME:
+			name = "LoadNextFrame"; keySeq = ""; title = "Forward One Recorded Frame"; group = "State";
+		break;
 		case HK_VOLUME_MUTE:
 			name = "VolumeMute"; keySeq = ""; title = "Sound Volume Mute"; group = "Sound";
 		break;
@@ -636,6 +642,12 @@ InitConfig()
 	config->addOption("SDL.NetPlayHostAllowClientRomLoadReq", 0);
 	config->addOption("SDL.NetPlayHostAllowClientStateLoadReq", 0);
 	config->addOption("SDL.NetPlayHostEnforceAppVersionChk", 1);
+	config->addOption("netplayRollback", "SDL.NetPlayHostRollbackFrames", 0);
+	config->addOption("netplayUdp", "SDL.NetPlayHostUdpRedundancy", 0);
+	config->addOption("join", "SDL.NetworkJoin", 0);
+	config->addOption("netplayPlayer", "SDL.NetPlayJoinPlayer", 1);
+	config->addOption("netplayInput", "SDL.NetPlayJoinInput", "");
+	config->addOption("netplayStats", "SDL.NetPlayJoinStats", "");
      
 	// input configuration options
 	config->addOption("input1", "SDL.Input.0", "GamePad.0");
@@ -788,6 +800,7 @@ InitConfig()
     // auto load/save on gameload/close
 	config->addOption("loadstate", "SDL.AutoLoadState", INVALID_STATE);
 	config->addOption("savestate", "SDL.AutoSaveState", INVALID_STATE);
+	config->addOption("SDL.IndexedSavestates", false);
 
 	config->addOption("SDL.StateRecorderEnable", false);
 	config->addOption("SDL.StateRecorderHistoryDurationMin", 15);
@@ -798,6 +811,7 @@ InitConfig()
 	config->addOption("SDL.StateRecorderCompressionLevel", 0);
 	config->addOption("SDL.StateRecorderPauseOnLoad", 1);
 	config->addOption("SDL.StateRecorderPauseDuration", 3);
+	config->addOption("SDL.StateRecorderMemoryBudgetMB", 256);
 
 	//TODO implement this
 	config->addOption("periodicsaves", "SDL.PeriodicSaves", 0);
@@ -855,8 +869,10 @@ InitConfig()
 	config->addOption("SDL.TasFollowUndoContext"                       , tasCfg.followUndoContext  );
 	config->addOption("SDL.TasFollowMarkerNoteContext"                 , tasCfg.followMarkerNoteContext  );
 	config->addOption("SDL.TasGreenzoneCapacity"                       , tasCfg.greenzoneCapacity  );
+	config->addOption("SDL.TasGreenzoneMemoryBudget"                   , tasCfg.greenzoneMemoryBudget  );
 	config->addOption("SDL.TasMaxUndoLevels"                           , tasCfg.maxUndoLevels  );
 	config->addOption("SDL.TasEnableGreenzoning"                       , tasCfg.enableGreenzoning  );
+	config->addOption("SDL.TasRegenerateGreenzoneInBackground"         , tasCfg.regenerateGreenzoneInBackground  );
 	config->addOption("SDL.TasAutofirePatternSkipsLag"                 , tasCfg.autofirePatternSkipsLag  );
 	config->addOption("SDL.TasAutoAdjustInputAccordingToLag"           , tasCfg.autoAdjustInputAccordingToLag  );
 	config->addOption("SDL.TasDrawInputByDragging"                     , tasCfg.drawInputByDragging  );
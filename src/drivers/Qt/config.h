@@ -38,6 +38,7 @@ enum HOTKEY {
 
 	// State Recorder
 	HK_LOAD_PREV_STATE, HK_LOAD_NEXT_STATE,
+	HK_LOAD_PREV_FRAME, HK_LOAD_NEXT_FRAME,
 
 	// GUI
 	HK_FULLSCREEN, HK_MAIN_MENU_HIDE, 
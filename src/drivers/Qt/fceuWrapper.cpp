@@ -676,11 +676,48 @@ static const char *DriverUsage =
 "--pauseframe   x       Pause movie playback at frame x.\n"
 "--fcmconvert   f       Convert fcm movie file f to fm2.\n"
 "--ripsubs      f       Convert movie's subtitles to srt\n"
+"--verify-movies f      Play back every movie listed in manifest f without GUI\n"
+"                         and print a JSON report of the results. Each line is\n"
+"                         rom<TAB>movie[<TAB>final RAM md5][<TAB>frame:RAM md5...]\n"
+"                         [<TAB>baseline=file of per-frame state hashes].\n"
+"--verify-jobs  x       Number of movies to verify at once (default: all cores).\n"
+"--verify-report f      Write the verification report to file f.\n"
+"--netplay-relay h[:p]  Relay the NetPlay session hosted at h (port p, default\n"
+"                         4046) to spectators, without GUI.\n"
+"--relay-port   x       Port spectators connect to the relay on (default: 4047).\n"
+"--relay-password s     Password spectators have to give to the relay.\n"
+"--relay-host-password s  Password of the session being relayed.\n"
+"--relay-name   s       Name the relay joins the host with.\n"
+"--netplay-sim  f|h[:p] Run fceux NetPlay clients through a proxy with the\n"
+"                         delay, jitter and loss given, against a host started\n"
+"                         for ROM file f or the one at h (port p, default 4046),\n"
+"                         and print a JSON report of latency, stalls and traffic.\n"
+"--sim-clients  x       Number of clients (default: 2).\n"
+"--sim-movie    f       Press the buttons of FM2 movie f (default: random).\n"
+"--sim-duration x       Measure for x seconds once all clients run (default: 60).\n"
+"--sim-delay    x       One way delay of the simulated link in ms.\n"
+"--sim-jitter   x       Extra random delay of up to x ms.\n"
+"--sim-loss     x       Lose x percent of the segments and packets sent.\n"
+"--sim-udp      x       UDP input redundancy of the host started (default: off).\n"
+"--sim-rollback x       Rollback frames of the host started (default: off).\n"
+"--sim-port     x       Port of the host started (default: 4046).\n"
+"--sim-password s       Password of the session.\n"
+"--sim-seed     x       Seed of the random delays, losses and buttons.\n"
+"--sim-report   f       Write the report to file f.\n"
 "--subtitles    {0|1}   Enable subtitle display\n"
 "--fourscore    {0|1}   Enable fourscore emulation\n"
 "--no-config    {0|1}   Use default config file and do not save\n"
 "--net          s       Connect to server 's' for TCP/IP network play.\n"
 "--port         x       Use TCP/IP port x for network play.\n"
+"--server      {0|1}    Host a NetPlay session for the ROM given, on the port\n"
+"                         given, without taking a player role.\n"
+"--netplayUdp   x       UDP input redundancy of a session hosted (0 = off).\n"
+"--netplayRollback x    Rollback frames of a session hosted (0 = off).\n"
+"--join        {0|1}    Join the NetPlay session at the --net host and --port.\n"
+"--netplayPlayer x      Player role taken when joining, 1-4 (0 = spectator).\n"
+"--netplayInput f       Press the buttons of FM2 movie f while joined, instead\n"
+"                         of the gamepad's.\n"
+"--netplayStats f       Keep writing the figures of the session joined to file f.\n"
 "--user         x       Set the nickname to use in network play.\n"
 "--pass         x       Set password to use for connecting to the server.\n"
 "--netkey       s       Use string 's' to create a unique session for the\n"
@@ -1013,6 +1050,15 @@ int  fceuWrapperInit( int argc, char *argv[] )
 		movieSubtitles = id ? true : false;
 	}
 
+	// Savestate container format
+	{
+		bool indexed = false;
+
+		g_config->getOption("SDL.IndexedSavestates", &indexed);
+
+		indexedSavestates = indexed;
+	}
+
 	// Emulation Timing Mechanism
 	{
 		int timingMode;
@@ -1036,6 +1082,7 @@ int  fceuWrapperInit( int argc, char *argv[] )
 		int srCompressionLevel = 0;
 		int pauseOnLoadTime = 3;
 		int pauseOnLoad = StateRecorderConfigData::TEMPORARY_PAUSE;
+		int srMemBudgetMB = 256;
 
 		g_config->getOption("SDL.StateRecorderEnable", &srEnable);
 		g_config->getOption("SDL.StateRecorderTimingMode", &srUseTimeMode);
@@ -1046,6 +1093,7 @@ int  fceuWrapperInit( int argc, char *argv[] )
 		g_config->getOption("SDL.StateRecorderCompressionLevel", &srCompressionLevel);
 		g_config->getOption("SDL.StateRecorderPauseOnLoad", &pauseOnLoad);
 		g_config->getOption("SDL.StateRecorderPauseDuration", &pauseOnLoadTime);
+		g_config->getOption("SDL.StateRecorderMemoryBudgetMB", &srMemBudgetMB);
 
 		StateRecorderConfigData srConfig;
 
@@ -1058,6 +1106,7 @@ int  fceuWrapperInit( int argc, char *argv[] )
 		srConfig.compressionLevel = srCompressionLevel;
 		srConfig.loadPauseTimeSeconds = pauseOnLoadTime;
 		srConfig.pauseOnLoad = static_cast<StateRecorderConfigData::PauseType>(pauseOnLoad);
+		srConfig.memoryBudgetMB = srMemBudgetMB;
 
 		FCEU_StateRecorderSetEnabled( srEnable );
 		FCEU_StateRecorderSetConfigData( srConfig );
@@ -1337,8 +1386,18 @@ static void DoFun(int frameskip, int periodic_saves)
 	int32 *sound = 0;
 	int32 ssize = 0;
 	static int fskipc = 0;
+	int seekSkip = 0;
 	//static int opause = 0;
 
+	// Rewinding to a frame between recorded states re-emulates the frames up to it
+	// here, on the emulator thread, and shows the one it lands on
+	if ( FCEU_StateRecorderReplayPending() )
+	{
+		FCEU_StateRecorderReplay(&gfx, &sound, &ssize);
+		FCEUD_Update(gfx, sound, ssize);
+		return;
+	}
+
 	// If TAS editor is engaged, check whether a seek frame is set.
 	// If a seek is in progress, don't emulate past target frame.
 	if ( tasWindowIsOpen() )
@@ -1354,6 +1413,11 @@ static void DoFun(int frameskip, int periodic_saves)
 				FCEUI_SetEmulationPaused(EMULATIONPAUSED_PAUSED);
 				return;
 			}
+			// fast seek: don't mix sound or output video until the last frame
+			if ( PLAYBACK::isFastSeeking() && (currFrameCounter + 1 < runToFrameTarget) )
+			{
+				seekSkip = 2;
+			}
 		}
 	}
     //TODO peroidic saves, working on it right now
@@ -1368,7 +1432,7 @@ static void DoFun(int frameskip, int periodic_saves)
 	{
 		gfx = 0;
 	}
-	FCEUI_Emulate(&gfx, &sound, &ssize, fskipc);
+	FCEUI_Emulate(&gfx, &sound, &ssize, seekSkip ? seekSkip : fskipc);
 	FCEUD_Update(gfx, sound, ssize);
 
 	//if(opause!=FCEUI_EmulationPaused()) 
@@ -1506,6 +1570,9 @@ int  fceuWrapperUpdate( void )
 	// For netplay, set pause if we do not have input ready for all players
 	if (NetPlayActive())
 	{
+		// Rollback clients correct mispredicted frames before running the next one
+		NetPlayRollbackUpdate();
+
 		if (NetPlayFrameWait())
 		{
 			FCEUI_SetNetPlayPause(true);
@@ -26,8 +26,13 @@
 
 #include "Qt/ConsoleWindow.h"
 #include "Qt/fceuWrapper.h"
+#include "Qt/MovieVerify.h"
+#include "Qt/NetPlay.h"
+#include "Qt/NetPlaySim.h"
+#include "Qt/NetPlayRelay.h"
 #include "Qt/SplashScreen.h"
 #include "Qt/QtScriptManager.h"
+#include "Qt/TasEditor/greenzone_worker.h"
 
 #if defined(WIN32) && (QT_VERSION_MAJOR < 6)
 #include <QtPlatformHeaders/QWindowsWindowFunctions>
@@ -105,6 +110,30 @@ int main( int argc, char *argv[] )
 
 	fceuWrapperPreInit(argc, argv);
 
+	// Batch movie verification runs without any GUI
+	if ( movieVerifyRequested(argc, argv) )
+	{
+		return movieVerifyMain(argc, argv);
+	}
+
+	// So does a NetPlay spectator relay
+	if ( netPlayRelayRequested(argc, argv) )
+	{
+		return netPlayRelayMain(argc, argv);
+	}
+
+	// And the NetPlay network simulation
+	if ( netPlaySimRequested(argc, argv) )
+	{
+		return netPlaySimMain(argc, argv);
+	}
+
+	// And the processes that regenerate the TAS Editor Greenzone in the background
+	if ( greenzoneWorkerRequested(argc, argv) )
+	{
+		return greenzoneWorkerMain(argc, argv);
+	}
+
 	qInstallMessageHandler(MessageOutput);
 	QApplication app(argc, argv);
 
@@ -156,6 +185,10 @@ int main( int argc, char *argv[] )
 
 	consoleWindow->show();
 
+	// --server 1 starts hosting a NetPlay session with the ROM given, --join 1 joins one
+	NetPlayHostFromConfig();
+	NetPlayJoinFromConfig();
+
 	// Need to wait for window to initialize before video init can be called.
 	//consoleWindow->videoInit();
 
@@ -459,6 +459,7 @@ static CFGSTRUCT fceuconfig[] =
 
 	AC(backupSavestates),
 	AC(compressSavestates),
+	AC(indexedSavestates),
 	AC(pauseWhileActive),
 	AC(disableAutoLSCheats),
 	AC(disableShowGG),
@@ -8,6 +8,7 @@ struct PENDING_CHANGES
 	int frame;
 	uint8 joypad;
 	int data;
+	int offset;			// LUA_CHANGE_TYPE_INPUTRANGE: position of the range's Input in pending_input
 };
 
 enum LUA_CHANGE_TYPES
@@ -15,6 +16,7 @@ enum LUA_CHANGE_TYPES
 	LUA_CHANGE_TYPE_INPUTCHANGE,
 	LUA_CHANGE_TYPE_INSERTFRAMES,
 	LUA_CHANGE_TYPE_DELETEFRAMES,
+	LUA_CHANGE_TYPE_INPUTRANGE,
 };
 
 enum
@@ -57,14 +59,17 @@ public:
 	void getselection(std::vector<int>& placeholder);
 	void setselection(std::vector<int>& new_set);
 	int getinput(int frame, int joypad);
+	bool getinputrange(int frame, int joypad, int number, std::vector<uint8>& placeholder);
 	void submitinputchange(int frame, int joypad, int input);
 	void submitinsertframes(int frame, int number);
 	void submitdeleteframes(int frame, int number);
+	void submitinputrange(int frame, int joypad, std::vector<uint8>& input);
 	int applyinputchanges(const char* name);
 	void clearinputchanges();
 
 private:
 	std::vector<PENDING_CHANGES> pending_changes;
+	std::vector<uint8> pending_input;		// Input of all submitted ranges, one byte per frame
 
 	HWND hwndRunFunctionButton;
 
@@ -26,6 +26,15 @@ THE SOFTWARE.
 #include <stdio.h>
 #include <vector>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 bool EMUFILE::readAllBytes(std::vector<u8>* dstbuf, const std::string& fname)
 {
 	EMUFILE_FILE file(fname.c_str(),"rb");
@@ -81,6 +90,7 @@ void EMUFILE_FILE::open(const char* fname, const char* mode)
 
 void EMUFILE_FILE::truncate(size_t length)
 {
+	long pos = ::ftell(fp);
 	::fflush(fp);
 	#ifdef _MSC_VER
 		_chsize(_fileno(fp),length);
@@ -90,10 +100,8 @@ void EMUFILE_FILE::truncate(size_t length)
 			printf("Warning: EMUFILE_FILE::truncate failed\n");
 		}
 	#endif
-	// this is probably wrong if mode is "wb"
-	fclose(fp);
-	fp = NULL;
-	open(fname.c_str(),mode);
+	// the file stays open (reopening it with a "wb" mode would empty it), the position is clamped to the new end
+	::fseek(fp, std::min<long>(pos, length), SEEK_SET);
 }
 
 
@@ -110,6 +118,101 @@ EMUFILE* EMUFILE_MEMORY::memwrap()
 	return this;
 }
 
+void EMUFILE_MMAP::open(const char* fname)
+{
+	data = NULL;
+	len = 0;
+	pos = 0;
+#ifdef _WIN32
+	hMapping = NULL;
+	std::wstring wfname = mbstowcs((std::string)fname);
+	HANDLE file = CreateFileW(wfname.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	hFile = file;
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		hFile = NULL;
+		failbit = true;
+		return;
+	}
+	LARGE_INTEGER fsize;
+	if(!GetFileSizeEx(file, &fsize) || fsize.QuadPart == 0)
+	{
+		failbit = true;
+		return;
+	}
+	hMapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(hMapping == NULL)
+	{
+		failbit = true;
+		return;
+	}
+	data = (const u8*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if(data == NULL)
+	{
+		failbit = true;
+		return;
+	}
+	len = static_cast<size_t>(fsize.QuadPart);
+#else
+	int fd = ::open(fname, O_RDONLY);
+	if(fd < 0)
+	{
+		failbit = true;
+		return;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size <= 0)
+	{
+		::close(fd);
+		failbit = true;
+		return;
+	}
+	void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	//the mapping holds its own reference to the file
+	::close(fd);
+	if(p == MAP_FAILED)
+	{
+		failbit = true;
+		return;
+	}
+	data = (const u8*)p;
+	len = static_cast<size_t>(st.st_size);
+#endif
+}
+
+void EMUFILE_MMAP::close()
+{
+#ifdef _WIN32
+	if(data) UnmapViewOfFile(data);
+	if(hMapping) CloseHandle(hMapping);
+	if(hFile) CloseHandle(hFile);
+	hMapping = hFile = NULL;
+#else
+	if(data) munmap((void*)data, len);
+#endif
+	data = NULL;
+	len = 0;
+}
+
+size_t EMUFILE_MMAP::_fread(const void *ptr, size_t bytes)
+{
+	size_t remain = (static_cast<size_t>(pos) < len) ? len-pos : 0;
+	size_t todo = std::min<size_t>(remain,bytes);
+	if(todo)
+	{
+		memcpy((void*)ptr,data+pos,todo);
+		pos += static_cast<long>(todo);
+	}
+	if(todo<bytes)
+		failbit = true;
+	return todo;
+}
+
+EMUFILE* EMUFILE_MMAP::memwrap()
+{
+	return new EMUFILE_MEMORY((void*)data,len);
+}
+
 void EMUFILE::write64le(u64* val)
 {
 	write64le(*val);
@@ -344,4 +344,90 @@ public:
 
 };
 
+//read-only view of a file mapped into memory. reads are served straight out of the mapping,
+//so consumers that know about it (like the savestate loader) can skip intermediate buffers entirely.
+class EMUFILE_MMAP : public EMUFILE {
+protected:
+	const u8* data;
+	size_t len;
+	long int pos;
+#ifdef _WIN32
+	void* hFile;
+	void* hMapping;
+#endif
+
+private:
+	void open(const char* fname);
+	void close();
+
+public:
+
+	EMUFILE_MMAP(const std::string& fname) { open(fname.c_str()); }
+	EMUFILE_MMAP(const char* fname) { open(fname); }
+
+	virtual ~EMUFILE_MMAP() { close(); }
+
+	bool is_open() { return data != NULL; }
+
+	//direct pointer into the mapping. valid for the lifetime of this object
+	const u8* map() { return data; }
+
+	virtual EMUFILE* memwrap();
+
+	virtual FILE *get_fp() { return NULL; }
+
+	virtual int fprintf(const char *format, ...) {
+		failbit = true;
+		return -1;
+	}
+
+	virtual int fgetc() {
+		if(static_cast<size_t>(pos) >= len) {
+			failbit = true;
+			return -1;
+		}
+		return data[pos++];
+	}
+
+	virtual int fputc(int c) {
+		failbit = true;
+		return EOF;
+	}
+
+	virtual size_t _fread(const void *ptr, size_t bytes);
+
+	virtual void fwrite(const void *ptr, size_t bytes) {
+		failbit = true;
+	}
+
+	virtual int fseek(long int offset, int origin) {
+		switch(origin) {
+			case SEEK_SET:
+				pos = offset;
+				break;
+			case SEEK_CUR:
+				pos += offset;
+				break;
+			case SEEK_END:
+				pos = (long int)(len+offset);
+				break;
+			default:
+				assert(false);
+		}
+		return 0;
+	}
+
+	virtual long int ftell() {
+		return pos;
+	}
+
+	virtual size_t size() { return len; }
+
+	virtual void fflush() {}
+
+	virtual void truncate(size_t length) {
+		failbit = true;
+	}
+};
+
 #endif
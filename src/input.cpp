@@ -465,8 +465,13 @@ void FCEU_UpdateInput(void)
 	if(FCEUnetplay)
 		NetplayUpdate(joy);
 
+	//when the state recorder is re-emulating up to a rewind point, feed it the input it logged
+	FCEU_StateRecorderReplayInput();
+
 	FCEUMOV_AddInputState();
 
+	FCEU_StateRecorderLogInput();
+
 	//TODO - should this apply to the movie data? should this be displayed in the input hud?
 	if(GameInfo->type==GIT_VSUNI){
 		FCEU_VSUniSwap(&joy[0],&joy[1]);
@@ -724,8 +729,7 @@ void FCEU_QSimpleCommand(int cmd)
 	{
 		if(!FCEUMOV_Mode(MOVIEMODE_TASEDITOR))		// TAS Editor will do the command himself
 			FCEU_DoSimpleCommand(cmd);
-		if(FCEUMOV_Mode(MOVIEMODE_RECORD|MOVIEMODE_TASEDITOR))
-			FCEUMOV_AddCommand(cmd);
+		FCEUMOV_AddCommand(cmd);
 	}
 }
 
@@ -205,11 +205,11 @@ static void LogZapper(int w, MovieRecord* mr)
 
 static void LoadZapper(int w, MovieRecord* mr)
 {
-	ZD[w].mzx = mr->zappers[w].x;
-	ZD[w].mzy = mr->zappers[w].y;
-	ZD[w].mzb = mr->zappers[w].b;
-	ZD[w].bogo = mr->zappers[w].bogo;
-	ZD[w].zaphit = mr->zappers[w].zaphit;
+	ZD[w].mzx = mr->zappers.get(w).x;
+	ZD[w].mzy = mr->zappers.get(w).y;
+	ZD[w].mzb = mr->zappers.get(w).b;
+	ZD[w].bogo = mr->zappers.get(w).bogo;
+	ZD[w].zaphit = mr->zappers.get(w).zaphit;
 }
 
 
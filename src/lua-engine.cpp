@@ -2135,98 +2135,94 @@ void HandleCallbackError(lua_State* L, bool stop, int msgDepth = -1)
 
 
 // the purpose of this structure is to provide a way of
-// QUICKLY determining whether a memory address range has a hook associated with it,
+// QUICKLY determining whether a memory address has a hook associated with it,
 // with a bias toward fast rejection because the majority of addresses will not be hooked.
 // (it must not use any part of Lua or perform any per-script operations,
 //  otherwise it would definitely be too slow.)
-// calculating the regions when a hook is added/removed may be slow,
+// the bitmap says which addresses are hooked, and the sorted entries hold a registry
+// reference to the callback of each hooked address, so a hit needs no table lookups.
+// only the runs of hooked addresses are registered with the CPU, so it does not call in here
+// for anything else. calculating all of this when a hook is added/removed may be slow,
 // but this is an intentional tradeoff to obtain a high speed of checking during later execution
-struct TieredRegion
+struct LuaMemHookMap
 {
-	template<unsigned int maxGap>
-	struct Region
+	struct Entry
 	{
-		struct Island
-		{
-			unsigned int start;
-			unsigned int end;
-#ifdef NEED_MINGW_HACKS
-			bool Contains(unsigned int address, int size) const { return address < end && address+size > start; }
-#else
-			__forceinline bool Contains(unsigned int address, int size) const { return address < end && address+size > start; }
-#endif
-		};
-		std::vector<Island> islands;
+		unsigned int address;
+		int ref;
 
-		void Calculate(const std::vector<unsigned int>& bytes)
-		{
-			islands.clear();
-
-			unsigned int lastEnd = ~0;
-
-			std::vector<unsigned int>::const_iterator iter = bytes.begin();
-			std::vector<unsigned int>::const_iterator end = bytes.end();
-			for(; iter != end; ++iter)
-			{
-				unsigned int addr = *iter;
-				if(addr < lastEnd || addr > lastEnd + (long long)maxGap)
-				{
-					islands.push_back(Island());
-					islands.back().start = addr;
-				}
-				islands.back().end = addr+1;
-				lastEnd = addr+1;
-			}
-		}
-		bool Contains(unsigned int address, int size) const
-		{
-			for (size_t i = 0; i != islands.size(); ++i)
-			{
-				if (islands[i].Contains(address, size))
-					return true;
-			}
-			return false;
-		}
+		bool operator<(const Entry& other) const { return address < other.address; }
 	};
 
-	Region<0xFFFFFFFF> broad;
-	Region<0x1000> mid;
-	Region<0> narrow;
+	uint32 bits[0x10000 / 32];
+	std::vector<Entry> entries;  // sorted by address
+	std::vector<int> refs;       // one registry reference per distinct callback
+	std::vector<std::pair<unsigned int, unsigned int>> ranges; // runs added to X6502_MemHook
 
-	void Calculate(std::vector<unsigned int>& bytes)
+	LuaMemHookMap()
 	{
-		std::sort(bytes.begin(), bytes.end());
-
-		broad.Calculate(bytes);
-		mid.Calculate(bytes);
-		narrow.Calculate(bytes);
+		memset( bits, 0, sizeof(bits) );
 	}
 
-	TieredRegion()
+	__forceinline bool Contains(unsigned int address) const
 	{
-		std::vector <unsigned int> temp;
-		Calculate(temp);
+		return (address < 0x10000) && ((bits[address >> 5] >> (address & 31)) & 1);
 	}
 
-	__forceinline int NotEmpty()
+	int FindRef(unsigned int address) const
 	{
-		return broad.islands.size();
-	}
+		Entry key = { address, LUA_NOREF };
+		std::vector<Entry>::const_iterator iter = std::lower_bound(entries.begin(), entries.end(), key);
 
-	// note: it is illegal to call this if NotEmpty() returns 0
-	__forceinline bool Contains(unsigned int address, int size)
-	{
-		return broad.islands[0].Contains(address,size) &&
-		       mid.Contains(address,size) &&
-			   narrow.Contains(address,size);
+		if ( (iter != entries.end()) && (iter->address == address) )
+		{
+			return iter->ref;
+		}
+		return LUA_NOREF;
 	}
 };
-TieredRegion hookedRegions [LUAMEMHOOK_COUNT];
+static LuaMemHookMap hookedRegions [LUAMEMHOOK_COUNT];
 
+static const X6502_MemHook::Type luaMemHookCpuTypes [] =
+{
+	X6502_MemHook::Write,
+	X6502_MemHook::Read,
+	X6502_MemHook::Exec,
+};
+CTASSERT(sizeof(luaMemHookCpuTypes)/sizeof(*luaMemHookCpuTypes) ==  LUAMEMHOOK_COUNT)
+
+static void (*const luaMemHookCpuFuncs [])(unsigned int address, unsigned int value, void *userData) =
+{
+	luaWriteMemHook,
+	luaReadMemHook,
+	luaExecMemHook,
+};
+
+static void RemoveMemHookRanges(LuaMemHookType hookType)
+{
+	LuaMemHookMap& map = hookedRegions[hookType];
+
+	for (size_t i = 0; i != map.ranges.size(); ++i)
+	{
+		X6502_MemHook::Remove( luaMemHookCpuTypes[hookType], luaMemHookCpuFuncs[hookType], nullptr,
+				map.ranges[i].first, map.ranges[i].second );
+	}
+	map.ranges.clear();
+}
 
 static void CalculateMemHookRegions(LuaMemHookType hookType)
 {
-	std::vector<unsigned int> hookedBytes;
+	LuaMemHookMap& map = hookedRegions[hookType];
+
+	if (L)
+	{
+		for (size_t i = 0; i != map.refs.size(); ++i)
+			luaL_unref(L, LUA_REGISTRYINDEX, map.refs[i]);
+	}
+	map.refs.clear();
+	map.entries.clear();
+	memset( map.bits, 0, sizeof(map.bits) );
+
 //	std::map<int, LuaContextInfo*>::iterator iter = luaContextInfo.begin();
 //	std::map<int, LuaContextInfo*>::iterator end = luaContextInfo.end();
 //	while(iter != end)
@@ -2239,13 +2235,35 @@ static void CalculateMemHookRegions(LuaMemHookType hookType)
 			{
 				lua_settop(L, 0);
 				lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
+				lua_newtable(L); // callback -> registry reference, so each callback is referenced once
 				lua_pushnil(L);
-				while(lua_next(L, -2))
+				while(lua_next(L, 1))
 				{
 					if(lua_isfunction(L, -1))
 					{
 						unsigned int addr = lua_tointeger(L, -2);
-						hookedBytes.push_back(addr);
+
+						// the CPU never reports anything beyond 16 bits
+						if(addr < 0x10000)
+						{
+							lua_pushvalue(L, -1);
+							lua_rawget(L, 2);
+							int ref = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : LUA_NOREF;
+							lua_pop(L, 1);
+
+							if(ref == LUA_NOREF)
+							{
+								lua_pushvalue(L, -1);
+								ref = luaL_ref(L, LUA_REGISTRYINDEX);
+								lua_pushvalue(L, -1);
+								lua_pushinteger(L, ref);
+								lua_rawset(L, 2);
+								map.refs.push_back(ref);
+							}
+							LuaMemHookMap::Entry entry = { addr, ref };
+							map.entries.push_back(entry);
+							map.bits[addr >> 5] |= 1u << (addr & 31);
+						}
 					}
 					lua_pop(L, 1);
 				}
@@ -2254,7 +2272,44 @@ static void CalculateMemHookRegions(LuaMemHookType hookType)
 		}
 //		++iter;
 //	}
-	hookedRegions[hookType].Calculate(hookedBytes);
+	std::sort(map.entries.begin(), map.entries.end());
+
+	std::vector<std::pair<unsigned int, unsigned int>> ranges;
+
+	for (size_t i = 0; i != map.entries.size(); )
+	{
+		size_t j = i + 1;
+
+		while ( (j != map.entries.size()) && (map.entries[j].address == map.entries[j-1].address + 1) )
+			++j;
+
+		ranges.push_back( std::make_pair(map.entries[i].address, map.entries[j-1].address) );
+		i = j;
+	}
+
+	// both lists are sorted, so only the runs that changed go through X6502_MemHook
+	size_t o = 0, n = 0;
+
+	while ( (o != map.ranges.size()) || (n != ranges.size()) )
+	{
+		if ( (o != map.ranges.size()) && (n != ranges.size()) && (map.ranges[o] == ranges[n]) )
+		{
+			++o; ++n;
+		}
+		else if ( (n == ranges.size()) || ((o != map.ranges.size()) && (map.ranges[o] < ranges[n])) )
+		{
+			X6502_MemHook::Remove( luaMemHookCpuTypes[hookType], luaMemHookCpuFuncs[hookType], nullptr,
+					map.ranges[o].first, map.ranges[o].second );
+			++o;
+		}
+		else
+		{
+			X6502_MemHook::Add( luaMemHookCpuTypes[hookType], luaMemHookCpuFuncs[hookType], nullptr,
+					ranges[n].first, ranges[n].second );
+			++n;
+		}
+	}
+	map.ranges.swap(ranges);
 }
 
 static void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, unsigned int value, LuaMemHookType hookType)
@@ -2273,11 +2328,17 @@ static void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, un
 				infoStack.insert(infoStack.begin(), &info);
 				struct Scope { ~Scope(){ infoStack.erase(infoStack.begin()); } } scope;
 #endif
-				lua_settop(L, 0);
-				lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
 				for(unsigned int i = address; i != address+size; i++)
 				{
-					lua_rawgeti(L, -1, i);
+					if(!hookedRegions[hookType].Contains(i))
+						continue;
+
+					int ref = hookedRegions[hookType].FindRef(i);
+					if(ref == LUA_NOREF)
+						continue;
+
+					lua_settop(L, 0);
+					lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
 					if (lua_isfunction(L, -1))
 					{
 						bool wasRunning = (luaRunning!=0) /*info.running*/;
@@ -2296,12 +2357,8 @@ static void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, un
 							//int uid = iter->first;
 							//HandleCallbackError(L,info,uid,true);
 						}
-						break;
-					}
-					else
-					{
-						lua_pop(L,1);
 					}
+					break;
 				}
 				lua_settop(L, 0);
 			}
@@ -2316,12 +2373,15 @@ void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value
 	// before and after, because even the most innocent change can make it become 30% to 400% slower.
 	// a good amount to test is: 100000000 calls with no hook set, and another 100000000 with a hook set.
 	// (on my system that consistently took 200 ms total in the former case and 350 ms total in the latter case)
-	if(hookedRegions[hookType].NotEmpty())
+	const LuaMemHookMap& map = hookedRegions[hookType];
+
+	for(unsigned int i = address; i != address+size; i++)
 	{
-		//if((hookType <= LUAMEMHOOK_EXEC) && (address >= 0xE00000))
-		//	address |= 0xFF0000; // account for mirroring of RAM
-		if(hookedRegions[hookType].Contains(address, size))
+		if(map.Contains(i))
+		{
 			CallRegisteredLuaMemHook_LuaMatch(address, size, value, hookType); // something has hooked this specific address
+			return;
+		}
 	}
 }
 
@@ -2782,9 +2842,9 @@ static int zapper_read(lua_State *L){
 		else
 			z = currFrameCounter -1;
 
-		x = currMovieData.records[z].zappers[1].x;	//adelikat:  Used hardcoded port 1 since as far as I know, only port 1 is valid for zappers
-		y = currMovieData.records[z].zappers[1].y;
-		click = currMovieData.records[z].zappers[1].b;
+		x = currMovieData.records[z].zappers.get(1).x;	//adelikat:  Used hardcoded port 1 since as far as I know, only port 1 is valid for zappers
+		y = currMovieData.records[z].zappers.get(1).y;
+		click = currMovieData.records[z].zappers.get(1).b;
 	}
 	else
 	{
@@ -5326,6 +5386,22 @@ static int taseditor_getinput(lua_State *L)
 	return 1;
 }
 
+// string taseditor.getinputrange(int frame, int joypad, int number)
+static int taseditor_getinputrange(lua_State *L)
+{
+#ifdef __WIN_DRIVER__
+	// one byte per frame, the string is shorter than requested if the range reaches the end of the movie
+	std::vector<uint8> input;
+	if (taseditor_lua.getinputrange(luaL_checkinteger(L, 1), luaL_checkinteger(L, 2), luaL_checkinteger(L, 3), input))
+		lua_pushlstring(L, input.size() ? (const char*)&input[0] : "", input.size());
+	else
+		lua_pushnil(L);
+#else
+	lua_pushnil(L);
+#endif
+	return 1;
+}
+
 // taseditor.submitinputchange(int frame, int joypad, int input)
 static int taseditor_submitinputchange(lua_State *L)
 {
@@ -5353,6 +5429,34 @@ static int taseditor_submitdeleteframes(lua_State *L)
 	return 0;
 }
 
+// taseditor.submitinputrange(int frame, int joypad, string|table input)
+static int taseditor_submitinputrange(lua_State *L)
+{
+#ifdef __WIN_DRIVER__
+	std::vector<uint8> input;
+	// retrieve input either from string (one byte per frame) or from table of numbers
+	if (lua_type(L, 3) == LUA_TSTRING)
+	{
+		size_t len;
+		const char* str = lua_tolstring(L, 3, &len);
+		input.assign(str, str + len);
+	} else
+	{
+		luaL_checktype(L, 3, LUA_TTABLE);
+		int max_index = luaL_getn(L, 3);
+		input.reserve(max_index);
+		for (int i = 1; i <= max_index; ++i)
+		{
+			lua_rawgeti(L, 3, i);
+			input.push_back(lua_tointeger(L, -1));
+			lua_pop(L, 1);
+		}
+	}
+	taseditor_lua.submitinputrange(luaL_checkinteger(L, 1), luaL_checkinteger(L, 2), input);
+#endif
+	return 0;
+}
+
 // int taseditor.applyinputchanges([string name])
 static int taseditor_applyinputchanges(lua_State *L)
 {
@@ -6290,9 +6394,11 @@ static const struct luaL_reg taseditorlib[] = {
 	{"getselection", taseditor_getselection},
 	{"setselection", taseditor_setselection},
 	{"getinput", taseditor_getinput},
+	{"getinputrange", taseditor_getinputrange},
 	{"submitinputchange", taseditor_submitinputchange},
 	{"submitinsertframes", taseditor_submitinsertframes},
 	{"submitdeleteframes", taseditor_submitdeleteframes},
+	{"submitinputrange", taseditor_submitinputrange},
 	{"applyinputchanges", taseditor_applyinputchanges},
 	{"clearinputchanges", taseditor_clearinputchanges},
 	{NULL,NULL}
@@ -6524,10 +6630,6 @@ int FCEU_LoadLuaCode(const char *filename, const char *arg)
 			lua_newtable(L);
 			lua_setfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[i]);
 		}
-
-		X6502_MemHook::Add( X6502_MemHook::Read , luaReadMemHook , nullptr );
-		X6502_MemHook::Add( X6502_MemHook::Write, luaWriteMemHook, nullptr );
-		X6502_MemHook::Add( X6502_MemHook::Exec , luaExecMemHook , nullptr );
 	}
 
 	// We make our thread NOW because we want it at the bottom of the stack.
@@ -6643,9 +6745,8 @@ void FCEU_LuaStop() {
 	//already killed
 	if (!L) return;
 
-	X6502_MemHook::Remove( X6502_MemHook::Read , luaReadMemHook , nullptr );
-	X6502_MemHook::Remove( X6502_MemHook::Write, luaWriteMemHook, nullptr );
-	X6502_MemHook::Remove( X6502_MemHook::Exec , luaExecMemHook , nullptr );
+	for(int i = 0; i < LUAMEMHOOK_COUNT; i++)
+		RemoveMemHookRanges((LuaMemHookType)i);
 
 	// Since the script is exiting, we want to prevent an infinite loop.
 	// CallExitFunction() > HandleCallbackError() > FCEU_LuaStop() > CallExitFunction() ...
@@ -99,6 +99,13 @@ EMOVIEMODE movieMode = MOVIEMODE_INACTIVE;
 //FILE* fpRecordingMovie = 0;
 EMUFILE* osRecordingMovie = NULL;
 
+//layout of the movie file while it's open for recording, so that a rerecord only rewrites what changed:
+//the header as it was written, and where each record starts (the last item is where the last record ends).
+//records before recordingFileFrames are on disk exactly as they are in currMovieData
+static std::vector<uint8> recordingFileHeader;
+static std::vector<uint32> recordingFileOffsets;
+static int recordingFileFrames = 0;
+
 int currFrameCounter;
 uint32 cur_input_display = 0;
 int pauseframe = -1;
@@ -168,18 +175,91 @@ void MovieData::cloneRegion(int at, int frames)
 		records[i + at].Clone(records[i + at + frames]);
 }
 // ----------------------------------------------------------------------------
+static const MovieZapperRecord zeroZappers[2] = {};
+
+MovieZappers::MovieZappers(const MovieZappers& other)
+{
+	data = NULL;
+	if(other.data)
+	{
+		data = new MovieZapperRecord[2];
+		memcpy(data, other.data, sizeof(MovieZapperRecord) * 2);
+	}
+}
+
+MovieZappers& MovieZappers::operator=(const MovieZappers& other)
+{
+	if(!other.data)
+		clear();
+	else if(this != &other)
+	{
+		if(!data)
+			data = new MovieZapperRecord[2];
+		memcpy(data, other.data, sizeof(MovieZapperRecord) * 2);
+	}
+	return *this;
+}
+
+MovieZappers& MovieZappers::operator=(MovieZappers&& other) noexcept
+{
+	if(this != &other)
+	{
+		delete[] data;
+		data = other.data;
+		other.data = NULL;
+	}
+	return *this;
+}
+
+MovieZapperRecord& MovieZappers::operator[](int port)
+{
+	if(!data)
+	{
+		data = new MovieZapperRecord[2];
+		memset(data, 0, sizeof(MovieZapperRecord) * 2);
+	}
+	return data[port];
+}
+
+const MovieZapperRecord& MovieZappers::get(int port) const
+{
+	return data ? data[port] : zeroZappers[port];
+}
+
+bool MovieZappers::operator==(const MovieZappers& other) const
+{
+	for(int port=0;port<2;port++)
+	{
+		const MovieZapperRecord& a = get(port);
+		const MovieZapperRecord& b = other.get(port);
+		if(a.x != b.x || a.y != b.y || a.b != b.b || a.bogo != b.bogo || a.zaphit != b.zaphit)
+			return false;
+	}
+	return true;
+}
+
+bool MovieZappers::isZero() const
+{
+	return *this == MovieZappers();
+}
+
+void MovieZappers::clear()
+{
+	delete[] data;
+	data = NULL;
+}
+// ----------------------------------------------------------------------------
 MovieRecord::MovieRecord()
 {
 	commands = 0;
 	*(uint32*)&joysticks = 0;
-	memset(zappers, 0, sizeof(zappers));
 }
 
 void MovieRecord::clear()
 {
 	commands = 0;
 	*(uint32*)&joysticks = 0;
-	memset(zappers, 0, sizeof(zappers));
+	zappers.clear();
 }
 
 bool MovieRecord::Compare(MovieRecord& compareRec)
@@ -190,7 +270,7 @@ bool MovieRecord::Compare(MovieRecord& compareRec)
 		return false;
 	if ((*(uint32*)&(this->joysticks)) != (*(uint32*)&(compareRec.joysticks)))
 		return false;
-	if (memcmp(this->zappers, compareRec.zappers, sizeof(zappers)))
+	if (!(this->zappers == compareRec.zappers))
 		return false;
 
 	/*
@@ -221,7 +301,7 @@ bool MovieRecord::Compare(MovieRecord& compareRec)
 void MovieRecord::Clone(MovieRecord& sourceRec)
 {
 	*(uint32*)&joysticks = *(uint32*)(&(sourceRec.joysticks));
-	memcpy(this->zappers, sourceRec.zappers, sizeof(zappers));
+	this->zappers = sourceRec.zappers;
 	this->commands = sourceRec.commands;
 }
 
@@ -348,11 +428,11 @@ void MovieRecord::dumpBinary(MovieData* md, EMUFILE* os, int index)
 				os->fwrite(&joysticks[port],sizeof(joysticks[port]));
 			else if(md->ports[port] == SI_ZAPPER)
 			{
-				write8le(zappers[port].x,os);
-				write8le(zappers[port].y,os);
-				write8le(zappers[port].b,os);
-				write8le(zappers[port].bogo,os);
-				write64le(zappers[port].zaphit, os);
+				write8le(zappers.get(port).x,os);
+				write8le(zappers.get(port).y,os);
+				write8le(zappers.get(port).b,os);
+				write8le(zappers.get(port).bogo,os);
+				write64le(zappers.get(port).zaphit, os);
 			}
 		}
 	}
@@ -383,11 +463,11 @@ void MovieRecord::dump(MovieData* md, EMUFILE* os, int index)
 				dumpJoy(os, joysticks[port]);
 			else if(md->ports[port] == SI_ZAPPER)
 			{
-				putdec<uint8,3,true>(os,zappers[port].x); os->fputc(' ');
-				putdec<uint8,3,true>(os,zappers[port].y); os->fputc(' ');
-				putdec<uint8,1,true>(os,zappers[port].b); os->fputc(' ');
-				putdec<uint8,1,true>(os,zappers[port].bogo); os->fputc(' ');
-				putdec<uint64,20,false>(os,zappers[port].zaphit);
+				putdec<uint8,3,true>(os,zappers.get(port).x); os->fputc(' ');
+				putdec<uint8,3,true>(os,zappers.get(port).y); os->fputc(' ');
+				putdec<uint8,1,true>(os,zappers.get(port).b); os->fputc(' ');
+				putdec<uint8,1,true>(os,zappers.get(port).bogo); os->fputc(' ');
+				putdec<uint64,20,false>(os,zappers.get(port).zaphit);
 			}
 		}
 		os->fputc('|');
@@ -492,6 +572,37 @@ void MovieData::installValue(std::string& key, std::string& val)
 int MovieData::dump(EMUFILE *os, bool binary, bool seekToCurrFramePos)
 {
 	int start = os->ftell();
+	dumpHeader(os, binary);
+
+	int currFramePos = -1;
+	if(binary)
+	{
+		//put one | to start the binary dump
+		os->fputc('|');
+		for (int i = 0; i < (int)records.size(); i++)
+		{
+			if (seekToCurrFramePos && currFrameCounter == i)
+				currFramePos = os->ftell();
+			records[i].dumpBinary(this, os, i);
+		}
+	} else
+	{
+		for (int i = 0; i < (int)records.size(); i++)
+		{
+			if (seekToCurrFramePos && currFrameCounter == i)
+				currFramePos = os->ftell();
+			records[i].dump(this, os, i);
+		}
+	}
+
+	int end = os->ftell();
+	if (currFramePos >= 0)
+		os->fseek(currFramePos, SEEK_SET);
+	return end-start;
+}
+
+void MovieData::dumpHeader(EMUFILE *os, bool binary)
+{
 	os->fprintf("version %d\n", version);
 	os->fprintf("emuVersion %d\n", emuVersion);
 	os->fprintf("rerecordCount %d\n", rerecordCount);
@@ -526,32 +637,6 @@ int MovieData::dump(EMUFILE *os, bool binary, bool seekToCurrFramePos)
 
 	if (this->loadFrameCount >= 0)
 		os->fprintf("length %d\n" , this->loadFrameCount);
-
-	int currFramePos = -1;
-	if(binary)
-	{
-		//put one | to start the binary dump
-		os->fputc('|');
-		for (int i = 0; i < (int)records.size(); i++)
-		{
-			if (seekToCurrFramePos && currFrameCounter == i)
-				currFramePos = os->ftell();
-			records[i].dumpBinary(this, os, i);
-		}
-	} else
-	{
-		for (int i = 0; i < (int)records.size(); i++)
-		{
-			if (seekToCurrFramePos && currFrameCounter == i)
-				currFramePos = os->ftell();
-			records[i].dump(this, os, i);
-		}
-	}
-
-	int end = os->ftell();
-	if (currFramePos >= 0)
-		os->fseek(currFramePos, SEEK_SET);
-	return end-start;
 }
 
 int FCEUMOV_GetFrame(void)
@@ -642,6 +727,115 @@ static void LoadFM2_binarychunk(MovieData& movieData, EMUFILE* fp, int size)
 	}
 }
 
+//decodes the 8 button characters of a gamepad like MovieRecord::parseJoy does, all of them at once:
+//any character other than '.' or ' ' is a set bit, the first character is the highest bit
+static inline uint8 LoadFM2_joy(const uint8* p)
+{
+	const uint64 low7 = 0x7F7F7F7F7F7F7F7FULL;
+	uint64 v = (uint64)p[0] | ((uint64)p[1] << 8) | ((uint64)p[2] << 16) | ((uint64)p[3] << 24)
+		| ((uint64)p[4] << 32) | ((uint64)p[5] << 40) | ((uint64)p[6] << 48) | ((uint64)p[7] << 56);
+	//a byte of these is zero where the character matches, the high bit of each byte is then set for nonzero bytes
+	uint64 dots = v ^ 0x2E2E2E2E2E2E2E2EULL;
+	uint64 spaces = v ^ 0x2020202020202020ULL;
+	dots |= (dots & low7) + low7;
+	spaces |= (spaces & low7) + low7;
+	uint64 bits = (dots & spaces & 0x8080808080808080ULL) >> 7;
+	//gather bit 0 of every byte, reversing their order
+	return (uint8)((bits * 0x8040201008040201ULL) >> 56);
+}
+
+//fast path for the text input log, decodes whole records straight from a buffer with the rest of the file.
+//data starts right after the pipe that opens a record. returns the number of bytes decoded, which ends
+//at the start of a line, or 0 if the first record has an unusual layout (the generic parser handles those).
+//done is set when loadFrameCount was reached.
+static size_t LoadFM2_textchunk(MovieData& movieData, const uint8* data, size_t len, bool& done)
+{
+	done = false;
+
+	//width of every port field. only gamepads and empty ports are known here
+	int widths[4];
+	int numFields = 0;
+	if(movieData.fourscore)
+	{
+		for(int i=0;i<4;i++)
+			widths[numFields++] = 8;
+	}
+	else
+	{
+		for(int port=0;port<2;port++)
+		{
+			if(movieData.ports[port] == SI_GAMEPAD)
+				widths[numFields++] = 8;
+			else if(movieData.ports[port] == SI_ZAPPER)
+				return 0;
+			else
+				widths[numFields++] = 0;
+		}
+	}
+
+	//most records have a single digit of commands
+	size_t recordsize = 2 + numFields + 2;
+	for(int i=0;i<numFields;i++)
+		recordsize += widths[i];
+	size_t expected = movieData.records.size() + len / recordsize;
+	if(movieData.loadFrameCount != -1)
+		expected = std::min<size_t>(expected, movieData.loadFrameCount);
+	movieData.records.reserve(expected);
+
+	MovieRecord record;
+	size_t pos = 0, decoded = 0;
+	for(;;)
+	{
+		//commands
+		size_t p = pos;
+		unsigned int commands = 0;
+		while(p < len && p - pos < 3 && data[p] >= '0' && data[p] <= '9')
+			commands = commands * 10 + (data[p++] - '0');
+		if(p == pos || p >= len || data[p] != '|')
+			break;
+		record.commands = commands;
+		p++;
+
+		//ports, then the empty fcexp field
+		int i;
+		for(i=0;i<numFields;i++)
+		{
+			if(p + widths[i] >= len || data[p + widths[i]] != '|')
+				break;
+			if(widths[i])
+				record.joysticks[i] = LoadFM2_joy(data + p);
+			p += widths[i] + 1;
+		}
+		if(i < numFields || p >= len || data[p] != '|')
+			break;
+		p++;
+
+		//the record must end the line
+		if(p < len && data[p] != '\n' && data[p] != '\r')
+			break;
+		movieData.records.push_back(record);
+		if(p == len)
+			return len;
+		if(static_cast<size_t>(movieData.loadFrameCount) == movieData.records.size())
+		{
+			done = true;
+			return p + 1;
+		}
+		p += (data[p] == '\r' && p + 1 < len && data[p + 1] == '\n') ? 2 : 1;
+		decoded = p;
+		if(p >= len || data[p] != '|')
+			break;
+		pos = p + 1;
+	}
+
+	return decoded;
+}
+
+//how much of the input log LoadFM2 reads at a time from streams it can't use in place
+#define LOADFM2_WINDOW (256*1024)
+//a window is refilled once less than this remains, which is more than any record the fast path decodes
+#define LOADFM2_WINDOW_MIN 4096
+
 //yuck... another custom text parser.
 bool LoadFM2(MovieData& movieData, EMUFILE* fp, int size, bool stopAfterHeader)
 {
@@ -673,6 +867,13 @@ bool LoadFM2(MovieData& movieData, EMUFILE* fp, int size, bool stopAfterHeader)
 	if(memcmp(buf,"version 3",9))
 		return false;
 
+	//the rest of the file, for decoding the text input log in bulk.
+	//other streams are read a window at a time, so that whatever follows the input log isn't read along
+	std::vector<uint8> inputLogBuf;
+	const uint8* inputLog = NULL;
+	size_t inputLogStart = 0, inputLogSize = 0;
+	bool inputLogBuffered = false, inputLogToEnd = false;
+
 	std::string key,value;
 	enum {
 		NEWLINE, KEY, SEPARATOR, VALUE, RECORD, COMMENT, SUBTITLE
@@ -712,6 +913,55 @@ bool LoadFM2(MovieData& movieData, EMUFILE* fp, int size, bool stopAfterHeader)
 			{
 				dorecord:
 				if (stopAfterHeader) return true;
+				if(!inputLog)
+				{
+					//mapped and in-memory files are used in place
+					inputLogStart = fp->ftell();
+					inputLogSize = std::min<size_t>(fp->size() - inputLogStart, std::max(size, 0));
+					EMUFILE_MMAP* mapped = dynamic_cast<EMUFILE_MMAP*>(fp);
+					EMUFILE_MEMORY* memory = dynamic_cast<EMUFILE_MEMORY*>(fp);
+					if(mapped)
+						inputLog = mapped->map() + inputLogStart;
+					else if(memory)
+						inputLog = memory->buf() + inputLogStart;
+					else
+						inputLogBuffered = true;
+				}
+				if(inputLogBuffered)
+				{
+					//(re)fill the window when the next record may not be complete in it
+					size_t pos = fp->ftell();
+					if(!inputLog || pos < inputLogStart || pos > inputLogStart + inputLogSize
+						|| (!inputLogToEnd && inputLogStart + inputLogSize - pos < LOADFM2_WINDOW_MIN))
+					{
+						size_t avail = std::min<size_t>(fp->size() - pos, std::max(size, 0));
+						size_t want = std::min<size_t>(avail, LOADFM2_WINDOW);
+						inputLogBuf.resize(want + 1);
+						inputLogStart = pos;
+						inputLogSize = fp->fread(&inputLogBuf[0], want);
+						inputLogToEnd = (want == avail);
+						//never hand the decoder a line that is cut off by the end of the window
+						if(!inputLogToEnd)
+							while(inputLogSize && inputLogBuf[inputLogSize - 1] != '\n' && inputLogBuf[inputLogSize - 1] != '\r')
+								inputLogSize--;
+						fp->fseek(inputLogStart, SEEK_SET);
+						inputLog = &inputLogBuf[0];
+					}
+				}
+				size_t offset = fp->ftell() - inputLogStart;
+				if(offset < inputLogSize)
+				{
+					bool done;
+					size_t decoded = LoadFM2_textchunk(movieData, inputLog + offset, inputLogSize - offset, done);
+					if(decoded)
+					{
+						fp->fseek(decoded, SEEK_CUR);
+						size -= decoded;
+						if(done) return true;
+						state = NEWLINE;
+						break;
+					}
+				}
 				int currcount = movieData.records.size();
 				movieData.records.resize(currcount+1);
 				int preparse = fp->ftell();
@@ -822,24 +1072,116 @@ static void closeRecordingMovie()
 		delete osRecordingMovie;
 		osRecordingMovie = 0;
 	}
+	recordingFileHeader.clear();
+	recordingFileOffsets.clear();
+	recordingFileFrames = 0;
+}
+
+//writes records of currMovieData from the given one on, at the place where that record starts in the file
+static void dumpRecordingMovieRecords(int start)
+{
+	int numRecords = currMovieData.records.size();
+	recordingFileOffsets.resize(start + 1);
+	osRecordingMovie->fseek(recordingFileOffsets[start], SEEK_SET);
+	for (int i = start; i < numRecords; i++)
+	{
+		currMovieData.records[i].dump(&currMovieData, osRecordingMovie, i);
+		recordingFileOffsets.push_back(osRecordingMovie->ftell());
+	}
+	recordingFileFrames = numRecords;
+}
+
+//writes the whole movie to a freshly opened recording file
+static void dumpRecordingMovie()
+{
+	EMUFILE_MEMORY header;
+	currMovieData.dumpHeader(&header, false);
+	recordingFileHeader = *header.get_vec();
+	if (recordingFileHeader.size())
+		osRecordingMovie->fwrite(&recordingFileHeader[0], recordingFileHeader.size());
+	recordingFileOffsets.assign(1, osRecordingMovie->ftell());
+	dumpRecordingMovieRecords(0);
+}
+
+//brings the recording file up to date with currMovieData without rewriting it from scratch:
+//the header is rewritten in place, the records from the first one that changed on.
+//returns false if that can't be done because the header changed its size
+static bool updateRecordingMovie(int firstChangedFrame)
+{
+	EMUFILE_MEMORY header;
+	currMovieData.dumpHeader(&header, false);
+	std::vector<uint8>& newHeader = *header.get_vec();
+	if (newHeader.size() != recordingFileHeader.size())
+		return false;
+	if (newHeader != recordingFileHeader)
+	{
+		osRecordingMovie->fseek(0, SEEK_SET);
+		osRecordingMovie->fwrite(&newHeader[0], newHeader.size());
+		recordingFileHeader = newHeader;
+	}
+
+	int start = std::min<int>(std::min(recordingFileFrames, firstChangedFrame), currMovieData.records.size());
+	dumpRecordingMovieRecords(start);
+	// cut off the records of the old timeline
+	if (osRecordingMovie->size() > recordingFileOffsets.back())
+		osRecordingMovie->truncate(recordingFileOffsets.back());
+	return true;
 }
 
-// Callers shall set the approriate movieMode before calling this
-static void RedumpWholeMovieFile(bool justToggledRecording = false)
+//makes the movie file match currMovieData. firstChangedFrame is the first record that was changed since the
+//file was last written, only the part of the file from there on is rewritten while the file stays open for recording.
+//Callers shall set the approriate movieMode before calling this
+static void RewriteMovieFile(int firstChangedFrame = INT_MAX)
 {
 	bool recording = (movieMode == MOVIEMODE_RECORD);
-	assert((NULL != osRecordingMovie) == (recording != justToggledRecording) && "osRecordingMovie should be consistent with movie mode!");
 
-	if (NULL == openRecordingMovie(curMovieFilename.c_str()))
-		return;
+	if (NULL == osRecordingMovie || recordingFileOffsets.empty() || !updateRecordingMovie(firstChangedFrame))
+	{
+		if (NULL == openRecordingMovie(curMovieFilename.c_str()))
+			return;
+		dumpRecordingMovie();
+	}
 
-	currMovieData.dump(osRecordingMovie, false/*currMovieData.binaryFlag*/, recording);
 	if (recording)
 		osRecordingMovie->fflush();
 	else
 		closeRecordingMovie();
 }
 
+//writes the record that was just recorded at the given frame
+static void dumpRecordedFrame(MovieRecord& mr, int frame)
+{
+	//the file already differs from the movie before this frame, the next RewriteMovieFile will take care of it
+	if (frame > recordingFileFrames)
+		return;
+
+	if (frame + 1 == (int)currMovieData.records.size())
+	{
+		//appending, the usual case
+		if (osRecordingMovie->ftell() != (long)recordingFileOffsets[frame])
+			osRecordingMovie->fseek(recordingFileOffsets[frame], SEEK_SET);
+		mr.dump(&currMovieData, osRecordingMovie, frame);
+		recordingFileOffsets.resize(frame + 1);
+		recordingFileOffsets.push_back(osRecordingMovie->ftell());
+		recordingFileFrames = frame + 1;
+		return;
+	}
+
+	//overwriting a record in the middle of the movie, which is only possible in place if it has the same size
+	if (movieRecordMode == MOVIE_RECORD_MODE_OVERWRITE && frame < recordingFileFrames)
+	{
+		EMUFILE_MEMORY record;
+		mr.dump(&currMovieData, &record, frame);
+		if (record.size() == recordingFileOffsets[frame + 1] - recordingFileOffsets[frame])
+		{
+			osRecordingMovie->fseek(recordingFileOffsets[frame], SEEK_SET);
+			osRecordingMovie->fwrite(record.buf(), record.size());
+			return;
+		}
+	}
+	recordingFileFrames = frame;
+}
+
 /// Stop movie playback.
 static void StopPlayback()
 {
@@ -870,7 +1212,7 @@ static void StopRecording()
 	assert(movieMode == MOVIEMODE_RECORD);
 
 	movieMode = MOVIEMODE_INACTIVE;
-	RedumpWholeMovieFile(true);
+	RewriteMovieFile();
 	FCEU_DispMessage("Movie recording stopped.",0);
 }
 
@@ -1062,7 +1404,19 @@ bool FCEUI_LoadMovie(const char *fname, bool _read_only, int _pauseframe)
 	AddRecentMovieFile(name.c_str());
 #endif
 
-	LoadFM2(currMovieData, fp->stream, fp->size, false);
+	//plain files are mapped, so that the input log is decoded right from the page cache
+	EMUFILE_MMAP* mapped = NULL;
+	if(!fp->isArchive() && fp->stream->get_fp())
+	{
+		mapped = new EMUFILE_MMAP(fp->fullFilename);
+		if(!mapped->is_open())
+		{
+			delete mapped;
+			mapped = NULL;
+		}
+	}
+	LoadFM2(currMovieData, mapped ? (EMUFILE*)mapped : fp->stream, fp->size, false);
+	delete mapped;
 	LoadSubtitles(currMovieData);
 	delete fp;
 
@@ -1179,7 +1533,7 @@ void FCEUI_SaveMovie(const char *fname, EMOVIE_FLAG flags, std::wstring author)
 	FCEUMOV_ClearCommands();
 
 	//we are going to go ahead and dump the header. from now on we will only be appending frames
-	currMovieData.dump(osRecordingMovie, false);
+	dumpRecordingMovie();
 
 	movieMode = MOVIEMODE_RECORD;
 	movie_readonly = false;
@@ -1312,7 +1666,7 @@ void FCEUMOV_AddInputState()
 		else
 			currMovieData.records.push_back(mr);
 
-		mr.dump(&currMovieData, osRecordingMovie, currFrameCounter);	// to disk
+		dumpRecordedFrame(mr, currFrameCounter);	// to disk
 	}
 
 	currFrameCounter++;
@@ -1325,10 +1679,6 @@ void FCEUMOV_AddInputState()
 //TODO
 void FCEUMOV_AddCommand(int cmd)
 {
-	// do nothing if not recording a movie
-	if(movieMode != MOVIEMODE_RECORD && movieMode != MOVIEMODE_TASEDITOR)
-		return;
-
 	// translate "FCEU NetPlay" command to "FCEU Movie" command
 	switch (cmd)
 	{
@@ -1343,6 +1693,13 @@ void FCEUMOV_AddCommand(int cmd)
 		default: return;
 	}
 
+	// the state recorder logs commands alongside input, movie or not
+	FCEU_StateRecorderAddCommand(cmd);
+
+	// do nothing else if not recording a movie
+	if(movieMode != MOVIEMODE_RECORD && movieMode != MOVIEMODE_TASEDITOR)
+		return;
+
 	_currCommand |= cmd;
 }
 
@@ -1427,6 +1784,17 @@ int CheckTimelines(MovieData& stateMovie, MovieData& currMovie)
 	return -1;
 }
 
+//returns the first frame at which the records of two movies differ
+static int FirstChangedFrame(MovieData& oldMovie, MovieData& newMovie)
+{
+	int end_frame = std::min(oldMovie.records.size(), newMovie.records.size());
+	for (int x = 0; x < end_frame; x++)
+	{
+		if (!newMovie.records[x].Compare(oldMovie.records[x]))
+			return x;
+	}
+	return end_frame;
+}
 
 static bool load_successful = false;
 
@@ -1557,7 +1925,7 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 			if (movieMode == MOVIEMODE_RECORD)
 			{
 				movieMode = MOVIEMODE_PLAY;
-				RedumpWholeMovieFile(true);
+				RewriteMovieFile();
 				closeRecordingMovie();
 			}
 
@@ -1599,16 +1967,16 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 		} else
 		{
 			//Read+Write mode
-			closeRecordingMovie();
-
+			//if we were recording, the movie file stays open, so that only the frames of the new timeline are written
 			if (currFrameCounter > (int)tempMovieData.records.size())
 			{
 				//This is a post movie savestate, handle it differently
 				//Replace movie contents but then switch to movie finished mode
+				int firstChangedFrame = FirstChangedFrame(currMovieData, tempMovieData);
 				currMovieData = tempMovieData;
 				movieMode = MOVIEMODE_PLAY;
 				FCEUMOV_IncrementRerecordCount();
-				RedumpWholeMovieFile();
+				RewriteMovieFile(firstChangedFrame);
 				FinishPlayback();
 			} else
 			{
@@ -1617,10 +1985,11 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 					//we can only assume this here since we have checked that the frame counter is not greater than the movie data
 					tempMovieData.truncateAt(currFrameCounter);
 				
+				int firstChangedFrame = FirstChangedFrame(currMovieData, tempMovieData);
 				currMovieData = tempMovieData;
 				movieMode = MOVIEMODE_RECORD;
 				FCEUMOV_IncrementRerecordCount();
-				RedumpWholeMovieFile(true);
+				RewriteMovieFile(firstChangedFrame);
 			}
 		}
 	}
@@ -1765,13 +2134,13 @@ void FCEUI_MovieToggleRecording()
 		movie_readonly = false;
 		FCEUMOV_IncrementRerecordCount();
 		movieMode = MOVIEMODE_RECORD;
-		RedumpWholeMovieFile(true);
+		RewriteMovieFile();
 	} else if (movieMode == MOVIEMODE_RECORD)
 	{
 		strcpy(message, "Movie is now Read-Only");
 		movie_readonly = true;
 		movieMode = MOVIEMODE_PLAY;
-		RedumpWholeMovieFile(true);
+		RewriteMovieFile();
 		if (currFrameCounter >= (int)currMovieData.records.size())
 		{
 			extern int closeFinishedMovie;
@@ -1807,7 +2176,7 @@ void FCEUI_MovieInsertFrame()
 		std::vector<MovieRecord>::iterator iter = currMovieData.records.begin();
 		currMovieData.records.insert(iter + currFrameCounter, MovieRecord());
 		FCEUMOV_IncrementRerecordCount();
-		RedumpWholeMovieFile();
+		RewriteMovieFile(currFrameCounter);
 	} else
 	{
 		strcpy(message, "Nothing to do in this mode");
@@ -1833,7 +2202,7 @@ void FCEUI_MovieDeleteFrame()
 		std::vector<MovieRecord>::iterator iter = currMovieData.records.begin();
 		currMovieData.records.erase(iter + currFrameCounter);
 		FCEUMOV_IncrementRerecordCount();
-		RedumpWholeMovieFile();
+		RewriteMovieFile(currFrameCounter);
 
 		if (movieMode != MOVIEMODE_RECORD && currFrameCounter >= (int)currMovieData.records.size())
 		{
@@ -1870,7 +2239,7 @@ void FCEUI_MovieTruncate()
 		strcpy(message, "Movie truncated");
 		currMovieData.truncateAt(currFrameCounter);
 		FCEUMOV_IncrementRerecordCount();
-		RedumpWholeMovieFile();
+		RewriteMovieFile(currFrameCounter);
 
 		if (movieMode != MOVIEMODE_RECORD)
 		{
@@ -1930,7 +2299,7 @@ void FCEUI_MoviePlayFromBeginning(void)
 		if (movieMode == MOVIEMODE_RECORD)
 		{
 			movieMode = MOVIEMODE_PLAY;
-			RedumpWholeMovieFile(true);
+			RewriteMovieFile();
 		}
 		if (currMovieData.savestate.empty())
 		{
@@ -111,6 +111,37 @@ bool FCEUMOV_FromPoweron();
 void FCEUMOV_CreateCleanMovie();
 void FCEUMOV_ClearCommands();
 
+struct MovieZapperRecord
+{
+	uint8 x,y,b,bogo;
+	uint64 zaphit;
+};
+
+//zapper data of both ports for one frame.
+//it's only allocated when written, so frames of movies without zappers don't pay for it
+class MovieZappers
+{
+public:
+	MovieZappers() : data(NULL) {}
+	MovieZappers(const MovieZappers& other);
+	MovieZappers(MovieZappers&& other) noexcept : data(other.data) { other.data = NULL; }
+	~MovieZappers() { delete[] data; }
+	MovieZappers& operator=(const MovieZappers& other);
+	MovieZappers& operator=(MovieZappers&& other) noexcept;
+
+	//allocates the data
+	MovieZapperRecord& operator[](int port);
+	//reads without allocating, unallocated zappers are all zeros
+	const MovieZapperRecord& get(int port) const;
+
+	bool operator==(const MovieZappers& other) const;
+	bool isZero() const;
+	void clear();
+
+private:
+	MovieZapperRecord* data;
+};
+
 class MovieData;
 class MovieRecord
 {
@@ -119,15 +150,12 @@ public:
 	MovieRecord();
 	ValueArray<uint8,4> joysticks;
 
-	struct {
-		uint8 x,y,b,bogo;
-		uint64 zaphit;
-	} zappers[2];
-
 	//misc commands like reset, etc.
 	//small now to save space; we might need to support more commands later.
 	//the disk format will support up to 64bit if necessary
 	uint8 commands;
+
+	MovieZappers zappers;
 	bool command_reset() { return (commands & MOVIECMD_RESET) != 0; }
 	bool command_power() { return (commands & MOVIECMD_POWER) != 0; }
 	bool command_fds_insert() { return (commands & MOVIECMD_FDS_INSERT) != 0; }
@@ -249,6 +277,7 @@ public:
 	void truncateAt(int frame);
 	void installValue(std::string& key, std::string& val);
 	int dump(EMUFILE* os, bool binary, bool seekToCurrFramePos = false);
+	void dumpHeader(EMUFILE* os, bool binary);
 
 	void clearRecordRange(int start, int len);
 	void eraseRecords(int at, int frames = 1);
@@ -30,6 +30,7 @@
 #include "utils/xstring.h"
 #include "file.h"
 #include "fds.h"
+#include "vsuni.h"
 #include "state.h"
 #include "movie.h"
 #include "ppu.h"
@@ -38,6 +39,8 @@
 #include "input.h"
 #include "zlib.h"
 #include "driver.h"
+#include "utils/fcsd.h"
+#include "utils/md5.h"
 #ifdef _S9XLUA_H
 #include "fceulua.h"
 #endif
@@ -57,6 +60,8 @@
 //#include <unistd.h> //mbg merge 7/17/06 removed
 
 #include <vector>
+#include <deque>
+#include <map>
 #include <fstream>
 
 using namespace std;
@@ -83,6 +88,7 @@ bool internalSaveLoad = false;
 
 bool backupSavestates = true;
 bool compressSavestates = true;  //By default FCEUX compresses savestates when a movie is inactive.
+bool indexedSavestates = false;  //Save state files in the indexed FCSD container instead of FCSX
 
 // a temp memory stream. We'll be dumping some data here and then compress
 static EMUFILE_MEMORY memory_savestate;
@@ -376,7 +382,8 @@ int CurrentState=0;
 extern int geniestage;
 
 
-bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
+// dumps every state chunk into memory_savestate, uncompressed. returns the total size or 0 on error
+static uint32 WriteStateChunks(void)
 {
 	// reinit memory_savestate
 	// memory_savestate is global variable which already has its vector of bytes, so no need to allocate memory every time we use save/loadstate
@@ -434,9 +441,70 @@ bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
 	if(len != totalsize)
 	{
 		FCEUD_PrintError("sanity violation: len != totalsize");
-		return false;
+		return 0;
 	}
 
+	return totalsize;
+}
+
+static void SubHash(md5_context* ctx, SFORMAT *sf)
+{
+	while(sf->v)
+	{
+		if(sf->s==~0u)		//Link to another struct
+		{
+			SubHash(ctx,(SFORMAT *)sf->v);
+			sf++;
+			continue;
+		}
+
+		uint32 size = sf->s&(~FCEUSTATE_FLAGS);
+		uint8* data = (sf->s&FCEUSTATE_INDIRECT) ? *(uint8 **)sf->v : (uint8*)sf->v;
+
+		//hash the values in the same byte order as SubWrite, so that the hashes don't depend on the host
+#ifdef FCEU_BIG_ENDIAN
+		if(sf->s&RLSB)
+			FlipByteOrder(data,size);
+#endif
+		md5_update(ctx,(uint8*)sf->desc,4);
+		md5_update(ctx,data,size);
+#ifdef FCEU_BIG_ENDIAN
+		if(sf->s&RLSB)
+			FlipByteOrder(data,size);
+#endif
+		sf++;
+	}
+}
+
+void FCEUSS_HashState(uint8 digest[16])
+{
+	md5_context ctx;
+	md5_starts(&ctx);
+
+	FCEUPPU_SaveState();
+	FCEUSND_SaveState();
+	SubHash(&ctx,SFCPU);
+	SubHash(&ctx,SFCPUC);
+	SubHash(&ctx,FCEUPPU_STATEINFO);
+	SubHash(&ctx,FCEU_NEWPPU_STATEINFO);
+	SubHash(&ctx,FCEUCTRL_STATEINFO);
+	SubHash(&ctx,FCEUSND_STATEINFO);
+
+	if(SPreSave) SPreSave();
+	SubHash(&ctx,SFMDATA);
+	if(SPostSave) SPostSave();
+
+	md5_finish(&ctx,digest);
+}
+
+bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
+{
+	uint32 totalsize = WriteStateChunks();
+	if(totalsize == 0)
+		return false;
+
+	size_t len = totalsize;
+
 	int error = Z_OK;
 	uint8* cbuf = (uint8*)memory_savestate.buf();
 	uLongf comprlen = ~0lu;
@@ -463,6 +531,23 @@ bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
 	return error == Z_OK;
 }
 
+bool FCEUSS_SaveIndexedMS(EMUFILE* outstream, int compressionLevel)
+{
+	uint32 totalsize = WriteStateChunks();
+	if(totalsize == 0)
+		return false;
+
+	if(!compressSavestates && !FCEUMOV_Mode(MOVIEMODE_TASEDITOR))
+		compressionLevel = Z_NO_COMPRESSION;
+
+	// each chunk is compressed on its own and indexed, see utils/fcsd.h
+	if(!FCSD_Build(memory_savestate.buf(), totalsize, FCEU_VERSION_NUMERIC, compressionLevel, compressed_buf))
+		return false;
+
+	outstream->fwrite((char*)&compressed_buf[0], compressed_buf.size());
+	return true;
+}
+
 
 void FCEUSS_Save(const char *fname, bool display_message)
 {
@@ -531,10 +616,11 @@ void FCEUSS_Save(const char *fname, bool display_message)
 	}
 	#endif
 
-	if(FCEUMOV_Mode(MOVIEMODE_INACTIVE))
-		FCEUSS_SaveMS(st,-1);
+	int compressionLevel = FCEUMOV_Mode(MOVIEMODE_INACTIVE) ? -1 : 0;
+	if(indexedSavestates)
+		FCEUSS_SaveIndexedMS(st,compressionLevel);
 	else
-		FCEUSS_SaveMS(st,0);
+		FCEUSS_SaveMS(st,compressionLevel);
 
 	delete st;
 
@@ -646,6 +732,96 @@ int FCEUSS_LoadFP_old(EMUFILE* is, ENUM_SSLOADPARAMS params)
 bool NetPlayStateLoadReq(EMUFILE* is);
 #endif
 
+// reads the chunk stream into the emulator and runs the post load fixups.
+// if that fails and a backup is given, the backup is restored
+static bool ApplyStateChunks(EMUFILE* is, size_t totalsize, int stateversion, EMUFILE_MEMORY* backup)
+{
+	FCEUMOV_PreLoad();
+
+	bool x = (ReadStateChunks(is, totalsize) != 0);
+
+	//mbg 5/24/08 - we don't support old states, so this shouldnt matter.
+	//if(read_sfcpuc && stateversion<9500)
+	//	X.IRQlow=0;
+
+	if(GameStateRestore)
+	{
+		GameStateRestore(stateversion);
+	}
+	if (x)
+	{
+		FCEUPPU_LoadState(stateversion);
+		FCEUSND_LoadState(stateversion);
+		x=FCEUMOV_PostLoad();
+	}
+	else if (backup)
+	{
+		backup->fseek(0,SEEK_SET);
+		FCEUSS_LoadFP(backup,SSLOADPARAM_NOBACKUP);
+	}
+
+	// Post state load callback that is used to notify driver code that a new state load occurred.
+	if (SPostLoad != NULL)
+	{
+		SPostLoad(x);
+	}
+	return x;
+}
+
+// loads a state saved in the indexed FCSD container. the 16 bytes of header have already been read
+static bool FCEUSS_LoadIndexedFP(EMUFILE* is, const uint8* header, EMUFILE_MEMORY* backup)
+{
+	// the rest of the directory header tells how big the whole blob is
+	uint8 dirheader[FCSD_HEADER_SIZE];
+	memcpy(dirheader, header, 16);
+	if(is->fread((char*)dirheader+16, FCSD_HEADER_SIZE-16) != FCSD_HEADER_SIZE-16)
+		return false;
+
+	size_t blobsize = FCSD_BlobSize(dirheader);
+	const uint8* blob;
+
+	EMUFILE_MMAP* mapped = dynamic_cast<EMUFILE_MMAP*>(is);
+	if (mapped)
+	{
+		size_t start = mapped->ftell() - FCSD_HEADER_SIZE;
+		if (mapped->size() < start + blobsize)
+			return false;
+		blob = mapped->map() + start;
+	}
+	else
+	{
+		if (compressed_buf.size() < blobsize) compressed_buf.resize(blobsize);
+		memcpy(&compressed_buf[0], dirheader, FCSD_HEADER_SIZE);
+		if(is->fread((char*)&compressed_buf[FCSD_HEADER_SIZE], blobsize-FCSD_HEADER_SIZE) != blobsize-FCSD_HEADER_SIZE)
+			return false;
+		blob = &compressed_buf[0];
+	}
+
+	FCSD_Reader reader;
+	if(!reader.open(blob, blobsize))
+		return false;
+
+#ifdef __QT_DRIVER__
+	if ( NetPlayStateLoadReq(is) )
+	{
+		return false;
+	}
+#endif
+
+	size_t totalsize = reader.totalSize();
+
+	if ((memory_savestate.get_vec())->size() < totalsize)
+		(memory_savestate.get_vec())->resize(totalsize);
+	memory_savestate.set_len(totalsize);
+	memory_savestate.unfail();
+	memory_savestate.fseek(0, SEEK_SET);
+
+	if(!reader.flatten(memory_savestate.buf(), totalsize))
+		return false;	// emulator state is still untouched
+
+	return ApplyStateChunks(&memory_savestate, totalsize, reader.emuVersion(), backup);
+}
+
 bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params)
 {
 	if(!is) return false;
@@ -661,6 +837,9 @@ bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params)
 	uint8 header[16];
 	//read and analyze the header
 	is->fread((char*)&header,16);
+	if(!memcmp(header,"FCSD",4)) {
+		return FCEUSS_LoadIndexedFP(is,header,backup ? &msBackupSavestate : NULL);
+	}
 	if(memcmp(header,"FCSX",4)) {
 		//its not an fceux save file.. perhaps it is an fceu savefile
 		is->fseek(0,SEEK_SET);
@@ -682,61 +861,59 @@ bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params)
 	int stateversion  = FCEU_de32lsb(header + 8);
 	uint32_t comprlen = FCEU_de32lsb(header + 12);
 
-	// reinit memory_savestate
-	// memory_savestate is global variable which already has its vector of bytes, so no need to allocate memory every time we use save/loadstate
-	if ((memory_savestate.get_vec())->size() < totalsize)
-		(memory_savestate.get_vec())->resize(totalsize);
-	memory_savestate.set_len(totalsize);
-	memory_savestate.unfail();
-	memory_savestate.fseek(0, SEEK_SET);
+	// if the source is a file mapping, the payload can be consumed in place
+	EMUFILE_MMAP* mapped = dynamic_cast<EMUFILE_MMAP*>(is);
+	size_t payloadlen = (comprlen != ~0u) ? comprlen : totalsize;
+	if (mapped && (mapped->size() < static_cast<size_t>(mapped->ftell()) + payloadlen))
+		return false;	// truncated file, nothing has been touched yet
 
-	if(comprlen != ~0u)
-	{
-		// the savestate is compressed: read from is to compressed_buf, then decompress from compressed_buf to memory_savestate.vec
-		if (compressed_buf.size() < comprlen) compressed_buf.resize(comprlen);
-		is->fread(&compressed_buf[0], comprlen);
+	// chunks are read from here. normally memory_savestate, but an uncompressed mapped file is read directly
+	EMUFILE* chunkstream = &memory_savestate;
 
-		uLongf uncomprlen = totalsize;
-		int error = uncompress(memory_savestate.buf(), &uncomprlen, &compressed_buf[0], comprlen);
-		if(error != Z_OK || uncomprlen != totalsize)
-			return false;	// we dont need to restore the backup here because we havent messed with the emulator state yet
+	if(comprlen == ~0u && mapped)
+	{
+		// the savestate is not compressed and already in memory: the chunk reader copies fields straight out of the mapping
+		chunkstream = mapped;
 	}
 	else
 	{
-		// the savestate is not compressed: just read from is to memory_savestate.vec
-		is->fread(memory_savestate.buf(), totalsize);
-	}
-
-	FCEUMOV_PreLoad();
-
-	bool x = (ReadStateChunks(&memory_savestate, totalsize) != 0);
-
-	//mbg 5/24/08 - we don't support old states, so this shouldnt matter.
-	//if(read_sfcpuc && stateversion<9500)
-	//	X.IRQlow=0;
+		// reinit memory_savestate
+		// memory_savestate is global variable which already has its vector of bytes, so no need to allocate memory every time we use save/loadstate
+		if ((memory_savestate.get_vec())->size() < totalsize)
+			(memory_savestate.get_vec())->resize(totalsize);
+		memory_savestate.set_len(totalsize);
+		memory_savestate.unfail();
+		memory_savestate.fseek(0, SEEK_SET);
+
+		if(comprlen != ~0u)
+		{
+			// the savestate is compressed: read from is to compressed_buf, then decompress from compressed_buf to memory_savestate.vec
+			// (a mapped file is decompressed directly from the mapping)
+			const uint8* cbuf;
+			if (mapped)
+			{
+				cbuf = mapped->map() + mapped->ftell();
+			}
+			else
+			{
+				if (compressed_buf.size() < comprlen) compressed_buf.resize(comprlen);
+				is->fread(&compressed_buf[0], comprlen);
+				cbuf = &compressed_buf[0];
+			}
 
-	if(GameStateRestore)
-	{
-		GameStateRestore(stateversion);
-	}
-	if (x)
-	{
-		FCEUPPU_LoadState(stateversion);
-		FCEUSND_LoadState(stateversion);
-		x=FCEUMOV_PostLoad();
-	}
-	else if (backup)
-	{
-		msBackupSavestate.fseek(0,SEEK_SET);
-		FCEUSS_LoadFP(&msBackupSavestate,SSLOADPARAM_NOBACKUP);
+			uLongf uncomprlen = totalsize;
+			int error = uncompress(memory_savestate.buf(), &uncomprlen, cbuf, comprlen);
+			if(error != Z_OK || uncomprlen != totalsize)
+				return false;	// we dont need to restore the backup here because we havent messed with the emulator state yet
+		}
+		else
+		{
+			// the savestate is not compressed: just read from is to memory_savestate.vec
+			is->fread(memory_savestate.buf(), totalsize);
+		}
 	}
 
-	// Post state load callback that is used to notify driver code that a new state load occurred.
-	if (SPostLoad != NULL)
-	{
-		SPostLoad(x);
-	}
-	return x;
+	return ApplyStateChunks(chunkstream, totalsize, stateversion, backup ? &msBackupSavestate : NULL);
 }
 
 void FCEUSS_SetLoadCallback( void (*cb)(bool) )
@@ -764,17 +941,28 @@ bool FCEUSS_Load(const char *fname, bool display_message)
 	}
 	if (fname)
 	{
-		st = FCEUD_UTF8_fstream(fname, "rb");
 		fn.assign(fname);
 	}
 	else
 	{
 		fn = FCEU_MakeFName(FCEUMKF_STATE,CurrentState,fname);
-		st=FCEUD_UTF8_fstream(fn.c_str(),"rb");
         	lastLoadstateMade.assign(fn);
 	}
 
-	if (st.get() == NULL || (st.get()->get_fp() == NULL))
+	// prefer mapping the file, so that the loader can read fields directly out of the page cache
+	EMUFILE_MMAP* mapped = new EMUFILE_MMAP(fn);
+	bool isMapped = mapped->is_open();
+	if (isMapped)
+	{
+		st = mapped;
+	}
+	else
+	{
+		delete mapped;
+		st = FCEUD_UTF8_fstream(fn.c_str(), "rb");
+	}
+
+	if (st.get() == NULL || (!isMapped && (st.get()->get_fp() == NULL)))
 	{
 		if (display_message)
 		{
@@ -1211,6 +1399,10 @@ void RedoLoadState()
 //-----------------------------------------------------------------------------------------------------
 static StateRecorderConfigData stateRecorderConfig;
 
+// The recorder keeps a multi-resolution history: the most recent snapsPerTier snapshots are
+// kept at full density, the next tier at every 2nd snapshot, the one after that at every 4th
+// and so on. Independent of that, the oldest snapshots are evicted when the history grows
+// past its duration or the total size goes over the configured memory budget.
 class StateRecorder
 {
 	public:
@@ -1218,26 +1410,26 @@ class StateRecorder
 		{
 			loadConfig( stateRecorderConfig );
 
-			for (int i=0; i<ringBufSize; i++)
-			{
-				EMUFILE_MEMORY *em = new EMUFILE_MEMORY( 0x1000 );
-
-				ringBuf.push_back(em);
-			}
-			ringStart = ringHead = ringTail = 0;
 			frameCounter = 0;
-			lastState = ringHead;
+			lastStateFrame = 0;
+			lastState = -1;
+			memUsage = 0;
 			loadIndexReset = false;
 			lastLoadFrame = 0;
+			replaying = false;
+			replayFrom = 0;
+			replayTarget = 0;
+			inputLogStart = 0;
+			pendingCommands = 0;
 		}
 
 		~StateRecorder(void)
 		{
-			for (size_t i=0; i<ringBuf.size(); i++)
+			for (size_t i=0; i<snaps.size(); i++)
 			{
-				delete ringBuf[i];
+				delete snaps[i].data;
 			}
-			ringBuf.clear();
+			snaps.clear();
 		}
 
 		void loadConfig( StateRecorderConfigData &config )
@@ -1254,37 +1446,38 @@ class StateRecorder
 			{
 				config.historyDurationMinutes = config.timeBetweenSnapsMinutes;
 			}
-
-			if (config.timingMode)
+			if (config.memoryBudgetMB < 1)
 			{
-				const double fhistMin  = config.historyDurationMinutes;
-				const double fsnapMin  = config.timeBetweenSnapsMinutes;
-				const double fnumSnaps = fhistMin / fsnapMin;
+				config.memoryBudgetMB = 1;
+			}
 
-				ringBufSize = static_cast<int>( fnumSnaps + 0.5f );
+			int32_t fps = FCEUI_GetDesiredFPS(); // Do >> 24 to get in Hz
 
-				int32_t fps = FCEUI_GetDesiredFPS(); // Do >> 24 to get in Hz
+			double hz = ( ((double)fps) / 16777216.0 );
 
-				double hz = ( ((double)fps) / 16777216.0 );
+			if (config.timingMode)
+			{
+				const double fsnapMin  = config.timeBetweenSnapsMinutes;
 
 				double framesPerSnapf = hz * fsnapMin * 60.0;
 
 				framesPerSnap = static_cast<unsigned int>( framesPerSnapf + 0.50 );
+
+				if (framesPerSnap < 1)
+				{
+					framesPerSnap = 1;
+				}
 			}
 			else
 			{
-				const double fhistMin  = config.historyDurationMinutes;
-				int32_t fps = FCEUI_GetDesiredFPS(); // Do >> 24 to get in Hz
-				double hz = ( ((double)fps) / 16777216.0 );
-
-				const double fsnapMin  = static_cast<double>(config.framesBetweenSnaps) / (hz * 60.0);
-				const double fnumSnaps = fhistMin / fsnapMin;
-
-				ringBufSize = static_cast<int>( fnumSnaps + 0.5f );
 				framesPerSnap = config.framesBetweenSnaps;
 			}
 
-			printf("ringBufSize:%i  framesPerSnap:%i\n", ringBufSize, framesPerSnap );
+			maxHistoryFrames = static_cast<unsigned int>( hz * config.historyDurationMinutes * 60.0 + 0.50 );
+
+			memBudget = static_cast<size_t>(config.memoryBudgetMB) * 1024 * 1024;
+
+			printf("framesPerSnap:%u  historyFrames:%u  budget:%zuMB\n", framesPerSnap, maxHistoryFrames, memBudget / (1024*1024) );
 
 			compressionLevel = config.compressionLevel;
 			loadPauseTime    = config.loadPauseTimeSeconds;
@@ -1293,41 +1486,41 @@ class StateRecorder
 
 		void update(void)
 		{
+			if (replaying)
+			{
+				return;
+			}
 			bool isPaused = EmulationPaused ? true : false;
 
 			unsigned int curFrame = static_cast<unsigned int>(currFrameCounter);
 
 			if (!isPaused && loadIndexReset)
 			{
-				ringHead = (lastState + 1) % ringBufSize;
+				// Timeline has branched off at the loaded snapshot, anything after it is invalid now.
+				dropAfter( lastStateFrame );
 
 				frameCounter = curFrame;
 
 				loadIndexReset = false;
 			}
 
+			if (!isPaused && (curFrame < frameCounter) )
+			{
+				// Frame counter went backwards behind our back (regular savestate load).
+				// The logged input no longer leads from our snapshots to the current state.
+				dropAfter( curFrame );
+				clearInputLog();
+
+				frameCounter = curFrame;
+			}
+
 			if (!isPaused && (curFrame > frameCounter) )
 			{
 				frameCounter = curFrame;
 
 				if ( (frameCounter % framesPerSnap) == 0 )
 				{
-					EMUFILE_MEMORY *em = ringBuf[ ringHead ];
-
-					em->set_len(0);
-
-					FCEUSS_SaveMS( em, compressionLevel );
-
-					//printf("Frame:%u  Save:%i  Size:%zu  Total:%zukB \n", frameCounter, ringHead, em->size(), dataSize() / 1024 );
-
-					lastState = ringHead;
-
-					ringHead = (ringHead + 1) % ringBufSize;
-
-					if (ringStart == ringHead)
-					{
-						ringStart = (ringHead + 1) % ringBufSize;
-					}
+					doSnap();
 				}
 			}
 		}
@@ -1338,134 +1531,542 @@ class StateRecorder
 			{
 				numSnapsFromLatest = 0;
 			}
-			numSnapsFromLatest = numSnapsFromLatest % ringBufSize;
-
-			int snapIdx = ringHead - numSnapsFromLatest - 1;
+			int snapIdx = static_cast<int>(snaps.size()) - numSnapsFromLatest - 1;
 
-			loadStateByIndex(snapIdx);
-
-			return 0;
+			return loadStateByIndex(snapIdx);
 		}
 
 		int loadStateByIndex( int snapIdx )
 		{
+			int numSnaps = static_cast<int>(snaps.size());
+
+			if (numSnaps == 0)
+			{
+				return -1;
+			}
 			if (snapIdx < 0)
 			{
-				snapIdx = snapIdx + ringBufSize;
+				snapIdx = snapIdx + numSnaps;
+			}
+			if ( (snapIdx < 0) || (snapIdx >= numSnaps) )
+			{
+				return -1;
 			}
-			snapIdx = snapIdx % ringBufSize;
 
-			EMUFILE_MEMORY *em = ringBuf[ snapIdx ];
+			EMUFILE_MEMORY *em = snaps[ snapIdx ].data;
 
-			em->fseek(SEEK_SET, 0);
+			em->fseek(0, SEEK_SET);
 
 			FCEUSS_LoadFP( em, SSLOADPARAM_NOBACKUP );
 
+			replayTarget = 0;
+
 			frameCounter = lastLoadFrame = static_cast<unsigned int>(currFrameCounter);
 
 			lastState = snapIdx;
+			lastStateFrame = snaps[ snapIdx ].frame;
 			loadIndexReset = true;
 
-			if (pauseOnLoad == StateRecorderConfigData::TEMPORARY_PAUSE)
+			applyPauseOnLoad();
+
+			return 0;
+		}
+
+		// Loads the snapshot at or before the requested frame. The frames from there to the
+		// requested one are re-emulated by runReplay() on the emulator thread, using the
+		// logged input (or the movie during playback).
+		// If exact is set, nothing is loaded unless the frame itself can be reached.
+		int loadStateAtFrame( unsigned int frame, bool exact = false )
+		{
+			int snapIdx = findSnapAtOrBefore( frame );
+
+			// One step at a time, the last one has to be replayed first
+			if ( (snapIdx < 0) || replayPending() )
 			{
-				if (loadPauseTime > 0)
-				{	// Temporary pause after loading new state for user to have time to process
-					FCEUI_PauseForDuration(loadPauseTime);
-				}
+				return -1;
 			}
-			else if (pauseOnLoad == StateRecorderConfigData::FULL_PAUSE)
+			const unsigned int snapFrame = snaps[ snapIdx ].frame;
+
+			bool canReplay = FCEUMOV_Mode(MOVIEMODE_PLAY) || haveInput( snapFrame, frame );
+
+			if (exact && (frame > snapFrame) && !canReplay)
 			{
-				FCEUI_SetEmulationPaused( EMULATIONPAUSED_PAUSED );
+				return -1;
+			}
+
+			if (loadStateByIndex( snapIdx ) != 0)
+			{
+				return -1;
+			}
+			if ( (frame > snapFrame) && canReplay )
+			{
+				replayFrom   = snapFrame;
+				replayTarget = frame;
+
+				frameCounter = lastLoadFrame = lastStateFrame = frame;
 			}
 			return 0;
 		}
 
-		int loadPrevState(void)
+		bool replayPending(void)
 		{
-			int snapIdx = lastState;
+			return replayTarget != 0;
+		}
 
-			if ( lastState == ringHead )
-			{	// No States to Load
-				return -1;
+		// Re-emulates up to the frame loadStateAtFrame() was asked for. The video and
+		// sound of the frame it lands on are returned, for the caller to show.
+		void runReplay( uint8 **gfx, int32 **sound, int32 *ssize )
+		{
+			const unsigned int target = replayTarget;
+
+			replayTarget = 0;
+
+			// Some other state was loaded in the meantime
+			if ( (static_cast<unsigned int>(currFrameCounter) != replayFrom) || (target <= replayFrom) )
+			{
+				return;
 			}
-			if ( lastState != ringStart )
+			reEmulate( target - replayFrom, gfx, sound, ssize );
+
+			frameCounter = lastLoadFrame = static_cast<unsigned int>(currFrameCounter);
+			lastStateFrame = frameCounter;
+		}
+
+		// Called from FCEU_UpdateInput() before the movie system sees the frame input.
+		// While re-emulating, replaces the polled input with what was logged for this frame.
+		void replayInput(void)
+		{
+			if (!replaying || FCEUMOV_Mode(MOVIEMODE_PLAY|MOVIEMODE_TASEDITOR))
 			{
-				if ( (lastLoadFrame+30) > frameCounter)
-				{
-					snapIdx--;
+				return;
+			}
+			unsigned int frame = static_cast<unsigned int>(currFrameCounter);
+
+			if ( !haveInput( frame, frame+1 ) )
+			{
+				return;
+			}
+			const InputLogEntry &e = inputLog[ frame - inputLogStart ];
 
-					if (snapIdx < 0)
-					{
-						snapIdx += ringBufSize;
-					}
+			MovieRecord mr;
+
+			if (e.flags & INPUTLOG_EXTENDED)
+			{
+				mr = inputLogExt[ frame ];
+			}
+			else
+			{
+				for (int i=0; i<4; i++)
+				{
+					mr.joysticks[i] = e.joysticks[i];
 				}
+				mr.commands = e.commands;
 			}
-			return loadStateByIndex( snapIdx );
+
+			if (mr.command_power())
+				PowerNES();
+			if (mr.command_reset())
+				ResetNES();
+			if (mr.command_fds_insert())
+				FCEU_FDSInsert();
+			if (mr.command_fds_select())
+				FCEU_FDSSelect();
+			if (mr.command_vs_insertcoin())
+				FCEU_VSUniCoin(0);
+			if (mr.command_vs_insertcoin2())
+				FCEU_VSUniCoin(1);
+			if (mr.command_vs_service())
+				FCEU_VSUniService();
+
+			joyports[0].load(&mr);
+			joyports[1].load(&mr);
 		}
 
-		int loadNextState(void)
+		// Called from FCEU_UpdateInput() once the input for a frame is final.
+		void logInput(void)
 		{
-			int snapIdx =  lastState;
-			int nextIdx = (lastState + 1) % ringBufSize;
+			if (replaying)
+			{
+				return;
+			}
+			// currFrameCounter has already been advanced past the frame the input belongs to
+			unsigned int frame = static_cast<unsigned int>(currFrameCounter) - 1;
 
-			if ( nextIdx != ringHead )
+			if ( inputLog.empty() || (frame < inputLogStart) || (frame > inputLogEnd()) )
 			{
-				snapIdx = nextIdx;
+				clearInputLog();
+				inputLogStart = frame;
 			}
-			return loadStateByIndex( snapIdx );
+			else if (frame < inputLogEnd())
+			{
+				// Timeline branched, forget the input of the old one
+				truncateInputLog( frame );
+			}
+			MovieRecord mr;
+
+			joyports[0].log(&mr);
+			joyports[1].log(&mr);
+
+			mr.commands = pendingCommands;
+			pendingCommands = 0;
+
+			InputLogEntry e;
+
+			for (int i=0; i<4; i++)
+			{
+				e.joysticks[i] = mr.joysticks[i];
+			}
+			e.commands = mr.commands;
+			e.flags    = 0;
+
+			if ( !mr.zappers.isZero() )
+			{
+				e.flags = INPUTLOG_EXTENDED;
+			}
+			if (e.flags & INPUTLOG_EXTENDED)
+			{
+				inputLogExt[ frame ] = mr;
+			}
+			inputLog.push_back(e);
 		}
 
-		int getHeadIndex(void)
+		void addCommand( uint8 cmd )
 		{
-			return ringHead;
+			if (!replaying)
+			{
+				pendingCommands |= cmd;
+			}
 		}
 
-		int getStartIndex(void)
+		// Previous/next state step along the framesPerSnap grid of the dense recent tier.
+		// Where older tiers have been thinned out, the grid frame is re-emulated from the
+		// nearest older snapshot that is still kept.
+		int loadPrevState(void)
 		{
-			return ringStart;
+			if ( snaps.empty() || replayPending() )
+			{	// No States to Load, or the last step is still being replayed
+				return -1;
+			}
+			unsigned int frame = (lastStateFrame / framesPerSnap) * framesPerSnap;
+
+			if ( (frame == lastStateFrame) && (frame >= framesPerSnap) )
+			{
+				if ( (lastLoadFrame+30) > frameCounter)
+				{
+					frame -= framesPerSnap;
+				}
+			}
+			if (frame < snaps.front().frame)
+			{
+				frame = snaps.front().frame;
+			}
+			return loadStateAtFrame( frame );
 		}
 
-		int numSnapsSaved(void)
+		int loadNextState(void)
 		{
-			int numSnaps = ringHead - ringStart;
+			if ( snaps.empty() || replayPending() )
+			{	// No States to Load, or the last step is still being replayed
+				return -1;
+			}
+			unsigned int frame = (lastStateFrame / framesPerSnap + 1) * framesPerSnap;
 
-			if (numSnaps < 0)
+			if (frame > snaps.back().frame)
 			{
-				numSnaps = numSnaps + static_cast<int>( ringBuf.size() );
+				frame = snaps.back().frame;
+			}
+			if ( !canReachFrame( frame ) )
+			{
+				// Input to get there is gone, fall back to the next snapshot that is still kept
+				int snapIdx = findSnapAtOrBefore( lastStateFrame );
+
+				if ( (snapIdx + 1) < static_cast<int>(snaps.size()) )
+				{
+					snapIdx++;
+				}
+				return loadStateByIndex( snapIdx );
 			}
-			return numSnaps;
+			return loadStateAtFrame( frame );
+		}
+
+		int numSnapsSaved(void)
+		{
+			return static_cast<int>( snaps.size() );
+		}
+
+		int maxSnaps(void)
+		{
+			return FCEU_StateRecorderCalcMaxSnaps( stateRecorderConfig );
 		}
 
 		size_t  dataSize(void)
 		{
-			return ringBuf.size() * ringBuf[0]->size();
+			return memUsage + inputLogUsage();
 		}
 
-		size_t  ringBufferSize(void)
+		size_t  dataBudget(void)
 		{
-			return ringBuf.size();
+			return memBudget;
 		}
+
+		unsigned int historyFrames(void)
+		{
+			if (snaps.empty())
+			{
+				return 0;
+			}
+			return snaps.back().frame - snaps.front().frame;
+		}
+
 		static bool enabled;
 		static int  lastState;
+
+		// Number of snapshots held at each resolution tier
+		static constexpr unsigned int snapsPerTier = 64;
+
 	private:
 
+		struct Snapshot
+		{
+			unsigned int    frame;
+			EMUFILE_MEMORY *data;
+		};
+
+		// Per frame controller input. Frames with zapper data keep their full record in inputLogExt.
+		struct InputLogEntry
+		{
+			uint8 joysticks[4];
+			uint8 commands;
+			uint8 flags;
+		};
+		static constexpr uint8 INPUTLOG_EXTENDED = 0x01;
+
 		void doSnap(void)
 		{
+			// Save into a reusable scratch buffer, then keep an exact sized copy so that
+			// the memory accounting matches what is actually held.
+			scratch.set_len(0);
+			scratch.unfail();
+
+			FCEUSS_SaveMS( &scratch, compressionLevel );
+
+			Snapshot snap;
+
+			snap.frame = frameCounter;
+			snap.data  = new EMUFILE_MEMORY( scratch.buf(), scratch.size() );
+
+			dropAfter( frameCounter - 1 );
+
+			snaps.push_back(snap);
+
+			memUsage += snap.data->size();
+
+			thin();
+
+			lastStateFrame = frameCounter;
+			lastState = static_cast<int>(snaps.size()) - 1;
+
+			//printf("Frame:%u  Snaps:%zu  Size:%zu  Total:%zukB \n", frameCounter, snaps.size(), snap.data->size(), memUsage / 1024 );
+		}
+
+		void dropSnap( size_t idx )
+		{
+			memUsage -= snaps[idx].data->size();
+
+			delete snaps[idx].data;
+
+			snaps.erase( snaps.begin() + idx );
+		}
+
+		void dropAfter( unsigned int frame )
+		{
+			while ( !snaps.empty() && (snaps.back().frame > frame) )
+			{
+				dropSnap( snaps.size() - 1 );
+			}
+		}
+
+		void thin(void)
+		{
+			if (snaps.size() < 2)
+			{
+				return;
+			}
+			const unsigned int newestFrame = snaps.back().frame;
+
+			// Thin out older tiers: in tier t only snapshots whose index is a multiple of 2^t survive.
+			for (size_t i = snaps.size() - 1; i-- > 0; )
+			{
+				unsigned int age = (newestFrame - snaps[i].frame) / framesPerSnap;
+				unsigned int tier = 0;
+
+				while ( (tier < 31) && (age >= snapsPerTier * ((2u << tier) - 1)) )
+				{
+					tier++;
+				}
+				unsigned int snapNum = snaps[i].frame / framesPerSnap;
+
+				if ( snapNum & ((1u << tier) - 1) )
+				{
+					dropSnap(i);
+				}
+			}
+
+			// Evict the oldest history beyond the configured duration or memory budget
+			while ( (snaps.size() > 1) && ((newestFrame - snaps.front().frame) > maxHistoryFrames) )
+			{
+				dropSnap(0);
+			}
+			// Input before the oldest snapshot can never be replayed
+			trimInputLog( snaps.front().frame );
+
+			while ( (snaps.size() > 1) && (dataSize() > memBudget) )
+			{
+				dropSnap(0);
+				trimInputLog( snaps.front().frame );
+			}
+		}
+
+		unsigned int inputLogEnd(void)
+		{
+			return inputLogStart + static_cast<unsigned int>( inputLog.size() );
+		}
+
+		// True if the input of every frame in [first, last) has been logged
+		bool haveInput( unsigned int first, unsigned int last )
+		{
+			return !inputLog.empty() && (first >= inputLogStart) && (last <= inputLogEnd());
+		}
+
+		size_t inputLogUsage(void)
+		{
+			return inputLog.size() * sizeof(InputLogEntry) + inputLogExt.size() * (sizeof(MovieRecord) + 2 * sizeof(MovieZapperRecord) + 32);
+		}
+
+		void clearInputLog(void)
+		{
+			inputLog.clear();
+			inputLogExt.clear();
+			inputLogStart = 0;
+		}
+
+		// Drops the input of frames at and after the given one
+		void truncateInputLog( unsigned int frame )
+		{
+			if (frame <= inputLogStart)
+			{
+				clearInputLog();
+				return;
+			}
+			if (frame < inputLogEnd())
+			{
+				inputLog.resize( frame - inputLogStart );
+				inputLogExt.erase( inputLogExt.lower_bound( frame ), inputLogExt.end() );
+			}
+		}
+
+		// Drops the input of frames before the given one
+		void trimInputLog( unsigned int frame )
+		{
+			if (inputLog.empty() || (frame <= inputLogStart))
+			{
+				return;
+			}
+			if (frame >= inputLogEnd())
+			{
+				clearInputLog();
+				return;
+			}
+			inputLog.erase( inputLog.begin(), inputLog.begin() + (frame - inputLogStart) );
+			inputLogExt.erase( inputLogExt.begin(), inputLogExt.lower_bound( frame ) );
+			inputLogStart = frame;
+		}
+
+		// True if the frame is either a snapshot or can be re-emulated from the one before it
+		bool canReachFrame( unsigned int frame )
+		{
+			int snapIdx = findSnapAtOrBefore( frame );
 
+			if (snapIdx < 0)
+			{
+				return false;
+			}
+			const unsigned int snapFrame = snaps[ snapIdx ].frame;
+
+			return (snapFrame == frame) || FCEUMOV_Mode(MOVIEMODE_PLAY) || haveInput( snapFrame, frame );
 		}
 
-		std::vector <EMUFILE_MEMORY*> ringBuf;
-		int  ringHead;
-		int  ringTail;
-		int  ringStart;
-		int  ringBufSize;
+		int findSnapAtOrBefore( unsigned int frame )
+		{
+			int lo = 0, hi = static_cast<int>(snaps.size()) - 1, ret = -1;
+
+			while (lo <= hi)
+			{
+				int mid = (lo + hi) / 2;
+
+				if (snaps[mid].frame <= frame)
+				{
+					ret = mid; lo = mid + 1;
+				}
+				else
+				{
+					hi = mid - 1;
+				}
+			}
+			return ret;
+		}
+
+		void reEmulate( unsigned int numFrames, uint8 **gfx, int32 **sound, int32 *ssize )
+		{
+			int savedPause = EmulationPaused;
+
+			replaying = true;
+			EmulationPaused = 0;
+
+			for (unsigned int i=0; i<numFrames; i++)
+			{
+				// skip = 2, no video or sound output, except for the frame we land on
+				FCEUI_Emulate(gfx, sound, ssize, (i+1 < numFrames) ? 2 : 0);
+			}
+			EmulationPaused = savedPause;
+			replaying = false;
+		}
+
+		void applyPauseOnLoad(void)
+		{
+			if (pauseOnLoad == StateRecorderConfigData::TEMPORARY_PAUSE)
+			{
+				if (loadPauseTime > 0)
+				{	// Temporary pause after loading new state for user to have time to process
+					FCEUI_PauseForDuration(loadPauseTime);
+				}
+			}
+			else if (pauseOnLoad == StateRecorderConfigData::FULL_PAUSE)
+			{
+				FCEUI_SetEmulationPaused( EMULATIONPAUSED_PAUSED );
+			}
+		}
+
+		std::deque <Snapshot> snaps;
+		std::deque <InputLogEntry> inputLog;
+		std::map <unsigned int, MovieRecord> inputLogExt;
+		unsigned int inputLogStart;
+		uint8 pendingCommands;
+		EMUFILE_MEMORY scratch;
+		size_t memUsage;
+		size_t memBudget;
 		int  compressionLevel;
 		int  loadPauseTime;
 		StateRecorderConfigData::PauseType pauseOnLoad;
 		unsigned int frameCounter;
 		unsigned int framesPerSnap;
+		unsigned int maxHistoryFrames;
 		unsigned int lastLoadFrame;
+		unsigned int lastStateFrame;
 		bool loadIndexReset;
+		bool replaying;
+		unsigned int replayFrom;   // Snapshot frame loaded for the pending replay
+		unsigned int replayTarget; // Frame to re-emulate up to, 0 if there is none pending
 
 };
 
@@ -1500,6 +2101,30 @@ int FCEU_StateRecorderUpdate(void)
 	return 0;
 }
 
+void FCEU_StateRecorderReplayInput(void)
+{
+	if (stateRecorder != nullptr)
+	{
+		stateRecorder->replayInput();
+	}
+}
+
+void FCEU_StateRecorderLogInput(void)
+{
+	if (stateRecorder != nullptr)
+	{
+		stateRecorder->logInput();
+	}
+}
+
+void FCEU_StateRecorderAddCommand(uint8 cmd)
+{
+	if (stateRecorder != nullptr)
+	{
+		stateRecorder->addCommand(cmd);
+	}
+}
+
 bool FCEU_StateRecorderIsEnabled(void)
 {
 	return StateRecorder::enabled;
@@ -1521,11 +2146,76 @@ int FCEU_StateRecorderGetMaxSnaps(void)
 
 	if (stateRecorder != nullptr)
 	{
-		size = stateRecorder->ringBufferSize();
+		size = stateRecorder->maxSnaps();
+	}
+	return size;
+}
+
+int FCEU_StateRecorderCalcMaxSnaps(const StateRecorderConfigData &config)
+{
+	int32_t fps = FCEUI_GetDesiredFPS(); // Do >> 24 to get in Hz
+	double hz = ( ((double)fps) / 16777216.0 );
+	double framesPerSnap;
+
+	if (config.timingMode)
+	{
+		framesPerSnap = hz * config.timeBetweenSnapsMinutes * 60.0;
+	}
+	else
+	{
+		framesPerSnap = config.framesBetweenSnaps;
+	}
+	if (framesPerSnap < 1.0)
+	{
+		framesPerSnap = 1.0;
+	}
+	// Snapshots that fit in the history at full density
+	double fullSnaps = (hz * config.historyDurationMinutes * 60.0) / framesPerSnap;
+
+	// Each tier holds snapsPerTier snapshots and covers twice the time of the previous one
+	int numSnaps = 0;
+	double covered = 0.0;
+	double tierSpan = StateRecorder::snapsPerTier;
+
+	while (covered < fullSnaps)
+	{
+		double tierSnaps = (fullSnaps - covered) < tierSpan ?
+			(fullSnaps - covered) * StateRecorder::snapsPerTier / tierSpan : StateRecorder::snapsPerTier;
+
+		numSnaps += static_cast<int>( tierSnaps + 0.5 );
+		covered  += tierSpan;
+		tierSpan *= 2.0;
+	}
+	return numSnaps;
+}
+
+size_t FCEU_StateRecorderGetMemoryUsage(void)
+{
+	size_t size = 0;
+
+	if (stateRecorder != nullptr)
+	{
+		size = stateRecorder->dataSize();
 	}
 	return size;
 }
 
+size_t FCEU_StateRecorderGetMemoryBudget(void)
+{
+	return static_cast<size_t>(stateRecorderConfig.memoryBudgetMB) * 1024 * 1024;
+}
+
+int FCEU_StateRecorderGetHistoryFrames(void)
+{
+	int n = 0;
+
+	if (stateRecorder != nullptr)
+	{
+		n = static_cast<int>( stateRecorder->historyFrames() );
+	}
+	return n;
+}
+
 int FCEU_StateRecorderGetNumSnapsSaved(void)
 {
 	int n = 0;
@@ -1548,6 +2238,30 @@ int FCEU_StateRecorderLoadState(int snapIndex)
 	return ret;
 }
 
+int FCEU_StateRecorderLoadFrame(int frame, bool exact)
+{
+	int ret = -1;
+
+	if ( (stateRecorder != nullptr) && (frame >= 0) )
+	{
+		ret = stateRecorder->loadStateAtFrame( static_cast<unsigned int>(frame), exact );
+	}
+	return ret;
+}
+
+bool FCEU_StateRecorderReplayPending(void)
+{
+	return (stateRecorder != nullptr) && stateRecorder->replayPending();
+}
+
+void FCEU_StateRecorderReplay(uint8 **gfx, int32 **sound, int32 *ssize)
+{
+	if (stateRecorder != nullptr)
+	{
+		stateRecorder->runReplay( gfx, sound, ssize );
+	}
+}
+
 int FCEU_StateRecorderGetStateIndex(void)
 {
 	return StateRecorder::lastState;
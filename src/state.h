@@ -32,9 +32,15 @@ void FCEUSS_SetLoadCallback( void (*cb)(bool) );
 
  //zlib values: 0 (none) through 9 (max) or -1 (default)
 bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel);
+ //same as above, but writes the indexed FCSD container (see utils/fcsd.h) with every chunk compressed separately
+bool FCEUSS_SaveIndexedMS(EMUFILE* outstream, int compressionLevel);
 
 bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params);
 
+ //md5 of the emulation state (cpu, ppu, apu, input, mapper and ram) as a savestate would restore it,
+ //leaving out the movie and the frame image, so it's cheap enough to be taken every frame
+void FCEUSS_HashState(uint8 digest[16]);
+
 extern int CurrentState;
 void FCEUSS_CheckStates(void);
 
@@ -80,6 +86,7 @@ extern bool backupSavestates;		 //Whether or not to make backups, true by defaul
 bool CheckBackupSaveStateExist();	 //Checks if backupsavestate exists
 
 extern bool compressSavestates;		//Whether or not to compress non-movie savestates (by default, yes)
+extern bool indexedSavestates;		//Whether or not to save state files in the indexed FCSD container (by default, no)
 
 struct StateRecorderConfigData
 {
@@ -88,6 +95,7 @@ struct StateRecorderConfigData
 	int   framesBetweenSnaps;
 	int   compressionLevel;
 	int   loadPauseTimeSeconds;
+	int   memoryBudgetMB;
 
 	enum TimingType
 	{
@@ -109,6 +117,7 @@ struct StateRecorderConfigData
 		timeBetweenSnapsMinutes = 3.0f / 60.0f;
 		compressionLevel = 0;
 		loadPauseTimeSeconds = 3;
+		memoryBudgetMB = 256;
 		pauseOnLoad = TEMPORARY_PAUSE;
 		timingMode = FRAMES;
 	}
@@ -122,13 +131,23 @@ struct StateRecorderConfigData
 int FCEU_StateRecorderStart(void);
 int FCEU_StateRecorderStop(void);
 int FCEU_StateRecorderUpdate(void);
+void FCEU_StateRecorderReplayInput(void);
+void FCEU_StateRecorderLogInput(void);
+void FCEU_StateRecorderAddCommand(uint8 cmd);
 bool FCEU_StateRecorderRunning(void);
 bool FCEU_StateRecorderIsEnabled(void);
 void FCEU_StateRecorderSetEnabled(bool enabled);
 int FCEU_StateRecorderGetMaxSnaps(void);
+int FCEU_StateRecorderCalcMaxSnaps(const StateRecorderConfigData &config);
 int FCEU_StateRecorderGetNumSnapsSaved(void);
+size_t FCEU_StateRecorderGetMemoryUsage(void);
+size_t FCEU_StateRecorderGetMemoryBudget(void);
+int FCEU_StateRecorderGetHistoryFrames(void);
 int FCEU_StateRecorderGetStateIndex(void);
 int FCEU_StateRecorderLoadState(int snapIndex);
+int FCEU_StateRecorderLoadFrame(int frame, bool exact = false);
+bool FCEU_StateRecorderReplayPending(void);
+void FCEU_StateRecorderReplay(uint8 **gfx, int32 **sound, int32 *ssize);
 int FCEU_StateRecorderLoadPrevState(void);
 int FCEU_StateRecorderLoadNextState(void);
 int FCEU_StateRecorderSetConfigData(const StateRecorderConfigData &newConfig);
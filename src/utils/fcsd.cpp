@@ -0,0 +1,477 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+// fcsd.cpp
+//
+#include <string.h>
+#include <zlib.h>
+
+#include "fcsd.h"
+
+//-----------------------------------------------------------------------------
+static uint32_t getLE32( const uint8_t *p )
+{
+	return  (uint32_t)p[0]        | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+//-----------------------------------------------------------------------------
+static void putLE32( uint8_t *p, uint32_t v )
+{
+	p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; p[2] = (v >> 16) & 0xff; p[3] = (v >> 24) & 0xff;
+}
+//-----------------------------------------------------------------------------
+// Chunks that are not a list of (tag, size, data) fields
+static bool chunkIsOpaque( uint8_t type )
+{
+	return (type == 7) || (type == 8);
+}
+//-----------------------------------------------------------------------------
+const char *FCSD_ChunkName( uint8_t type )
+{
+	switch (type)
+	{
+		case 1:    return "CPU";
+		case 2:    return "CPUC";
+		case 3:    return "PPU";
+		case 31:   return "NEWPPU";
+		case 4:    return "CTRL";
+		case 5:    return "SND";
+		case 6:    return "MOVSTATE";
+		case 7:    return "MOVIE";
+		case 8:    return "BACKBUF";
+		case 0x10: return "EXTRA";
+		default:   break;
+	}
+	return NULL;
+}
+//-----------------------------------------------------------------------------
+size_t FCSD_BlobSize( const uint8_t *header )
+{
+	if (memcmp(header, "FCSD", 4))
+	{
+		return 0;
+	}
+	size_t numChunks   = getLE32(header + 12);
+	size_t numFields   = getLE32(header + 16);
+	size_t payloadSize = getLE32(header + 20);
+
+	return FCSD_HEADER_SIZE + (numChunks * FCSD_CHUNK_ENTRY_SIZE) +
+		(numFields * FCSD_FIELD_ENTRY_SIZE) + payloadSize;
+}
+//-----------------------------------------------------------------------------
+bool FCSD_Build( const uint8_t *raw, size_t rawSize, uint32_t emuVersion, int compressionLevel, std::vector<uint8_t> &out )
+{
+	std::vector <FCSD_Chunk> chunks;
+	std::vector <FCSD_Field> fields;
+	std::vector <uint8_t> payload;
+	size_t pos = 0;
+
+	payload.reserve( rawSize );
+
+	// Walk the flat chunk stream and index it
+	while (pos + 5 <= rawSize)
+	{
+		FCSD_Chunk c;
+		uint32_t size = getLE32(raw + pos + 1);
+
+		c.type = raw[pos];
+		c.flags = 0;
+		c.rawSize = size;
+		c.firstField = static_cast<uint32_t>(fields.size());
+		c.numFields = 0;
+
+		pos += 5;
+
+		if (pos + size > rawSize)
+		{
+			return false;
+		}
+		const uint8_t *data = raw + pos;
+
+		if (!chunkIsOpaque(c.type))
+		{
+			uint32_t ofs = 0;
+
+			while (ofs + 8 <= size)
+			{
+				FCSD_Field f;
+				uint32_t fsize = getLE32(data + ofs + 4);
+
+				if (ofs + 8 + fsize > size)
+				{	// Malformed field list, leave the chunk unindexed
+					fields.resize( c.firstField );
+					break;
+				}
+				f.chunkIndex = static_cast<uint32_t>(chunks.size());
+				memcpy( f.tag, data + ofs, 4 );
+				f.offset = ofs + 8;
+				f.size = fsize;
+
+				fields.push_back(f);
+
+				ofs += 8 + fsize;
+			}
+			c.numFields = static_cast<uint32_t>(fields.size()) - c.firstField;
+		}
+
+		c.offset = static_cast<uint32_t>(payload.size());
+
+		if ((compressionLevel != Z_NO_COMPRESSION) && (size > 0))
+		{
+			uLongf comprlen = compressBound(size);
+			size_t start = payload.size();
+
+			payload.resize( start + comprlen );
+
+			if (compress2( &payload[start], &comprlen, data, size, compressionLevel ) != Z_OK)
+			{
+				return false;
+			}
+			if (comprlen < size)
+			{
+				payload.resize( start + comprlen );
+				c.flags |= FCSD_CHUNK_COMPRESSED;
+			}
+			else
+			{	// Not worth it, store instead
+				payload.resize( start );
+			}
+		}
+		if ( !(c.flags & FCSD_CHUNK_COMPRESSED) )
+		{
+			payload.insert( payload.end(), data, data + size );
+		}
+		c.storedSize = static_cast<uint32_t>(payload.size()) - c.offset;
+
+		chunks.push_back(c);
+
+		pos += size;
+	}
+
+	out.resize( FCSD_HEADER_SIZE + (chunks.size() * FCSD_CHUNK_ENTRY_SIZE) +
+			(fields.size() * FCSD_FIELD_ENTRY_SIZE) + payload.size() );
+
+	uint8_t *p = &out[0];
+
+	memcpy( p, "FCSD", 4 );
+	putLE32( p +  4, static_cast<uint32_t>(rawSize) );
+	putLE32( p +  8, emuVersion );
+	putLE32( p + 12, static_cast<uint32_t>(chunks.size()) );
+	putLE32( p + 16, static_cast<uint32_t>(fields.size()) );
+	putLE32( p + 20, static_cast<uint32_t>(payload.size()) );
+	p += FCSD_HEADER_SIZE;
+
+	for (size_t i=0; i<chunks.size(); i++)
+	{
+		const FCSD_Chunk &c = chunks[i];
+
+		p[0] = c.type;
+		p[1] = c.flags;
+		p[2] = p[3] = 0;
+		putLE32( p +  4, c.offset );
+		putLE32( p +  8, c.rawSize );
+		putLE32( p + 12, c.storedSize );
+		putLE32( p + 16, c.firstField );
+		putLE32( p + 20, c.numFields );
+		p += FCSD_CHUNK_ENTRY_SIZE;
+	}
+
+	for (size_t i=0; i<fields.size(); i++)
+	{
+		const FCSD_Field &f = fields[i];
+
+		putLE32( p, f.chunkIndex );
+		memcpy( p + 4, f.tag, 4 );
+		putLE32( p +  8, f.offset );
+		putLE32( p + 12, f.size );
+		p += FCSD_FIELD_ENTRY_SIZE;
+	}
+
+	if (payload.size() > 0)
+	{
+		memcpy( p, &payload[0], payload.size() );
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool FCSD_BuildFromFCSX( const uint8_t *data, size_t size, int compressionLevel, std::vector<uint8_t> &out )
+{
+	if ((size < 16) || memcmp(data, "FCSX", 4))
+	{
+		return false;
+	}
+	uint32_t totalsize  = getLE32(data + 4);
+	uint32_t emuVersion = getLE32(data + 8);
+	uint32_t comprlen   = getLE32(data + 12);
+
+	if (comprlen == ~0u)
+	{
+		if (size - 16 < totalsize)
+		{
+			return false;
+		}
+		return FCSD_Build( data + 16, totalsize, emuVersion, compressionLevel, out );
+	}
+
+	if (size - 16 < comprlen)
+	{
+		return false;
+	}
+	std::vector <uint8_t> raw( totalsize );
+	uLongf uncomprlen = totalsize;
+
+	if ((uncompress( &raw[0], &uncomprlen, data + 16, comprlen ) != Z_OK) || (uncomprlen != totalsize))
+	{
+		return false;
+	}
+	return FCSD_Build( &raw[0], totalsize, emuVersion, compressionLevel, out );
+}
+//-----------------------------------------------------------------------------
+//---- FCSD Reader
+//-----------------------------------------------------------------------------
+FCSD_Reader::FCSD_Reader(void)
+{
+	base = payload = NULL;
+	payloadSize = 0;
+	_totalSize = _emuVersion = 0;
+}
+//-----------------------------------------------------------------------------
+bool FCSD_Reader::open( const uint8_t *data, size_t size )
+{
+	chunks.clear();
+	fields.clear();
+
+	if (size < FCSD_HEADER_SIZE)
+	{
+		return false;
+	}
+	size_t blobSize = FCSD_BlobSize(data);
+
+	if ((blobSize == 0) || (blobSize > size))
+	{
+		return false;
+	}
+	base        = data;
+	_totalSize  = getLE32(data +  4);
+	_emuVersion = getLE32(data +  8);
+	uint32_t numChunks = getLE32(data + 12);
+	uint32_t numFields = getLE32(data + 16);
+	payloadSize = getLE32(data + 20);
+
+	const uint8_t *p = data + FCSD_HEADER_SIZE;
+
+	chunks.resize( numChunks );
+
+	for (uint32_t i=0; i<numChunks; i++)
+	{
+		FCSD_Chunk &c = chunks[i];
+
+		c.type       = p[0];
+		c.flags      = p[1];
+		c.offset     = getLE32(p +  4);
+		c.rawSize    = getLE32(p +  8);
+		c.storedSize = getLE32(p + 12);
+		c.firstField = getLE32(p + 16);
+		c.numFields  = getLE32(p + 20);
+
+		// Uncompressed chunks are copied out rawSize bytes at a time, so both sizes must agree
+		if ( (static_cast<size_t>(c.offset) + c.storedSize > payloadSize) ||
+			( !(c.flags & FCSD_CHUNK_COMPRESSED) && (c.storedSize != c.rawSize) ) ||
+			(static_cast<size_t>(c.firstField) + c.numFields > numFields) )
+		{
+			chunks.clear();
+			return false;
+		}
+		p += FCSD_CHUNK_ENTRY_SIZE;
+	}
+
+	fields.resize( numFields );
+
+	for (uint32_t i=0; i<numFields; i++)
+	{
+		FCSD_Field &f = fields[i];
+
+		f.chunkIndex = getLE32(p);
+		memcpy( f.tag, p + 4, 4 );
+		f.offset = getLE32(p +  8);
+		f.size   = getLE32(p + 12);
+
+		if ( (f.chunkIndex >= numChunks) ||
+			(static_cast<size_t>(f.offset) + f.size > chunks[f.chunkIndex].rawSize) )
+		{
+			chunks.clear();
+			fields.clear();
+			return false;
+		}
+		p += FCSD_FIELD_ENTRY_SIZE;
+	}
+	payload = p;
+
+	return true;
+}
+//-----------------------------------------------------------------------------
+int FCSD_Reader::findChunk( uint8_t type )
+{
+	for (size_t i=0; i<chunks.size(); i++)
+	{
+		if (chunks[i].type == type)
+		{
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+//-----------------------------------------------------------------------------
+int FCSD_Reader::findField( uint8_t chunkType, const char *tag )
+{
+	// Tags are stored NUL padded to 4 characters
+	char tag4[4] = { 0 };
+
+	for (int i=0; (i<4) && tag[i]; i++)
+	{
+		tag4[i] = tag[i];
+	}
+
+	int c = findChunk(chunkType);
+
+	if (c < 0)
+	{
+		return -1;
+	}
+	const FCSD_Chunk &chunk = chunks[c];
+
+	for (uint32_t i=chunk.firstField; i<chunk.firstField+chunk.numFields; i++)
+	{
+		if (memcmp(fields[i].tag, tag4, 4) == 0)
+		{
+			return static_cast<int>(i);
+		}
+	}
+	return -1;
+}
+//-----------------------------------------------------------------------------
+bool FCSD_Reader::readRange( const FCSD_Chunk &c, uint32_t ofs, uint32_t len, uint8_t *dst )
+{
+	if (static_cast<size_t>(ofs) + len > c.rawSize)
+	{
+		return false;
+	}
+	const uint8_t *src = payload + c.offset;
+
+	if ( !(c.flags & FCSD_CHUNK_COMPRESSED) )
+	{
+		if (len > 0)
+		{
+			memcpy( dst, src + ofs, len );
+		}
+		return true;
+	}
+
+	// Inflate only as far as the end of the requested range
+	std::vector <uint8_t> tmp( static_cast<size_t>(ofs) + len );
+	z_stream zs;
+
+	memset( &zs, 0, sizeof(zs) );
+
+	if (inflateInit(&zs) != Z_OK)
+	{
+		return false;
+	}
+	zs.next_in   = (Bytef*)src;
+	zs.avail_in  = c.storedSize;
+	zs.next_out  = tmp.size() ? &tmp[0] : NULL;
+	zs.avail_out = static_cast<uInt>(tmp.size());
+
+	int ret = Z_OK;
+
+	while ((zs.avail_out > 0) && (ret == Z_OK))
+	{
+		ret = inflate( &zs, Z_SYNC_FLUSH );
+	}
+	inflateEnd(&zs);
+
+	if (zs.avail_out != 0)
+	{
+		return false;
+	}
+	if (len > 0)
+	{
+		memcpy( dst, &tmp[ofs], len );
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+bool FCSD_Reader::readChunk( size_t idx, std::vector<uint8_t> &out )
+{
+	if (idx >= chunks.size())
+	{
+		return false;
+	}
+	const FCSD_Chunk &c = chunks[idx];
+
+	out.resize( c.rawSize );
+
+	return readRange( c, 0, c.rawSize, out.size() ? &out[0] : NULL );
+}
+//-----------------------------------------------------------------------------
+bool FCSD_Reader::readField( size_t idx, std::vector<uint8_t> &out )
+{
+	if (idx >= fields.size())
+	{
+		return false;
+	}
+	const FCSD_Field &f = fields[idx];
+
+	out.resize( f.size );
+
+	return readRange( chunks[f.chunkIndex], f.offset, f.size, out.size() ? &out[0] : NULL );
+}
+//-----------------------------------------------------------------------------
+bool FCSD_Reader::flatten( uint8_t *dst, size_t dstSize )
+{
+	size_t pos = 0;
+
+	for (size_t i=0; i<chunks.size(); i++)
+	{
+		const FCSD_Chunk &c = chunks[i];
+
+		if (pos + 5 + c.rawSize > dstSize)
+		{
+			return false;
+		}
+		dst[pos] = c.type;
+		putLE32( dst + pos + 1, c.rawSize );
+		pos += 5;
+
+		if ( c.flags & FCSD_CHUNK_COMPRESSED )
+		{
+			uLongf uncomprlen = c.rawSize;
+
+			if ((uncompress( dst + pos, &uncomprlen, payload + c.offset, c.storedSize ) != Z_OK) ||
+				(uncomprlen != c.rawSize))
+			{
+				return false;
+			}
+		}
+		else if (c.rawSize > 0)
+		{
+			memcpy( dst + pos, payload + c.offset, c.rawSize );
+		}
+		pos += c.rawSize;
+	}
+	return pos == dstSize;
+}
+//-----------------------------------------------------------------------------
@@ -0,0 +1,129 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+// fcsd.h
+//
+// Indexed savestate container ("FCSD").
+//
+// This is an alternative to the "FCSX" container that keeps a directory of every
+// chunk and every field inside it, and compresses each chunk independently. A single
+// field can therefore be located and read without inflating the whole state.
+//
+// This file and fcsd.cpp only depend on zlib and the standard library, so that
+// external tools can read saved states without linking the emulator.
+//
+// Layout (all integers little endian):
+//
+//   header    24 bytes  "FCSD", u32 totalSize, u32 emuVersion, u32 numChunks,
+//                       u32 numFields, u32 payloadSize
+//   chunks    numChunks * 24 bytes
+//                       u8 type, u8 flags, u16 reserved, u32 offset,
+//                       u32 rawSize, u32 storedSize, u32 firstField, u32 numFields
+//   fields    numFields * 16 bytes
+//                       u32 chunkIndex, char tag[4], u32 offset, u32 size
+//   payload   payloadSize bytes, chunk data (deflated when FCSD_CHUNK_COMPRESSED is set)
+//
+// totalSize is the size of the equivalent flat FCSX chunk stream. Chunk offsets are
+// relative to the start of the payload, field offsets are relative to the start of
+// the uncompressed chunk data and point at the field contents (past its tag and size).
+//
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#define FCSD_HEADER_SIZE       24
+#define FCSD_CHUNK_ENTRY_SIZE  24
+#define FCSD_FIELD_ENTRY_SIZE  16
+
+#define FCSD_CHUNK_COMPRESSED  0x01
+
+struct FCSD_Chunk
+{
+	uint8_t  type;
+	uint8_t  flags;
+	uint32_t offset;
+	uint32_t rawSize;
+	uint32_t storedSize;
+	uint32_t firstField;
+	uint32_t numFields;
+};
+
+struct FCSD_Field
+{
+	uint32_t chunkIndex;
+	char     tag[4];
+	uint32_t offset;
+	uint32_t size;
+};
+
+class FCSD_Reader
+{
+	public:
+		FCSD_Reader(void);
+
+		// Parses the header and directory. The buffer must stay valid while the reader is used.
+		bool open( const uint8_t *data, size_t size );
+
+		uint32_t totalSize(void){ return _totalSize; }
+		uint32_t emuVersion(void){ return _emuVersion; }
+
+		size_t numChunks(void){ return chunks.size(); }
+		size_t numFields(void){ return fields.size(); }
+
+		const FCSD_Chunk &chunk( size_t idx ){ return chunks[idx]; }
+		const FCSD_Field &field( size_t idx ){ return fields[idx]; }
+
+		// Returns -1 if not found
+		int findChunk( uint8_t type );
+		int findField( uint8_t chunkType, const char *tag );
+
+		// Copies out the uncompressed contents of a chunk
+		bool readChunk( size_t idx, std::vector<uint8_t> &out );
+
+		// Copies out one field. Only the part of its chunk up to the end of the field is inflated.
+		bool readField( size_t idx, std::vector<uint8_t> &out );
+
+		// Rebuilds the flat FCSX chunk stream (type, size, data for every chunk) into dst,
+		// which must hold totalSize() bytes.
+		bool flatten( uint8_t *dst, size_t dstSize );
+
+	private:
+		bool readRange( const FCSD_Chunk &c, uint32_t ofs, uint32_t len, uint8_t *dst );
+
+		const uint8_t *base;
+		const uint8_t *payload;
+		size_t payloadSize;
+		uint32_t _totalSize;
+		uint32_t _emuVersion;
+
+		std::vector <FCSD_Chunk> chunks;
+		std::vector <FCSD_Field> fields;
+};
+
+// Returns the full size of an FCSD blob from its first FCSD_HEADER_SIZE bytes, or 0 if it is not one.
+size_t FCSD_BlobSize( const uint8_t *header );
+
+// Builds an FCSD blob from a flat FCSX chunk stream (the uncompressed savestate body).
+// compressionLevel follows zlib: 0 stores chunks uncompressed, -1 is the zlib default.
+bool FCSD_Build( const uint8_t *raw, size_t rawSize, uint32_t emuVersion, int compressionLevel, std::vector<uint8_t> &out );
+
+// Builds an FCSD blob from a complete FCSX savestate file image.
+bool FCSD_BuildFromFCSX( const uint8_t *data, size_t size, int compressionLevel, std::vector<uint8_t> &out );
+
+// Human readable name of a savestate chunk type, or NULL if unknown.
+const char *FCSD_ChunkName( uint8_t type );
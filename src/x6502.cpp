@@ -48,111 +48,227 @@ static X6502_MemHook* readMemHook = nullptr;
 static X6502_MemHook* writeMemHook = nullptr;
 static X6502_MemHook* execMemHook = nullptr;
 
-void X6502_MemHook::Add(enum X6502_MemHook::Type type, void (*func)(unsigned int address, unsigned int value, void *userData), void *userData )
+// Every address some hook of the type watches, so the CPU only walks the hooks for those
+static uint32 readMemHookMap[0x10000 / 32] = { 0 };
+static uint32 writeMemHookMap[0x10000 / 32] = { 0 };
+static uint32 execMemHookMap[0x10000 / 32] = { 0 };
+
+// How many hooks of the type watch each address, so adding or removing a range only updates its own bits
+static uint16 readMemHookRefs[0x10000] = { 0 };
+static uint16 writeMemHookRefs[0x10000] = { 0 };
+static uint16 execMemHookRefs[0x10000] = { 0 };
+
+// Hooks may add or remove hooks, so nodes removed while a chain is being walked are only freed after it
+static int memHookCallDepth = 0;
+static std::vector <X6502_MemHook*> retiredMemHooks;
+
+static INLINE bool MemHookWatched(const uint32 *map, unsigned int A)
 {
-	X6502_MemHook** hookStart = nullptr;
+	A &= 0xFFFF;
+	return (map[A >> 5] >> (A & 31)) & 1;
+}
 
-	switch (type)
+static INLINE void MemHookCall(X6502_MemHook* hook, unsigned int A, unsigned int V)
+{
+	if (hook == nullptr)
 	{
-		case Read:
-			hookStart = &readMemHook;
-		break;
-		case Write:
-			hookStart = &writeMemHook;
-		break;
-		case Exec:
-			hookStart = &execMemHook;
-		break;
+		return;
 	}
-	if (hookStart == nullptr)
+	memHookCallDepth++;
+
+	hook->call(A, V);
+
+	if ( (--memHookCallDepth == 0) && !retiredMemHooks.empty() )
 	{
-		return;
+		for (auto retired : retiredMemHooks)
+		{
+			delete retired;
+		}
+		retiredMemHooks.clear();
+	}
+}
+
+static X6502_MemHook** MemHookStart(enum X6502_MemHook::Type type, uint32 **map, uint16 **refs)
+{
+	switch (type)
+	{
+		case X6502_MemHook::Read:
+			*map = readMemHookMap;
+			*refs = readMemHookRefs;
+			return &readMemHook;
+		case X6502_MemHook::Write:
+			*map = writeMemHookMap;
+			*refs = writeMemHookRefs;
+			return &writeMemHook;
+		case X6502_MemHook::Exec:
+			*map = execMemHookMap;
+			*refs = execMemHookRefs;
+			return &execMemHook;
 	}
+	*map = nullptr;
+	*refs = nullptr;
+	return nullptr;
+}
+
+void X6502_MemHook::RemoveAll(void)
+{
+	const enum X6502_MemHook::Type types[] = { Read, Write, Exec };
 
-	if (*hookStart != nullptr)
+	for (auto type : types)
 	{
-		X6502_MemHook* hook = *hookStart;
+		uint32 *map = nullptr;
+		uint16 *refs = nullptr;
+		X6502_MemHook** hookStart = MemHookStart(type, &map, &refs);
 
-		while (hook->next != nullptr)
+		while (*hookStart != nullptr)
 		{
-			if ((hook->func == func) && (hook->userData == userData))
+			X6502_MemHook* hook = *hookStart;
+
+			*hookStart = hook->next;
+
+			if (memHookCallDepth > 0)
 			{
-				// Already registered
-				//printf("LUA MemHook Already Registered\n");
-				hook->refCount++;
-				return;
+				memset( hook->addrMap, 0, sizeof(hook->addrMap) );
+				retiredMemHooks.push_back(hook);
+			}
+			else
+			{
+				delete hook;
 			}
-			hook = hook->next;
 		}
-		X6502_MemHook* newHook = new X6502_MemHook();
-		newHook->type = type;
-		newHook->func = func;
-		newHook->userData = userData;
-		newHook->refCount = 1;
-		hook->next = newHook;
+		memset( map, 0, sizeof(readMemHookMap) );
+		memset( refs, 0, sizeof(readMemHookRefs) );
 	}
-	else
-	{
-		X6502_MemHook* newHook = new X6502_MemHook();
-		newHook->type = type;
-		newHook->func = func;
-		newHook->userData = userData;
-		newHook->refCount = 1;
-		*hookStart = newHook;
-	}
-	//printf("LUA MemHook Added: %p\n", func);
 }
 
-void X6502_MemHook::Remove(enum X6502_MemHook::Type type, void (*func)(unsigned int address, unsigned int value, void *userData), void *userData )
+void X6502_MemHook::Add(enum X6502_MemHook::Type type, void (*func)(unsigned int address, unsigned int value, void *userData), void *userData,
+		unsigned int start, unsigned int end )
 {
-	X6502_MemHook** hookStart = nullptr;
+	uint32 *map = nullptr;
+	uint16 *refs = nullptr;
+	X6502_MemHook** hookStart = MemHookStart(type, &map, &refs);
 
-	switch (type)
+	if ( (hookStart == nullptr) || (start > end) || (end > 0xFFFF) )
 	{
-		case Read:
-			hookStart = &readMemHook;
-		break;
-		case Write:
-			hookStart = &writeMemHook;
-		break;
-		case Exec:
-			hookStart = &execMemHook;
-		break;
+		return;
 	}
+	X6502_MemHook* hook = *hookStart;
+	X6502_MemHook* last = nullptr;
+
+	while ( (hook != nullptr) && ((hook->func != func) || (hook->userData != userData)) )
+	{
+		last = hook;
+		hook = hook->next;
+	}
+
+	if (hook == nullptr)
+	{
+		hook = new X6502_MemHook();
+		hook->type = type;
+		hook->func = func;
+		hook->userData = userData;
+		hook->addrRefs.resize(0x10000, 0);
+
+		if (last != nullptr)
+		{
+			last->next = hook;
+		}
+		else
+		{
+			*hookStart = hook;
+		}
+		//printf("LUA MemHook Added: %p\n", func);
+	}
+
+	for (unsigned int A = start; A <= end; A++)
+	{
+		if (hook->addrRefs[A] == 0xFFFF)
+		{
+			return; // The count would wrap, so this range could never be taken back
+		}
+	}
+	hook->ranges[ std::make_pair(start, end) ]++;
+
+	for (unsigned int A = start; A <= end; A++)
+	{
+		if (hook->addrRefs[A]++ == 0)
+		{
+			hook->addrMap[A >> 5] |= 1u << (A & 31);
+
+			if (refs[A]++ == 0)
+			{
+				map[A >> 5] |= 1u << (A & 31);
+			}
+		}
+	}
+}
+
+void X6502_MemHook::Remove(enum X6502_MemHook::Type type, void (*func)(unsigned int address, unsigned int value, void *userData), void *userData,
+		unsigned int start, unsigned int end )
+{
+	uint32 *map = nullptr;
+	uint16 *refs = nullptr;
+	X6502_MemHook** hookStart = MemHookStart(type, &map, &refs);
+
 	if (hookStart == nullptr)
 	{
 		return;
 	}
+	X6502_MemHook* hook = *hookStart;
+	X6502_MemHook* prev =  nullptr;
 
-	if (*hookStart != nullptr)
+	while (hook != nullptr)
 	{
-		X6502_MemHook* hook = *hookStart;
-		X6502_MemHook* prev =  nullptr;
-
-		while (hook != nullptr)
+		if ((hook->func == func) && (hook->userData == userData))
 		{
-			if ((hook->func == func) && (hook->userData == userData))
+			auto range = hook->ranges.find( std::make_pair(start, end) );
+
+			if (range == hook->ranges.end())
 			{
-				hook->refCount--;
-				
-				if (hook->refCount <= 0)
+				return;
+			}
+			if (--range->second == 0)
+			{
+				hook->ranges.erase(range);
+			}
+
+			for (unsigned int A = start; A <= end; A++)
+			{
+				if (--hook->addrRefs[A] == 0)
 				{
-					if (prev != nullptr)
-					{
-						prev->next = hook->next;
-					}
-					else
+					hook->addrMap[A >> 5] &= ~(1u << (A & 31));
+
+					if (--refs[A] == 0)
 					{
-						*hookStart = hook->next;
+						map[A >> 5] &= ~(1u << (A & 31));
 					}
+				}
+			}
+
+			if (hook->ranges.empty())
+			{
+				if (prev != nullptr)
+				{
+					prev->next = hook->next;
+				}
+				else
+				{
+					*hookStart = hook->next;
+				}
+				if (memHookCallDepth > 0)
+				{
+					retiredMemHooks.push_back(hook);
+				}
+				else
+				{
 					delete hook;
-					//printf("LUA MemHook Removed: %p\n", func);
 				}
-				return;
+				//printf("LUA MemHook Removed: %p\n", func);
 			}
-			prev = hook;
-			hook = hook->next;
+			return;
 		}
+		prev = hook;
+		hook = hook->next;
 	}
 }
 
@@ -160,9 +276,9 @@ void X6502_MemHook::Remove(enum X6502_MemHook::Type type, void (*func)(unsigned
 static INLINE uint8 RdMem(unsigned int A)
 {
  _DB=ARead[A](A);
- if (readMemHook)
+ if (MemHookWatched(readMemHookMap, A))
  {
-	 readMemHook->call(A, _DB);
+	 MemHookCall(readMemHook, A, _DB);
  }
  return(_DB);
 }
@@ -171,9 +287,9 @@ static INLINE uint8 RdMem(unsigned int A)
 static INLINE void WrMem(unsigned int A, uint8 V)
 {
 	BWrite[A](A,V);
- 	if (writeMemHook)
+ 	if (MemHookWatched(writeMemHookMap, A))
  	{
- 	        writeMemHook->call(A, V);
+ 	        MemHookCall(writeMemHook, A, V);
  	}
 	_DB = V;
 }
@@ -181,9 +297,9 @@ static INLINE void WrMem(unsigned int A, uint8 V)
 static INLINE uint8 RdRAM(unsigned int A)
 {
   _DB=ARead[A](A);
-  if (readMemHook)
+  if (MemHookWatched(readMemHookMap, A))
   {
-          readMemHook->call(A, _DB);
+          MemHookCall(readMemHook, A, _DB);
   }
   //bbit edited: this was changed so cheat substituion would work
   // return(_DB=RAM[A]);
@@ -193,9 +309,9 @@ static INLINE uint8 RdRAM(unsigned int A)
 static INLINE void WrRAM(unsigned int A, uint8 V)
 {
 	RAM[A]=V;
- 	if (writeMemHook)
+ 	if (MemHookWatched(writeMemHookMap, A))
  	{
- 	        writeMemHook->call(A, V);
+ 	        MemHookCall(writeMemHook, A, V);
  	}
 	_DB = V;
 }
@@ -204,9 +320,9 @@ uint8 X6502_DMR(uint32 A)
 {
  ADDCYC(1);
  _DB=ARead[A](A);
-  if (readMemHook)
+  if (MemHookWatched(readMemHookMap, A))
   {
-          readMemHook->call(A, _DB);
+          MemHookCall(readMemHook, A, _DB);
   }
  return(_DB);
 }
@@ -215,9 +331,9 @@ void X6502_DMW(uint32 A, uint8 V)
 {
  ADDCYC(1);
  BWrite[A](A,V);
- if (writeMemHook)
+ if (MemHookWatched(writeMemHookMap, A))
  {
-         writeMemHook->call(A, V);
+         MemHookCall(writeMemHook, A, V);
  }
  _DB = V;
 }
@@ -638,9 +754,9 @@ extern int test; test++;
    
    if (!overclocking)
     FCEU_SoundCPUHook(temp);
-   if (execMemHook)
+   if (MemHookWatched(execMemHookMap, _PC))
    {
-           execMemHook->call(_PC, 0);
+           MemHookCall(execMemHook, _PC, 0);
    }
    _PC++;
    switch(b1)
@@ -20,6 +20,10 @@
 
 #ifndef _X6502H
 
+#include <map>
+#include <vector>
+#include <utility>
+
 #include "x6502struct.h"
 
 extern X6502 X;
@@ -97,12 +101,27 @@ class X6502_MemHook
 	public:
 		enum Type { Read = 0, Write, Exec } type;
 
-		static void Add(enum Type type, void (*func)(unsigned int address, unsigned int value, void *userData), void *userData = nullptr );
-		static void Remove(enum Type type, void (*func)(unsigned int address, unsigned int value, void *userData), void *userData = nullptr );
+		// A hook is only called for accesses to the addresses in [start, end]. Adding the same
+		// function and user data again adds another range, Remove takes one such range back.
+		static void Add(enum Type type, void (*func)(unsigned int address, unsigned int value, void *userData), void *userData = nullptr,
+				unsigned int start = 0x0000, unsigned int end = 0xFFFF );
+		static void Remove(enum Type type, void (*func)(unsigned int address, unsigned int value, void *userData), void *userData = nullptr,
+				unsigned int start = 0x0000, unsigned int end = 0xFFFF );
+		// Drops every hook of every type, whoever added it
+		static void RemoveAll(void);
+
+		inline bool watches( unsigned int address ) const
+		{
+			address &= 0xFFFF;
+			return (addrMap[address >> 5] >> (address & 31)) & 1;
+		}
 
 		inline void call( unsigned int address, unsigned int value )
 		{
-			func(address, value, userData);
+			if (watches(address))
+			{
+				func(address, value, userData);
+			}
 
 			if (next != nullptr)
 			{
@@ -113,7 +132,9 @@ class X6502_MemHook
 		void (*func)(unsigned int address, unsigned int value, void *userData) = nullptr;
 		void  *userData = nullptr;
 		X6502_MemHook* next = nullptr;
-		int refCount = 0;
+		std::map <std::pair<unsigned int, unsigned int>, unsigned int> ranges; // How many times each range was added
+		std::vector <uint16> addrRefs; // How many of the ranges cover each address
+		uint32 addrMap[0x10000 / 32] = { 0 }; // One bit per address in any of the ranges
 };
 
 #define _X6502H